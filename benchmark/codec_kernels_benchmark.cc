@@ -0,0 +1,94 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Throughput of the checksum and escape scanning kernels for each
+// instruction set the CPU supports, on frames without escaped bytes.
+//
+// Usage: codec_kernels_benchmark [frame_len] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/jt808_simd.h"
+
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+}
+
+// Run |kernel| over |frame| |iterations| times, return MB/s.
+template <typename Kernel>
+static double Measure(const Kernel &kernel, const size_t &len,
+                      const int &iterations) {
+  // Consume the results so the calls are not optimized away.
+  volatile size_t sink = 0;
+  double start = NowSeconds();
+
+  for (int i = 0; i < iterations; ++i) {
+    sink = sink + kernel();
+  }
+  return static_cast<double>(len) * iterations / (NowSeconds() - start) / 1e6;
+}
+
+int main(int argc, char **argv) {
+  const CodecKernels *tables[] = {
+    &ScalarCodecKernels(), Sse2CodecKernels(), Avx2CodecKernels(),
+  };
+  size_t frame_len = 1024;
+  int iterations = 500000;
+  uint8_t *frame;
+  uint8_t *dst;
+
+  if (argc > 1) frame_len = static_cast<size_t>(atoi(argv[1]));
+  if (argc > 2) iterations = atoi(argv[2]);
+  if (frame_len == 0) frame_len = 1;
+
+  frame = new uint8_t[frame_len];
+  dst = new uint8_t[frame_len];
+  srand(808);
+  for (size_t i = 0; i < frame_len; ++i) {
+    frame[i] = static_cast<uint8_t>(rand() % 0x7D);
+  }
+
+  printf("frame: %lu bytes, iterations: %d, selected: %s\n", frame_len,
+         iterations, CodecKernelsForCpu().name);
+  printf("%8s %12s %12s %12s %12s\n", "kernels", "bcc MB/s", "count MB/s",
+         "find MB/s", "unesc MB/s");
+  for (const CodecKernels *kernels : tables) {
+    if (kernels == nullptr) {
+      continue;
+    }
+    printf("%8s %12.0f %12.0f %12.0f %12.0f\n", kernels->name,
+           Measure([&]() { return kernels->xor_bytes(frame, frame_len); },
+                   frame_len, iterations),
+           Measure([&]() { return kernels->count_escape(frame, frame_len); },
+                   frame_len, iterations),
+           Measure([&]() { return kernels->find_escape(frame, frame_len); },
+                   frame_len, iterations),
+           Measure([&]() {
+                     uint8_t checksum = 0;
+                     return kernels->copy_unescaped(frame, frame_len, dst,
+                                                    &checksum);
+                   }, frame_len, iterations));
+  }
+
+  delete [] dst;
+  delete [] frame;
+  return 0;
+}
@@ -0,0 +1,83 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares level-triggered and edge-triggered terminal sockets: position
+// reports acknowledged per second and service syscalls per received frame
+// (epoll_wait, reads, writes and EPOLLOUT arming).
+//
+// Usage: epoll_mode_benchmark [connections] [window] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "benchmark/service_benchmark.h"
+#include "service/jt808_service.h"
+
+
+static const char *kDevicesFilePath = "/tmp/jt808_benchmark_devices.txt";
+static const char *kCommandInterfacePath = "/tmp/jt808_benchmark_cmd.sock";
+static const uint16_t kBasePort = 18293;
+
+static void RunMode(FILE *report, const bool &edge_triggered,
+                    const int &connections, const int &window,
+                    const int &seconds) {
+  uint16_t port = static_cast<uint16_t>(kBasePort + edge_triggered);
+  Jt808Service service;
+
+  service.set_edge_triggered(edge_triggered);
+  service.set_devices_file_path(kDevicesFilePath);
+  service.set_command_interface_path(kCommandInterfacePath);
+  service.Init(port, 1024);
+  ServiceBenchmarkResult result = RunServiceBenchmark(&service, port,
+                                                      connections, window,
+                                                      seconds);
+
+  const ReactorStatistics &stats = result.statistics;
+  double frames = stats.frames > 0 ? static_cast<double>(stats.frames) : 1.0;
+  uint64_t syscalls = stats.epoll_waits + stats.reads + stats.writes +
+                      stats.epoll_ctls;
+  fprintf(report, "%6s %12.0f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+          edge_triggered ? "edge" : "level", result.reports_per_second,
+          syscalls / frames, stats.epoll_waits / frames, stats.reads / frames,
+          stats.writes / frames, stats.epoll_ctls / frames);
+  fflush(report);
+}
+
+int main(int argc, char **argv) {
+  int connections = 64;
+  int window = 16;
+  int seconds = 3;
+
+  if (argc > 1) connections = atoi(argv[1]);
+  if (argc > 2) window = atoi(argv[2]);
+  if (argc > 3) seconds = atoi(argv[3]);
+
+  WriteBenchmarkDevices(kDevicesFilePath, connections);
+  FILE *report = RedirectServiceOutput();
+  if (report == nullptr) {
+    return 1;
+  }
+
+  fprintf(report, "connections: %d, window: %d, duration: %ds\n",
+          connections, window, seconds);
+  fprintf(report, "%6s %12s %10s %10s %10s %10s %10s\n", "mode",
+          "reports/sec", "syscall/f", "wait/f", "read/f", "write/f", "ctl/f");
+  RunMode(report, false, connections, window, seconds);
+  RunMode(report, true, connections, window, seconds);
+
+  unlink(kDevicesFilePath);
+  fclose(report);
+  return 0;
+}
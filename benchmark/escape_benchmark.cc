@@ -0,0 +1,149 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Compares the in-place Escape/ReverseEscape codec against the previous
+// implementation that allocated a temporary buffer for every frame.
+//
+// Usage: escape_benchmark [frame_len] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/jt808_protocol.h"
+#include "common/jt808_util.h"
+
+
+// The implementation before the in-place codec, kept for reference.
+static size_t LegacyEscape(uint8_t *src, const size_t &len) {
+  size_t i;
+  size_t j;
+  uint8_t *buffer = new uint8_t[len * 2];
+
+  memset(buffer, 0x0, len * 2);
+  for (i = 0, j = 0; i < len; ++i) {
+    if (src[i] == PROTOCOL_SIGN) {
+      buffer[j++] = PROTOCOL_ESCAPE;
+      buffer[j++] = PROTOCOL_ESCAPE_SIGN;
+    } else if (src[i] == PROTOCOL_ESCAPE) {
+      buffer[j++] = PROTOCOL_ESCAPE;
+      buffer[j++] = PROTOCOL_ESCAPE_ESCAPE;
+    } else {
+      buffer[j++] = src[i];
+    }
+  }
+
+  memcpy(src, buffer, j);
+  delete [] buffer;
+  return j;
+}
+
+static size_t LegacyReverseEscape(uint8_t *src, const size_t &len) {
+  size_t i;
+  size_t j;
+  uint8_t *buffer = new uint8_t[len];
+
+  memset(buffer, 0x0, len);
+  for (i = 0, j = 0; i < len; ++i) {
+    if ((src[i] == PROTOCOL_ESCAPE) && (i + 1 < len) &&
+        (src[i+1] == PROTOCOL_ESCAPE_SIGN)) {
+      buffer[j++] = PROTOCOL_SIGN;
+      ++i;
+    } else if ((src[i] == PROTOCOL_ESCAPE) && (i + 1 < len) &&
+               (src[i+1] == PROTOCOL_ESCAPE_ESCAPE)) {
+      buffer[j++] = PROTOCOL_ESCAPE;
+      ++i;
+    } else {
+      buffer[j++] = src[i];
+    }
+  }
+
+  memcpy(src, buffer, j);
+  delete [] buffer;
+  return j;
+}
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+}
+
+// Fill |frame| with payload-like bytes, one in |every| needs escaping
+// (0 for none).
+static void FillFrame(uint8_t *frame, const size_t &len, const int &every) {
+  for (size_t i = 0; i < len; ++i) {
+    frame[i] = static_cast<uint8_t>(rand() % 0x7D);
+    if ((every > 0) && (rand() % every == 0)) {
+      frame[i] = (rand() % 2) ? PROTOCOL_SIGN : PROTOCOL_ESCAPE;
+    }
+  }
+}
+
+// Escape and reverse escape |frame| |iterations| times, return MB/s.
+static double Measure(size_t (*escape)(uint8_t *, const size_t &),
+                      size_t (*reverse)(uint8_t *, const size_t &),
+                      const uint8_t *frame, const size_t &len,
+                      const int &iterations) {
+  uint8_t *buffer = new uint8_t[len * 2];
+  size_t size = 0;
+  double start;
+  double elapsed;
+
+  start = NowSeconds();
+  for (int i = 0; i < iterations; ++i) {
+    memcpy(buffer, frame, len);
+    size = escape(buffer, len);
+    size = reverse(buffer, size);
+  }
+  elapsed = NowSeconds() - start;
+  if ((size != len) || (memcmp(buffer, frame, len) != 0)) {
+    fprintf(stderr, "round trip mismatch!!!\n");
+  }
+  delete [] buffer;
+
+  return static_cast<double>(len) * iterations / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+  const int kDensities[] = {0, 128, 32, 8};
+  size_t frame_len = 1024;
+  int iterations = 200000;
+  uint8_t *frame;
+  double legacy;
+  double current;
+
+  if (argc > 1) frame_len = static_cast<size_t>(atoi(argv[1]));
+  if (argc > 2) iterations = atoi(argv[2]);
+  if (frame_len == 0) frame_len = 1;
+
+  srand(808);
+  frame = new uint8_t[frame_len];
+  printf("frame: %lu bytes, iterations: %d\n", frame_len, iterations);
+  printf("%12s %14s %14s %8s\n", "escape 1/n", "legacy MB/s", "in-place MB/s",
+         "speedup");
+  for (const int &every : kDensities) {
+    FillFrame(frame, frame_len, every);
+    legacy = Measure(LegacyEscape, LegacyReverseEscape, frame, frame_len,
+                     iterations);
+    current = Measure(Escape, ReverseEscape, frame, frame_len, iterations);
+    printf("%12d %14.0f %14.0f %8.2f\n", every, legacy, current,
+           current / legacy);
+  }
+
+  delete [] frame;
+  return 0;
+}
@@ -0,0 +1,152 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Memory cleared per received frame by the service, before and after the
+// parse context was slimmed down: ProtocolParameters lost its embedded
+// upgrade package and the 4 KB Message buffers are no longer zeroed.
+//
+// The bytes per frame path are derived, not measured: each one is the sum
+// of the sizes of the buffers that path used to memset, as read off the
+// service code before and after the change. Only the cost of those clears
+// is timed.
+//
+// Usage: parse_context_benchmark [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "service/jt808_protocol.h"
+
+
+#pragma pack(push, 1)
+
+// ProtocolParameters as it was, with the upgrade package inlined.
+struct LegacyProtocolParameters {
+  uint8_t respond_result;
+  uint8_t respond_para_num;
+  uint8_t version_num_len;
+  uint8_t upgrade_type;
+  uint8_t set_area_route_type;
+  uint8_t terminal_parameter_id_count;
+  uint8_t area_route_id_count;
+  uint16_t respond_flow_num;
+  uint16_t respond_id;
+  uint16_t packet_first_flow_num;
+  uint16_t packet_response_success_num;
+  uint16_t packet_total_num;
+  uint16_t packet_sequence_num;
+  uint32_t packet_data_len;
+  uint8_t manufacturer_id[5];
+  uint8_t phone_num[6];
+  uint8_t authen_code[4];
+  uint8_t version_num[32];
+  uint8_t packet_data[1024];
+  uint16_t report_interval;
+  uint32_t report_valid_time;
+  uint8_t terminal_control_type;
+  VehicleControlFlag vehicle_control_flag;
+  CanBusDataTimestamp can_bus_data_timestamp;
+  PassThrough *pass_through;
+  std::vector<CircularArea *> *circular_area_list;
+  std::vector<RectangleArea *> *rectangle_area_list;
+  std::vector<PolygonalArea *> *polygonal_area_list;
+  std::vector<Route *> *route_list;
+  std::vector<CanBusData *> *can_bus_data_list;
+  std::list<uint16_t> *packet_id_list;
+  std::map<uint16_t, Message> *packet_map;
+  std::map<uint32_t, std::string> *terminal_parameter_map;
+  uint8_t *terminal_parameter_id_buffer;
+  uint8_t *area_route_id_buffer;
+};
+
+#pragma pack(pop)
+
+struct FramePath {
+  const char *name;
+  size_t before;
+  size_t after;
+};
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+}
+
+// Nanoseconds to clear |len| bytes of |buffer|, as the service did.
+static double MeasureClear(void *buffer, const size_t &len,
+                           const int &iterations) {
+  double start = NowSeconds();
+
+  for (int i = 0; i < iterations; ++i) {
+    memset(buffer, 0x0, len);
+    // Keep the stores, the buffer is read afterwards in the service too.
+    asm volatile("" : : "r"(buffer) : "memory");
+  }
+  return (NowSeconds() - start) * 1e9 / iterations;
+}
+
+int main(int argc, char **argv) {
+  const size_t legacy = sizeof(LegacyProtocolParameters);
+  const size_t context = sizeof(ProtocolParameters);
+  const size_t message = sizeof(Message);
+  // What each kind of frame zeroed on its way through the service, from
+  // the sizes of the cleared structs.
+  const FramePath paths[] = {
+    // Acknowledged report: the answer buffer was zeroed before packing.
+    {"report ack", MAX_PROFRAMEBUF_LEN, 0},
+    // Register/authentication: context plus the answer buffer.
+    {"handshake", legacy + MAX_PROFRAMEBUF_LEN, context},
+    // Deal*Request: context plus the request message.
+    {"command request", legacy + message, context},
+    // Upgrade chunk: answer buffer plus the inline 1 KB chunk, which was
+    // then copied in again.
+    {"upgrade chunk", MAX_PROFRAMEBUF_LEN + 2 * 1024, 0},
+  };
+  int iterations = 10000000;
+  Message msg;
+  LegacyProtocolParameters old_propara;
+  ProtocolParameters propara;
+  double message_ns;
+  double legacy_ns;
+  double context_ns;
+
+  if (argc > 1) iterations = atoi(argv[1]);
+  if (iterations < 1) iterations = 1;
+
+  printf("sizeof ProtocolParameters: %lu -> %lu bytes, Message: %lu bytes\n",
+         legacy, context, message);
+  printf("bytes cleared per frame, derived from the struct sizes:\n");
+  printf("%16s %14s %14s\n", "path", "bytes before", "bytes after");
+  for (const FramePath &path : paths) {
+    printf("%16s %14lu %14lu\n", path.name, path.before, path.after);
+  }
+
+  message_ns = MeasureClear(&msg, sizeof(msg), iterations);
+  legacy_ns = MeasureClear(&old_propara, legacy, iterations);
+  context_ns = MeasureClear(&propara, context, iterations);
+  printf("clear cost: Message %.1f ns, context %.1f -> %.1f ns\n",
+         message_ns, legacy_ns, context_ns);
+  printf("command request: %.1f -> %.1f ns per frame\n",
+         legacy_ns + message_ns, context_ns);
+  return 0;
+}
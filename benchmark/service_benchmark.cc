@@ -0,0 +1,218 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark/service_benchmark.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/jt808_protocol.h"
+#include "common/jt808_util.h"
+#include "service/jt808_frame_buffer.h"
+
+
+static std::atomic<bool> running;
+static std::atomic<uint64_t> acknowledged;
+
+uint64_t TerminalPhoneNumber(const int &index) {
+  return 13900000000ull + index;
+}
+
+static uint32_t AuthenCode(const int &index) {
+  return 100000u + index;
+}
+
+void WriteBenchmarkDevices(const char *path, const int &count) {
+  std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+  for (int i = 0; i < count; ++i) {
+    ofs << TerminalPhoneNumber(i) << ";" << AuthenCode(i) << ";" << std::endl;
+  }
+}
+
+size_t PackTerminalFrame(const uint16_t &id, const uint8_t *phone_bcd,
+                         const uint16_t &flow_num, const uint8_t *body,
+                         const uint16_t &body_len, uint8_t *frame) {
+  Message msg;
+  MessageHead *msghead_ptr;
+
+  memset(&msg, 0x0, sizeof(msg));
+  msghead_ptr = reinterpret_cast<MessageHead *>(&msg.buffer[1]);
+  msghead_ptr->id = EndianSwap16(id);
+  msghead_ptr->attribute.value = EndianSwap16(body_len);
+  memcpy(msghead_ptr->phone, phone_bcd, 6);
+  msghead_ptr->msgflownum = EndianSwap16(flow_num);
+  memcpy(&msg.buffer[MSGBODY_NOPACKAGE_POS], body, body_len);
+  msg.size = MSGBODY_NOPACKAGE_POS + body_len;
+  msg.buffer[msg.size] = BccCheckSum(&msg.buffer[1], msg.size - 1);
+  msg.size = Escape(&msg.buffer[1], msg.size) + 1;
+  msg.buffer[0] = PROTOCOL_SIGN;
+  msg.buffer[msg.size++] = PROTOCOL_SIGN;
+  memcpy(frame, msg.buffer, msg.size);
+  return msg.size;
+}
+
+// Block until |count| frames have been received, false on error or when
+// the run is over.
+static bool WaitFrames(const int &fd, FrameBuffer *buffer, const int &count) {
+  Message msg;
+  int received = 0;
+  int ret;
+
+  while (received < count) {
+    while ((received < count) && buffer->PopFrame(&msg)) {
+      ++received;
+    }
+    if (received == count) {
+      break;
+    }
+    ret = buffer->RecvFrom(fd);
+    // Receive times out periodically to notice the end of the run.
+    if ((ret < 0) || ((ret == 0) && !running)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int ConnectTerminal(const uint16_t &port, const int &index,
+                    uint8_t *phone_bcd, FrameBuffer *buffer) {
+  struct sockaddr_in server_addr;
+  struct timeval timeout = {0, 100000};
+  uint8_t frame[MAX_PROFRAMEBUF_LEN];
+  uint32_t authen_code = AuthenCode(index);
+  char phone_num[16] = {0};
+  Message msg;
+  size_t len;
+  int fd;
+
+  snprintf(phone_num, sizeof(phone_num), "%llu",
+           static_cast<unsigned long long>(TerminalPhoneNumber(index)));
+  PreparePhoneNum(phone_num, phone_bcd);
+
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&server_addr),
+              sizeof(server_addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  // Authentication code as stored in the devices file.
+  len = PackTerminalFrame(UP_AUTHENTICATION, phone_bcd, 0,
+                          reinterpret_cast<uint8_t *>(&authen_code), 4,
+                          frame);
+  if (send(fd, frame, len, 0) < 0) {
+    close(fd);
+    return -1;
+  }
+  // Answered well within the handshake timeout.
+  for (int tries = 0; !buffer->PopFrame(&msg); ++tries) {
+    if ((tries == 50) || (buffer->RecvFrom(fd) < 0)) {
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+static void RunTerminal(const uint16_t &port, const int &index,
+                        const int &window) {
+  uint8_t phone_bcd[6] = {0};
+  uint8_t body[28] = {0};
+  uint8_t frame[MAX_PROFRAMEBUF_LEN];
+  std::vector<uint8_t> reports;
+  uint16_t flow_num = 1;
+  FrameBuffer buffer;
+  size_t len;
+  int fd = ConnectTerminal(port, index, phone_bcd, &buffer);
+
+  if (fd < 0) {
+    return;
+  }
+  for (int i = 0; i < window; ++i) {
+    len = PackTerminalFrame(UP_POSITIONREPORT, phone_bcd, flow_num++,
+                            body, sizeof(body), frame);
+    reports.insert(reports.end(), frame, frame + len);
+  }
+  while (running) {
+    if (send(fd, reports.data(), reports.size(), 0) < 0) {
+      break;
+    }
+    if (!WaitFrames(fd, &buffer, window)) {
+      break;
+    }
+    acknowledged += window;
+  }
+  close(fd);
+}
+
+ServiceBenchmarkResult RunServiceBenchmark(Jt808Service *service,
+                                           const uint16_t &port,
+                                           const int &connections,
+                                           const int &window,
+                                           const int &seconds) {
+  ServiceBenchmarkResult result;
+  std::vector<std::thread> terminals;
+  std::thread service_thread([service] { service->Run(100); });
+
+  running = true;
+  acknowledged = 0;
+  for (int i = 0; i < connections; ++i) {
+    terminals.push_back(std::thread(RunTerminal, port, i, window));
+  }
+  // Leave the handshakes out of the measurement.
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  uint64_t start_count = acknowledged;
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  uint64_t count = acknowledged - start_count;
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  running = false;
+  for (auto &terminal : terminals) {
+    terminal.join();
+  }
+  service->Stop();
+  service_thread.join();
+  result.reports_per_second = count / elapsed.count();
+  result.statistics = service->statistics();
+  result.position_reports = service->message_statistics(UP_POSITIONREPORT);
+  result.pipeline = service->position_pipeline()->statistics();
+  return result;
+}
+
+FILE *RedirectServiceOutput(void) {
+  FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+  if ((report == nullptr) || (freopen("/dev/null", "w", stdout) == nullptr)) {
+    return nullptr;
+  }
+  return report;
+}
@@ -0,0 +1,65 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_BENCHMARK_SERVICE_BENCHMARK_H_
+#define JT808_BENCHMARK_SERVICE_BENCHMARK_H_
+
+#include <stdint.h>
+
+#include "service/jt808_frame_buffer.h"
+#include "service/jt808_service.h"
+
+
+// Simulated terminals driving a service in the same process. Every
+// terminal authenticates and then keeps a window of position reports in
+// flight, a report counts once the service has acknowledged it.
+struct ServiceBenchmarkResult {
+  double reports_per_second = 0.0;
+  // Service counters over the whole run, handshakes included.
+  ReactorStatistics statistics;
+  // Handler counters of the position reports.
+  MessageStatistics position_reports;
+  // Records handed to the position pipeline and dropped by it.
+  PositionPipelineStatistics pipeline;
+};
+
+// Write |count| devices the simulated terminals authenticate as.
+void WriteBenchmarkDevices(const char *path, const int &count);
+uint64_t TerminalPhoneNumber(const int &index);
+
+// Pack an uplink frame of the terminal with |phone_bcd| into |frame|,
+// return its size.
+size_t PackTerminalFrame(const uint16_t &id, const uint8_t *phone_bcd,
+                         const uint16_t &flow_num, const uint8_t *body,
+                         const uint16_t &body_len, uint8_t *frame);
+
+// Connect simulated terminal |index| to the service on |port| and
+// authenticate it, fill its |phone_bcd|. Receives time out every 100ms.
+// Return the socket, -1 on error.
+int ConnectTerminal(const uint16_t &port, const int &index,
+                    uint8_t *phone_bcd, FrameBuffer *buffer);
+
+// Run |service|, already initialized on |port|, against |connections|
+// terminals for |seconds| and stop it.
+ServiceBenchmarkResult RunServiceBenchmark(Jt808Service *service,
+                                           const uint16_t &port,
+                                           const int &connections,
+                                           const int &window,
+                                           const int &seconds);
+
+// The service logs every frame, send stdout to /dev/null and return a
+// stream to the original one for the report.
+FILE *RedirectServiceOutput(void);
+
+#endif  // JT808_BENCHMARK_SERVICE_BENCHMARK_H_
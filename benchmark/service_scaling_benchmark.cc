@@ -0,0 +1,89 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures position reports acknowledged per second by the service with
+// 1, 2, 4 ... worker reactors. Every terminal connection authenticates and
+// then keeps a window of position reports in flight.
+//
+// Usage: service_scaling_benchmark [max_workers] [connections] [seconds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <thread>  // NOLINT
+
+#include "benchmark/service_benchmark.h"
+#include "service/jt808_service.h"
+
+
+static const char *kDevicesFilePath = "/tmp/jt808_benchmark_devices.txt";
+static const char *kCommandInterfacePath = "/tmp/jt808_benchmark_cmd.sock";
+static const uint16_t kBasePort = 18193;
+// Position reports in flight per connection.
+static const int kWindow = 16;
+
+static ServiceBenchmarkResult Measure(const int &workers,
+                                      const int &connections,
+                                      const int &seconds) {
+  uint16_t port = static_cast<uint16_t>(kBasePort + workers);
+  Jt808Service service;
+
+  service.set_worker_count(workers);
+  service.set_devices_file_path(kDevicesFilePath);
+  service.set_command_interface_path(kCommandInterfacePath);
+  service.Init(port, 1024);
+  return RunServiceBenchmark(&service, port, connections, kWindow, seconds);
+}
+
+int main(int argc, char **argv) {
+  int max_workers = static_cast<int>(std::thread::hardware_concurrency());
+  int connections = 64;
+  int seconds = 3;
+  double base = 0.0;
+
+  if (argc > 1) max_workers = atoi(argv[1]);
+  if (argc > 2) connections = atoi(argv[2]);
+  if (argc > 3) seconds = atoi(argv[3]);
+  if (max_workers < 1) max_workers = 1;
+
+  WriteBenchmarkDevices(kDevicesFilePath, connections);
+  FILE *report = RedirectServiceOutput();
+  if (report == nullptr) {
+    return 1;
+  }
+
+  fprintf(report, "connections: %d, window: %d, duration: %ds\n",
+          connections, kWindow, seconds);
+  // Handler latency percentiles are bucket upper bounds.
+  fprintf(report, "%8s %16s %8s %12s %12s %12s\n", "workers",
+          "reports/sec", "speedup", "p50 ns", "p99 ns", "dropped");
+  for (int workers = 1; workers <= max_workers; workers *= 2) {
+    ServiceBenchmarkResult result = Measure(workers, connections, seconds);
+    double rate = result.reports_per_second;
+    if (workers == 1) {
+      base = rate;
+    }
+    fprintf(report, "%8d %16.0f %8.2f %12lu %12lu %12lu\n", workers, rate,
+            base > 0.0 ? rate / base : 0.0,
+            result.position_reports.Percentile(50),
+            result.position_reports.Percentile(99),
+            result.pipeline.dropped);
+    fflush(report);
+  }
+
+  unlink(kDevicesFilePath);
+  fclose(report);
+  return 0;
+}
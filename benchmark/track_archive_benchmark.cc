@@ -0,0 +1,137 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Archives simulated tracks of a fleet reporting every |interval| seconds
+// for a day, then reports the size against raw track records and the rate
+// a whole day is played back.
+//
+// Usage: track_archive_benchmark [devices] [interval] [directory]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "service/jt808_track_archive.h"
+#include "service/jt808_track_store.h"
+
+
+// 2019-06-01 00:00:00 GMT+8.
+static const uint32_t kDayStart = 1559318400;
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+}
+
+static uint8_t Bcd(const int &value) {
+  return static_cast<uint8_t>(((value / 10) << 4) | (value % 10));
+}
+
+static void SetTime(const uint32_t &time, PositionRecord *record) {
+  time_t local = time + 8 * 3600;
+  struct tm tm;
+
+  gmtime_r(&local, &tm);
+  record->timestamp[0] = Bcd(tm.tm_year - 100);
+  record->timestamp[1] = Bcd(tm.tm_mon + 1);
+  record->timestamp[2] = Bcd(tm.tm_mday);
+  record->timestamp[3] = Bcd(tm.tm_hour);
+  record->timestamp[4] = Bcd(tm.tm_min);
+  record->timestamp[5] = Bcd(tm.tm_sec);
+}
+
+int main(int argc, char **argv) {
+  int devices = 100;
+  int interval = 30;
+  std::string directory = "/tmp/jt808_archive_benchmark";
+  std::vector<PositionRecord> fleet;
+  TrackArchive archive;
+  uint8_t phone_bcd[6];
+  uint64_t points = 0;
+  uint64_t played = 0;
+  double start;
+  double elapsed;
+
+  if (argc > 1) devices = atoi(argv[1]);
+  if (argc > 2) interval = atoi(argv[2]);
+  if (argc > 3) directory = argv[3];
+  if (devices < 1) devices = 1;
+  if (interval < 1) interval = 1;
+
+  srand(808);
+  fleet.resize(devices);
+  for (int i = 0; i < devices; ++i) {
+    memset(&fleet[i], 0x0, sizeof(PositionRecord));
+    fleet[i].phone_bcd[4] = static_cast<uint8_t>(i >> 8);
+    fleet[i].phone_bcd[5] = static_cast<uint8_t>(i);
+    fleet[i].latitude = 22500000 + rand() % 100000;
+    fleet[i].longitude = 113900000 + rand() % 100000;
+    fleet[i].status = 0x00040003;
+  }
+  if (!archive.Open(directory.c_str())) {
+    fprintf(stderr, "open %s failed!!!\n", directory.c_str());
+    return 1;
+  }
+
+  start = NowSeconds();
+  for (uint32_t time = kDayStart; time < kDayStart + 86400;
+       time += interval) {
+    for (auto &record : fleet) {
+      // A vehicle moving at up to about 60km/h.
+      record.latitude += rand() % 1001 - 500;
+      record.longitude += rand() % 1001 - 500;
+      record.speed = static_cast<uint16_t>(rand() % 600);
+      record.bearing = static_cast<uint16_t>(rand() % 360);
+      record.altitude = static_cast<uint16_t>(20 + rand() % 3);
+      SetTime(time, &record);
+      archive.Append(0, record);
+      ++points;
+    }
+  }
+  archive.Flush();
+  elapsed = NowSeconds() - start;
+  printf("devices: %d, interval: %ds, points: %lu\n", devices, interval,
+         points);
+  printf("%24s %12.0f\n", "append points/sec", points / elapsed);
+  printf("%24s %12.2f\n", "archive bytes/point",
+         static_cast<double>(archive.bytes_written()) / points);
+  printf("%24s %12.1fx\n", "vs track records",
+         static_cast<double>(points * sizeof(TrackRecord)) /
+             archive.bytes_written());
+  printf("%24s %12.1fx\n", "vs basic info",
+         static_cast<double>(points * 28) / archive.bytes_written());
+
+  start = NowSeconds();
+  for (int i = 0; i < devices; ++i) {
+    memcpy(phone_bcd, fleet[i].phone_bcd, 6);
+    played += TrackArchive::Query(
+                  directory.c_str(), phone_bcd, kDayStart,
+                  kDayStart + 86399,
+                  [](const TrackColumns &, const size_t &, const size_t &) {
+                    return true;
+                  });
+  }
+  elapsed = NowSeconds() - start;
+  printf("%24s %12.0f (%lu points)\n", "playback points/sec",
+         played / elapsed, played);
+
+  std::string command = "rm -rf " + directory;
+  return system(command.c_str());
+}
@@ -0,0 +1,89 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Measures records/s appended to the track store in batches the size the
+// position pipeline hands over, with the default sync interval, and the
+// rate a time range is scanned back.
+//
+// Usage: track_store_benchmark [directory] [records] [batch]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "service/jt808_track_store.h"
+
+
+static double NowSeconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  std::string directory = "/tmp/jt808_track_benchmark";
+  uint64_t records = 2000000;
+  size_t batch = 256;
+  std::vector<PositionRecord> positions;
+  TrackStore store;
+  uint64_t start_ms;
+  uint64_t scanned;
+  double start;
+  double elapsed;
+
+  if (argc > 1) directory = argv[1];
+  if (argc > 2) records = strtoull(argv[2], nullptr, 10);
+  if (argc > 3) batch = static_cast<size_t>(atoi(argv[3]));
+  if (batch == 0) batch = 1;
+
+  positions.resize(batch);
+  memset(positions.data(), 0x0, batch * sizeof(PositionRecord));
+  if (!store.Open(directory.c_str())) {
+    fprintf(stderr, "open %s failed!!!\n", directory.c_str());
+    return 1;
+  }
+  printf("records: %lu, batch: %lu, record: %lu bytes\n", records, batch,
+         sizeof(TrackRecord));
+
+  start_ms = TrackStore::NowMs();
+  start = NowSeconds();
+  for (uint64_t i = 0; i < records; i += batch) {
+    for (auto &position : positions) {
+      position.mileage = static_cast<uint32_t>(i);
+    }
+    if (!store.Append(TrackStore::NowMs(), positions.data(), batch)) {
+      fprintf(stderr, "append failed!!!\n");
+      return 1;
+    }
+  }
+  store.Close();
+  elapsed = NowSeconds() - start;
+  printf("%12s %16.0f\n", "append/sec", records / elapsed);
+
+  start = NowSeconds();
+  scanned = TrackStore::Scan(directory.c_str(), start_ms,
+                             TrackStore::NowMs(),
+                             [](const TrackRecord &) { return true; });
+  elapsed = NowSeconds() - start;
+  printf("%12s %16.0f (%lu records)\n", "scan/sec", scanned / elapsed,
+         scanned);
+
+  std::string command = "rm -rf " + directory;
+  return system(command.c_str());
+}
@@ -0,0 +1,260 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Upgrades simulated terminals at once over links with a round trip time
+// of |rtt| milliseconds, with upgrade windows of 1, 4, 16 and 64 package
+// frames, then as a campaign with a quarter of the terminals upgrading at
+// once and with the bandwidth capped to |bandwidth_kb| KB/s. A terminal
+// answers every package one round trip after it arrived.
+//
+// Usage: upgrade_benchmark [terminals] [image_kb] [rtt_ms] [bandwidth_kb]
+
+#include <stdio.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <deque>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "benchmark/service_benchmark.h"
+#include "service/jt808_frame_decoder.h"
+#include "service/jt808_service.h"
+#include "unix_socket/unix_socket.h"
+
+
+static const char *kDevicesFilePath = "/tmp/jt808_benchmark_devices.txt";
+static const char *kCommandInterfacePath = "/tmp/jt808_benchmark_cmd.sock";
+static const char *kImagePath = "/tmp/jt808_benchmark_image.bin";
+static const uint16_t kBasePort = 18393;
+
+static std::atomic<int> connected;
+
+// An answer waiting for its round trip to elapse.
+struct PendingAnswer {
+  std::chrono::steady_clock::time_point due;
+  std::vector<uint8_t> frame;
+};
+
+// Seconds from the first package received to the last one answered, 0 if
+// the upgrade did not complete.
+static double RunTerminal(const uint16_t &port, const int &index,
+                          const int &rtt) {
+  uint8_t phone_bcd[6] = {0};
+  uint8_t body[5] = {0};
+  uint8_t frame[MAX_PROFRAMEBUF_LEN];
+  std::deque<PendingAnswer> pending;
+  std::vector<uint8_t> answers;
+  std::vector<bool> received;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point now;
+  std::chrono::duration<double> elapsed(0.0);
+  uint16_t flow_num = 1;
+  uint16_t sequence;
+  size_t count = 0;
+  FrameBuffer buffer;
+  FrameView view;
+  Message msg;
+  int timeout;
+  int idle = 0;
+  int fd = ConnectTerminal(port, index, phone_bcd, &buffer);
+
+  ++connected;
+  if (fd < 0) {
+    return 0.0;
+  }
+  // Give up after a few seconds without packages, or a minute in line.
+  while ((received.empty() || (count < received.size() - 1) ||
+          !pending.empty()) && (idle < (received.empty() ? 600 : 50))) {
+    now = std::chrono::steady_clock::now();
+    while (buffer.PopFrame(&msg)) {
+      if ((DecodeFrame(&msg, &view) != kFrameDecodeOk) ||
+          (view.id != DOWN_UPGRADEPACKAGE)) {
+        continue;
+      }
+      if (received.empty()) {
+        start = now;
+        received.resize(view.attribute.bit.package ?
+                            view.total_package + 1 : 2, false);
+      }
+      sequence = view.attribute.bit.package ? view.packet_seq : 1;
+      if ((sequence < received.size()) && !received[sequence]) {
+        received[sequence] = true;
+        ++count;
+      }
+      body[0] = static_cast<uint8_t>(view.flow_num >> 8);
+      body[1] = static_cast<uint8_t>(view.flow_num);
+      body[2] = static_cast<uint8_t>(DOWN_UPGRADEPACKAGE >> 8);
+      body[3] = static_cast<uint8_t>(DOWN_UPGRADEPACKAGE & 0xFF);
+      body[4] = kSuccess;
+      size_t len = PackTerminalFrame(UP_UNIRESPONSE, phone_bcd, flow_num++,
+                                     body, sizeof(body), frame);
+      pending.push_back({now + std::chrono::milliseconds(rtt),
+                         std::vector<uint8_t>(frame, frame + len)});
+    }
+
+    answers.clear();
+    while (!pending.empty() && (pending.front().due <= now)) {
+      answers.insert(answers.end(), pending.front().frame.begin(),
+                     pending.front().frame.end());
+      pending.pop_front();
+    }
+    if (!answers.empty()) {
+      if (send(fd, answers.data(), answers.size(), MSG_NOSIGNAL) < 0) {
+        break;
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+    // Sleep until the next answer is due or a package arrives.
+    timeout = 100;
+    if (!pending.empty()) {
+      timeout = static_cast<int>(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              pending.front().due - now).count());
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, std::max(timeout, 0)) > 0) {
+      if (buffer.RecvFrom(fd) < 0) {
+        break;
+      }
+      idle = 0;
+    } else if (pending.empty()) {
+      ++idle;
+    }
+  }
+  close(fd);
+  return (!received.empty() && (count == received.size() - 1)) ?
+             elapsed.count() : 0.0;
+}
+
+static void Upgrade(const int &index) {
+  char answer[256] = {0};
+  std::string command = std::to_string(TerminalPhoneNumber(index)) +
+                        " upgrade device 1.0.0 " + kImagePath;
+  int fd = ClientConnect(kCommandInterfacePath);
+
+  if (fd > 0) {
+    send(fd, command.c_str(), command.length(), 0);
+    recv(fd, answer, sizeof(answer) - 1, 0);
+    close(fd);
+  }
+}
+
+static void Measure(FILE *report, const size_t &window,
+                    const size_t &concurrent, const int &bandwidth_kb,
+                    const int &terminals, const int &image_kb,
+                    const int &rtt) {
+  static uint16_t port = kBasePort;
+  std::vector<std::thread> threads;
+  std::vector<double> seconds(terminals, 0.0);
+  std::chrono::steady_clock::time_point start;
+  std::chrono::duration<double> elapsed;
+  double total = 0.0;
+  int completed = 0;
+  Jt808Service service;
+
+  service.set_upgrade_window(window);
+  service.set_max_concurrent_upgrades(concurrent);
+  service.set_upgrade_bandwidth(bandwidth_kb * 1024ULL);
+  service.set_devices_file_path(kDevicesFilePath);
+  service.set_command_interface_path(kCommandInterfacePath);
+  service.Init(++port, 1024);
+  std::thread service_thread([&service] { service.Run(100); });
+
+  connected = 0;
+  for (int i = 0; i < terminals; ++i) {
+    threads.emplace_back([&seconds, i, rtt] {
+      seconds[i] = RunTerminal(port, i, rtt);
+    });
+  }
+  while (connected < terminals) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < terminals; ++i) {
+    Upgrade(i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  service.Stop();
+  service_thread.join();
+
+  for (auto &second : seconds) {
+    if (second > 0.0) {
+      total += image_kb / second;
+      ++completed;
+    }
+  }
+  fprintf(report, "%8zu %12zu %10d %10d %16.1f %12.1f %10.3f\n", window,
+          concurrent, bandwidth_kb, completed,
+          completed > 0 ? total / completed : 0.0,
+          completed * image_kb / elapsed.count(), elapsed.count());
+  fflush(report);
+}
+
+int main(int argc, char **argv) {
+  int terminals = 16;
+  int image_kb = 256;
+  int rtt = 20;
+  int bandwidth_kb = 2048;
+
+  if (argc > 1) terminals = atoi(argv[1]);
+  if (argc > 2) image_kb = atoi(argv[2]);
+  if (argc > 3) rtt = atoi(argv[3]);
+  if (argc > 4) bandwidth_kb = atoi(argv[4]);
+  if (terminals < 1) terminals = 1;
+  if (image_kb < 1) image_kb = 1;
+
+  WriteBenchmarkDevices(kDevicesFilePath, terminals);
+  FILE *image = fopen(kImagePath, "wb");
+  std::vector<uint8_t> data(image_kb * 1024);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 131);
+  }
+  fwrite(data.data(), 1, data.size(), image);
+  fclose(image);
+  FILE *report = RedirectServiceOutput();
+  if (report == nullptr) {
+    return 1;
+  }
+
+  fprintf(report, "terminals: %d, image: %dKB, rtt: %dms\n", terminals,
+          image_kb, rtt);
+  // 0 for no limit.
+  fprintf(report, "%8s %12s %10s %10s %16s %12s %10s\n", "window",
+          "concurrent", "cap KB/s", "completed", "KB/s per device",
+          "KB/s total", "total s");
+  for (size_t window = 1; window <= 64; window *= 4) {
+    Measure(report, window, 0, 0, terminals, image_kb, rtt);
+  }
+  Measure(report, UpgradeSession::kDefaultWindow,
+          std::max(terminals / 4, 1), 0, terminals, image_kb, rtt);
+  Measure(report, UpgradeSession::kDefaultWindow, 0, bandwidth_kb,
+          terminals, image_kb, rtt);
+
+  unlink(kImagePath);
+  unlink(kDevicesFilePath);
+  fclose(report);
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_COMMON_JT808_CODEC_H_
+#define JT808_COMMON_JT808_CODEC_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+
+// Message bodies are described as a list of field descriptors bound to the
+// members of a struct. Schema<...> then generates Size(), Encode() and
+// Decode() for the whole body at compile time, so each message gets a
+// straight-line codec without per-field dispatch.
+//
+// Encode() writes Size() bytes and does not check the destination,
+// Decode() stops at |end| and returns nullptr on a truncated body.
+
+// Big-endian integer member, BYTE/WORD/DWORD.
+template <typename S, typename T, T S::*M>
+struct IntField {
+  static size_t Size(const S &) { return sizeof(T); }
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    T value = s.*M;
+    for (size_t i = sizeof(T); i > 0; --i) {
+      dst[i - 1] = static_cast<uint8_t>(value & 0xFF);
+      value = static_cast<T>(value >> 8);
+    }
+    return dst + sizeof(T);
+  }
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    T value = 0;
+    if (static_cast<size_t>(end - src) < sizeof(T)) {
+      return nullptr;
+    }
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      value = static_cast<T>((value << 8) | src[i]);
+    }
+    s->*M = value;
+    return src + sizeof(T);
+  }
+};
+
+template <typename S, uint8_t S::*M>
+using ByteField = IntField<S, uint8_t, M>;
+template <typename S, uint16_t S::*M>
+using WordField = IntField<S, uint16_t, M>;
+template <typename S, uint32_t S::*M>
+using DwordField = IntField<S, uint32_t, M>;
+
+// Fixed length byte array copied as is, e.g. BCD[6] timestamps.
+template <typename S, size_t N, uint8_t (S::*M)[N]>
+struct BytesField {
+  static size_t Size(const S &) { return N; }
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    memcpy(dst, s.*M, N);
+    return dst + N;
+  }
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    if (static_cast<size_t>(end - src) < N) {
+      return nullptr;
+    }
+    memcpy(s->*M, src, N);
+    return src + N;
+  }
+};
+
+// Byte string prefixed by its length, the length member |L| counts the
+// valid bytes of the array member |M|.
+template <typename S, typename L, L S::*LM, size_t N, uint8_t (S::*M)[N]>
+struct PrefixedBytesField {
+  static size_t Size(const S &s) { return sizeof(L) + s.*LM; }
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    dst = IntField<S, L, LM>::Encode(s, dst);
+    memcpy(dst, s.*M, s.*LM);
+    return dst + s.*LM;
+  }
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    src = IntField<S, L, LM>::Decode(src, end, s);
+    if ((src == nullptr) || (s->*LM > N) ||
+        (static_cast<size_t>(end - src) < s->*LM)) {
+      return nullptr;
+    }
+    memcpy(s->*M, src, s->*LM);
+    return src + s->*LM;
+  }
+};
+
+// Member struct or union encoded with its own schema.
+template <typename S, typename T, T S::*M, typename Codec>
+struct NestedField {
+  static size_t Size(const S &s) { return Codec::Size(s.*M); }
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    return Codec::Encode(s.*M, dst);
+  }
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    return Codec::Decode(src, end, &(s->*M));
+  }
+};
+
+// List of heap allocated items led by an item count of type |C|, which
+// Decode also stores into the member |CM| if given. Decode allocates the
+// list and the items, the caller owns them even if the body turns out to
+// be truncated.
+template <typename S, typename C, typename T, std::vector<T *> *S::*M,
+          typename Codec, C S::*CM = nullptr>
+struct RepeatedField {
+  static size_t Size(const S &s) {
+    size_t size = sizeof(C);
+    if (s.*M != nullptr) {
+      for (auto item : *(s.*M)) {
+        size += Codec::Size(*item);
+      }
+    }
+    return size;
+  }
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    Count count;
+    count.value = static_cast<C>(s.*M != nullptr ? (s.*M)->size() : 0);
+    dst = IntField<Count, C, &Count::value>::Encode(count, dst);
+    for (size_t i = 0; i < count.value; ++i) {
+      dst = Codec::Encode(*(*(s.*M))[i], dst);
+    }
+    return dst;
+  }
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    Count count;
+    src = IntField<Count, C, &Count::value>::Decode(src, end, &count);
+    if (src == nullptr) {
+      return nullptr;
+    }
+    if (CM != nullptr) {
+      s->*CM = count.value;
+    }
+    s->*M = new std::vector<T *>;
+    for (size_t i = 0; (i < count.value) && (src != nullptr); ++i) {
+      (s->*M)->push_back(new T());
+      src = Codec::Decode(src, end, (s->*M)->back());
+    }
+    return src;
+  }
+
+ private:
+  struct Count {
+    C value;
+  };
+};
+
+// Fields present only when Pred::Test() holds, the predicate sees the
+// fields decoded before it.
+template <typename Pred, typename... Fields>
+struct OptionalFields;
+
+template <typename... Fields>
+struct Schema;
+
+template <>
+struct Schema<> {
+  template <typename S>
+  static size_t Size(const S &) { return 0; }
+  template <typename S>
+  static uint8_t *Encode(const S &, uint8_t *dst) { return dst; }
+  template <typename S>
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *, S *) {
+    return src;
+  }
+};
+
+template <typename Field, typename... Rest>
+struct Schema<Field, Rest...> {
+  template <typename S>
+  static size_t Size(const S &s) {
+    return Field::Size(s) + Schema<Rest...>::Size(s);
+  }
+  template <typename S>
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    return Schema<Rest...>::Encode(s, Field::Encode(s, dst));
+  }
+  template <typename S>
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    src = Field::Decode(src, end, s);
+    return (src != nullptr) ? Schema<Rest...>::Decode(src, end, s) : nullptr;
+  }
+};
+
+template <typename Pred, typename... Fields>
+struct OptionalFields {
+  template <typename S>
+  static size_t Size(const S &s) {
+    return Pred::Test(s) ? Schema<Fields...>::Size(s) : 0;
+  }
+  template <typename S>
+  static uint8_t *Encode(const S &s, uint8_t *dst) {
+    return Pred::Test(s) ? Schema<Fields...>::Encode(s, dst) : dst;
+  }
+  template <typename S>
+  static const uint8_t *Decode(const uint8_t *src, const uint8_t *end,
+                               S *s) {
+    return Pred::Test(*s) ? Schema<Fields...>::Decode(src, end, s) : src;
+  }
+};
+
+#endif  // JT808_COMMON_JT808_CODEC_H_
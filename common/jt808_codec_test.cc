@@ -0,0 +1,299 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_message_schema.h"
+#include "util/container_clear.h"
+
+
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+using ::testing::IsNull;
+using ::testing::NotNull;
+
+static const int kFuzzRounds = 2000;
+
+// Optional parts left out of the body are kept zero, so decoded items can
+// be compared against the originals field by field.
+static void RandomAreaTimeAndSpeed(std::mt19937 *rng, AreaAttribute *attribute,
+                                   uint8_t *start_time, uint8_t *end_time,
+                                   uint16_t *max_speed,
+                                   uint8_t *overspeed_duration) {
+  attribute->value = static_cast<uint16_t>((*rng)());
+  for (int i = 0; i < 6; ++i) {
+    start_time[i] = attribute->bit.bytime ? (*rng)() & 0xFF : 0;
+    end_time[i] = attribute->bit.bytime ? (*rng)() & 0xFF : 0;
+  }
+  *max_speed = attribute->bit.speedlimit ? (*rng)() & 0xFFFF : 0;
+  *overspeed_duration = attribute->bit.speedlimit ? (*rng)() & 0xFF : 0;
+}
+
+static Route *RandomRoute(std::mt19937 *rng) {
+  Route *route = new Route();
+  route->route_id = (*rng)();
+  route->route_attribute.value = static_cast<uint16_t>((*rng)());
+  if (route->route_attribute.bit.bytime) {
+    for (int i = 0; i < 6; ++i) {
+      route->start_time[i] = (*rng)() & 0xFF;
+      route->end_time[i] = (*rng)() & 0xFF;
+    }
+  }
+  route->inflection_point_count = (*rng)() % 8;
+  route->inflection_point_list = new std::vector<InflectionPoint *>;
+  for (int i = 0; i < route->inflection_point_count; ++i) {
+    InflectionPoint *point = new InflectionPoint();
+    point->inflection_point_id = (*rng)();
+    point->road_section_id = (*rng)();
+    point->coordinate.latitude = (*rng)();
+    point->coordinate.longitude = (*rng)();
+    point->road_section_wide = (*rng)() & 0xFF;
+    point->road_section_attribute.value = (*rng)() & 0xFF;
+    if (point->road_section_attribute.bit.traveltime) {
+      point->max_driving_time = (*rng)() & 0xFFFF;
+      point->min_driving_time = (*rng)() & 0xFFFF;
+    }
+    if (point->road_section_attribute.bit.speedlimit) {
+      point->max_speed = (*rng)() & 0xFFFF;
+      point->overspeed_duration = (*rng)() & 0xFF;
+    }
+    route->inflection_point_list->push_back(point);
+  }
+  return route;
+}
+
+static void DeleteRoute(Route *route) {
+  if (route->inflection_point_list != nullptr) {
+    ClearContainerElement(route->inflection_point_list);
+    delete route->inflection_point_list;
+  }
+  delete route;
+}
+
+static void ExpectSameRoute(const Route &a, const Route &b) {
+  EXPECT_THAT(a.route_id, Eq(b.route_id));
+  EXPECT_THAT(a.route_attribute.value, Eq(b.route_attribute.value));
+  EXPECT_THAT(memcmp(a.start_time, b.start_time, 6), Eq(0));
+  EXPECT_THAT(memcmp(a.end_time, b.end_time, 6), Eq(0));
+  EXPECT_THAT(a.inflection_point_count, Eq(b.inflection_point_count));
+  ASSERT_THAT(a.inflection_point_list->size(),
+              Eq(b.inflection_point_list->size()));
+  for (size_t i = 0; i < a.inflection_point_list->size(); ++i) {
+    EXPECT_THAT(memcmp((*a.inflection_point_list)[i],
+                       (*b.inflection_point_list)[i],
+                       sizeof(InflectionPoint)), Eq(0));
+  }
+}
+
+TEST(Jt808CodecTest, GeneralResponseLayoutTest) {
+  const uint8_t expected[] = {0x12, 0x34, 0x02, 0x00, 0x01};
+  GeneralResponse response = {0x1234, 0x0200, 0x01};
+  GeneralResponse decoded;
+  uint8_t buffer[8];
+
+  EXPECT_THAT(GeneralResponseCodec::Size(response), Eq(sizeof(expected)));
+  EXPECT_THAT(GeneralResponseCodec::Encode(response, buffer),
+              Eq(buffer + sizeof(expected)));
+  EXPECT_THAT(std::vector<uint8_t>(buffer, buffer + sizeof(expected)),
+              ElementsAreArray(expected));
+  EXPECT_THAT(GeneralResponseCodec::Decode(buffer, buffer + 5, &decoded),
+              Eq(buffer + 5));
+  EXPECT_THAT(decoded.flow_num, Eq(0x1234));
+  EXPECT_THAT(decoded.id, Eq(0x0200));
+  EXPECT_THAT(decoded.result, Eq(0x01));
+  EXPECT_THAT(GeneralResponseCodec::Decode(buffer, buffer + 4, &decoded),
+              IsNull());
+}
+
+TEST(Jt808CodecTest, CircularAreaLayoutTest) {
+  const uint8_t expected[] = {
+    0x00, 0x00, 0x00, 0x07,  // id
+    0x00, 0x02,  // attribute, speed limit only
+    0x01, 0x5A, 0x2D, 0x8C,  // latitude
+    0x06, 0xCA, 0x8B, 0x1D,  // longitude
+    0x00, 0x00, 0x01, 0xF4,  // radius
+    0x00, 0x50, 0x0A,  // max speed, overspeed duration
+  };
+  CircularArea area = {};
+  uint8_t buffer[64];
+
+  area.area_id = 7;
+  area.area_attribute.bit.speedlimit = 1;
+  area.center_point.latitude = 0x015A2D8C;
+  area.center_point.longitude = 0x06CA8B1D;
+  area.radius = 500;
+  area.max_speed = 80;
+  area.overspeed_duration = 10;
+  EXPECT_THAT(CircularAreaCodec::Size(area), Eq(sizeof(expected)));
+  CircularAreaCodec::Encode(area, buffer);
+  EXPECT_THAT(std::vector<uint8_t>(buffer, buffer + sizeof(expected)),
+              ElementsAreArray(expected));
+}
+
+TEST(Jt808CodecTest, AreaRoundTripFuzzTest) {
+  std::mt19937 rng(808);
+  uint8_t buffer[128];
+
+  for (int round = 0; round < kFuzzRounds; ++round) {
+    CircularArea circular = {};
+    CircularArea circular_decoded = {};
+    RectangleArea rectangle = {};
+    RectangleArea rectangle_decoded = {};
+    uint8_t *end;
+
+    circular.area_id = rng();
+    circular.center_point.latitude = rng();
+    circular.center_point.longitude = rng();
+    circular.radius = rng();
+    RandomAreaTimeAndSpeed(&rng, &circular.area_attribute,
+                           circular.start_time, circular.end_time,
+                           &circular.max_speed, &circular.overspeed_duration);
+    end = CircularAreaCodec::Encode(circular, buffer);
+    ASSERT_THAT(static_cast<size_t>(end - buffer),
+                Eq(CircularAreaCodec::Size(circular)));
+    ASSERT_THAT(CircularAreaCodec::Decode(buffer, end, &circular_decoded),
+                Eq(end));
+    EXPECT_THAT(memcmp(&circular, &circular_decoded, sizeof(circular)), Eq(0));
+
+    rectangle.area_id = rng();
+    rectangle.upper_left_corner.latitude = rng();
+    rectangle.upper_left_corner.longitude = rng();
+    rectangle.bottom_right_corner.latitude = rng();
+    rectangle.bottom_right_corner.longitude = rng();
+    RandomAreaTimeAndSpeed(&rng, &rectangle.area_attribute,
+                           rectangle.start_time, rectangle.end_time,
+                           &rectangle.max_speed,
+                           &rectangle.overspeed_duration);
+    end = RectangleAreaCodec::Encode(rectangle, buffer);
+    ASSERT_THAT(static_cast<size_t>(end - buffer),
+                Eq(RectangleAreaCodec::Size(rectangle)));
+    ASSERT_THAT(RectangleAreaCodec::Decode(buffer, end, &rectangle_decoded),
+                Eq(end));
+    EXPECT_THAT(memcmp(&rectangle, &rectangle_decoded, sizeof(rectangle)),
+                Eq(0));
+  }
+}
+
+TEST(Jt808CodecTest, PolygonalAreaRoundTripFuzzTest) {
+  std::mt19937 rng(8604);
+  uint8_t buffer[512];
+
+  for (int round = 0; round < kFuzzRounds; ++round) {
+    PolygonalArea area = {};
+    PolygonalArea decoded = {};
+    uint8_t *end;
+
+    area.area_id = rng();
+    RandomAreaTimeAndSpeed(&rng, &area.area_attribute, area.start_time,
+                           area.end_time, &area.max_speed,
+                           &area.overspeed_duration);
+    area.coordinate_count = rng() % 16;
+    area.coordinate_list = new std::vector<Coordinate *>;
+    for (int i = 0; i < area.coordinate_count; ++i) {
+      Coordinate *coordinate = new Coordinate;
+      coordinate->latitude = rng();
+      coordinate->longitude = rng();
+      area.coordinate_list->push_back(coordinate);
+    }
+    end = PolygonalAreaCodec::Encode(area, buffer);
+    ASSERT_THAT(static_cast<size_t>(end - buffer),
+                Eq(PolygonalAreaCodec::Size(area)));
+    ASSERT_THAT(PolygonalAreaCodec::Decode(buffer, end, &decoded), Eq(end));
+    EXPECT_THAT(decoded.area_id, Eq(area.area_id));
+    EXPECT_THAT(decoded.area_attribute.value, Eq(area.area_attribute.value));
+    EXPECT_THAT(decoded.max_speed, Eq(area.max_speed));
+    EXPECT_THAT(decoded.coordinate_count, Eq(area.coordinate_count));
+    ASSERT_THAT(decoded.coordinate_list, NotNull());
+    ASSERT_THAT(decoded.coordinate_list->size(),
+                Eq(area.coordinate_list->size()));
+    for (size_t i = 0; i < area.coordinate_list->size(); ++i) {
+      EXPECT_THAT((*decoded.coordinate_list)[i]->latitude,
+                  Eq((*area.coordinate_list)[i]->latitude));
+      EXPECT_THAT((*decoded.coordinate_list)[i]->longitude,
+                  Eq((*area.coordinate_list)[i]->longitude));
+    }
+    ClearContainerElement(area.coordinate_list);
+    delete area.coordinate_list;
+    ClearContainerElement(decoded.coordinate_list);
+    delete decoded.coordinate_list;
+  }
+}
+
+TEST(Jt808CodecTest, RouteRoundTripFuzzTest) {
+  std::mt19937 rng(8606);
+  uint8_t buffer[512];
+
+  for (int round = 0; round < kFuzzRounds; ++round) {
+    Route *route = RandomRoute(&rng);
+    Route decoded = {};
+    uint8_t *end;
+
+    end = RouteCodec::Encode(*route, buffer);
+    ASSERT_THAT(static_cast<size_t>(end - buffer),
+                Eq(RouteCodec::Size(*route)));
+    ASSERT_THAT(RouteCodec::Decode(buffer, end, &decoded), Eq(end));
+    ExpectSameRoute(*route, decoded);
+    ClearContainerElement(decoded.inflection_point_list);
+    delete decoded.inflection_point_list;
+
+    // Every truncated body is rejected.
+    for (uint8_t *cut = buffer; cut < end; ++cut) {
+      Route truncated = {};
+      EXPECT_THAT(RouteCodec::Decode(buffer, cut, &truncated), IsNull());
+      if (truncated.inflection_point_list != nullptr) {
+        ClearContainerElement(truncated.inflection_point_list);
+        delete truncated.inflection_point_list;
+      }
+    }
+    DeleteRoute(route);
+  }
+}
+
+TEST(Jt808CodecTest, RandomBytesFuzzTest) {
+  std::mt19937 rng(8600);
+  uint8_t input[256];
+  uint8_t output[1024];
+
+  // Whatever decodes must encode back to the very bytes it consumed.
+  for (int round = 0; round < kFuzzRounds; ++round) {
+    size_t len = rng() % sizeof(input);
+    Route route = {};
+    const uint8_t *end;
+
+    for (size_t i = 0; i < len; ++i) {
+      input[i] = rng() & 0xFF;
+    }
+    // Keep the counts small so that some bodies are complete.
+    if (len > 8) {
+      input[6] = 0;
+      input[7] = rng() % 3;
+    }
+    end = RouteCodec::Decode(input, input + len, &route);
+    if (end != nullptr) {
+      size_t consumed = static_cast<size_t>(end - input);
+      ASSERT_THAT(RouteCodec::Size(route), Eq(consumed));
+      RouteCodec::Encode(route, output);
+      EXPECT_THAT(memcmp(input, output, consumed), Eq(0));
+    }
+    if (route.inflection_point_list != nullptr) {
+      ClearContainerElement(route.inflection_point_list);
+      delete route.inflection_point_list;
+    }
+  }
+}
@@ -0,0 +1,246 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "common/jt808_logger.h"
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>  // NOLINT
+
+
+const size_t Logger::kMaxRecordLen;
+const size_t Logger::kRingSize;
+const size_t Logger::kRateLimitSlots;
+
+static const char kLevelLetters[] = "TDIWE";
+
+// "hh:mm:ss.uuuuuu L function[line]: ", return its length.
+static int FormatPrefix(char *buffer, const size_t &size,
+                        const LogLevel &level, const char *function,
+                        const int &line) {
+  struct timespec ts;
+  struct tm tm;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  localtime_r(&ts.tv_sec, &tm);
+  return snprintf(buffer, size, "%02d:%02d:%02d.%06ld %c %s[%d]: ",
+                  tm.tm_hour, tm.tm_min, tm.tm_sec, ts.tv_nsec / 1000,
+                  kLevelLetters[level], function, line);
+}
+
+// Clamp a snprintf result to what |size| bytes hold, keeping room for the
+// trailing newline.
+static size_t Clamp(const int &len, const size_t &size) {
+  if (len < 0) {
+    return 0;
+  }
+  return static_cast<size_t>(len) < size - 1 ? static_cast<size_t>(len) :
+                                               size - 2;
+}
+
+Logger::Logger() {
+  slots_ = new Slot[kRingSize];
+  for (size_t i = 0; i < kRingSize; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  rate_slots_ = new std::atomic<uint64_t>[kRateLimitSlots];
+  for (size_t i = 0; i < kRateLimitSlots; ++i) {
+    rate_slots_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+Logger::~Logger() {
+  Stop();
+  delete [] slots_;
+  delete [] rate_slots_;
+}
+
+Logger *Logger::Instance(void) {
+  static Logger logger;
+  return &logger;
+}
+
+void Logger::Start(FILE *output) {
+  if (running_) {
+    return;
+  }
+  output_ = output;
+  running_ = true;
+  writer_ = std::thread(&Logger::WriterLoop, this);
+}
+
+void Logger::Stop(void) {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  writer_.join();
+  Drain();
+  fflush(output_);
+}
+
+void Logger::Flush(void) {
+  size_t target = enqueue_pos_.load(std::memory_order_acquire);
+
+  while (running_ &&
+         (dequeue_pos_.load(std::memory_order_acquire) < target)) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  fflush(output_);
+}
+
+bool Logger::Allow(const uint64_t &key) {
+  uint64_t now = static_cast<uint64_t>(time(nullptr));
+  uint64_t hash = key * 0x9E3779B97F4A7C15ULL;
+  std::atomic<uint64_t> &slot = rate_slots_[(hash >> 32) % kRateLimitSlots];
+  uint64_t value = slot.load(std::memory_order_relaxed);
+  uint64_t next;
+
+  do {
+    if ((value >> 32) != (now & 0xFFFFFFFF)) {
+      next = (now << 32) | 1;
+    } else if ((value & 0xFFFFFFFF) < rate_limit_) {
+      next = value + 1;
+    } else {
+      ++suppressed_;
+      return false;
+    }
+  } while (!slot.compare_exchange_weak(value, next,
+                                       std::memory_order_relaxed));
+  return true;
+}
+
+Logger::Slot *Logger::Claim(size_t *pos) {
+  size_t current = enqueue_pos_.load(std::memory_order_relaxed);
+  Slot *slot;
+  intptr_t diff;
+
+  while (true) {
+    slot = &slots_[current & (kRingSize - 1)];
+    diff = static_cast<intptr_t>(
+               slot->sequence.load(std::memory_order_acquire)) -
+           static_cast<intptr_t>(current);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(current, current + 1,
+                                             std::memory_order_relaxed)) {
+        *pos = current;
+        return slot;
+      }
+    } else if (diff < 0) {
+      return nullptr;
+    } else {
+      current = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Logger::Publish(Slot *slot, const size_t &pos) {
+  slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::Log(const LogLevel &level, const char *function,
+                 const int &line, const char *format, ...) {
+  char local[kMaxRecordLen];
+  char *text = local;
+  Slot *slot = nullptr;
+  size_t pos = 0;
+  size_t len;
+  va_list args;
+
+  if (running_) {
+    slot = Claim(&pos);
+    if (slot == nullptr) {
+      ++dropped_;
+      return;
+    }
+    text = slot->text;
+  }
+
+  len = Clamp(FormatPrefix(text, kMaxRecordLen, level, function, line),
+              kMaxRecordLen);
+  va_start(args, format);
+  len += Clamp(vsnprintf(text + len, kMaxRecordLen - len, format, args),
+               kMaxRecordLen - len);
+  va_end(args);
+  text[len++] = '\n';
+
+  if (slot != nullptr) {
+    slot->len = static_cast<uint16_t>(len);
+    Publish(slot, pos);
+  } else {
+    fwrite(text, 1, len, output_);
+  }
+}
+
+void Logger::LogFrame(const char *function, const int &line,
+                      const char *what, const uint8_t *data,
+                      const size_t &len) {
+  static const char kHex[] = "0123456789ABCDEF";
+  char dump[kMaxRecordLen];
+  // Three characters a byte, the record header takes the rest.
+  size_t count = len < (kMaxRecordLen - 128) / 3 ?
+                     len : (kMaxRecordLen - 128) / 3;
+
+  for (size_t i = 0; i < count; ++i) {
+    dump[i * 3] = kHex[data[i] >> 4];
+    dump[i * 3 + 1] = kHex[data[i] & 0x0F];
+    dump[i * 3 + 2] = ' ';
+  }
+  dump[count * 3] = '\0';
+  Log(kLogTrace, function, line, "%s[%lu]: %s%s", what, len, dump,
+      count < len ? "..." : "");
+}
+
+size_t Logger::Drain(void) {
+  char batch[16 * kMaxRecordLen];
+  size_t batch_len = 0;
+  size_t count = 0;
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  Slot *slot;
+
+  while (true) {
+    slot = &slots_[pos & (kRingSize - 1)];
+    if (slot->sequence.load(std::memory_order_acquire) != pos + 1) {
+      break;
+    }
+    if (batch_len + slot->len > sizeof(batch)) {
+      fwrite(batch, 1, batch_len, output_);
+      batch_len = 0;
+    }
+    memcpy(batch + batch_len, slot->text, slot->len);
+    batch_len += slot->len;
+    slot->sequence.store(pos + kRingSize, std::memory_order_release);
+    ++pos;
+    ++count;
+  }
+  if (batch_len > 0) {
+    fwrite(batch, 1, batch_len, output_);
+  }
+  if (count > 0) {
+    fflush(output_);
+    // Flush waits for this, so only after the records are written.
+    dequeue_pos_.store(pos, std::memory_order_release);
+  }
+  return count;
+}
+
+void Logger::WriterLoop(void) {
+  while (running_) {
+    if (Drain() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
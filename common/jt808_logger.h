@@ -0,0 +1,153 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_COMMON_JT808_LOGGER_H_
+#define JT808_COMMON_JT808_LOGGER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>  // NOLINT
+
+
+enum LogLevel {
+  kLogTrace = 0x0,  // 收发帧内容
+  kLogDebug,  // 心跳等高频消息
+  kLogInfo,
+  kLogWarning,
+  kLogError,
+};
+
+// Leveled logger. Records are formatted by the calling thread straight
+// into a slot of a lock-free ring buffer and written out in batches by a
+// background thread, the hot path never blocks: when the ring is full the
+// record is dropped and counted. Before Start, or after Stop, records are
+// written synchronously.
+class Logger {
+ public:
+  // Longest record, longer ones are truncated.
+  static const size_t kMaxRecordLen = 512;
+  // Slots of the ring buffer, a power of two.
+  static const size_t kRingSize = 1024;
+  // Slots of the per-key rate limiting table.
+  static const size_t kRateLimitSlots = 1024;
+
+  Logger();
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+  virtual ~Logger();
+
+  static Logger *Instance(void);
+
+  // Start the writer thread on |output|.
+  void Start(FILE *output = stdout);
+  // Write everything queued and stop the writer thread.
+  void Stop(void);
+  // Wait until everything queued so far is written.
+  void Flush(void);
+
+  void set_level(const LogLevel &level) { level_ = level; }
+  LogLevel level(void) const { return level_; }
+  bool Enabled(const LogLevel &level) const {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+  // Records a second allowed per key by Allow, default 1.
+  void set_rate_limit(const uint32_t &per_second) {
+    rate_limit_ = per_second;
+  }
+  // Return false once |key| has used up the records of this second, keys
+  // sharing a slot share the limit.
+  bool Allow(const uint64_t &key);
+
+  void Log(const LogLevel &level, const char *function, const int &line,
+           const char *format, ...) __attribute__((format(printf, 5, 6)));
+  // Hex dump of |len| bytes of |data|.
+  void LogFrame(const char *function, const int &line, const char *what,
+                const uint8_t *data, const size_t &len);
+
+  // Records dropped on a full ring.
+  uint64_t dropped(void) const { return dropped_; }
+  // Records refused by Allow.
+  uint64_t suppressed(void) const { return suppressed_; }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    uint16_t len;
+    char text[kMaxRecordLen];
+  };
+
+  // Claim a slot for writing, nullptr when the ring is full.
+  Slot *Claim(size_t *pos);
+  void Publish(Slot *slot, const size_t &pos);
+  // Write the records published so far, return how many.
+  size_t Drain(void);
+  void WriterLoop(void);
+
+  Slot *slots_ = nullptr;
+  std::atomic<size_t> enqueue_pos_{0};
+  // Only moved by the writer.
+  std::atomic<size_t> dequeue_pos_{0};
+  std::atomic<bool> running_{false};
+  std::thread writer_;
+  FILE *output_ = stdout;
+  std::atomic<LogLevel> level_{kLogInfo};
+  std::atomic<uint32_t> rate_limit_{1};
+  // Second in the high half, records in that second in the low half.
+  std::atomic<uint64_t> *rate_slots_ = nullptr;
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> suppressed_{0};
+};
+
+#define JT808_LOG(level, ...)                                         \
+  do {                                                                \
+    if (Logger::Instance()->Enabled(level)) {                         \
+      Logger::Instance()->Log(level, __FUNCTION__, __LINE__,          \
+                              __VA_ARGS__);                           \
+    }                                                                 \
+  } while (0)
+
+#define JT808_DEBUG(...) JT808_LOG(kLogDebug, __VA_ARGS__)
+#define JT808_INFO(...) JT808_LOG(kLogInfo, __VA_ARGS__)
+#define JT808_WARNING(...) JT808_LOG(kLogWarning, __VA_ARGS__)
+#define JT808_ERROR(...) JT808_LOG(kLogError, __VA_ARGS__)
+
+// Per device records, e.g. position reports, at most the rate limit a
+// second for every |key|.
+#define JT808_DEVICE_LOG(level, key, ...)                             \
+  do {                                                                \
+    if (Logger::Instance()->Enabled(level) &&                         \
+        Logger::Instance()->Allow(key)) {                             \
+      Logger::Instance()->Log(level, __FUNCTION__, __LINE__,          \
+                              __VA_ARGS__);                           \
+    }                                                                 \
+  } while (0)
+
+// Trace records and frame dumps are only compiled in with JT808_TRACE_LOG.
+#ifdef JT808_TRACE_LOG
+#define JT808_TRACE(...) JT808_LOG(kLogTrace, __VA_ARGS__)
+#define JT808_TRACE_FRAME(what, data, len)                            \
+  do {                                                                \
+    if (Logger::Instance()->Enabled(kLogTrace)) {                     \
+      Logger::Instance()->LogFrame(__FUNCTION__, __LINE__, what,      \
+                                   data, len);                        \
+    }                                                                 \
+  } while (0)
+#else
+#define JT808_TRACE(...) do {} while (0)
+#define JT808_TRACE_FRAME(what, data, len) do {} while (0)
+#endif
+
+#endif  // JT808_COMMON_JT808_LOGGER_H_
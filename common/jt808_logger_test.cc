@@ -0,0 +1,161 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_logger.h"
+
+
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+// Everything written to |output| so far.
+static std::string ReadAll(FILE *output) {
+  std::string text;
+  char buffer[1024];
+  size_t len;
+
+  fflush(output);
+  rewind(output);
+  while ((len = fread(buffer, 1, sizeof(buffer), output)) > 0) {
+    text.append(buffer, len);
+  }
+  return text;
+}
+
+static size_t CountLines(const std::string &text) {
+  size_t count = 0;
+  for (char c : text) {
+    if (c == '\n') {
+      ++count;
+    }
+  }
+  return count;
+}
+
+TEST(LoggerTest, SynchronousTest) {
+  FILE *output = tmpfile();
+  Logger logger;
+
+  // After Stop records are written straight away.
+  logger.Start(output);
+  logger.Stop();
+  logger.Log(kLogInfo, "Function", 7, "value %d", 42);
+  EXPECT_THAT(ReadAll(output), HasSubstr(" I Function[7]: value 42\n"));
+  fclose(output);
+}
+
+TEST(LoggerTest, AsynchronousTest) {
+  FILE *output = tmpfile();
+  Logger logger;
+  std::string text;
+
+  logger.Start(output);
+  logger.Log(kLogWarning, "Function", 8, "first");
+  logger.Log(kLogError, "Function", 9, "second");
+  logger.Flush();
+  text = ReadAll(output);
+  EXPECT_THAT(text, HasSubstr(" W Function[8]: first\n"));
+  EXPECT_THAT(text, HasSubstr(" E Function[9]: second\n"));
+  EXPECT_THAT(text.find("first") < text.find("second"), IsTrue());
+  logger.Stop();
+  fclose(output);
+}
+
+TEST(LoggerTest, ConcurrentProducersTest) {
+  const int kThreads = 4;
+  const int kRecords = 5000;
+  FILE *output = tmpfile();
+  Logger logger;
+  std::vector<std::thread> producers;
+
+  logger.Start(output);
+  for (int i = 0; i < kThreads; ++i) {
+    producers.emplace_back([&logger, i] {
+      for (int j = 0; j < kRecords; ++j) {
+        logger.Log(kLogInfo, "Producer", i, "record %d", j);
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  logger.Stop();
+  // Every record is either written whole or counted as dropped.
+  EXPECT_THAT(CountLines(ReadAll(output)) + logger.dropped(),
+              Eq(static_cast<size_t>(kThreads * kRecords)));
+  fclose(output);
+}
+
+TEST(LoggerTest, LevelTest) {
+  Logger logger;
+
+  EXPECT_THAT(logger.Enabled(kLogDebug), IsFalse());
+  EXPECT_THAT(logger.Enabled(kLogInfo), IsTrue());
+  logger.set_level(kLogError);
+  EXPECT_THAT(logger.Enabled(kLogWarning), IsFalse());
+  EXPECT_THAT(logger.Enabled(kLogError), IsTrue());
+}
+
+TEST(LoggerTest, RateLimitTest) {
+  Logger logger;
+
+  logger.set_rate_limit(2);
+  EXPECT_THAT(logger.Allow(1), IsTrue());
+  EXPECT_THAT(logger.Allow(1), IsTrue());
+  EXPECT_THAT(logger.Allow(2), IsTrue());
+  // Unless the second rolls over in between.
+  if (!logger.Allow(1)) {
+    EXPECT_THAT(logger.suppressed(), Eq(1u));
+  }
+}
+
+TEST(LoggerTest, TruncateTest) {
+  FILE *output = tmpfile();
+  std::string payload(2 * Logger::kMaxRecordLen, 'x');
+  std::string text;
+  Logger logger;
+
+  logger.Start(output);
+  logger.Log(kLogInfo, "Function", 1, "%s", payload.c_str());
+  logger.Stop();
+  text = ReadAll(output);
+  EXPECT_THAT(text.size(), Eq(Logger::kMaxRecordLen - 1));
+  EXPECT_THAT(text.back(), Eq('\n'));
+  fclose(output);
+}
+
+TEST(LoggerTest, FrameDumpTest) {
+  const uint8_t frame[] = {0x7E, 0x00, 0x02, 0x7E};
+  FILE *output = tmpfile();
+  Logger logger;
+
+  logger.Start(output);
+  logger.LogFrame("Function", 2, "socket-send", frame, sizeof(frame));
+  logger.Stop();
+  EXPECT_THAT(ReadAll(output),
+              HasSubstr("T Function[2]: socket-send[4]: 7E 00 02 7E \n"));
+  fclose(output);
+}
@@ -0,0 +1,186 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_COMMON_JT808_MESSAGE_SCHEMA_H_
+#define JT808_COMMON_JT808_MESSAGE_SCHEMA_H_
+
+#include <stdint.h>
+
+#include "common/jt808_area_route.h"
+#include "common/jt808_codec.h"
+
+
+// Message body schemas shared by the service and the terminal.
+
+#pragma pack(push, 1)
+
+// 平台/终端通用应答 0x8001/0x0001
+struct GeneralResponse {
+  uint16_t flow_num;  // 应答流水号
+  uint16_t id;  // 应答 ID
+  uint8_t result;  // 结果
+};
+
+// 临时位置跟踪控制 0x8202
+struct PositionTrackRequest {
+  uint16_t report_interval;  // 时间间隔, s
+  uint32_t report_valid_time;  // 跟踪有效期, s
+};
+
+// 设置区域/路线 0x8600/0x8602/0x8604/0x8606 的消息头, 后跟 count 个项
+struct AreaRouteSetHead {
+  uint8_t operation;  // 设置属性
+  uint8_t count;  // 区域/路线总数
+};
+
+#pragma pack(pop)
+
+typedef Schema<
+    WordField<GeneralResponse, &GeneralResponse::flow_num>,
+    WordField<GeneralResponse, &GeneralResponse::id>,
+    ByteField<GeneralResponse, &GeneralResponse::result>
+> GeneralResponseCodec;
+
+typedef Schema<
+    WordField<PositionTrackRequest, &PositionTrackRequest::report_interval>,
+    DwordField<PositionTrackRequest, &PositionTrackRequest::report_valid_time>
+> PositionTrackRequestCodec;
+
+typedef Schema<
+    ByteField<AreaRouteSetHead, &AreaRouteSetHead::operation>,
+    ByteField<AreaRouteSetHead, &AreaRouteSetHead::count>
+> AreaRouteSetHeadCodec;
+
+typedef Schema<
+    DwordField<Coordinate, &Coordinate::latitude>,
+    DwordField<Coordinate, &Coordinate::longitude>
+> CoordinateCodec;
+
+typedef Schema<
+    WordField<AreaAttribute, &AreaAttribute::value>
+> AreaAttributeCodec;
+
+typedef Schema<
+    WordField<RouteAttribute, &RouteAttribute::value>
+> RouteAttributeCodec;
+
+typedef Schema<
+    ByteField<RoadSectionAttribute, &RoadSectionAttribute::value>
+> RoadSectionAttributeCodec;
+
+// Presence of the optional parts of an area, route or road section.
+template <typename S>
+struct AreaByTime {
+  static bool Test(const S &s) { return s.area_attribute.bit.bytime; }
+};
+
+template <typename S>
+struct AreaSpeedLimit {
+  static bool Test(const S &s) { return s.area_attribute.bit.speedlimit; }
+};
+
+struct RouteByTime {
+  static bool Test(const Route &s) { return s.route_attribute.bit.bytime; }
+};
+
+struct RoadSectionTravelTime {
+  static bool Test(const InflectionPoint &s) {
+    return s.road_section_attribute.bit.traveltime;
+  }
+};
+
+struct RoadSectionSpeedLimit {
+  static bool Test(const InflectionPoint &s) {
+    return s.road_section_attribute.bit.speedlimit;
+  }
+};
+
+// Optional start/end time and speed limit shared by all area types.
+template <typename S>
+struct AreaTimeAndSpeedCodec : Schema<
+    OptionalFields<AreaByTime<S>,
+        BytesField<S, 6, &S::start_time>,
+        BytesField<S, 6, &S::end_time>>,
+    OptionalFields<AreaSpeedLimit<S>,
+        WordField<S, &S::max_speed>,
+        ByteField<S, &S::overspeed_duration>>
+> {};
+
+// 圆形区域项
+typedef Schema<
+    DwordField<CircularArea, &CircularArea::area_id>,
+    NestedField<CircularArea, AreaAttribute, &CircularArea::area_attribute,
+                AreaAttributeCodec>,
+    NestedField<CircularArea, Coordinate, &CircularArea::center_point,
+                CoordinateCodec>,
+    DwordField<CircularArea, &CircularArea::radius>,
+    AreaTimeAndSpeedCodec<CircularArea>
+> CircularAreaCodec;
+
+// 矩形区域项
+typedef Schema<
+    DwordField<RectangleArea, &RectangleArea::area_id>,
+    NestedField<RectangleArea, AreaAttribute, &RectangleArea::area_attribute,
+                AreaAttributeCodec>,
+    NestedField<RectangleArea, Coordinate, &RectangleArea::upper_left_corner,
+                CoordinateCodec>,
+    NestedField<RectangleArea, Coordinate,
+                &RectangleArea::bottom_right_corner, CoordinateCodec>,
+    AreaTimeAndSpeedCodec<RectangleArea>
+> RectangleAreaCodec;
+
+// 多边形区域项
+typedef Schema<
+    DwordField<PolygonalArea, &PolygonalArea::area_id>,
+    NestedField<PolygonalArea, AreaAttribute, &PolygonalArea::area_attribute,
+                AreaAttributeCodec>,
+    AreaTimeAndSpeedCodec<PolygonalArea>,
+    RepeatedField<PolygonalArea, uint16_t, Coordinate,
+                  &PolygonalArea::coordinate_list, CoordinateCodec,
+                  &PolygonalArea::coordinate_count>
+> PolygonalAreaCodec;
+
+// 路线拐点项
+typedef Schema<
+    DwordField<InflectionPoint, &InflectionPoint::inflection_point_id>,
+    DwordField<InflectionPoint, &InflectionPoint::road_section_id>,
+    NestedField<InflectionPoint, Coordinate, &InflectionPoint::coordinate,
+                CoordinateCodec>,
+    ByteField<InflectionPoint, &InflectionPoint::road_section_wide>,
+    NestedField<InflectionPoint, RoadSectionAttribute,
+                &InflectionPoint::road_section_attribute,
+                RoadSectionAttributeCodec>,
+    OptionalFields<RoadSectionTravelTime,
+        WordField<InflectionPoint, &InflectionPoint::max_driving_time>,
+        WordField<InflectionPoint, &InflectionPoint::min_driving_time>>,
+    OptionalFields<RoadSectionSpeedLimit,
+        WordField<InflectionPoint, &InflectionPoint::max_speed>,
+        ByteField<InflectionPoint, &InflectionPoint::overspeed_duration>>
+> InflectionPointCodec;
+
+// 路线项
+typedef Schema<
+    DwordField<Route, &Route::route_id>,
+    NestedField<Route, RouteAttribute, &Route::route_attribute,
+                RouteAttributeCodec>,
+    OptionalFields<RouteByTime,
+        BytesField<Route, 6, &Route::start_time>,
+        BytesField<Route, 6, &Route::end_time>>,
+    RepeatedField<Route, uint16_t, InflectionPoint,
+                  &Route::inflection_point_list, InflectionPointCodec,
+                  &Route::inflection_point_count>
+> RouteCodec;
+
+#endif  // JT808_COMMON_JT808_MESSAGE_SCHEMA_H_
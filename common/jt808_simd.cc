@@ -0,0 +1,370 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "common/jt808_simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JT808_X86_KERNELS 1
+#endif
+
+#include "common/jt808_protocol.h"
+
+
+static inline bool IsEscapeByte(const uint8_t &value) {
+  return (value == PROTOCOL_SIGN) || (value == PROTOCOL_ESCAPE);
+}
+
+static uint8_t ScalarXorBytes(const uint8_t *src, const size_t &len) {
+  uint8_t checksum = 0;
+  for (size_t i = 0; i < len; ++i) {
+    checksum ^= src[i];
+  }
+  return checksum;
+}
+
+static size_t ScalarCountEscape(const uint8_t *src, const size_t &len) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; ++i) {
+    count += IsEscapeByte(src[i]);
+  }
+  return count;
+}
+
+static size_t ScalarFindEscape(const uint8_t *src, const size_t &len) {
+  size_t i = 0;
+  while ((i < len) && !IsEscapeByte(src[i])) {
+    ++i;
+  }
+  return i;
+}
+
+static size_t ScalarFindLastEscape(const uint8_t *src, const size_t &len) {
+  for (size_t i = len; i > 0; --i) {
+    if (IsEscapeByte(src[i - 1])) {
+      return i - 1;
+    }
+  }
+  return len;
+}
+
+static size_t ScalarCopyUnescaped(const uint8_t *src, const size_t &len,
+                                  uint8_t *dst, uint8_t *checksum) {
+  uint8_t value = 0;
+  size_t i;
+
+  for (i = 0; (i < len) && (src[i] != PROTOCOL_ESCAPE); ++i) {
+    dst[i] = src[i];
+    value ^= src[i];
+  }
+  *checksum ^= value;
+  return i;
+}
+
+static const CodecKernels kScalarKernels = {
+  "scalar",
+  ScalarXorBytes,
+  ScalarCountEscape,
+  ScalarFindEscape,
+  ScalarFindLastEscape,
+  ScalarCopyUnescaped,
+};
+
+const CodecKernels &ScalarCodecKernels(void) {
+  return kScalarKernels;
+}
+
+#ifdef JT808_X86_KERNELS
+
+// SSE2, 16 bytes per step.
+
+__attribute__((target("sse2")))
+static inline __m128i Sse2Load(const uint8_t *src) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+}
+
+// 0xFF in every lane holding 0x7E or 0x7D.
+__attribute__((target("sse2")))
+static inline __m128i Sse2EscapeLanes(const __m128i &block) {
+  return _mm_or_si128(
+      _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(PROTOCOL_SIGN))),
+      _mm_cmpeq_epi8(block,
+                     _mm_set1_epi8(static_cast<char>(PROTOCOL_ESCAPE))));
+}
+
+__attribute__((target("sse2")))
+static inline uint8_t Sse2FoldXor(const __m128i &acc) {
+  uint8_t lanes[16];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+  return ScalarXorBytes(lanes, sizeof(lanes));
+}
+
+__attribute__((target("sse2")))
+static uint8_t Sse2XorBytes(const uint8_t *src, const size_t &len) {
+  __m128i acc = _mm_setzero_si128();
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    acc = _mm_xor_si128(acc, Sse2Load(src + i));
+  }
+  return Sse2FoldXor(acc) ^ ScalarXorBytes(src + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t Sse2CountEscape(const uint8_t *src, const size_t &len) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i counts = zero;
+  uint64_t sums[2];
+  size_t count = 0;
+  size_t i = 0;
+  int steps = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    // Matching lanes are -1, subtracting counts them per lane.
+    counts = _mm_sub_epi8(counts, Sse2EscapeLanes(Sse2Load(src + i)));
+    if ((++steps == 255) || (i + 32 > len)) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(sums),
+                       _mm_sad_epu8(counts, zero));
+      count += sums[0] + sums[1];
+      counts = zero;
+      steps = 0;
+    }
+  }
+  return count + ScalarCountEscape(src + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t Sse2FindEscape(const uint8_t *src, const size_t &len) {
+  size_t i = 0;
+  int mask;
+
+  for (; i + 16 <= len; i += 16) {
+    mask = _mm_movemask_epi8(Sse2EscapeLanes(Sse2Load(src + i)));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + ScalarFindEscape(src + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t Sse2FindLastEscape(const uint8_t *src, const size_t &len) {
+  size_t i = len;
+  size_t pos;
+  int mask;
+
+  for (; i >= 16; i -= 16) {
+    mask = _mm_movemask_epi8(Sse2EscapeLanes(Sse2Load(src + i - 16)));
+    if (mask != 0) {
+      return i - 16 + (31 - __builtin_clz(mask));
+    }
+  }
+  pos = ScalarFindLastEscape(src, i);
+  return pos < i ? pos : len;
+}
+
+__attribute__((target("sse2")))
+static size_t Sse2CopyUnescaped(const uint8_t *src, const size_t &len,
+                                uint8_t *dst, uint8_t *checksum) {
+  const __m128i escape = _mm_set1_epi8(static_cast<char>(PROTOCOL_ESCAPE));
+  __m128i acc = _mm_setzero_si128();
+  __m128i block;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    block = Sse2Load(src + i);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, escape)) != 0) {
+      break;
+    }
+    acc = _mm_xor_si128(acc, block);
+    // The block is already loaded, a store below |src| can't clobber
+    // anything not yet read.
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), block);
+  }
+  *checksum ^= Sse2FoldXor(acc);
+  return i + ScalarCopyUnescaped(src + i, len - i, dst + i, checksum);
+}
+
+static const CodecKernels kSse2Kernels = {
+  "sse2",
+  Sse2XorBytes,
+  Sse2CountEscape,
+  Sse2FindEscape,
+  Sse2FindLastEscape,
+  Sse2CopyUnescaped,
+};
+
+// AVX2, 32 bytes per step.
+
+__attribute__((target("avx2")))
+static inline __m256i Avx2Load(const uint8_t *src) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Avx2EscapeLanes(const __m256i &block) {
+  return _mm256_or_si256(
+      _mm256_cmpeq_epi8(block,
+                        _mm256_set1_epi8(static_cast<char>(PROTOCOL_SIGN))),
+      _mm256_cmpeq_epi8(block,
+                        _mm256_set1_epi8(static_cast<char>(PROTOCOL_ESCAPE))));
+}
+
+__attribute__((target("avx2")))
+static inline uint8_t Avx2FoldXor(const __m256i &acc) {
+  uint8_t lanes[32];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+  return ScalarXorBytes(lanes, sizeof(lanes));
+}
+
+__attribute__((target("avx2")))
+static uint8_t Avx2XorBytes(const uint8_t *src, const size_t &len) {
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64) {
+    acc0 = _mm256_xor_si256(acc0, Avx2Load(src + i));
+    acc1 = _mm256_xor_si256(acc1, Avx2Load(src + i + 32));
+  }
+  for (; i + 32 <= len; i += 32) {
+    acc0 = _mm256_xor_si256(acc0, Avx2Load(src + i));
+  }
+  return Avx2FoldXor(_mm256_xor_si256(acc0, acc1)) ^
+         ScalarXorBytes(src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t Avx2CountEscape(const uint8_t *src, const size_t &len) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i counts = zero;
+  uint64_t sums[4];
+  size_t count = 0;
+  size_t i = 0;
+  int steps = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    counts = _mm256_sub_epi8(counts, Avx2EscapeLanes(Avx2Load(src + i)));
+    if ((++steps == 255) || (i + 64 > len)) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums),
+                          _mm256_sad_epu8(counts, zero));
+      count += sums[0] + sums[1] + sums[2] + sums[3];
+      counts = zero;
+      steps = 0;
+    }
+  }
+  return count + ScalarCountEscape(src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t Avx2FindEscape(const uint8_t *src, const size_t &len) {
+  size_t i = 0;
+  uint32_t mask;
+
+  for (; i + 32 <= len; i += 32) {
+    mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(Avx2EscapeLanes(Avx2Load(src + i))));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  return i + ScalarFindEscape(src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t Avx2FindLastEscape(const uint8_t *src, const size_t &len) {
+  size_t i = len;
+  size_t pos;
+  uint32_t mask;
+
+  for (; i >= 32; i -= 32) {
+    mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(Avx2EscapeLanes(Avx2Load(src + i - 32))));
+    if (mask != 0) {
+      return i - 32 + (31 - __builtin_clz(mask));
+    }
+  }
+  pos = ScalarFindLastEscape(src, i);
+  return pos < i ? pos : len;
+}
+
+__attribute__((target("avx2")))
+static size_t Avx2CopyUnescaped(const uint8_t *src, const size_t &len,
+                                uint8_t *dst, uint8_t *checksum) {
+  const __m256i escape =
+      _mm256_set1_epi8(static_cast<char>(PROTOCOL_ESCAPE));
+  __m256i acc = _mm256_setzero_si256();
+  __m256i block;
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    block = Avx2Load(src + i);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, escape)) != 0) {
+      break;
+    }
+    acc = _mm256_xor_si256(acc, block);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), block);
+  }
+  *checksum ^= Avx2FoldXor(acc);
+  return i + ScalarCopyUnescaped(src + i, len - i, dst + i, checksum);
+}
+
+static const CodecKernels kAvx2Kernels = {
+  "avx2",
+  Avx2XorBytes,
+  Avx2CountEscape,
+  Avx2FindEscape,
+  Avx2FindLastEscape,
+  Avx2CopyUnescaped,
+};
+
+#endif  // JT808_X86_KERNELS
+
+const CodecKernels *Sse2CodecKernels(void) {
+#ifdef JT808_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    return &kSse2Kernels;
+  }
+#endif
+  return nullptr;
+}
+
+const CodecKernels *Avx2CodecKernels(void) {
+#ifdef JT808_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &kAvx2Kernels;
+  }
+#endif
+  return nullptr;
+}
+
+static const CodecKernels *SelectCodecKernels(void) {
+  const CodecKernels *kernels = Avx2CodecKernels();
+
+  if (kernels == nullptr) {
+    kernels = Sse2CodecKernels();
+  }
+  if (kernels == nullptr) {
+    kernels = &kScalarKernels;
+  }
+  return kernels;
+}
+
+const CodecKernels &CodecKernelsForCpu(void) {
+  static const CodecKernels *kernels = SelectCodecKernels();
+  return *kernels;
+}
@@ -0,0 +1,48 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_COMMON_JT808_SIMD_H_
+#define JT808_COMMON_JT808_SIMD_H_
+
+#include <stdint.h>
+#include <string.h>
+
+
+// Byte kernels behind BccCheckSum() and the escape codec, one table per
+// instruction set. Every table gives the same results as the scalar one.
+struct CodecKernels {
+  const char *name;
+  // XOR of all bytes.
+  uint8_t (*xor_bytes)(const uint8_t *src, const size_t &len);
+  // Number of 0x7E and 0x7D bytes.
+  size_t (*count_escape)(const uint8_t *src, const size_t &len);
+  // Index of the first 0x7E or 0x7D, |len| if there is none.
+  size_t (*find_escape)(const uint8_t *src, const size_t &len);
+  // Index of the last 0x7E or 0x7D, |len| if there is none.
+  size_t (*find_last_escape)(const uint8_t *src, const size_t &len);
+  // Copy the bytes before the first 0x7D to |dst|, which may overlap |src|
+  // from below, XOR them into |*checksum| and return how many were copied.
+  size_t (*copy_unescaped)(const uint8_t *src, const size_t &len,
+                           uint8_t *dst, uint8_t *checksum);
+};
+
+const CodecKernels &ScalarCodecKernels(void);
+// nullptr if the build target or the running CPU lacks the instructions.
+const CodecKernels *Sse2CodecKernels(void);
+const CodecKernels *Avx2CodecKernels(void);
+// The fastest table for the running CPU, chosen once.
+const CodecKernels &CodecKernelsForCpu(void);
+
+#endif  // JT808_COMMON_JT808_SIMD_H_
@@ -0,0 +1,110 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_simd.h"
+
+
+using ::testing::Eq;
+
+// Every vector table available on this machine, checked against scalar.
+static std::vector<const CodecKernels *> VectorKernels(void) {
+  std::vector<const CodecKernels *> kernels;
+  if (Sse2CodecKernels() != nullptr) kernels.push_back(Sse2CodecKernels());
+  if (Avx2CodecKernels() != nullptr) kernels.push_back(Avx2CodecKernels());
+  return kernels;
+}
+
+// Mostly clean bytes with the occasional 0x7E/0x7D, one in |every|.
+static void FillRandom(uint8_t *buffer, const size_t &len, const int &every) {
+  for (size_t i = 0; i < len; ++i) {
+    buffer[i] = static_cast<uint8_t>(rand());
+    if ((buffer[i] == 0x7E) || (buffer[i] == 0x7D) || (rand() % every == 0)) {
+      buffer[i] = (rand() % 2) ? 0x7E : 0x7D;
+    }
+  }
+}
+
+TEST(Jt808SimdTest, SelectedKernelsTest) {
+  const CodecKernels &kernels = CodecKernelsForCpu();
+  EXPECT_THAT(kernels.xor_bytes, testing::NotNull());
+  EXPECT_THAT(&CodecKernelsForCpu(), Eq(&kernels));
+}
+
+TEST(Jt808SimdTest, MatchesScalarTest) {
+  const CodecKernels &scalar = ScalarCodecKernels();
+  uint8_t buffer[600];
+  uint8_t expected_dst[sizeof(buffer)];
+  uint8_t dst[sizeof(buffer)];
+  uint8_t expected_checksum;
+  uint8_t checksum;
+  size_t offset;
+  size_t len;
+
+  srand(808);
+  for (const CodecKernels *kernels : VectorKernels()) {
+    SCOPED_TRACE(kernels->name);
+    for (int i = 0; i < 2000; ++i) {
+      FillRandom(buffer, sizeof(buffer), 1 + i % 300);
+      // Random alignment and lengths across the vector widths.
+      offset = static_cast<size_t>(rand()) % 64;
+      len = static_cast<size_t>(rand()) % (sizeof(buffer) - offset);
+      const uint8_t *src = buffer + offset;
+
+      ASSERT_THAT(kernels->xor_bytes(src, len),
+                  Eq(scalar.xor_bytes(src, len)));
+      ASSERT_THAT(kernels->count_escape(src, len),
+                  Eq(scalar.count_escape(src, len)));
+      ASSERT_THAT(kernels->find_escape(src, len),
+                  Eq(scalar.find_escape(src, len)));
+      ASSERT_THAT(kernels->find_last_escape(src, len),
+                  Eq(scalar.find_last_escape(src, len)));
+
+      expected_checksum = checksum = static_cast<uint8_t>(i);
+      size_t expected = scalar.copy_unescaped(src, len, expected_dst,
+                                              &expected_checksum);
+      ASSERT_THAT(kernels->copy_unescaped(src, len, dst, &checksum),
+                  Eq(expected));
+      ASSERT_THAT(checksum, Eq(expected_checksum));
+      ASSERT_THAT(memcmp(dst, expected_dst, expected), Eq(0));
+    }
+  }
+}
+
+TEST(Jt808SimdTest, CopyUnescapedOverlapTest) {
+  uint8_t buffer[256];
+  uint8_t expected[sizeof(buffer)];
+  uint8_t checksum;
+
+  for (const CodecKernels *kernels : VectorKernels()) {
+    SCOPED_TRACE(kernels->name);
+    for (size_t i = 0; i < sizeof(buffer); ++i) {
+      buffer[i] = static_cast<uint8_t>(i % 0x7D);
+    }
+    memcpy(expected, buffer + 5, sizeof(buffer) - 5);
+    // Shift down by a few bytes, as reverse escaping does in place.
+    checksum = 0;
+    ASSERT_THAT(kernels->copy_unescaped(buffer + 5, sizeof(buffer) - 5,
+                                        buffer, &checksum),
+                Eq(sizeof(buffer) - 5));
+    EXPECT_THAT(memcmp(buffer, expected, sizeof(buffer) - 5), Eq(0));
+  }
+}
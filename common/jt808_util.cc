@@ -24,8 +24,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "bcd/bcd.h"
 #include "common/jt808_protocol.h"
+#include "common/jt808_simd.h"
 
 
 uint16_t EndianSwap16(const uint16_t &value) {
@@ -42,62 +45,135 @@ uint32_t EndianSwap32(const uint32_t &value) {
 }
 
 uint8_t BccCheckSum(const uint8_t *src, const size_t &len) {
-  uint8_t checksum = 0;
-  for (size_t i = 0; i < len; ++i) {
-    checksum = checksum ^ src[i];
+  return CodecKernelsForCpu().xor_bytes(src, len);
+}
+
+// Escaped bytes tend to cluster, this many bytes are handled one by one
+// before handing a clean run to the vector kernels.
+static const size_t kProbeLen = 16;
+
+static inline bool NeedEscape(const uint8_t &value) {
+  return (value == PROTOCOL_SIGN) || (value == PROTOCOL_ESCAPE);
+}
+
+static inline uint8_t EscapeCode(const uint8_t &value) {
+  return (value == PROTOCOL_SIGN) ? PROTOCOL_ESCAPE_SIGN :
+                                    PROTOCOL_ESCAPE_ESCAPE;
+}
+
+size_t Escape(const uint8_t *src, const size_t &len, uint8_t *dst) {
+  const CodecKernels &kernels = CodecKernelsForCpu();
+  const uint8_t *end = src + len;
+  const uint8_t *pos = src;
+  const uint8_t *near;
+  uint8_t *out = dst;
+  size_t run;
+
+  while (pos < end) {
+    near = pos + std::min<size_t>(end - pos, kProbeLen);
+    while ((pos < near) && !NeedEscape(*pos)) {
+      *out++ = *pos++;
+    }
+    if (pos == near) {
+      run = kernels.find_escape(pos, end - pos);
+      memcpy(out, pos, run);
+      out += run;
+      pos += run;
+      if (pos == end) {
+        break;
+      }
+    }
+    *out++ = PROTOCOL_ESCAPE;
+    *out++ = EscapeCode(*pos++);
   }
-  return checksum;
+
+  return out - dst;
 }
 
 size_t Escape(uint8_t *src, const size_t &len) {
-  size_t i;
-  size_t j;
-  uint8_t *buffer = new uint8_t[len * 2];
-
-  memset(buffer, 0x0, len * 2);
-  for (i = 0, j = 0; i < len; ++i) {
-    if (src[i] == PROTOCOL_SIGN) {
-      buffer[j++] = PROTOCOL_ESCAPE;
-      buffer[j++] = PROTOCOL_ESCAPE_SIGN;
-    } else if (src[i] == PROTOCOL_ESCAPE) {
-      buffer[j++] = PROTOCOL_ESCAPE;
-      buffer[j++] = PROTOCOL_ESCAPE_ESCAPE;
-    } else {
-      buffer[j++] = src[i];
+  const CodecKernels &kernels = CodecKernelsForCpu();
+  size_t count = kernels.count_escape(src, len);
+  uint8_t *pos = src + len;
+  uint8_t *out = pos + count;
+  uint8_t *near;
+  size_t found;
+  size_t run;
+
+  // Nothing to escape is the common case, leave the data where it is.
+  if (count == 0) {
+    return len;
+  }
+
+  // Expand from the back so no byte is overwritten before it is moved,
+  // once |out| meets |pos| the rest is already in place.
+  while (out > pos) {
+    near = pos - std::min<size_t>(pos - src, kProbeLen);
+    while ((pos > near) && !NeedEscape(pos[-1])) {
+      *--out = *--pos;
     }
+    if (pos == near) {
+      found = kernels.find_last_escape(src, pos - src);
+      run = (pos - src) - found - 1;
+      out -= run;
+      memmove(out, &src[found + 1], run);
+      pos = &src[found + 1];
+    }
+    --pos;
+    *--out = EscapeCode(*pos);
+    *--out = PROTOCOL_ESCAPE;
   }
 
-  memcpy(src, buffer, j);
-  delete [] buffer;
-  return j;
+  return len + count;
 }
 
-size_t ReverseEscape(uint8_t *src, const size_t &len) {
-  size_t i;
-  size_t j;
-  uint8_t *buffer = new uint8_t[len];
-
-  memset(buffer, 0x0, len);
-  for (i = 0, j = 0; i < len; ++i) {
-    if ((src[i] == PROTOCOL_ESCAPE) && (src[i+1] == PROTOCOL_ESCAPE_SIGN)) {
-      buffer[j++] = PROTOCOL_SIGN;
-      ++i;
-    } else if ((src[i] == PROTOCOL_ESCAPE) &&
-               (src[i+1] == PROTOCOL_ESCAPE_ESCAPE)) {
-      buffer[j++] = PROTOCOL_ESCAPE;
-      ++i;
+size_t ReverseEscape(uint8_t *src, const size_t &len, uint8_t *checksum) {
+  const CodecKernels &kernels = CodecKernelsForCpu();
+  uint8_t *end = src + len;
+  uint8_t *pos = src;
+  uint8_t *out = src;
+  uint8_t *near;
+  uint8_t value = 0;
+  size_t run;
+
+  while (pos < end) {
+    near = pos + std::min<size_t>(end - pos, kProbeLen);
+    while ((pos < near) && (*pos != PROTOCOL_ESCAPE)) {
+      value ^= *pos;
+      *out++ = *pos++;
+    }
+    if (pos == near) {
+      run = kernels.copy_unescaped(pos, end - pos, out, &value);
+      out += run;
+      pos += run;
+      if (pos == end) {
+        break;
+      }
+    }
+    if ((pos + 1 < end) && (pos[1] == PROTOCOL_ESCAPE_SIGN)) {
+      *out = PROTOCOL_SIGN;
+      pos += 2;
+    } else if ((pos + 1 < end) && (pos[1] == PROTOCOL_ESCAPE_ESCAPE)) {
+      *out = PROTOCOL_ESCAPE;
+      pos += 2;
     } else {
-      buffer[j++] = src[i];
+      // Malformed escape, keep the byte as it is.
+      *out = *pos++;
     }
+    value ^= *out++;
   }
 
-  memcpy(src, buffer, j);
-  delete [] buffer;
-  return j;
+  *checksum = value;
+  return out - src;
+}
+
+size_t ReverseEscape(uint8_t *src, const size_t &len) {
+  uint8_t checksum;
+  return ReverseEscape(src, len, &checksum);
 }
 
 void PreparePhoneNum(const char *src, uint8_t *bcd_array) {
-  char phone_num[6] = {0};
+  // One more for the terminating zero written by the conversion.
+  char phone_num[7] = {0};
   BcdFromStringCompress(src, phone_num, strlen(src));
   memcpy(bcd_array, phone_num, 6);
 }
@@ -23,8 +23,16 @@
 uint16_t EndianSwap16(const uint16_t &value);
 uint32_t EndianSwap32(const uint32_t &value);
 uint8_t BccCheckSum(const uint8_t *src, const size_t &len);
+// Escape |len| bytes of |src| into |dst|, which must hold 2 * |len| bytes.
+// Return the escaped length.
+size_t Escape(const uint8_t *src, const size_t &len, uint8_t *dst);
+// Escape in place, |src| must have room for the escaped data.
 size_t Escape(uint8_t *src, const size_t &len);
+// Reverse escape in place, return the new (never larger) length.
 size_t ReverseEscape(uint8_t *src, const size_t &len);
+// Same in a single pass that also XORs the unescaped bytes into
+// |checksum|, which is zero when a trailing check code is correct.
+size_t ReverseEscape(uint8_t *src, const size_t &len, uint8_t *checksum);
 void PreparePhoneNum(const char *src, uint8_t *bcd_array);
 
 #endif  // JT808_COMMON_JT808_UTIL_H_
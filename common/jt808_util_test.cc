@@ -0,0 +1,106 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_util.h"
+
+
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+
+static const uint8_t kRaw[] = {0x30, 0x7E, 0x08, 0x7D, 0x55, 0x7E, 0x7D};
+static const uint8_t kEscaped[] = {0x30, 0x7D, 0x02, 0x08, 0x7D, 0x01, 0x55,
+                                   0x7D, 0x02, 0x7D, 0x01};
+
+TEST(Jt808UtilTest, EscapeToBufferTest) {
+  uint8_t dst[2 * sizeof(kRaw)];
+
+  EXPECT_THAT(Escape(kRaw, sizeof(kRaw), dst), Eq(sizeof(kEscaped)));
+  EXPECT_THAT(std::vector<uint8_t>(dst, dst + sizeof(kEscaped)),
+              ElementsAreArray(kEscaped));
+}
+
+TEST(Jt808UtilTest, EscapeInPlaceTest) {
+  uint8_t buffer[2 * sizeof(kRaw)];
+
+  memcpy(buffer, kRaw, sizeof(kRaw));
+  EXPECT_THAT(Escape(buffer, sizeof(kRaw)), Eq(sizeof(kEscaped)));
+  EXPECT_THAT(std::vector<uint8_t>(buffer, buffer + sizeof(kEscaped)),
+              ElementsAreArray(kEscaped));
+}
+
+TEST(Jt808UtilTest, ReverseEscapeTest) {
+  uint8_t buffer[sizeof(kEscaped)];
+
+  memcpy(buffer, kEscaped, sizeof(kEscaped));
+  EXPECT_THAT(ReverseEscape(buffer, sizeof(kEscaped)), Eq(sizeof(kRaw)));
+  EXPECT_THAT(std::vector<uint8_t>(buffer, buffer + sizeof(kRaw)),
+              ElementsAreArray(kRaw));
+}
+
+TEST(Jt808UtilTest, ReverseEscapeChecksumTest) {
+  // Body "30 7E 08" with its check code 0x46 escaped behind it.
+  uint8_t frame[] = {0x30, 0x7D, 0x02, 0x08, 0x46};
+  uint8_t checksum = 0xFF;
+
+  EXPECT_THAT(ReverseEscape(frame, sizeof(frame), &checksum), Eq(4u));
+  EXPECT_THAT(checksum, Eq(0));
+  EXPECT_THAT(BccCheckSum(frame, 3), Eq(0x46));
+  frame[0] = 0x31;
+  ReverseEscape(frame, 4, &checksum);
+  EXPECT_THAT(checksum, Eq(1));
+}
+
+TEST(Jt808UtilTest, MalformedEscapeTest) {
+  // A lone 0x7D, or one followed by anything but 0x01/0x02, is kept.
+  uint8_t buffer[] = {0x7D, 0x03, 0x7D, 0x02, 0x7D};
+  const uint8_t expected[] = {0x7D, 0x03, 0x7E, 0x7D};
+
+  EXPECT_THAT(ReverseEscape(buffer, sizeof(buffer)), Eq(sizeof(expected)));
+  EXPECT_THAT(std::vector<uint8_t>(buffer, buffer + sizeof(expected)),
+              ElementsAreArray(expected));
+}
+
+TEST(Jt808UtilTest, RandomRoundTripTest) {
+  uint8_t raw[256];
+  uint8_t buffer[2 * sizeof(raw)];
+  uint8_t escaped[2 * sizeof(raw)];
+  size_t escaped_len;
+  size_t len;
+  uint8_t checksum;
+
+  srand(808);
+  for (int i = 0; i < 1000; ++i) {
+    len = static_cast<size_t>(rand()) % sizeof(raw);
+    for (size_t j = 0; j < len; ++j) {
+      // Bias towards the bytes that need escaping.
+      raw[j] = (rand() % 4 == 0) ? (0x7D + rand() % 2) : rand();
+    }
+    escaped_len = Escape(raw, len, escaped);
+    memcpy(buffer, raw, len);
+    ASSERT_THAT(Escape(buffer, len), Eq(escaped_len));
+    ASSERT_THAT(memcmp(buffer, escaped, escaped_len), Eq(0));
+    EXPECT_THAT(memchr(buffer, 0x7E, escaped_len), Eq(nullptr));
+    ASSERT_THAT(ReverseEscape(buffer, escaped_len, &checksum), Eq(len));
+    ASSERT_THAT(memcmp(buffer, raw, len), Eq(0));
+    ASSERT_THAT(checksum, Eq(BccCheckSum(raw, len)));
+  }
+}
@@ -40,6 +40,7 @@ static inline void PrintUsage(void) {
          "\tdelpolygonalarea [areaid ...]\n"
          "\tdelroute [routeid ...]\n"
          "\tupgrade device/gps versionid filepath\n"
+         "\tgettrack starttime endtime\n"
          "Additional instructions:\n"
          "\tlatitude/longitude -- value in degrees, "
               "accurate to 6 decimal places.\n"
@@ -50,6 +51,8 @@ static inline void PrintUsage(void) {
               "6: trun off data communication; "
               "7: turn off all wireless communication. not support 1 and 2.\n"
          "\tstarttime/endtime -- yymmddhhmmss\n"
+         "\tgettrack -- archived positions, those of the last minute "
+              "may not be archived yet.\n"
          "\tcoordinateitem -- latitude longitude\n"
          "\tcircularareaitem -- id(hex) attribute(hex) coordinateitem radius "
               "[starttime] [endtime] [maxspeed] [overspeedtime]\n"
@@ -69,6 +72,7 @@ static inline void PrintUsage(void) {
 int main(int argc, char **argv) {
   std::string command;
   char recv_buf[65536] = {0};
+  ssize_t len;
 
   if (argc < 3) {
     PrintUsage();
@@ -85,8 +89,11 @@ int main(int argc, char **argv) {
   int fd = ClientConnect("/tmp/jt808cmd.sock");
   if (fd > 0) {
     send(fd, command.c_str(), command.length(), 0);
-    if (recv(fd, recv_buf, sizeof(recv_buf), 0) > 0)
-      printf("%s\n", recv_buf);
+    // Long answers such as a track come in chunks until the service
+    // closes the connection.
+    while ((len = recv(fd, recv_buf, sizeof(recv_buf), 0)) > 0)
+      fwrite(recv_buf, 1, static_cast<size_t>(len), stdout);
+    printf("\n");
 
     close(fd);
   }
@@ -12,10 +12,26 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/jt808_logger.h"
 #include "service/jt808_service.h"
 
-int main(void) {
+// Usage: jt808service [worker_count] [et]
+int main(int argc, char **argv) {
   Jt808Service my_service;
+  if (argc > 1) {
+    my_service.set_worker_count(atoi(argv[1]));
+  }
+  if ((argc > 2) && (strcmp(argv[2], "et") == 0)) {
+    my_service.set_edge_triggered(true);
+  }
+  // Records are written by a background thread from now on.
+  Logger::Instance()->Start();
+  my_service.set_track_directory("/var/lib/jt808/track");
+  my_service.set_archive_directory("/var/lib/jt808/archive");
+  my_service.set_upgrade_progress_directory("/var/lib/jt808/upgrade");
   my_service.Init(8193, 10);
   my_service.Run(2000);
 
@@ -0,0 +1,83 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_CONNECTION_H_
+#define JT808_SERVICE_JT808_CONNECTION_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <list>
+
+#include "service/jt808_frame_buffer.h"
+#include "service/jt808_util.h"
+#include "service/jt808_write_queue.h"
+
+
+enum ConnectionType {
+  kTerminalListenConnection = 0x0,  // 终端监听套接字
+  kCommandListenConnection,  // 控制命令监听套接字
+  kCommandConnection,  // 控制命令客户端
+  kTerminalConnection,  // 终端连接
+  kWakeupConnection,  // 事件循环唤醒
+};
+
+// 终端注册鉴权状态
+enum HandshakeState {
+  kHandshakeRegister = 0x0,  // 等待注册或鉴权
+  kHandshakeAuthentication,  // 已注册, 等待鉴权
+  kHandshakeDone,  // 已鉴权
+};
+
+struct Reactor;
+
+// Per-socket context, attached to epoll_event.data.ptr so a readiness
+// event leads straight to its connection state.
+struct Connection {
+  Connection(const ConnectionType &type, const int &fd, Reactor *reactor)
+      : type(type), fd(fd), reactor(reactor) {
+    if (type == kTerminalConnection) {
+      recv_buffer = new FrameBuffer;
+      send_queue = new WriteQueue;
+    }
+  }
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+  ~Connection() {
+    delete recv_buffer;
+    delete send_queue;
+  }
+
+  ConnectionType type;
+  // -1 once closed, events still queued for it are then ignored.
+  int fd;
+  // The event loop serving this connection.
+  Reactor *reactor;
+  // Set when the terminal has been authenticated.
+  DeviceNode *device = nullptr;
+  FrameBuffer *recv_buffer = nullptr;
+  WriteQueue *send_queue = nullptr;
+  // EPOLLOUT is only asked for while |send_queue| has bytes left.
+  bool epollout_armed = false;
+
+  // Registration and authentication are driven by events on the
+  // connection, it is dropped if they do not finish before the deadline.
+  HandshakeState handshake_state = kHandshakeDone;
+  std::chrono::steady_clock::time_point handshake_deadline;
+  // Position in the handshake list of its reactor.
+  std::list<Connection *>::iterator handshake_it;
+  uint8_t manufacturer_id[5] = {0};
+};
+
+#endif  // JT808_SERVICE_JT808_CONNECTION_H_
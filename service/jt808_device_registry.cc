@@ -0,0 +1,117 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/jt808_device_registry.h"
+
+#include <sys/socket.h>
+
+#include <string.h>
+
+#include <utility>
+
+#include "common/jt808_util.h"
+#include "service/jt808_connection.h"
+#include "util/container_clear.h"
+
+
+DeviceRegistry::~DeviceRegistry() {
+  ClearContainerElement(&device_list_);
+}
+
+bool DeviceRegistry::Load(const char *path) {
+  if (!ReadDevicesList(path, &device_list_)) {
+    return false;
+  }
+
+  phone_index_.reserve(device_list_.size());
+  for (auto *device : device_list_) {
+    PreparePhoneNum(device->phone_num, device->phone_bcd);
+    phone_index_.insert(std::make_pair(PhoneKey(device->phone_bcd), device));
+  }
+
+  return true;
+}
+
+DeviceNode *DeviceRegistry::FindByPhone(const uint8_t *phone_bcd) const {
+  auto device_it = phone_index_.find(PhoneKey(phone_bcd));
+  return (device_it == phone_index_.end() ? nullptr : device_it->second);
+}
+
+DeviceNode *DeviceRegistry::FindByPhone(const char *phone_num) const {
+  uint8_t phone_bcd[6] = {0};
+  size_t len = strlen(phone_num);
+
+  if ((len == 0) || (len > 12)) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if ((phone_num[i] < '0') || (phone_num[i] > '9')) {
+      return nullptr;
+    }
+  }
+  PreparePhoneNum(phone_num, phone_bcd);
+  return FindByPhone(phone_bcd);
+}
+
+Reactor *DeviceRegistry::BindConnection(DeviceNode *device,
+                                        Connection *connection) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Reactor *previous = nullptr;
+
+  if (device->connection != nullptr) {
+    // The fd stays valid until its loop unbinds it under this lock.
+    shutdown(device->connection->fd, SHUT_RDWR);
+    previous = device->connection->reactor;
+  }
+  device->socket_fd = connection->fd;
+  device->connection = connection;
+  return previous;
+}
+
+bool DeviceRegistry::UnbindConnection(DeviceNode *device,
+                                      Connection *connection) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (device->connection != connection) {
+    return false;
+  }
+  device->socket_fd = -1;
+  device->connection = nullptr;
+  return true;
+}
+
+bool DeviceRegistry::IsBound(const DeviceNode *device) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return device->connection != nullptr;
+}
+
+Reactor *DeviceRegistry::ReactorOf(const DeviceNode *device) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return device->connection != nullptr ? device->connection->reactor : nullptr;
+}
+
+Connection *DeviceRegistry::ConnectionOf(const DeviceNode *device,
+                                         const Reactor *reactor) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if ((device->connection == nullptr) ||
+      (device->connection->reactor != reactor)) {
+    return nullptr;
+  }
+  return device->connection;
+}
+
+uint64_t DeviceRegistry::PhoneKey(const uint8_t *phone_bcd) {
+  uint64_t key = 0;
+  memcpy(&key, phone_bcd, 6);
+  return key;
+}
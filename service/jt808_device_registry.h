@@ -0,0 +1,78 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_DEVICE_REGISTRY_H_
+#define JT808_SERVICE_JT808_DEVICE_REGISTRY_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
+#include "service/jt808_util.h"
+
+
+struct Connection;
+struct Reactor;
+
+// Owns all known devices, indexed by BCD phone number so that lookups on
+// the packet path do not depend on the fleet size.
+// The phone index is built once by Load and read without locking, the
+// connection binding of devices may change from any event loop and is
+// guarded by a mutex.
+class DeviceRegistry {
+ public:
+  DeviceRegistry() = default;
+  DeviceRegistry(const DeviceRegistry&) = delete;
+  DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+  virtual ~DeviceRegistry();
+
+  // Read devices from |path| and build the phone number index.
+  bool Load(const char *path);
+
+  // Find device by 6 bytes BCD phone number, as in the message head.
+  DeviceNode *FindByPhone(const uint8_t *phone_bcd) const;
+  // Find device by phone number string, as typed on the command line.
+  DeviceNode *FindByPhone(const char *phone_num) const;
+
+  // Bind |device| to an authenticated |connection|. A connection it was
+  // bound to before is shut down, its own event loop then closes it.
+  // Return the event loop of that connection, nullptr if there was none.
+  Reactor *BindConnection(DeviceNode *device, Connection *connection);
+  // Unbind |device| if it is still bound to |connection|.
+  bool UnbindConnection(DeviceNode *device, Connection *connection);
+  // Whether |device| is bound to a connection.
+  bool IsBound(const DeviceNode *device) const;
+  // The event loop serving |device|, nullptr if it has not connect.
+  Reactor *ReactorOf(const DeviceNode *device) const;
+  // The connection of |device| if |reactor| serves it, else nullptr. Work
+  // for a device only writes to the connection this returns, so that its
+  // socket is only ever used by the thread of its own reactor.
+  Connection *ConnectionOf(const DeviceNode *device,
+                           const Reactor *reactor) const;
+
+  const std::list<DeviceNode *> &devices(void) const { return device_list_; }
+  bool empty(void) const { return device_list_.empty(); }
+
+  // Index key of a 6 bytes BCD phone number.
+  static uint64_t PhoneKey(const uint8_t *phone_bcd);
+
+ private:
+  std::list<DeviceNode *> device_list_;
+  std::unordered_map<uint64_t, DeviceNode *> phone_index_;
+  mutable std::mutex mutex_;
+};
+
+#endif  // JT808_SERVICE_JT808_DEVICE_REGISTRY_H_
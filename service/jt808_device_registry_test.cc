@@ -0,0 +1,115 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_device_registry.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fstream>
+
+#include "service/jt808_connection.h"
+#include "service/jt808_reactor.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsNull;
+using ::testing::IsTrue;
+
+static const char *kDevicesPath = "/tmp/jt808_device_registry_test.txt";
+
+class DeviceRegistryTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::ofstream ofs(kDevicesPath, std::ios::out | std::ios::trunc);
+    ofs << "13826539850;1234;" << std::endl;
+    ofs << "13826539851;5678;" << std::endl;
+    ofs.close();
+    ASSERT_THAT(registry_.Load(kDevicesPath), IsTrue());
+  }
+  void TearDown() override { unlink(kDevicesPath); }
+
+  DeviceRegistry registry_;
+};
+
+TEST_F(DeviceRegistryTest, LoadTest) {
+  DeviceRegistry registry;
+
+  EXPECT_THAT(registry_.devices().size(), Eq(2u));
+  EXPECT_THAT(registry_.empty(), IsFalse());
+  EXPECT_THAT(registry.Load("/tmp/jt808_device_registry_none.txt"),
+              IsFalse());
+  EXPECT_THAT(registry.empty(), IsTrue());
+}
+
+TEST_F(DeviceRegistryTest, FindByPhoneTest) {
+  // As in the message head, the phone number padded to 12 digits.
+  const uint8_t phone_bcd[6] = {0x01, 0x38, 0x26, 0x53, 0x98, 0x51};
+  const uint8_t unknown_bcd[6] = {0x01, 0x38, 0x26, 0x53, 0x98, 0x52};
+  DeviceNode *device = registry_.FindByPhone(phone_bcd);
+
+  ASSERT_THAT(device != nullptr, IsTrue());
+  EXPECT_THAT(strcmp(device->phone_num, "13826539851"), Eq(0));
+  EXPECT_THAT(registry_.FindByPhone("13826539851"), Eq(device));
+  EXPECT_THAT(registry_.FindByPhone(unknown_bcd), IsNull());
+  EXPECT_THAT(registry_.FindByPhone("13826539852"), IsNull());
+  EXPECT_THAT(registry_.FindByPhone("1382653985a"), IsNull());
+  EXPECT_THAT(registry_.FindByPhone(""), IsNull());
+}
+
+TEST_F(DeviceRegistryTest, BindConnectionTest) {
+  DeviceNode *device = registry_.FindByPhone("13826539850");
+  int fds[2][2];
+  char byte;
+
+  ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[0]), Eq(0));
+  ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[1]), Eq(0));
+  Reactor reactors[2];
+  Connection first(kTerminalConnection, fds[0][0], &reactors[0]);
+  Connection second(kTerminalConnection, fds[1][0], &reactors[1]);
+
+  EXPECT_THAT(registry_.IsBound(device), IsFalse());
+  EXPECT_THAT(registry_.BindConnection(device, &first), IsNull());
+  EXPECT_THAT(registry_.IsBound(device), IsTrue());
+  EXPECT_THAT(device->connection, Eq(&first));
+  EXPECT_THAT(device->socket_fd, Eq(fds[0][0]));
+  EXPECT_THAT(registry_.ReactorOf(device), Eq(&reactors[0]));
+
+  // A second connection replaces the first one, which is shut down. Its
+  // reactor is returned to hand the work for the device over.
+  EXPECT_THAT(registry_.BindConnection(device, &second), Eq(&reactors[0]));
+  EXPECT_THAT(device->connection, Eq(&second));
+  EXPECT_THAT(registry_.ConnectionOf(device, &reactors[0]), IsNull());
+  EXPECT_THAT(registry_.ConnectionOf(device, &reactors[1]), Eq(&second));
+  EXPECT_THAT(device->socket_fd, Eq(fds[1][0]));
+  EXPECT_THAT(read(fds[0][1], &byte, 1), Eq(0));
+
+  // Closing the replaced connection leaves the binding alone.
+  EXPECT_THAT(registry_.UnbindConnection(device, &first), IsFalse());
+  EXPECT_THAT(device->connection, Eq(&second));
+  EXPECT_THAT(registry_.UnbindConnection(device, &second), IsTrue());
+  EXPECT_THAT(device->connection, IsNull());
+  EXPECT_THAT(device->socket_fd, Eq(-1));
+  EXPECT_THAT(registry_.IsBound(device), IsFalse());
+
+  for (auto &pair : fds) {
+    close(pair[0]);
+    close(pair[1]);
+  }
+}
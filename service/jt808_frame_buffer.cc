@@ -0,0 +1,176 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/jt808_frame_buffer.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/jt808_logger.h"
+
+
+const size_t FrameBuffer::kDefaultCapacity;
+
+FrameBuffer::FrameBuffer(const size_t &capacity) {
+  capacity_ = MAX_PROFRAMEBUF_LEN;
+  while (capacity_ < capacity) {
+    capacity_ <<= 1;
+  }
+  mask_ = capacity_ - 1;
+  buffer_ = new uint8_t[capacity_];
+}
+
+FrameBuffer::~FrameBuffer() {
+  delete [] buffer_;
+}
+
+int FrameBuffer::RecvFrom(const int &fd) {
+  struct iovec iov[2];
+  size_t free_len = capacity_ - size();
+  size_t pos = tail_ & mask_;
+  int iov_count = 1;
+  ssize_t ret;
+
+  if (free_len == 0) {
+    return 0;
+  }
+
+  iov[0].iov_base = &buffer_[pos];
+  iov[0].iov_len = std::min(free_len, capacity_ - pos);
+  if (iov[0].iov_len < free_len) {
+    iov[1].iov_base = buffer_;
+    iov[1].iov_len = free_len - iov[0].iov_len;
+    iov_count = 2;
+  }
+
+  // Retried on a signal, in edge-triggered mode an early stop would leave
+  // the rest unread without another event.
+  do {
+    ret = readv(fd, iov, iov_count);
+  } while ((ret < 0) && (errno == EINTR));
+  if (ret < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      return 0;
+    }
+    JT808_ERROR("recv data failed!!!");
+    return -1;
+  } else if (ret == 0) {
+    JT808_INFO("connection disconect!!!");
+    return -1;
+  }
+
+  tail_ += static_cast<size_t>(ret);
+  return static_cast<int>(ret);
+}
+
+size_t FrameBuffer::Append(const uint8_t *data, const size_t &len) {
+  size_t count = std::min(len, capacity_ - size());
+  size_t pos = tail_ & mask_;
+  size_t first = std::min(count, capacity_ - pos);
+
+  memcpy(&buffer_[pos], data, first);
+  memcpy(buffer_, data + first, count - first);
+  tail_ += count;
+  return count;
+}
+
+bool FrameBuffer::PopFrame(Message *msg) {
+  size_t start;
+  size_t end;
+  size_t len;
+
+  while (head_ != tail_) {
+    // Resynchronize on a start flag.
+    start = FindSign(head_);
+    if (start == tail_) {
+      Clear();
+      return false;
+    }
+    head_ = start;
+    if (scan_ <= head_) {
+      scan_ = head_ + 1;
+    }
+
+    end = FindSign(scan_);
+    if (end == tail_) {
+      scan_ = tail_;
+      // No end flag within the longest legal frame, drop what we have.
+      if (size() >= MAX_PROFRAMEBUF_LEN) {
+        Clear();
+      }
+      return false;
+    }
+
+    len = end - head_ + 1;
+    if (len == 2) {
+      // "7E 7E", the second flag starts the next frame.
+      head_ = end;
+      continue;
+    }
+    if (len > MAX_PROFRAMEBUF_LEN) {
+      head_ = end;
+      continue;
+    }
+
+    CopyOut(head_, len, msg->buffer);
+    msg->size = len;
+    head_ = end + 1;
+    scan_ = head_;
+    return true;
+  }
+
+  return false;
+}
+
+void FrameBuffer::Clear(void) {
+  head_ = 0;
+  tail_ = 0;
+  scan_ = 0;
+}
+
+size_t FrameBuffer::FindSign(const size_t &from) const {
+  size_t pos = from;
+  size_t len;
+  const void *found;
+
+  while (pos < tail_) {
+    len = std::min(tail_ - pos, capacity_ - (pos & mask_));
+    found = memchr(&buffer_[pos & mask_], PROTOCOL_SIGN, len);
+    if (found != nullptr) {
+      return pos + static_cast<size_t>(
+                       static_cast<const uint8_t *>(found) -
+                       &buffer_[pos & mask_]);
+    }
+    pos += len;
+  }
+
+  return tail_;
+}
+
+void FrameBuffer::CopyOut(const size_t &from, const size_t &len,
+                          uint8_t *dst) const {
+  size_t pos = from & mask_;
+  size_t first = std::min(len, capacity_ - pos);
+
+  memcpy(dst, &buffer_[pos], first);
+  memcpy(dst + first, buffer_, len - first);
+}
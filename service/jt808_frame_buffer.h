@@ -0,0 +1,68 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_FRAME_BUFFER_H_
+#define JT808_SERVICE_JT808_FRAME_BUFFER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common/jt808_protocol.h"
+
+
+// Per-connection receive ring buffer, reassembles the TCP byte stream into
+// 0x7E delimited frames. One read may yield zero, one or many frames.
+class FrameBuffer {
+ public:
+  // Default capacity, enough for several maximum length frames.
+  static const size_t kDefaultCapacity = 4 * MAX_PROFRAMEBUF_LEN;
+
+  // |capacity| is rounded up to a power of two.
+  explicit FrameBuffer(const size_t &capacity = kDefaultCapacity);
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+  virtual ~FrameBuffer();
+
+  // Receive as much data as the free space allows with a single readv().
+  // Return bytes received, 0 if no data for now or no free space, -1 on
+  // error or peer closed. Interrupted reads are retried.
+  int RecvFrom(const int &fd);
+  // Append raw stream bytes, return the count actually stored.
+  size_t Append(const uint8_t *data, const size_t &len);
+  // Extract the next complete frame including both 0x7E flags into |msg|.
+  // Garbage before a start flag and oversize frames are discarded.
+  bool PopFrame(Message *msg);
+  void Clear(void);
+
+  size_t size(void) const { return tail_ - head_; }
+  size_t capacity(void) const { return capacity_; }
+  bool empty(void) const { return head_ == tail_; }
+
+ private:
+  // Return the absolute position of the first 0x7E in [from, tail_),
+  // or tail_ if there is none.
+  size_t FindSign(const size_t &from) const;
+  void CopyOut(const size_t &from, const size_t &len, uint8_t *dst) const;
+
+  uint8_t *buffer_ = nullptr;
+  size_t capacity_ = 0;
+  size_t mask_ = 0;
+  // Monotonic read/write positions, index into |buffer_| with |mask_|.
+  size_t head_ = 0;
+  size_t tail_ = 0;
+  // Everything before this position has been searched for an end flag.
+  size_t scan_ = 0;
+};
+
+#endif  // JT808_SERVICE_JT808_FRAME_BUFFER_H_
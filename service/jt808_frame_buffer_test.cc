@@ -0,0 +1,96 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_frame_buffer.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+static const uint8_t kFrame1[] = {0x7E, 0x00, 0x02, 0x00, 0x00, 0x7E};
+static const uint8_t kFrame2[] = {0x7E, 0x02, 0x00, 0x7D, 0x02, 0x11, 0x7E};
+
+TEST(FrameBufferTest, CoalescedFramesTest) {
+  FrameBuffer buffer;
+  Message msg;
+
+  buffer.Append(kFrame1, sizeof(kFrame1));
+  buffer.Append(kFrame2, sizeof(kFrame2));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsTrue());
+  EXPECT_THAT(msg.size, Eq(sizeof(kFrame1)));
+  EXPECT_THAT(memcmp(msg.buffer, kFrame1, sizeof(kFrame1)), Eq(0));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsTrue());
+  EXPECT_THAT(msg.size, Eq(sizeof(kFrame2)));
+  EXPECT_THAT(memcmp(msg.buffer, kFrame2, sizeof(kFrame2)), Eq(0));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsFalse());
+  EXPECT_THAT(buffer.empty(), IsTrue());
+}
+
+TEST(FrameBufferTest, SplitFrameTest) {
+  FrameBuffer buffer;
+  Message msg;
+
+  buffer.Append(kFrame2, 3);
+  EXPECT_THAT(buffer.PopFrame(&msg), IsFalse());
+  buffer.Append(kFrame2 + 3, sizeof(kFrame2) - 3);
+  EXPECT_THAT(buffer.PopFrame(&msg), IsTrue());
+  EXPECT_THAT(memcmp(msg.buffer, kFrame2, sizeof(kFrame2)), Eq(0));
+}
+
+TEST(FrameBufferTest, ResynchronizeTest) {
+  const uint8_t garbage[] = {0x01, 0x02, 0x7E};
+  FrameBuffer buffer;
+  Message msg;
+
+  // Leading garbage is dropped and "7E 7E" opens a new frame.
+  buffer.Append(garbage, sizeof(garbage));
+  buffer.Append(kFrame1, sizeof(kFrame1));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsTrue());
+  EXPECT_THAT(msg.size, Eq(sizeof(kFrame1)));
+  EXPECT_THAT(memcmp(msg.buffer, kFrame1, sizeof(kFrame1)), Eq(0));
+}
+
+TEST(FrameBufferTest, WrapAroundTest) {
+  FrameBuffer buffer(MAX_PROFRAMEBUF_LEN);
+  Message msg;
+  size_t count = 0;
+
+  // Push enough traffic through to wrap the ring several times.
+  for (int i = 0; i < 3000; ++i) {
+    EXPECT_THAT(buffer.Append(kFrame2, sizeof(kFrame2)),
+                Eq(sizeof(kFrame2)));
+    while (buffer.PopFrame(&msg)) {
+      EXPECT_THAT(memcmp(msg.buffer, kFrame2, sizeof(kFrame2)), Eq(0));
+      ++count;
+    }
+  }
+  EXPECT_THAT(count, Eq(3000u));
+}
+
+TEST(FrameBufferTest, OversizeFrameTest) {
+  uint8_t data[MAX_PROFRAMEBUF_LEN] = {0};
+  FrameBuffer buffer;
+  Message msg;
+
+  data[0] = PROTOCOL_SIGN;
+  buffer.Append(data, sizeof(data));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsFalse());
+  EXPECT_THAT(buffer.empty(), IsTrue());
+  buffer.Append(kFrame1, sizeof(kFrame1));
+  EXPECT_THAT(buffer.PopFrame(&msg), IsTrue());
+}
@@ -0,0 +1,82 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_frame_decoder.h"
+
+#include "common/jt808_util.h"
+
+
+FrameDecodeResult DecodeFrame(Message *msg, FrameView *view) {
+  const MessageHead *msghead_ptr;
+  uint8_t checksum;
+  uint16_t u16val;
+  size_t head_len;
+  size_t len;
+
+  // Head, body and check code between the two flags.
+  if (msg->size < 2 + MSGBODY_NOPACKAGE_POS) {
+    return kFrameTooShort;
+  }
+  len = ReverseEscape(&msg->buffer[1], msg->size - 2, &checksum);
+  msg->buffer[len + 1] = PROTOCOL_SIGN;
+  msg->size = len + 2;
+  if (len < MSGBODY_NOPACKAGE_POS) {
+    return kFrameTooShort;
+  }
+  if (checksum != 0) {
+    return kFrameBadChecksum;
+  }
+
+  msghead_ptr = reinterpret_cast<const MessageHead *>(&msg->buffer[1]);
+  memcpy(&u16val, &msghead_ptr->attribute.value, 2);
+  view->attribute.value = EndianSwap16(u16val);
+  head_len = view->attribute.bit.package ? MSGBODY_PACKAGE_POS - 1 :
+                                           MSGBODY_NOPACKAGE_POS - 1;
+  if (len != head_len + view->attribute.bit.msglen + 1) {
+    return kFrameBadLength;
+  }
+
+  memcpy(&u16val, &msghead_ptr->id, 2);
+  view->id = EndianSwap16(u16val);
+  view->phone = msghead_ptr->phone;
+  memcpy(&u16val, &msghead_ptr->msgflownum, 2);
+  view->flow_num = EndianSwap16(u16val);
+  view->total_package = 0;
+  view->packet_seq = 0;
+  if (view->attribute.bit.package) {
+    memcpy(&u16val, &msghead_ptr->totalpackage, 2);
+    view->total_package = EndianSwap16(u16val);
+    memcpy(&u16val, &msghead_ptr->packetseq, 2);
+    view->packet_seq = EndianSwap16(u16val);
+  }
+  view->body = &msg->buffer[1 + head_len];
+  view->body_len = view->attribute.bit.msglen;
+  return kFrameDecodeOk;
+}
+
+const char *FrameDecodeResultName(const FrameDecodeResult &result) {
+  switch (result) {
+    case kFrameDecodeOk:
+      return "ok";
+    case kFrameTooShort:
+      return "too short";
+    case kFrameBadLength:
+      return "bad length";
+    case kFrameBadChecksum:
+      return "bad checksum";
+    default:
+      return "unknown";
+  }
+}
@@ -0,0 +1,50 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_FRAME_DECODER_H_
+#define JT808_SERVICE_JT808_FRAME_DECODER_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common/jt808_protocol.h"
+
+
+enum FrameDecodeResult {
+  kFrameDecodeOk = 0,
+  kFrameTooShort,  // 放不下消息头和校验码
+  kFrameBadLength,  // 消息体长度与帧长度不符
+  kFrameBadChecksum,  // 校验码错误
+};
+
+// Head fields of a decoded frame in host byte order.
+struct FrameView {
+  uint16_t id;
+  MessageBodyAttr attribute;
+  const uint8_t *phone;  // 6 BCD bytes inside the frame.
+  uint16_t flow_num;
+  uint16_t total_package;  // Only set for packaged messages.
+  uint16_t packet_seq;
+  uint8_t *body;
+  size_t body_len;
+};
+
+// Reverse escape a whole "7E ... 7E" frame in place, verifying its body
+// length and check code in the same pass, and fill |view| on success.
+// The frame keeps both flags, |msg->size| becomes the unescaped size.
+FrameDecodeResult DecodeFrame(Message *msg, FrameView *view);
+const char *FrameDecodeResultName(const FrameDecodeResult &result);
+
+#endif  // JT808_SERVICE_JT808_FRAME_DECODER_H_
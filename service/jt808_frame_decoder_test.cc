@@ -0,0 +1,108 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_util.h"
+#include "service/jt808_frame_decoder.h"
+
+
+using ::testing::Eq;
+
+// Build an escaped frame the way terminals do.
+static void PackFrame(const uint16_t &id, const uint16_t &attribute,
+                      const uint8_t *body, const size_t &body_len,
+                      Message *msg) {
+  MessageHead *msghead_ptr = reinterpret_cast<MessageHead *>(&msg->buffer[1]);
+  size_t head_len = (attribute & 0x2000) ? MSGBODY_PACKAGE_POS - 1 :
+                                           MSGBODY_NOPACKAGE_POS - 1;
+
+  memset(msg->buffer, 0x0, sizeof(msg->buffer));
+  msghead_ptr->id = EndianSwap16(id);
+  msghead_ptr->attribute.value = EndianSwap16(attribute);
+  PreparePhoneNum("13826539850", msghead_ptr->phone);
+  msghead_ptr->msgflownum = EndianSwap16(0x7E01);
+  msghead_ptr->totalpackage = EndianSwap16(3);
+  msghead_ptr->packetseq = EndianSwap16(2);
+  memcpy(&msg->buffer[1 + head_len], body, body_len);
+  msg->size = head_len + body_len;
+  msg->buffer[1 + msg->size] = BccCheckSum(&msg->buffer[1], msg->size);
+  msg->size = Escape(&msg->buffer[1], msg->size + 1) + 1;
+  msg->buffer[0] = PROTOCOL_SIGN;
+  msg->buffer[msg->size++] = PROTOCOL_SIGN;
+}
+
+static const uint8_t kBody[] = {0x01, 0x7E, 0x02, 0x7D, 0x03};
+
+TEST(FrameDecoderTest, DecodeTest) {
+  Message msg;
+  FrameView view;
+
+  PackFrame(0x0200, sizeof(kBody), kBody, sizeof(kBody), &msg);
+  ASSERT_THAT(DecodeFrame(&msg, &view), Eq(kFrameDecodeOk));
+  EXPECT_THAT(view.id, Eq(0x0200));
+  EXPECT_THAT(view.flow_num, Eq(0x7E01));
+  EXPECT_THAT(view.phone, Eq(&msg.buffer[5]));
+  EXPECT_THAT(view.body, Eq(&msg.buffer[MSGBODY_NOPACKAGE_POS]));
+  EXPECT_THAT(view.body_len, Eq(sizeof(kBody)));
+  EXPECT_THAT(memcmp(view.body, kBody, sizeof(kBody)), Eq(0));
+  EXPECT_THAT(msg.size, Eq(MSGBODY_NOPACKAGE_POS + sizeof(kBody) + 2));
+  EXPECT_THAT(msg.buffer[msg.size - 1], Eq(PROTOCOL_SIGN));
+}
+
+TEST(FrameDecoderTest, PackageTest) {
+  Message msg;
+  FrameView view;
+
+  PackFrame(0x0104, 0x2000 | sizeof(kBody), kBody, sizeof(kBody), &msg);
+  ASSERT_THAT(DecodeFrame(&msg, &view), Eq(kFrameDecodeOk));
+  EXPECT_THAT(view.total_package, Eq(3));
+  EXPECT_THAT(view.packet_seq, Eq(2));
+  EXPECT_THAT(view.body, Eq(&msg.buffer[MSGBODY_PACKAGE_POS]));
+}
+
+TEST(FrameDecoderTest, BadChecksumTest) {
+  Message msg;
+  FrameView view;
+
+  PackFrame(0x0200, sizeof(kBody), kBody, sizeof(kBody), &msg);
+  msg.buffer[3] ^= 0x40;
+  EXPECT_THAT(DecodeFrame(&msg, &view), Eq(kFrameBadChecksum));
+}
+
+TEST(FrameDecoderTest, BadLengthTest) {
+  Message msg;
+  FrameView view;
+
+  PackFrame(0x0200, sizeof(kBody) + 1, kBody, sizeof(kBody), &msg);
+  EXPECT_THAT(DecodeFrame(&msg, &view), Eq(kFrameBadLength));
+}
+
+TEST(FrameDecoderTest, TooShortTest) {
+  Message msg = {{0x7E, 0x00, 0x02, 0x00, 0x00, 0x02, 0x7E}, 7};
+  FrameView view;
+
+  EXPECT_THAT(DecodeFrame(&msg, &view), Eq(kFrameTooShort));
+  // Long enough raw, too short once the "7D 01" pairs collapse.
+  msg.buffer[0] = PROTOCOL_SIGN;
+  for (int i = 0; i < 12; ++i) {
+    msg.buffer[1 + 2 * i] = PROTOCOL_ESCAPE;
+    msg.buffer[2 + 2 * i] = PROTOCOL_ESCAPE_ESCAPE;
+  }
+  msg.buffer[25] = PROTOCOL_SIGN;
+  msg.size = 26;
+  EXPECT_THAT(DecodeFrame(&msg, &view), Eq(kFrameTooShort));
+}
@@ -0,0 +1,104 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_message_dispatcher.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+
+
+const int MessageStatistics::kLatencyBuckets;
+
+void MessageStatistics::Add(const MessageStatistics &other) {
+  count += other.count;
+  total_ns += other.total_ns;
+  max_ns = std::max(max_ns, other.max_ns);
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    latency_buckets[i] += other.latency_buckets[i];
+  }
+}
+
+uint64_t MessageStatistics::Percentile(const double &percent) const {
+  uint64_t target = static_cast<uint64_t>(count * percent / 100.0);
+  uint64_t seen = 0;
+
+  for (int i = 0; i < kLatencyBuckets; ++i) {
+    seen += latency_buckets[i];
+    if ((seen > target) || (seen == count)) {
+      return (i == kLatencyBuckets - 1) ? max_ns : (1ULL << i);
+    }
+  }
+  return 0;
+}
+
+MessageDispatcher::MessageDispatcher() : slots_(0x10000, 0) {
+}
+
+void MessageDispatcher::Register(const uint16_t &id, const Handler &handler) {
+  if (slots_[id] != 0) {
+    entries_[slots_[id] - 1].handler = handler;
+    return;
+  }
+  assert(entries_.size() < 0xFF);
+  entries_.push_back(Entry());
+  entries_.back().id = id;
+  entries_.back().handler = handler;
+  slots_[id] = static_cast<uint8_t>(entries_.size());
+}
+
+bool MessageDispatcher::Dispatch(const uint16_t &id, Connection *connection,
+                                 Message *msg, ProtocolParameters *propara) {
+  uint8_t slot = slots_[id];
+  uint64_t elapsed;
+  int bucket;
+
+  if (slot == 0) {
+    ++unhandled_;
+    return false;
+  }
+
+  Entry &entry = entries_[slot - 1];
+  auto start = std::chrono::steady_clock::now();
+  entry.handler(connection, id, msg, propara);
+  elapsed = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+
+  ++entry.statistics.count;
+  entry.statistics.total_ns += elapsed;
+  entry.statistics.max_ns = std::max(entry.statistics.max_ns, elapsed);
+  bucket = (elapsed == 0) ? 0 : 64 - __builtin_clzll(elapsed);
+  bucket = std::min(bucket, MessageStatistics::kLatencyBuckets - 1);
+  ++entry.statistics.latency_buckets[bucket];
+  return true;
+}
+
+MessageStatistics MessageDispatcher::statistics(const uint16_t &id) const {
+  if (slots_[id] == 0) {
+    return MessageStatistics();
+  }
+  return entries_[slots_[id] - 1].statistics;
+}
+
+std::vector<uint16_t> MessageDispatcher::ids(void) const {
+  std::vector<uint16_t> ids;
+
+  for (auto &entry : entries_) {
+    ids.push_back(entry.id);
+  }
+  return ids;
+}
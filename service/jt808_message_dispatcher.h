@@ -0,0 +1,86 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_MESSAGE_DISPATCHER_H_
+#define JT808_SERVICE_JT808_MESSAGE_DISPATCHER_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "common/jt808_protocol.h"
+#include "service/jt808_protocol.h"
+
+
+struct Connection;
+
+// Counters of one message ID, only written by the owning reactor thread.
+struct MessageStatistics {
+  // Handler latency histogram, bucket i counts calls that took less than
+  // 2^i nanoseconds and at least half of that, the last bucket the rest.
+  static const int kLatencyBuckets = 32;
+
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+  uint64_t latency_buckets[kLatencyBuckets] = {0};
+
+  void Add(const MessageStatistics &other);
+  // Upper bound of the bucket holding the |percent| percentile, in ns.
+  uint64_t Percentile(const double &percent) const;
+};
+
+// Maps uplink message IDs to their handlers through a flat table indexed
+// by the ID, and keeps count and latency of every handled ID.
+class MessageDispatcher {
+ public:
+  typedef std::function<void(Connection *connection, const uint16_t &id,
+                             Message *msg, ProtocolParameters *propara)>
+      Handler;
+
+  MessageDispatcher();
+  MessageDispatcher(const MessageDispatcher&) = delete;
+  MessageDispatcher& operator=(const MessageDispatcher&) = delete;
+  virtual ~MessageDispatcher() = default;
+
+  // Replace the handler of |id| if there is one already.
+  void Register(const uint16_t &id, const Handler &handler);
+  bool registered(const uint16_t &id) const { return slots_[id] != 0; }
+  // Run the handler of |id|, return false if there is none.
+  bool Dispatch(const uint16_t &id, Connection *connection, Message *msg,
+                ProtocolParameters *propara);
+
+  // Statistics of |id|, zero if it has no handler.
+  MessageStatistics statistics(const uint16_t &id) const;
+  // Frames with an ID without handler.
+  uint64_t unhandled(void) const { return unhandled_; }
+  // IDs with a handler, in registration order.
+  std::vector<uint16_t> ids(void) const;
+
+ private:
+  struct Entry {
+    uint16_t id;
+    Handler handler;
+    MessageStatistics statistics;
+  };
+
+  // Index into |entries_| plus one for every ID, 0 means no handler.
+  std::vector<uint8_t> slots_;
+  std::vector<Entry> entries_;
+  uint64_t unhandled_ = 0;
+};
+
+#endif  // JT808_SERVICE_JT808_MESSAGE_DISPATCHER_H_
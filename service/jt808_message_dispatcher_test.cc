@@ -0,0 +1,105 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_message_dispatcher.h"
+
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+TEST(MessageDispatcherTest, DispatchTest) {
+  MessageDispatcher dispatcher;
+  Message msg;
+  ProtocolParameters propara;
+  uint16_t seen = 0;
+  int calls = 0;
+
+  dispatcher.Register(UP_HEARTBEAT,
+                      [&](Connection *, const uint16_t &id, Message *,
+                          ProtocolParameters *) { seen = id; ++calls; });
+  dispatcher.Register(UP_POSITIONREPORT,
+                      [&](Connection *, const uint16_t &id, Message *,
+                          ProtocolParameters *) { seen = id; ++calls; });
+  EXPECT_THAT(dispatcher.registered(UP_HEARTBEAT), IsTrue());
+  EXPECT_THAT(dispatcher.registered(UP_REGISTER), IsFalse());
+  EXPECT_THAT(dispatcher.Dispatch(UP_POSITIONREPORT, nullptr, &msg, &propara),
+              IsTrue());
+  EXPECT_THAT(seen, Eq(UP_POSITIONREPORT));
+  EXPECT_THAT(dispatcher.Dispatch(UP_REGISTER, nullptr, &msg, &propara),
+              IsFalse());
+  EXPECT_THAT(calls, Eq(1));
+  EXPECT_THAT(dispatcher.unhandled(), Eq(1u));
+  EXPECT_THAT(dispatcher.ids(), ElementsAre(UP_HEARTBEAT, UP_POSITIONREPORT));
+}
+
+TEST(MessageDispatcherTest, ReplaceHandlerTest) {
+  MessageDispatcher dispatcher;
+  int first = 0;
+  int second = 0;
+
+  dispatcher.Register(UP_HEARTBEAT,
+                      [&](Connection *, const uint16_t &, Message *,
+                          ProtocolParameters *) { ++first; });
+  dispatcher.Register(UP_HEARTBEAT,
+                      [&](Connection *, const uint16_t &, Message *,
+                          ProtocolParameters *) { ++second; });
+  dispatcher.Dispatch(UP_HEARTBEAT, nullptr, nullptr, nullptr);
+  EXPECT_THAT(first, Eq(0));
+  EXPECT_THAT(second, Eq(1));
+  EXPECT_THAT(dispatcher.ids().size(), Eq(1u));
+}
+
+TEST(MessageDispatcherTest, StatisticsTest) {
+  MessageDispatcher dispatcher;
+  MessageStatistics statistics;
+  uint64_t bucketed = 0;
+
+  dispatcher.Register(UP_HEARTBEAT,
+                      [](Connection *, const uint16_t &, Message *,
+                         ProtocolParameters *) {});
+  for (int i = 0; i < 100; ++i) {
+    dispatcher.Dispatch(UP_HEARTBEAT, nullptr, nullptr, nullptr);
+  }
+  statistics = dispatcher.statistics(UP_HEARTBEAT);
+  EXPECT_THAT(statistics.count, Eq(100u));
+  for (auto bucket : statistics.latency_buckets) {
+    bucketed += bucket;
+  }
+  EXPECT_THAT(bucketed, Eq(100u));
+  EXPECT_THAT(statistics.max_ns, Ge(statistics.Percentile(50) / 2));
+  EXPECT_THAT(dispatcher.statistics(UP_REGISTER).count, Eq(0u));
+
+  statistics.Add(dispatcher.statistics(UP_HEARTBEAT));
+  EXPECT_THAT(statistics.count, Eq(200u));
+}
+
+TEST(MessageDispatcherTest, PercentileTest) {
+  MessageStatistics statistics;
+
+  // 90 calls under 1us, 10 calls around 1ms.
+  statistics.count = 100;
+  statistics.latency_buckets[10] = 90;
+  statistics.latency_buckets[20] = 10;
+  statistics.max_ns = 1000000;
+  EXPECT_THAT(statistics.Percentile(50), Eq(1024u));
+  EXPECT_THAT(statistics.Percentile(90), Eq(1u << 20));
+  EXPECT_THAT(statistics.Percentile(99), Eq(1u << 20));
+}
@@ -0,0 +1,197 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_MESSAGE_VIEWS_H_
+#define JT808_SERVICE_JT808_MESSAGE_VIEWS_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "common/jt808_position_report.h"
+
+
+// Read-only views over the body of a decoded uplink message. They point
+// into the message buffer and convert fields from network byte order on
+// access, so nothing is copied or allocated. Check valid() first, every
+// accessor assumes the body is long enough.
+
+inline uint16_t ReadBigEndian16(const uint8_t *src) {
+  return static_cast<uint16_t>((src[0] << 8) | src[1]);
+}
+
+inline uint32_t ReadBigEndian32(const uint8_t *src) {
+  return (static_cast<uint32_t>(src[0]) << 24) |
+         (static_cast<uint32_t>(src[1]) << 16) |
+         (static_cast<uint32_t>(src[2]) << 8) |
+         static_cast<uint32_t>(src[3]);
+}
+
+// 终端通用应答 0x0001
+class GeneralResponseView {
+ public:
+  GeneralResponseView(const uint8_t *body, const size_t &len)
+      : body_(body), len_(len) {}
+
+  bool valid(void) const { return len_ >= 5; }
+  uint16_t flow_num(void) const { return ReadBigEndian16(body_); }
+  uint16_t id(void) const { return ReadBigEndian16(body_ + 2); }
+  uint8_t result(void) const { return body_[4]; }
+
+ private:
+  const uint8_t *body_;
+  size_t len_;
+};
+
+// 位置信息汇报 0x0200. The answers 0x0201 and 0x0500 carry the same body
+// behind a 2-byte response flow number, skip it before building the view.
+class PositionReportView {
+ public:
+  static const size_t kBasicInfoLen = 28;
+
+  PositionReportView(const uint8_t *body, const size_t &len)
+      : body_(body), len_(len) {}
+
+  bool valid(void) const { return len_ >= kBasicInfoLen; }
+  uint32_t alarm(void) const { return ReadBigEndian32(body_); }
+  uint32_t status(void) const { return ReadBigEndian32(body_ + 4); }
+  // 1/1000000 degree.
+  uint32_t latitude(void) const { return ReadBigEndian32(body_ + 8); }
+  uint32_t longitude(void) const { return ReadBigEndian32(body_ + 12); }
+  // m.
+  uint16_t altitude(void) const { return ReadBigEndian16(body_ + 16); }
+  // 1/10 km/h.
+  uint16_t speed(void) const { return ReadBigEndian16(body_ + 18); }
+  uint16_t bearing(void) const { return ReadBigEndian16(body_ + 20); }
+  // BCD[6] YY-MM-DD-hh-mm-ss.
+  const uint8_t *timestamp(void) const { return body_ + 22; }
+
+  // Additional items, id(1) + length(1) + value, behind the basic info.
+  const uint8_t *extra(void) const { return body_ + kBasicInfoLen; }
+  size_t extra_len(void) const { return len_ - kBasicInfoLen; }
+  // Find the additional item |id|, nullptr if absent.
+  const uint8_t *FindExtra(const uint8_t &id, uint8_t *len) const {
+    return FindItem(extra(), extra_len(), id, len);
+  }
+
+  // Walk id(1) + length(1) + value items, also used for the nested
+  // custom items. Stop at a truncated item.
+  static const uint8_t *FindItem(const uint8_t *items, const size_t &len,
+                                 const uint8_t &id, uint8_t *item_len) {
+    size_t pos = 0;
+    while ((pos + 2 <= len) && (pos + 2 + items[pos + 1] <= len)) {
+      if (items[pos] == id) {
+        *item_len = items[pos + 1];
+        return items + pos + 2;
+      }
+      pos += 2 + items[pos + 1];
+    }
+    return nullptr;
+  }
+
+ private:
+  const uint8_t *body_;
+  size_t len_;
+};
+
+// CAN 总线数据上传 0x0705
+class CanBatchView {
+ public:
+  static const size_t kHeadLen = 7;
+  static const size_t kItemLen = 12;
+
+  CanBatchView(const uint8_t *body, const size_t &len)
+      : body_(body), len_(len) {}
+
+  // An empty batch carries only the count.
+  bool valid(void) const {
+    return (len_ >= 2) &&
+           ((count() == 0) || (len_ >= kHeadLen + count() * kItemLen));
+  }
+  uint16_t count(void) const { return ReadBigEndian16(body_); }
+  // BCD[5] hh-mm-ss-msms.
+  const uint8_t *timestamp(void) const { return body_ + 2; }
+  uint32_t can_id(const size_t &index) const {
+    return ReadBigEndian32(item(index));
+  }
+  // 8 data bytes.
+  const uint8_t *can_data(const size_t &index) const {
+    return item(index) + 4;
+  }
+
+ private:
+  const uint8_t *item(const size_t &index) const {
+    return body_ + kHeadLen + index * kItemLen;
+  }
+
+  const uint8_t *body_;
+  size_t len_;
+};
+
+// 查询终端参数应答 0x0104
+class ParameterResponseView {
+ public:
+  struct Parameter {
+    uint32_t id;
+    uint8_t len;
+    const uint8_t *value;
+  };
+
+  ParameterResponseView(const uint8_t *body, const size_t &len)
+      : body_(body), len_(len), pos_(3) {}
+
+  bool valid(void) const { return len_ >= 3; }
+  uint16_t flow_num(void) const { return ReadBigEndian16(body_); }
+  uint8_t count(void) const { return body_[2]; }
+  // Step to the next parameter, false at the end or on a truncated item.
+  bool Next(Parameter *parameter) {
+    if ((pos_ + 5 > len_) || (pos_ + 5 + body_[pos_ + 4] > len_)) {
+      return false;
+    }
+    parameter->id = ReadBigEndian32(body_ + pos_);
+    parameter->len = body_[pos_ + 4];
+    parameter->value = body_ + pos_ + 5;
+    pos_ += 5 + parameter->len;
+    return true;
+  }
+
+ private:
+  const uint8_t *body_;
+  size_t len_;
+  size_t pos_;
+};
+
+// 补传分包请求 0x8003, sent by terminals missing upgrade packages.
+class PacketResendView {
+ public:
+  PacketResendView(const uint8_t *body, const size_t &len)
+      : body_(body), len_(len) {}
+
+  bool valid(void) const { return len_ >= 3; }
+  uint16_t first_flow_num(void) const { return ReadBigEndian16(body_); }
+  // Ids actually present, a truncated list is cut short.
+  size_t count(void) const {
+    size_t present = (len_ - 3) / 2;
+    return body_[2] < present ? body_[2] : present;
+  }
+  uint16_t id(const size_t &index) const {
+    return ReadBigEndian16(body_ + 3 + 2 * index);
+  }
+
+ private:
+  const uint8_t *body_;
+  size_t len_;
+};
+
+#endif  // JT808_SERVICE_JT808_MESSAGE_VIEWS_H_
@@ -0,0 +1,141 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_message_views.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsNull;
+using ::testing::IsTrue;
+
+TEST(MessageViewsTest, GeneralResponseTest) {
+  const uint8_t body[] = {0x00, 0x05, 0x81, 0x03, 0x01};
+
+  GeneralResponseView response(body, sizeof(body));
+  EXPECT_THAT(response.valid(), IsTrue());
+  EXPECT_THAT(response.flow_num(), Eq(0x0005));
+  EXPECT_THAT(response.id(), Eq(0x8103));
+  EXPECT_THAT(response.result(), Eq(0x01));
+  EXPECT_THAT(GeneralResponseView(body, 4).valid(), IsFalse());
+}
+
+TEST(MessageViewsTest, PositionReportTest) {
+  uint8_t body[PositionReportView::kBasicInfoLen + 9] = {0};
+  uint8_t len = 0;
+  const uint8_t *value;
+
+  body[3] = 0x01;  // alarm
+  body[7] = 0x02;  // status
+  body[8] = 0x01; body[9] = 0x5A; body[10] = 0x2D; body[11] = 0x8C;
+  body[12] = 0x06; body[13] = 0xCA; body[14] = 0x8B; body[15] = 0x1D;
+  body[17] = 100;  // altitude
+  body[18] = 0x01; body[19] = 0x2C;  // speed
+  body[21] = 90;  // bearing
+  body[22] = 0x19;  // year
+  // Mileage then satellites.
+  body[28] = 0x01; body[29] = 0x04;
+  body[34] = 0x31; body[35] = 0x01; body[36] = 12;
+
+  PositionReportView report(body, sizeof(body));
+  EXPECT_THAT(report.valid(), IsTrue());
+  EXPECT_THAT(report.alarm(), Eq(1u));
+  EXPECT_THAT(report.status(), Eq(2u));
+  EXPECT_THAT(report.latitude(), Eq(0x015A2D8Cu));
+  EXPECT_THAT(report.longitude(), Eq(0x06CA8B1Du));
+  EXPECT_THAT(report.altitude(), Eq(100));
+  EXPECT_THAT(report.speed(), Eq(300));
+  EXPECT_THAT(report.bearing(), Eq(90));
+  EXPECT_THAT(report.timestamp()[0], Eq(0x19));
+  EXPECT_THAT(report.extra_len(), Eq(9u));
+  value = report.FindExtra(0x31, &len);
+  ASSERT_THAT(value, Eq(&body[36]));
+  EXPECT_THAT(len, Eq(1));
+  EXPECT_THAT(value[0], Eq(12));
+  EXPECT_THAT(report.FindExtra(0x30, &len), IsNull());
+  EXPECT_THAT(PositionReportView(body, 27).valid(), IsFalse());
+}
+
+TEST(MessageViewsTest, TruncatedItemTest) {
+  // The second item claims more bytes than are left.
+  const uint8_t items[] = {0x01, 0x01, 0xAA, 0x02, 0x04, 0xBB};
+  uint8_t len = 0;
+
+  EXPECT_THAT(PositionReportView::FindItem(items, sizeof(items), 0x01, &len),
+              Eq(&items[2]));
+  EXPECT_THAT(PositionReportView::FindItem(items, sizeof(items), 0x02, &len),
+              IsNull());
+}
+
+TEST(MessageViewsTest, CanBatchTest) {
+  const uint8_t body[] = {
+    0x00, 0x02, 0x10, 0x20, 0x30, 0x45, 0x06,
+    0x00, 0x00, 0x01, 0x23, 1, 2, 3, 4, 5, 6, 7, 8,
+    0x18, 0xFE, 0xF1, 0x00, 8, 7, 6, 5, 4, 3, 2, 1,
+  };
+  const uint8_t empty[] = {0x00, 0x00};
+
+  CanBatchView batch(body, sizeof(body));
+  EXPECT_THAT(batch.valid(), IsTrue());
+  EXPECT_THAT(batch.count(), Eq(2));
+  EXPECT_THAT(batch.timestamp()[4], Eq(0x06));
+  EXPECT_THAT(batch.can_id(0), Eq(0x123u));
+  EXPECT_THAT(batch.can_id(1), Eq(0x18FEF100u));
+  EXPECT_THAT(batch.can_data(1)[0], Eq(8));
+  EXPECT_THAT(CanBatchView(body, sizeof(body) - 1).valid(), IsFalse());
+  EXPECT_THAT(CanBatchView(empty, sizeof(empty)).valid(), IsTrue());
+}
+
+TEST(MessageViewsTest, ParameterResponseTest) {
+  const uint8_t body[] = {
+    0x00, 0x07, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x00, 0x05,
+    0x00, 0x00, 0x00, 0x13, 0x03, 'a', 'b', 'c',
+  };
+  ParameterResponseView::Parameter parameter;
+
+  ParameterResponseView response(body, sizeof(body));
+  EXPECT_THAT(response.valid(), IsTrue());
+  EXPECT_THAT(response.flow_num(), Eq(7));
+  EXPECT_THAT(response.count(), Eq(2));
+  ASSERT_THAT(response.Next(&parameter), IsTrue());
+  EXPECT_THAT(parameter.id, Eq(0x0001u));
+  EXPECT_THAT(ReadBigEndian32(parameter.value), Eq(5u));
+  ASSERT_THAT(response.Next(&parameter), IsTrue());
+  EXPECT_THAT(parameter.id, Eq(0x0013u));
+  EXPECT_THAT(parameter.len, Eq(3));
+  EXPECT_THAT(memcmp(parameter.value, "abc", 3), Eq(0));
+  EXPECT_THAT(response.Next(&parameter), IsFalse());
+
+  ParameterResponseView truncated(body, sizeof(body) - 1);
+  EXPECT_THAT(truncated.Next(&parameter), IsTrue());
+  EXPECT_THAT(truncated.Next(&parameter), IsFalse());
+}
+
+TEST(MessageViewsTest, PacketResendTest) {
+  const uint8_t body[] = {0x00, 0x21, 0x03, 0x00, 0x02, 0x01, 0x04, 0x00};
+
+  PacketResendView request(body, sizeof(body));
+  EXPECT_THAT(request.valid(), IsTrue());
+  EXPECT_THAT(request.first_flow_num(), Eq(0x21));
+  // Three ids announced, two and a half present.
+  ASSERT_THAT(request.count(), Eq(2u));
+  EXPECT_THAT(request.id(0), Eq(2));
+  EXPECT_THAT(request.id(1), Eq(0x0104));
+  EXPECT_THAT(PacketResendView(body, 2).valid(), IsFalse());
+}
@@ -0,0 +1,57 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_PENDING_COMMAND_H_
+#define JT808_SERVICE_JT808_PENDING_COMMAND_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "service/jt808_util.h"
+
+
+// A control command sent to a terminal and not answered yet. The command
+// client is answered when every frame of it has been responded to, or
+// when it times out.
+struct PendingCommand {
+  // jt808command client waiting for the result.
+  int client_fd = -1;
+  DeviceNode *device = nullptr;
+  // Connection of |device| on the reactor holding the command.
+  Connection *connection = nullptr;
+  // Message id of the first downlink frame.
+  uint16_t request_id = 0;
+  // Uplink message id answering the downlink frames.
+  uint16_t response_id = 0;
+  // Flow numbers of the downlink frames, one answer is expected for each.
+  std::vector<uint16_t> flow_nums;
+  size_t outstanding = 0;
+  // Collected from UP_GETPARARESPONSE.
+  std::map<uint32_t, std::string> terminal_parameters;
+  std::chrono::steady_clock::time_point deadline;
+  // Position in the timeout list of its reactor.
+  std::list<PendingCommand *>::iterator timeout_it;
+};
+
+// Pending commands of a reactor keyed by device and downlink flow number.
+typedef std::map<std::pair<const DeviceNode *, uint16_t>, PendingCommand *>
+    PendingCommandMap;
+
+#endif  // JT808_SERVICE_JT808_PENDING_COMMAND_H_
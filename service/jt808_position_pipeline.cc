@@ -0,0 +1,123 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_position_pipeline.h"
+
+#include <chrono>  // NOLINT
+
+
+const size_t PositionPipeline::kDefaultCapacity;
+const size_t PositionPipeline::kMaxBatch;
+const int PositionPipeline::kIdleInterval;
+
+PositionPipeline::~PositionPipeline() {
+  Stop();
+  for (auto *producer : queues_) {
+    delete producer;
+  }
+  queues_.clear();
+}
+
+void PositionPipeline::Init(const int &producers, const size_t &capacity) {
+  for (int i = 0; i < producers; ++i) {
+    queues_.push_back(new Producer(capacity));
+  }
+}
+
+void PositionPipeline::AddStage(const Stage &stage) {
+  stages_.push_back(stage);
+}
+
+void PositionPipeline::Start(void) {
+  if (running_) {
+    return;
+  }
+  running_ = true;
+  consumer_ = std::thread(&PositionPipeline::ConsumerLoop, this);
+}
+
+void PositionPipeline::Stop(void) {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  consumer_.join();
+}
+
+bool PositionPipeline::Push(const int &producer,
+                            const PositionRecord &record) {
+  Producer *queue = queues_[producer];
+
+  if (!queue->queue.Push(record)) {
+    queue->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  queue->pushed.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+PositionPipelineStatistics PositionPipeline::statistics(void) const {
+  PositionPipelineStatistics statistics;
+
+  for (auto *producer : queues_) {
+    statistics.pushed += producer->pushed.load(std::memory_order_relaxed);
+    statistics.dropped += producer->dropped.load(std::memory_order_relaxed);
+  }
+  statistics.processed = processed_.load(std::memory_order_relaxed);
+  statistics.batches = batches_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+size_t PositionPipeline::ProcessRound(PositionRecord *batch) {
+  size_t total = 0;
+  size_t count;
+
+  for (auto *producer : queues_) {
+    count = producer->queue.PopBatch(batch, kMaxBatch);
+    if (count == 0) {
+      continue;
+    }
+    for (auto &stage : stages_) {
+      stage(batch, count);
+    }
+    processed_.fetch_add(count, std::memory_order_relaxed);
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    total += count;
+  }
+  return total;
+}
+
+void PositionPipeline::ConsumerLoop(void) {
+  std::vector<PositionRecord> batch(kMaxBatch);
+  auto last_run = std::chrono::steady_clock::now();
+  auto now = last_run;
+
+  while (running_) {
+    if (ProcessRound(batch.data()) > 0) {
+      last_run = std::chrono::steady_clock::now();
+      continue;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    now = std::chrono::steady_clock::now();
+    if (now - last_run >= std::chrono::milliseconds(kIdleInterval)) {
+      for (auto &stage : stages_) {
+        stage(batch.data(), 0);
+      }
+      last_run = now;
+    }
+  }
+  // Whatever the producers queued before Stop.
+  while (ProcessRound(batch.data()) > 0) {}
+}
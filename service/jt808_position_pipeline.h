@@ -0,0 +1,99 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_POSITION_PIPELINE_H_
+#define JT808_SERVICE_JT808_POSITION_PIPELINE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "service/jt808_position_report.h"
+#include "service/jt808_spsc_queue.h"
+
+
+struct PositionPipelineStatistics {
+  uint64_t pushed = 0;
+  // Refused because the consumer fell behind a full queue.
+  uint64_t dropped = 0;
+  uint64_t processed = 0;
+  uint64_t batches = 0;
+};
+
+// Hands decoded position reports from the reactors over to one processing
+// thread. Every reactor pushes into its own SPSC queue, so the network
+// threads never wait on storage or alerting; when a queue is full the
+// record is dropped and counted instead. The processing thread pops the
+// queues in batches and runs every stage on each batch in order. While
+// idle the stages are also run without records every kIdleInterval
+// milliseconds, so they can do time based work such as flushing.
+class PositionPipeline {
+ public:
+  typedef std::function<void(const PositionRecord *records,
+                             const size_t &count)> Stage;
+
+  // Records a producer may run ahead of the processing thread.
+  static const size_t kDefaultCapacity = 8192;
+  // Largest batch handed to the stages.
+  static const size_t kMaxBatch = 256;
+  static const int kIdleInterval = 1000;
+
+  PositionPipeline() = default;
+  PositionPipeline(const PositionPipeline&) = delete;
+  PositionPipeline& operator=(const PositionPipeline&) = delete;
+  virtual ~PositionPipeline();
+
+  // One queue of |capacity| records for every producer thread, before
+  // Start.
+  void Init(const int &producers, const size_t &capacity = kDefaultCapacity);
+  // Append a processing stage, before Start.
+  void AddStage(const Stage &stage);
+  void Start(void);
+  // Process everything queued and stop the processing thread.
+  void Stop(void);
+
+  // Only ever called by the thread of |producer|. Return false if the
+  // record was dropped.
+  bool Push(const int &producer, const PositionRecord &record);
+
+  int producer_count(void) const { return static_cast<int>(queues_.size()); }
+  // Counters summed over all producers.
+  PositionPipelineStatistics statistics(void) const;
+
+ private:
+  struct Producer {
+    explicit Producer(const size_t &capacity) : queue(capacity) {}
+
+    SpscQueue<PositionRecord> queue;
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped{0};
+  };
+
+  // Pop and process one batch of every queue, return the records done.
+  size_t ProcessRound(PositionRecord *batch);
+  void ConsumerLoop(void);
+
+  std::vector<Producer *> queues_;
+  std::vector<Stage> stages_;
+  std::atomic<bool> running_{false};
+  std::thread consumer_;
+  std::atomic<uint64_t> processed_{0};
+  std::atomic<uint64_t> batches_{0};
+};
+
+#endif  // JT808_SERVICE_JT808_POSITION_PIPELINE_H_
@@ -0,0 +1,162 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_position_pipeline.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+TEST(SpscQueueTest, PushPopTest) {
+  SpscQueue<int> queue(3);
+  int out[8];
+
+  EXPECT_THAT(queue.capacity(), Eq(4u));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_THAT(queue.Push(i), IsTrue());
+  }
+  EXPECT_THAT(queue.Push(4), IsFalse());
+  EXPECT_THAT(queue.PopBatch(out, 3), Eq(3u));
+  EXPECT_THAT(out[2], Eq(2));
+  EXPECT_THAT(queue.Push(4), IsTrue());
+  EXPECT_THAT(queue.PopBatch(out, 8), Eq(2u));
+  EXPECT_THAT(out[0], Eq(3));
+  EXPECT_THAT(out[1], Eq(4));
+  EXPECT_THAT(queue.PopBatch(out, 8), Eq(0u));
+}
+
+TEST(SpscQueueTest, ConcurrentOrderTest) {
+  const int kCount = 200000;
+  SpscQueue<int> queue(64);
+  std::vector<int> received;
+  int out[16];
+  size_t count;
+
+  std::thread producer([&queue] {
+    for (int i = 0; i < kCount; ++i) {
+      while (!queue.Push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  while (received.size() < static_cast<size_t>(kCount)) {
+    count = queue.PopBatch(out, 16);
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    received.insert(received.end(), out, out + count);
+  }
+  producer.join();
+  for (int i = 0; i < kCount; ++i) {
+    ASSERT_THAT(received[i], Eq(i));
+  }
+}
+
+TEST(PositionPipelineTest, ProcessTest) {
+  const int kProducers = 3;
+  const int kRecords = 10000;
+  PositionPipeline pipeline;
+  std::vector<std::thread> producers;
+  std::vector<uint32_t> seen(kProducers, 0);
+  uint64_t stage_count = 0;
+  PositionPipelineStatistics statistics;
+
+  pipeline.Init(kProducers, 128);
+  pipeline.AddStage([&seen](const PositionRecord *records,
+                            const size_t &count) {
+    for (size_t i = 0; i < count; ++i) {
+      // In order per producer, drops only leave gaps.
+      EXPECT_THAT(records[i].mileage >= seen[records[i].alarm], IsTrue());
+      seen[records[i].alarm] = records[i].mileage + 1;
+    }
+  });
+  pipeline.AddStage([&stage_count](const PositionRecord *,
+                                   const size_t &count) {
+    stage_count += count;
+  });
+  pipeline.Start();
+  for (int i = 0; i < kProducers; ++i) {
+    producers.emplace_back([&pipeline, i] {
+      PositionRecord record;
+      memset(&record, 0x0, sizeof(record));
+      record.alarm = static_cast<uint32_t>(i);
+      for (int j = 0; j < kRecords; ++j) {
+        record.mileage = static_cast<uint32_t>(j);
+        pipeline.Push(i, record);
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  pipeline.Stop();
+
+  statistics = pipeline.statistics();
+  EXPECT_THAT(statistics.pushed + statistics.dropped,
+              Eq(static_cast<uint64_t>(kProducers * kRecords)));
+  EXPECT_THAT(statistics.processed, Eq(statistics.pushed));
+  EXPECT_THAT(stage_count, Eq(statistics.processed));
+  EXPECT_THAT(statistics.batches > 0, IsTrue());
+}
+
+TEST(PositionPipelineTest, BackPressureTest) {
+  PositionPipeline pipeline;
+  PositionRecord record;
+  PositionPipelineStatistics statistics;
+
+  // Not started, the queue fills up and further records are dropped.
+  memset(&record, 0x0, sizeof(record));
+  pipeline.Init(1, 4);
+  for (int i = 0; i < 6; ++i) {
+    pipeline.Push(0, record);
+  }
+  statistics = pipeline.statistics();
+  EXPECT_THAT(statistics.pushed, Eq(4u));
+  EXPECT_THAT(statistics.dropped, Eq(2u));
+  // Queued records are still processed on Stop.
+  pipeline.Start();
+  pipeline.Stop();
+  EXPECT_THAT(pipeline.statistics().processed, Eq(4u));
+}
+
+TEST(PositionPipelineTest, IdleTest) {
+  PositionPipeline pipeline;
+  std::atomic<int> idle_runs{0};
+
+  // Stages run without records while nothing arrives.
+  pipeline.Init(1);
+  pipeline.AddStage([&idle_runs](const PositionRecord *,
+                                 const size_t &count) {
+    if (count == 0) {
+      ++idle_runs;
+    }
+  });
+  pipeline.Start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(
+      PositionPipeline::kIdleInterval * 3 / 2));
+  pipeline.Stop();
+  EXPECT_THAT(idle_runs.load() >= 1, IsTrue());
+}
@@ -12,72 +12,215 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+
 #include "service/jt808_position_report.h"
 
-#include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <type_traits>
+
 #include "bcd/bcd.h"
+#include "common/jt808_logger.h"
 #include "common/jt808_position_report.h"
 #include "common/jt808_util.h"
 #include "service/jt808_util.h"
 
 
-void ParsePositionReport(const uint8_t *buffer,
-                         const size_t &len, const size_t &offset) {
-  uint16_t u16val;
-  uint32_t u32val;
-  double latitude;
-  double longitude;
-  float altitude;
-  float speed;
-  float bearing;
-  AlarmBit alarm_bit;
+static_assert(std::is_pod<PositionRecord>::value,
+              "PositionRecord is copied around as plain bytes");
+static_assert(sizeof(PositionRecord) == 80, "PositionRecord grew");
+
+// Store the additional item |id| of |len| bytes at |value| into |record|.
+static void DecodeItem(const uint8_t &id, const uint8_t *value,
+                       const uint8_t &len, PositionRecord *record) {
+  switch (id) {
+    case POSITIONEXTENSIONMILEAGE:
+      if (len == 4) {
+        record->mileage = ReadBigEndian32(value);
+        record->items |= kPositionMileage;
+      }
+      break;
+    case POSITIONEXTENSIONOLIQUANTITY:
+      if (len == 2) {
+        record->oil_quantity = ReadBigEndian16(value);
+        record->items |= kPositionOilQuantity;
+      }
+      break;
+    case POSITIONEXTENSIONTACHOGRAPHSPEED:
+      if (len == 2) {
+        record->tachograph_speed = ReadBigEndian16(value);
+        record->items |= kPositionTachographSpeed;
+      }
+      break;
+    case POSITIONEXTENSIONALARMCOUNT:
+      if (len == 2) {
+        record->alarm_event_id = ReadBigEndian16(value);
+        record->items |= kPositionAlarmEventId;
+      }
+      break;
+    case POSITIONEXTENSIONOVERSPEEDALARM:
+      // Without an area id when the position type is 0.
+      if ((len == 1) || (len == 5)) {
+        record->overspeed_area_type = value[0];
+        record->overspeed_area_id = len == 5 ? ReadBigEndian32(value + 1) :
+                                               0;
+        record->items |= kPositionOverspeedAlarm;
+      }
+      break;
+    case POSITIONEXTENSIONACCESSAREAALARM:
+      if (len == 6) {
+        record->access_area_type = value[0];
+        record->access_area_id = ReadBigEndian32(value + 1);
+        record->access_direction = value[5];
+        record->items |= kPositionAccessAreaAlarm;
+      }
+      break;
+    case POSITIONEXTENSIONDRIVINGTIMEALARM:
+      if (len == 7) {
+        record->driving_route_id = ReadBigEndian32(value);
+        record->driving_time = ReadBigEndian16(value + 4);
+        record->driving_result = value[6];
+        record->items |= kPositionDrivingTimeAlarm;
+      }
+      break;
+    case POSITIONEXTENSIONVEHICLESIGNAL:
+      if (len == 4) {
+        record->vehicle_signal = ReadBigEndian32(value);
+        record->items |= kPositionVehicleSignal;
+      }
+      break;
+    case POSITIONEXTENSIONIOSTATUS:
+      if (len == 2) {
+        record->io_status = ReadBigEndian16(value);
+        record->items |= kPositionIoStatus;
+      }
+      break;
+    case POSITIONEXTENSIONANALOGQUANTITY:
+      if (len == 4) {
+        record->analog_quantity = ReadBigEndian32(value);
+        record->items |= kPositionAnalogQuantity;
+      }
+      break;
+    case POSITIONEXTENSIONNETWORKQUALITY:
+      if (len == 1) {
+        record->network_quality = value[0];
+        record->items |= kPositionNetworkQuality;
+      }
+      break;
+    case POSITIONEXTENSIONGNSSSATELLITENUM:
+      if (len == 1) {
+        record->gnss_satellites = value[0];
+        record->items |= kPositionGnssSatellites;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// The custom items nest inside 0xE0, only the position status is known.
+static void DecodeCustomItems(const uint8_t *items, const size_t &len,
+                              PositionRecord *record) {
+  size_t pos = 0;
+
+  while ((pos + 2 <= len) && (pos + 2 + items[pos + 1] <= len)) {
+    if ((items[pos] == POSITIONEXTENSIONPOSITIONSTATUS) &&
+        (items[pos + 1] == 1)) {
+      record->position_status = items[pos + 2];
+      record->items |= kPositionPositionStatus;
+    }
+    pos += 2 + items[pos + 1];
+  }
+}
+
+bool DecodePositionReport(const uint8_t *phone_bcd,
+                          const PositionReportView &report,
+                          PositionRecord *record) {
+  const uint8_t *items = report.extra();
+  size_t len;
+  size_t pos = 0;
+
+  if (!report.valid()) {
+    return false;
+  }
+  memset(record, 0x0, sizeof(*record));
+  memcpy(record->phone_bcd, phone_bcd, 6);
+  memcpy(record->timestamp, report.timestamp(), 6);
+  record->alarm = report.alarm();
+  record->status = report.status();
+  record->latitude = report.latitude();
+  record->longitude = report.longitude();
+  record->altitude = report.altitude();
+  record->speed = report.speed();
+  record->bearing = report.bearing();
+
+  len = report.extra_len();
+  while ((pos + 2 <= len) && (pos + 2 + items[pos + 1] <= len)) {
+    if (items[pos] == POSITIONEXTENSIONCUSTOMITEMLENGTH) {
+      DecodeCustomItems(items + pos + 2, items[pos + 1], record);
+    } else {
+      DecodeItem(items[pos], items + pos + 2, items[pos + 1], record);
+    }
+    pos += 2 + items[pos + 1];
+  }
+  return true;
+}
+
+void LogPositionReport(const char *what, const PositionRecord &record,
+                       const bool &rate_limited) {
   StatusBit status_bit;
   unsigned char timestamp[6] = {0};
   char phone_num[6] = {0};
   char device_num[12] = {0};
+  char extras[128] = {0};
+  size_t len = 0;
+  uint64_t key = 0;
 
-  memcpy(phone_num, &buffer[5], 6);
+  // Everything below only feeds the record, skip it when nobody reads it.
+  memcpy(&key, record.phone_bcd, 6);
+  if (!Logger::Instance()->Enabled(kLogInfo) ||
+      (rate_limited && !Logger::Instance()->Allow(key))) {
+    return;
+  }
+  memcpy(phone_num, record.phone_bcd, 6);
   StringFromBcdCompress(phone_num, device_num, 6);
-  memcpy(&u32val, &buffer[13+offset], 4);
-  alarm_bit.value = EndianSwap32(u32val);
-  memcpy(&u32val, &buffer[17+offset], 4);
-  status_bit.value = EndianSwap32(u32val);
-  memcpy(&u32val, &buffer[21+offset], 4);
-  latitude = EndianSwap32(u32val) / 1000000.0;
-  memcpy(&u32val, &buffer[25+offset], 4);
-  longitude = EndianSwap32(u32val) / 1000000.0;
-  memcpy(&u16val, &buffer[29+offset], 2);
-  altitude = static_cast<float>(EndianSwap16(u16val));
-  memcpy(&u16val, &buffer[31+offset], 2);
-  speed = static_cast<float>(EndianSwap16(u16val) * 10.0);
-  memcpy(&u16val, &buffer[33+offset], 2);
-  bearing = static_cast<float>(EndianSwap16(u16val));
-  timestamp[0] = HexFromBcd(buffer[35+offset]);
-  timestamp[1] = HexFromBcd(buffer[36+offset]);
-  timestamp[2] = HexFromBcd(buffer[37+offset]);
-  timestamp[3] = HexFromBcd(buffer[38+offset]);
-  timestamp[4] = HexFromBcd(buffer[39+offset]);
-  timestamp[5] = HexFromBcd(buffer[40+offset]);
-  fprintf(stdout, "\tdevice: %s\n"
-                  "\talarm flags: %08X\n""\tstatus flags: %08X\n"
-                  "\tlongitude: %lf%c\n"
-                  "\tlatitude: %lf%c\n"
-                  "\taltitude: %f\n"
-                  "\tspeed: %f\n""\tbearing: %f\n"
-                  "\ttimestamp: %02d-%02d-%02d, %02d:%02d:%02d\n",
-          device_num, alarm_bit.value, status_bit.value,
-          longitude, status_bit.bit.ewlongitude == 0 ? 'E':'W',
-          latitude, status_bit.bit.snlatitude == 0 ? 'N':'S',
-          altitude, speed, bearing,
-          timestamp[0], timestamp[1], timestamp[2],
-          timestamp[3], timestamp[4], timestamp[5]);
-  if (len >= (46+offset)) {
-    fprintf(stdout, "\tgnss satellite count: %d\n", buffer[43+offset]);
+  status_bit.value = record.status;
+  for (int i = 0; i < 6; ++i) {
+    timestamp[i] = HexFromBcd(record.timestamp[i]);
+  }
+  if (record.items & kPositionMileage) {
+    len += snprintf(extras + len, sizeof(extras) - len,
+                    "\n\tmileage: %.1fkm", record.mileage / 10.0);
+  }
+  if (record.items & kPositionOilQuantity) {
+    len += snprintf(extras + len, sizeof(extras) - len,
+                    "\n\toil quantity: %.1fL", record.oil_quantity / 10.0);
   }
-  if (len >= (51+offset)) {
-    fprintf(stdout, "\tgnss position status: %d\n", buffer[48+offset]);
+  if (record.items & kPositionGnssSatellites) {
+    len += snprintf(extras + len, sizeof(extras) - len,
+                    "\n\tgnss satellite count: %d", record.gnss_satellites);
   }
+  if (record.items & kPositionPositionStatus) {
+    snprintf(extras + len, sizeof(extras) - len,
+             "\n\tgnss position status: %d", record.position_status);
+  }
+  JT808_INFO("received %s:\n"
+             "\tdevice: %s\n"
+             "\talarm flags: %08X\n""\tstatus flags: %08X\n"
+             "\tlongitude: %lf%c\n"
+             "\tlatitude: %lf%c\n"
+             "\taltitude: %f\n"
+             "\tspeed: %f\n""\tbearing: %f\n"
+             "\ttimestamp: %02d-%02d-%02d, %02d:%02d:%02d%s",
+             what, device_num, record.alarm, record.status,
+             record.longitude / 1000000.0,
+             status_bit.bit.ewlongitude == 0 ? 'E':'W',
+             record.latitude / 1000000.0,
+             status_bit.bit.snlatitude == 0 ? 'N':'S',
+             static_cast<float>(record.altitude),
+             static_cast<float>(record.speed * 10.0),
+             static_cast<float>(record.bearing),
+             timestamp[0], timestamp[1], timestamp[2],
+             timestamp[3], timestamp[4], timestamp[5], extras);
 }
-
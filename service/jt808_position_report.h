@@ -18,8 +18,70 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "service/jt808_message_views.h"
 
-void ParsePositionReport(const uint8_t *buffer,
-                         const size_t &len, const size_t &offset);
+
+// Additional items present in a PositionRecord.
+enum PositionItem {
+  kPositionMileage = 1 << 0,  // 0x01
+  kPositionOilQuantity = 1 << 1,  // 0x02
+  kPositionTachographSpeed = 1 << 2,  // 0x03
+  kPositionAlarmEventId = 1 << 3,  // 0x04
+  kPositionOverspeedAlarm = 1 << 4,  // 0x11
+  kPositionAccessAreaAlarm = 1 << 5,  // 0x12
+  kPositionDrivingTimeAlarm = 1 << 6,  // 0x13
+  kPositionVehicleSignal = 1 << 7,  // 0x25
+  kPositionIoStatus = 1 << 8,  // 0x2A
+  kPositionAnalogQuantity = 1 << 9,  // 0x2B
+  kPositionNetworkQuality = 1 << 10,  // 0x30
+  kPositionGnssSatellites = 1 << 11,  // 0x31
+  kPositionPositionStatus = 1 << 12,  // 0xEE, 自定义信息 0xE0 内
+};
+
+// 位置信息汇报解码结果, 定长无指针, 可直接拷贝给存储和告警等下游.
+// 附加信息项只有 |items| 中对应位置位时有效.
+struct PositionRecord {
+  uint8_t phone_bcd[6];
+  uint8_t timestamp[6];  // BCD[6] YY-MM-DD-hh-mm-ss
+  uint32_t alarm;
+  uint32_t status;
+  uint32_t latitude;  // 1/1000000 度
+  uint32_t longitude;  // 1/1000000 度
+  uint16_t altitude;  // m
+  uint16_t speed;  // 1/10km/h
+  uint16_t bearing;
+  uint16_t oil_quantity;  // 1/10L
+  uint32_t items;  // PositionItem 位掩码
+  uint32_t mileage;  // 1/10km
+  uint16_t tachograph_speed;  // 1/10km/h
+  uint16_t alarm_event_id;
+  uint32_t overspeed_area_id;
+  uint8_t overspeed_area_type;  // 0 时无区域 ID
+  uint8_t access_area_type;
+  uint8_t access_direction;  // 0:进; 1:出
+  uint8_t network_quality;
+  uint32_t access_area_id;
+  uint32_t driving_route_id;
+  uint16_t driving_time;  // s
+  uint8_t driving_result;  // 0:不足; 1:过长
+  uint8_t gnss_satellites;
+  uint32_t vehicle_signal;  // ExtendedVehicleSignalBit
+  uint32_t analog_quantity;
+  uint16_t io_status;  // IoStatusBit
+  uint8_t position_status;
+  uint8_t reserved;
+};
+
+// Fill |record| from |report| of |phone_bcd| in one walk of the additional
+// items. Unknown items and items of an unexpected length are skipped, the
+// walk stops at a truncated item. Return false if the basic info is short.
+bool DecodePositionReport(const uint8_t *phone_bcd,
+                          const PositionReportView &report,
+                          PositionRecord *record);
+
+// Log |record| as "received |what|". Periodic reports are |rate_limited| to
+// the logger rate limit per device.
+void LogPositionReport(const char *what, const PositionRecord &record,
+                       const bool &rate_limited = true);
 
 #endif  // JT808_SERVICE_JT808_POSITION_REPORT_H_
@@ -0,0 +1,114 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_position_report.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+static const uint8_t kPhone[6] = {0x01, 0x38, 0x26, 0x53, 0x98, 0x50};
+
+TEST(PositionReportTest, BasicInfoTest) {
+  uint8_t body[PositionReportView::kBasicInfoLen] = {0};
+  PositionRecord record;
+
+  body[3] = 0x01;  // alarm
+  body[7] = 0x02;  // status
+  body[8] = 0x01; body[9] = 0x5A; body[10] = 0x2D; body[11] = 0x8C;
+  body[12] = 0x06; body[13] = 0xCA; body[14] = 0x8B; body[15] = 0x1D;
+  body[17] = 100;  // altitude
+  body[18] = 0x01; body[19] = 0x2C;  // speed
+  body[21] = 90;  // bearing
+  body[22] = 0x19;  // year
+
+  ASSERT_THAT(DecodePositionReport(kPhone, PositionReportView(body,
+                                                              sizeof(body)),
+                                   &record), IsTrue());
+  EXPECT_THAT(memcmp(record.phone_bcd, kPhone, 6), Eq(0));
+  EXPECT_THAT(record.alarm, Eq(1u));
+  EXPECT_THAT(record.status, Eq(2u));
+  EXPECT_THAT(record.latitude, Eq(0x015A2D8Cu));
+  EXPECT_THAT(record.longitude, Eq(0x06CA8B1Du));
+  EXPECT_THAT(record.altitude, Eq(100));
+  EXPECT_THAT(record.speed, Eq(300));
+  EXPECT_THAT(record.bearing, Eq(90));
+  EXPECT_THAT(record.timestamp[0], Eq(0x19));
+  EXPECT_THAT(record.items, Eq(0u));
+  EXPECT_THAT(DecodePositionReport(kPhone, PositionReportView(body, 27),
+                                   &record), IsFalse());
+}
+
+TEST(PositionReportTest, ExtensionItemsTest) {
+  const uint8_t extra[] = {
+    0x01, 0x04, 0x00, 0x00, 0x30, 0x39,  // mileage
+    0x02, 0x02, 0x01, 0xF4,  // oil
+    0x11, 0x01, 0x00,  // overspeed without area
+    0x12, 0x06, 0x02, 0x00, 0x00, 0x00, 0x07, 0x01,  // area
+    0x25, 0x04, 0x00, 0x00, 0x00, 0x03,  // signal
+    0x2A, 0x02, 0x00, 0x01,  // io
+    0x30, 0x01, 0x1F,  // network
+    0x31, 0x01, 0x0C,  // satellites
+    0x7F, 0x02, 0xAA, 0xBB,  // unknown
+    0xE0, 0x03, 0xEE, 0x01, 0x02,  // custom, position status
+  };
+  uint8_t body[PositionReportView::kBasicInfoLen + sizeof(extra)] = {0};
+  PositionRecord record;
+
+  memcpy(body + PositionReportView::kBasicInfoLen, extra, sizeof(extra));
+  ASSERT_THAT(DecodePositionReport(kPhone, PositionReportView(body,
+                                                              sizeof(body)),
+                                   &record), IsTrue());
+  EXPECT_THAT(record.items,
+              Eq(static_cast<uint32_t>(
+                  kPositionMileage | kPositionOilQuantity |
+                  kPositionOverspeedAlarm | kPositionAccessAreaAlarm |
+                  kPositionVehicleSignal | kPositionIoStatus |
+                  kPositionNetworkQuality | kPositionGnssSatellites |
+                  kPositionPositionStatus)));
+  EXPECT_THAT(record.mileage, Eq(12345u));
+  EXPECT_THAT(record.oil_quantity, Eq(500));
+  EXPECT_THAT(record.overspeed_area_type, Eq(0));
+  EXPECT_THAT(record.overspeed_area_id, Eq(0u));
+  EXPECT_THAT(record.access_area_type, Eq(2));
+  EXPECT_THAT(record.access_area_id, Eq(7u));
+  EXPECT_THAT(record.access_direction, Eq(1));
+  EXPECT_THAT(record.vehicle_signal, Eq(3u));
+  EXPECT_THAT(record.io_status, Eq(1));
+  EXPECT_THAT(record.network_quality, Eq(0x1F));
+  EXPECT_THAT(record.gnss_satellites, Eq(12));
+  EXPECT_THAT(record.position_status, Eq(2));
+}
+
+TEST(PositionReportTest, MalformedItemsTest) {
+  const uint8_t extra[] = {
+    0x01, 0x02, 0x00, 0x01,  // mileage of the wrong length
+    0x31, 0x01, 0x0C,
+    0x30, 0x04, 0x1F,  // truncated
+  };
+  uint8_t body[PositionReportView::kBasicInfoLen + sizeof(extra)] = {0};
+  PositionRecord record;
+
+  memcpy(body + PositionReportView::kBasicInfoLen, extra, sizeof(extra));
+  ASSERT_THAT(DecodePositionReport(kPhone, PositionReportView(body,
+                                                              sizeof(body)),
+                                   &record), IsTrue());
+  EXPECT_THAT(record.items, Eq(static_cast<uint32_t>(kPositionGnssSatellites)));
+  EXPECT_THAT(record.gnss_satellites, Eq(12));
+}
@@ -0,0 +1,86 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_REACTOR_H_
+#define JT808_SERVICE_JT808_REACTOR_H_
+
+#include <sys/epoll.h>
+#include <stdint.h>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "service/jt808_message_dispatcher.h"
+#include "service/jt808_pending_command.h"
+#include "service/jt808_upgrade_session.h"
+
+
+struct Connection;
+
+// Event loop counters, only written by the reactor thread.
+struct ReactorStatistics {
+  uint64_t epoll_waits = 0;
+  // Socket reads and writes on terminal connections.
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  // epoll_ctl() calls arming or disarming EPOLLOUT.
+  uint64_t epoll_ctls = 0;
+  // Frames received from terminals.
+  uint64_t frames = 0;
+};
+
+// One event loop of the service. Every reactor owns an epoll instance and
+// a SO_REUSEPORT listen socket; a connection is only ever served by the
+// reactor that accepted it, work for it from other threads is posted.
+struct Reactor {
+  Reactor() = default;
+  Reactor(const Reactor&) = delete;
+  Reactor& operator=(const Reactor&) = delete;
+
+  int index = 0;
+  int epoll_fd = -1;
+  int listen_sock = -1;
+  // eventfd, wakes the loop up when tasks are posted.
+  int wakeup_fd = -1;
+  struct epoll_event *epoll_events = nullptr;
+  Connection *listen_connection = nullptr;
+  Connection *wakeup_connection = nullptr;
+  std::thread thread;
+  ReactorStatistics statistics;
+  // Handlers of uplink messages from authenticated terminals.
+  MessageDispatcher dispatcher;
+  // Connections still registering or authenticating, oldest first. Only
+  // touched by the reactor thread.
+  std::list<Connection *> handshakes;
+  // Control commands waiting for terminals to answer, and the same
+  // commands oldest first for timing them out.
+  PendingCommandMap pending_commands;
+  std::list<PendingCommand *> pending_timeouts;
+  // Upgrades of the devices served by this reactor, and the last one
+  // resumed when the bandwidth held them back.
+  std::map<const DeviceNode *, UpgradeSession *> upgrades;
+  const DeviceNode *upgrade_cursor = nullptr;
+
+  // Guards |tasks| and |closed_connections|.
+  std::mutex mutex;
+  std::vector<std::function<void(void)>> tasks;
+  // Closed during the current round of events, freed after it.
+  std::vector<Connection *> closed_connections;
+};
+
+#endif  // JT808_SERVICE_JT808_REACTOR_H_
@@ -15,16 +15,17 @@
 #include "service/jt808_service.h"
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
-#include <signal.h>
 #include <unistd.h>
 #include <errno.h>
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -35,120 +36,324 @@
 #include <sstream>
 #include <map>
 #include <utility>
+#include <mutex>  // NOLINT
 #include <thread>  // NOLINT
 
 #include "bcd/bcd.h"
+#include "common/jt808_logger.h"
+#include "common/jt808_message_schema.h"
+#include "service/jt808_frame_decoder.h"
+#include "service/jt808_message_views.h"
 #include "unix_socket/unix_socket.h"
 #include "util/container_clear.h"
 
 
-Jt808Service::~Jt808Service() {
-  if (listen_sock_ > 0) {
-    close(listen_sock_);
-  }
-  if (epoll_fd_ > 0) {
-    close(epoll_fd_);
+// Downlink bodies packed straight from the protocol parameters.
+typedef Schema<
+    WordField<ProtocolParameters, &ProtocolParameters::respond_flow_num>,
+    WordField<ProtocolParameters, &ProtocolParameters::respond_id>,
+    ByteField<ProtocolParameters, &ProtocolParameters::respond_result>
+> UniResponseCodec;
+
+typedef Schema<
+    WordField<ProtocolParameters, &ProtocolParameters::report_interval>,
+    DwordField<ProtocolParameters, &ProtocolParameters::report_valid_time>
+> PositionTrackCodec;
+
+typedef Schema<
+    ByteField<ProtocolParameters, &ProtocolParameters::set_area_route_type>,
+    RepeatedField<ProtocolParameters, uint8_t, CircularArea,
+                  &ProtocolParameters::circular_area_list, CircularAreaCodec>
+> SetCircularAreaCodec;
+
+typedef Schema<
+    ByteField<ProtocolParameters, &ProtocolParameters::set_area_route_type>,
+    RepeatedField<ProtocolParameters, uint8_t, RectangleArea,
+                  &ProtocolParameters::rectangle_area_list,
+                  RectangleAreaCodec>
+> SetRectangleAreaCodec;
+
+typedef Schema<
+    ByteField<ProtocolParameters, &ProtocolParameters::set_area_route_type>,
+    RepeatedField<ProtocolParameters, uint8_t, PolygonalArea,
+                  &ProtocolParameters::polygonal_area_list,
+                  PolygonalAreaCodec>
+> SetPolygonalAreaCodec;
+
+typedef Schema<
+    ByteField<ProtocolParameters, &ProtocolParameters::set_area_route_type>,
+    RepeatedField<ProtocolParameters, uint8_t, Route,
+                  &ProtocolParameters::route_list, RouteCodec>
+> SetRouteCodec;
+
+// Downlink commands answered by a general response, for logging.
+static const struct {
+  uint16_t id;
+  const char *name;
+} kResponseCommandNames[] = {
+  {DOWN_UPGRADEPACKAGE, "upgrade package"},
+  {DOWN_SETTERMPARA, "set terminal parameter"},
+  {DOWN_TERMINALCONTROL, "terminal control"},
+  {DOWN_POSITIONTRACK, "position track"},
+  {DOWN_SETCIRCULARAREA, "set circular area"},
+  {DOWN_DELCIRCULARAREA, "delete circular area"},
+  {DOWN_SETRECTANGLEAREA, "set rectangle area"},
+  {DOWN_DELRECTANGLEAREA, "delete rectangle area"},
+  {DOWN_SETPOLYGONALAREA, "set polygonal area"},
+  {DOWN_DELPOLYGONALAREA, "delete polygonal area"},
+  {DOWN_SETROUTE, "set route"},
+  {DOWN_DELROUTE, "delete route"},
+  {DOWN_PASSTHROUGH, "down passthrough"},
+};
+
+static const char *ResponseCommandName(const uint16_t &id) {
+  for (auto &command : kResponseCommandNames) {
+    if (command.id == id) {
+      return command.name;
+    }
   }
-  ClearContainerElement(&device_list_);
-  delete [] epoll_events_;
+  return nullptr;
 }
 
-bool Jt808Service::Init(const uint16_t &port, const int &max_count) {
-  if (ReadDevicesList(kDevicesFilePath, &device_list_) == false) {
-    exit(1);
+static const char *ResponseResultName(const uint8_t &result) {
+  switch (result) {
+    case kSuccess:
+      return "normal";
+    case kFailure:
+      return "failed";
+    case kMessageHasWrong:
+      return "message has something wrong";
+    case kNotSupport:
+      return "message not support";
+    default:
+      return "unknown";
   }
+}
 
-  max_count_ = max_count;
-  struct sockaddr_in server_addr;
-  memset(&server_addr, 0, sizeof(struct sockaddr_in));
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(port);
-  server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+// Send all of |data|, return false once the client is gone.
+static bool SendChunk(const int &fd, const std::string &data) {
+  size_t sent = 0;
+  ssize_t ret;
 
-  listen_sock_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_sock_ == -1) {
-    exit(1);
+  while (sent < data.size()) {
+    ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += static_cast<size_t>(ret);
   }
+  return true;
+}
 
-  if (bind(listen_sock_, reinterpret_cast<struct sockaddr*>(&server_addr),
-           sizeof(struct sockaddr)) == -1) {
-    exit(1);
-  }
+// Head of the packed frame |msg|, which may have been escaped, in
+// network byte order.
+static MessageHead FrameHead(const Message &msg) {
+  uint8_t buffer[2 * sizeof(MessageHead)];
+  size_t len = std::min(msg.size - 1, sizeof(buffer));
+  MessageHead head;
+
+  memcpy(buffer, &msg.buffer[1], len);
+  ReverseEscape(buffer, len);
+  memcpy(&head, buffer, sizeof(head));
+  return head;
+}
 
-  if (listen(listen_sock_, 5) == -1) {
-    exit(1);
-  }
+// Body of the parsed frame |msg| and its length.
+static const uint8_t *FrameBody(const Message &msg, size_t *len) {
+  MessageBodyAttr msgbody_attribute;
+  uint16_t u16val;
 
-  epoll_events_ = new struct epoll_event[max_count_];
-  if (epoll_events_ == nullptr) {
-    exit(1);
-  }
+  memcpy(&u16val, &msg.buffer[3], 2);
+  msgbody_attribute.value = EndianSwap16(u16val);
+  *len = msgbody_attribute.bit.msglen;
+  return &msg.buffer[msgbody_attribute.bit.package ? MSGBODY_PACKAGE_POS :
+                                                     MSGBODY_NOPACKAGE_POS];
+}
 
-  epoll_fd_ = epoll_create(max_count_);
-  EpollRegister(epoll_fd_, listen_sock_);
+// Encode the body with |Codec| at |msg_body| and account for it in the
+// frame, return the end of the body.
+template <typename Codec>
+static uint8_t *PackBody(const ProtocolParameters &propara,
+                         uint8_t *msg_body, MessageHead *msghead_ptr,
+                         Message *msg) {
+  uint8_t *end = Codec::Encode(propara, msg_body);
+  uint16_t len = static_cast<uint16_t>(end - msg_body);
+
+  msg->size += len;
+  msghead_ptr->attribute.bit.msglen += len;
+  return end;
+}
 
-  socket_fd_ = ServerListen(kCommandInterfacePath);
-  EpollRegister(epoll_fd_, socket_fd_);
+Jt808Service::~Jt808Service() {
+  for (auto *device : device_registry_.devices()) {
+    if (device->connection != nullptr) {
+      CloseDeviceConnection(device);
+    }
+  }
+  for (auto *reactor : reactors_) {
+    while (!reactor->handshakes.empty()) {
+      CloseTerminalConnection(reactor->handshakes.front());
+    }
+    ReleaseClosedConnections(reactor);
+    if (reactor->listen_sock > 0) {
+      close(reactor->listen_sock);
+    }
+    if (reactor->wakeup_fd > 0) {
+      close(reactor->wakeup_fd);
+    }
+    if (reactor->epoll_fd > 0) {
+      close(reactor->epoll_fd);
+    }
+    delete reactor->listen_connection;
+    delete reactor->wakeup_connection;
+    delete [] reactor->epoll_events;
+    delete reactor;
+  }
+  reactors_.clear();
+  if (socket_fd_ > 0) {
+    close(socket_fd_);
+  }
+  delete command_listen_connection_;
+}
 
-  return true;
+bool Jt808Service::Init(const uint16_t &port, const int &max_count) {
+  struct sockaddr_in server_addr;
+  memset(&server_addr, 0, sizeof(struct sockaddr_in));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  return Init(server_addr, max_count);
 }
 
 bool Jt808Service::Init(const char *ip,
                         const uint16_t &port, const int &max_count) {
-  if (ReadDevicesList(kDevicesFilePath, &device_list_) == false) {
-    exit(1);
-  }
-
-  max_count_ = max_count;
   struct sockaddr_in server_addr;
   memset(&server_addr, 0, sizeof(struct sockaddr));
   server_addr.sin_family = AF_INET;
   server_addr.sin_port = htons(port);
   server_addr.sin_addr.s_addr = inet_addr(ip);
 
-  listen_sock_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_sock_ == -1) {
+  return Init(server_addr, max_count);
+}
+
+bool Jt808Service::Init(const struct sockaddr_in &server_addr,
+                        const int &max_count) {
+  if (device_registry_.Load(devices_file_path_) == false) {
     exit(1);
   }
 
-  if (bind(listen_sock_, reinterpret_cast<struct sockaddr*>(&server_addr),
+  max_count_ = max_count;
+  // One queue per reactor, the records are logged before later stages.
+  position_pipeline_.Init(worker_count_);
+  position_pipeline_.AddStage([](const PositionRecord *records,
+                                 const size_t &count) {
+    for (size_t i = 0; i < count; ++i) {
+      LogPositionReport("position report", records[i]);
+    }
+  });
+  if ((track_directory_ != nullptr) && track_store_.Open(track_directory_)) {
+    position_pipeline_.AddStage([this](const PositionRecord *records,
+                                       const size_t &count) {
+      track_store_.Append(TrackStore::NowMs(), records, count);
+    });
+  }
+  if ((archive_directory_ != nullptr) &&
+      track_archive_.Open(archive_directory_)) {
+    position_pipeline_.AddStage([this](const PositionRecord *records,
+                                       const size_t &count) {
+      uint64_t now_ms = TrackStore::NowMs();
+      for (size_t i = 0; i < count; ++i) {
+        track_archive_.Append(now_ms, records[i]);
+      }
+      if (now_ms >= archive_flushed_ms_ + 1000) {
+        track_archive_.FlushIdle(now_ms, kArchiveIdleMs);
+        archive_flushed_ms_ = now_ms;
+      }
+    });
+  }
+  if (upgrade_progress_directory_ != nullptr) {
+    upgrade_progress_.Open(upgrade_progress_directory_);
+  }
+  for (int i = 0; i < worker_count_; ++i) {
+    Reactor *reactor = new Reactor;
+    reactor->index = i;
+    reactors_.push_back(reactor);
+    if (!InitReactor(reactor, server_addr)) {
+      exit(1);
+    }
+  }
+
+  // Control commands are accepted by the first reactor only.
+  socket_fd_ = ServerListen(command_interface_path_);
+  command_listen_connection_ = new Connection(kCommandListenConnection,
+                                              socket_fd_, reactors_[0]);
+  EpollRegister(reactors_[0]->epoll_fd, socket_fd_,
+                command_listen_connection_);
+
+  return true;
+}
+
+bool Jt808Service::InitReactor(Reactor *reactor,
+                               const struct sockaddr_in &server_addr) {
+  int reuse = 1;
+
+  reactor->listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (reactor->listen_sock == -1) {
+    return false;
+  }
+
+  // Every reactor listens on the same port, the kernel spreads
+  // incoming connections over them.
+  setsockopt(reactor->listen_sock, SOL_SOCKET, SO_REUSEPORT,
+             &reuse, sizeof(reuse));
+  if (bind(reactor->listen_sock,
+           reinterpret_cast<const struct sockaddr*>(&server_addr),
            sizeof(struct sockaddr)) == -1) {
-    exit(1);
+    return false;
   }
 
-  if (listen(listen_sock_, 5) == -1) {
-    exit(1);
+  // Deep enough for a reconnect storm after an outage.
+  if (listen(reactor->listen_sock, SOMAXCONN) == -1) {
+    return false;
   }
 
-  epoll_events_ = new struct epoll_event[max_count_];
-  if (epoll_events_ == nullptr) {
-    exit(1);
+  reactor->epoll_events = new struct epoll_event[max_count_];
+  if (reactor->epoll_events == nullptr) {
+    return false;
   }
 
-  epoll_fd_ = epoll_create(max_count_);
-  EpollRegister(epoll_fd_, listen_sock_);
+  reactor->epoll_fd = epoll_create(max_count_);
+  reactor->listen_connection = new Connection(kTerminalListenConnection,
+                                              reactor->listen_sock, reactor);
+  EpollRegister(reactor->epoll_fd, reactor->listen_sock,
+                reactor->listen_connection);
 
-  socket_fd_ = ServerListen(kCommandInterfacePath);
-  EpollRegister(epoll_fd_, socket_fd_);
+  reactor->wakeup_fd = eventfd(0, EFD_NONBLOCK);
+  reactor->wakeup_connection = new Connection(kWakeupConnection,
+                                              reactor->wakeup_fd, reactor);
+  EpollRegister(reactor->epoll_fd, reactor->wakeup_fd,
+                reactor->wakeup_connection);
+  RegisterMessageHandlers(reactor);
 
   return true;
 }
 
-int Jt808Service::AcceptNewClient(void) {
-  uint16_t command = 0;
+int Jt808Service::AcceptNewClient(Reactor *reactor) {
   struct sockaddr_in client_addr;
-  char phone_num[6] = {0};
-  decltype(device_list_.begin()) device_it;
-  ProtocolParameters propara;
-  Message msg;
+  Connection *connection;
 
-  memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   memset(&client_addr, 0, sizeof(struct sockaddr_in));
   socklen_t clilen = sizeof(struct sockaddr);
-  int new_sock = accept(listen_sock_,
+  int new_sock = accept(reactor->listen_sock,
                         reinterpret_cast<struct sockaddr*>(&client_addr),
                         &clilen);
+  if (new_sock < 0) {
+    return new_sock;
+  }
 
   int keepalive = 1;  // enable keepalive attributes.
   int keepidle = 30;  // time out for starting detection.
@@ -159,185 +364,528 @@ int Jt808Service::AcceptNewClient(void) {
   setsockopt(new_sock, SOL_TCP, TCP_KEEPINTVL,
              &keepinterval, sizeof(keepinterval));
   setsockopt(new_sock, SOL_TCP, TCP_KEEPCNT, &keepcount, sizeof(keepcount));
+  // Frames are flushed whole, a window of upgrade packages must not wait
+  // for the peer's delayed ack.
+  int nodelay = 1;
+  setsockopt(new_sock, IPPROTO_TCP, TCP_NODELAY,
+             &nodelay, sizeof(nodelay));
+
+  // Registration and authentication go on in the event loop.
+  connection = new Connection(kTerminalConnection, new_sock, reactor);
+  connection->handshake_state = kHandshakeRegister;
+  connection->handshake_deadline = std::chrono::steady_clock::now() +
+                                   std::chrono::seconds(kHandshakeTimeout);
+  connection->handshake_it = reactor->handshakes.insert(
+                                 reactor->handshakes.end(), connection);
+  EpollRegister(reactor->epoll_fd, new_sock, connection,
+                edge_triggered_ ? EPOLLIN | EPOLLOUT | EPOLLET : EPOLLIN);
 
-  if (RecvFrameData(new_sock, &msg) > 0) {
-    memset(&propara, 0x0, sizeof(propara));
-    command = Jt808FrameParse(&msg, &propara);
-    switch (command) {
-      case UP_REGISTER:
-        memset(msg.buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-        Jt808FramePack(DOWN_REGISTERRESPONSE, propara, &msg);
-        SendFrameData(new_sock, msg);
-        if (propara.respond_result != kSuccess) {
-          close(new_sock);
-          new_sock = -1;
-          break;
-        }
+  return new_sock;
+}
 
-        if (RecvFrameData(new_sock, &msg) > 0) {
-          command = Jt808FrameParse(&msg, &propara);
-          if (command != UP_AUTHENTICATION) {
-            close(new_sock);
-            new_sock = -1;
-            break;
-          }
-        }
-      case UP_AUTHENTICATION:
-        memset(msg.buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-        Jt808FramePack(DOWN_UNIRESPONSE, propara, &msg);
-        SendFrameData(new_sock, msg);
-        if (propara.respond_result != kSuccess) {
-          close(new_sock);
-          new_sock = -1;
-        } else if (!device_list_.empty()) {
-          for (auto *device : device_list_) {
-            BcdFromStringCompress(device->phone_num,
-                                  phone_num, strlen(device->phone_num));
-            if (memcmp(phone_num, propara.phone_num, 6) == 0) {
-              memcpy(device->manufacturer_id, propara.manufacturer_id, 5);
-              device->socket_fd = new_sock;
-              break;
-            }
-          }
-        }
+void Jt808Service::RegisterMessageHandlers(Reactor *reactor) {
+  using std::placeholders::_1;
+  using std::placeholders::_2;
+  using std::placeholders::_3;
+  using std::placeholders::_4;
+  MessageDispatcher::Handler command_response =
+      std::bind(&Jt808Service::HandleCommandResponse, this, _1, _2, _3, _4);
+  MessageDispatcher::Handler acknowledged =
+      std::bind(&Jt808Service::HandleAcknowledgedMessage,
+                this, _1, _2, _3, _4);
+
+  reactor->dispatcher.Register(UP_UNIRESPONSE, command_response);
+  reactor->dispatcher.Register(UP_GETPOSITIONINFORESPONSE, command_response);
+  reactor->dispatcher.Register(UP_VEHICLECONTROLRESPONSE, command_response);
+  reactor->dispatcher.Register(
+      UP_GETPARARESPONSE,
+      std::bind(&Jt808Service::HandleParameterResponse,
+                this, _1, _2, _3, _4));
+  reactor->dispatcher.Register(UP_HEARTBEAT, acknowledged);
+  reactor->dispatcher.Register(UP_UPGRADERESULT, acknowledged);
+  reactor->dispatcher.Register(
+      DOWN_PACKETRESEND,
+      std::bind(&Jt808Service::HandlePacketResend, this, _1, _2, _3, _4));
+  reactor->dispatcher.Register(
+      UP_POSITIONREPORT,
+      std::bind(&Jt808Service::HandlePositionReport, this, _1, _2, _3, _4));
+}
+
+void Jt808Service::HandleCommandResponse(Connection *connection,
+                                         const uint16_t &id, Message *msg,
+                                         ProtocolParameters *propara) {
+  if ((id == UP_UNIRESPONSE) && (propara->respond_id == DOWN_UPGRADEPACKAGE)) {
+    HandleUpgradeResponse(connection, *msg);
+    return;
+  }
+  CompletePendingCommand(connection, id, *msg, *propara);
+}
+
+void Jt808Service::HandleAcknowledgedMessage(Connection *connection,
+                                             const uint16_t &,
+                                             Message *msg,
+                                             ProtocolParameters *propara) {
+  memcpy(propara->phone_num, connection->device->phone_bcd, 6);
+  Jt808FramePack(DOWN_UNIRESPONSE, *propara, msg);
+  // Flushed with the other answers of this read.
+  QueueFrameData(connection, *msg);
+}
+
+void Jt808Service::HandleParameterResponse(Connection *connection,
+                                           const uint16_t &id, Message *msg,
+                                           ProtocolParameters *propara) {
+  CompletePendingCommand(connection, id, *msg, *propara);
+  HandleAcknowledgedMessage(connection, id, msg, propara);
+}
+
+void Jt808Service::HandlePositionReport(Connection *connection,
+                                        const uint16_t &id, Message *msg,
+                                        ProtocolParameters *propara) {
+  // Answer first, a full queue only costs the record.
+  HandleAcknowledgedMessage(connection, id, msg, propara);
+  position_pipeline_.Push(connection->reactor->index,
+                          *propara->position_record);
+}
+
+void Jt808Service::HandlePacketResend(Connection *connection,
+                                      const uint16_t &id, Message *msg,
+                                      ProtocolParameters *propara) {
+  uint16_t sequences[UINT8_MAX];
+  const uint8_t *body;
+  size_t len;
+  size_t count;
+
+  body = FrameBody(*msg, &len);
+  PacketResendView request(body, len);
+  count = request.valid() ? request.count() : 0;
+  for (size_t i = 0; i < count; ++i) {
+    sequences[i] = request.id(i);
+  }
+  // |msg| is reused for the answer.
+  HandleAcknowledgedMessage(connection, id, msg, propara);
+
+  auto it = connection->reactor->upgrades.find(connection->device);
+  if (it == connection->reactor->upgrades.end()) {
+    return;
+  }
+  it->second->OnResendRequest(sequences, count);
+  if (ResendUpgradeChunks(connection->reactor, it->second)) {
+    PumpUpgrade(connection->reactor, it->second);
+  }
+}
+
+void Jt808Service::HandleHandshakeFrame(Connection *connection,
+                                        Message *msg) {
+  uint16_t command = 0;
+  DeviceNode *device;
+  Reactor *previous;
+  ProtocolParameters propara;
+
+  memset(&propara, 0x0, sizeof(propara));
+  command = Jt808FrameParse(msg, &propara);
+  switch (command) {
+    case UP_REGISTER:
+      if (connection->handshake_state != kHandshakeRegister) {
+        CloseTerminalConnection(connection);
         break;
-      default:
-        close(new_sock);
-        new_sock = -1;
+      }
+      Jt808FramePack(DOWN_REGISTERRESPONSE, propara, msg);
+      if ((SendFrameData(connection, *msg) < 0) ||
+          (propara.respond_result != kSuccess)) {
+        CloseTerminalConnection(connection);
         break;
-    }
+      }
+      memcpy(connection->manufacturer_id, propara.manufacturer_id, 5);
+      connection->handshake_state = kHandshakeAuthentication;
+      break;
+    case UP_AUTHENTICATION:
+      Jt808FramePack(DOWN_UNIRESPONSE, propara, msg);
+      if ((SendFrameData(connection, *msg) < 0) ||
+          (propara.respond_result != kSuccess) ||
+          ((device = device_registry_.FindByPhone(
+                         propara.phone_num)) == nullptr)) {
+        CloseTerminalConnection(connection);
+        break;
+      }
+      memcpy(device->manufacturer_id, connection->manufacturer_id, 5);
+      connection->reactor->handshakes.erase(connection->handshake_it);
+      connection->handshake_state = kHandshakeDone;
+      connection->device = device;
+      // A stale connection of a re-authenticated device is shut down here,
+      // its reactor hands the work it holds for the device over.
+      previous = device_registry_.BindConnection(device, connection);
+      if (previous == nullptr) {
+        ResumeUpgrade(connection->reactor, device);
+      } else if (previous == connection->reactor) {
+        HandOverDevice(previous, device);
+      } else {
+        PostTask(previous, [this, previous, device] {
+          HandOverDevice(previous, device);
+        });
+      }
+      break;
+    default:
+      CloseTerminalConnection(connection);
+      break;
   }
+}
 
-  if (new_sock > 0) {
-    EpollRegister(epoll_fd_, new_sock);
-  }
+void Jt808Service::ExpireHandshakes(Reactor *reactor) {
+  auto now = std::chrono::steady_clock::now();
 
-  return new_sock;
+  // Same timeout for all, so the list is ordered by deadline.
+  while (!reactor->handshakes.empty() &&
+         (reactor->handshakes.front()->handshake_deadline <= now)) {
+    JT808_WARNING("handshake time out!!!");
+    CloseTerminalConnection(reactor->handshakes.front());
+  }
 }
 
-int Jt808Service::AcceptNewCommandClient(void) {
-  memset(&uid_, 0x0, sizeof(uid_));
-  client_fd_ = ServerAccept(socket_fd_, &uid_);
-  return client_fd_;
+int Jt808Service::AcceptNewCommandClient(Reactor *reactor) {
+  uid_t uid;
+  int client_fd = ServerAccept(socket_fd_, &uid);
+  if (client_fd >= 0) {
+    EpollRegister(reactor->epoll_fd, client_fd,
+                  new Connection(kCommandConnection, client_fd, reactor));
+  }
+  return client_fd;
 }
 
-int Jt808Service::Jt808ServiceWait(const int &time_out) {
-  return epoll_wait(epoll_fd_, epoll_events_, max_count_, time_out);
+int Jt808Service::Jt808ServiceWait(Reactor *reactor, const int &time_out) {
+  ++reactor->statistics.epoll_waits;
+  return epoll_wait(reactor->epoll_fd, reactor->epoll_events,
+                    max_count_, time_out);
 }
 
 void Jt808Service::Run(const int &time_out) {
+  running_ = true;
+  position_pipeline_.Start();
+  track_thread_ = std::thread([this] { RunTrackQueries(); });
+  for (size_t i = 1; i < reactors_.size(); ++i) {
+    Reactor *reactor = reactors_[i];
+    reactor->thread = std::thread([this, reactor, time_out] {
+      RunReactor(reactor, time_out);
+    });
+  }
+  RunReactor(reactors_[0], time_out);
+  for (size_t i = 1; i < reactors_.size(); ++i) {
+    reactors_[i]->thread.join();
+  }
+  track_cond_.notify_all();
+  track_thread_.join();
+  // Queries nobody got to.
+  for (auto &query : track_queries_) {
+    send(query.client_fd, "operation failed!!!", 19, MSG_NOSIGNAL);
+    close(query.client_fd);
+  }
+  track_queries_.clear();
+  position_pipeline_.Stop();
+  // Blocks still being filled are written out on a clean shutdown.
+  track_archive_.Flush();
+}
+
+void Jt808Service::RunReactor(Reactor *reactor, const int &time_out) {
   int ret = -1;
   int i;
   int active_count;
-  char recv_buff[65536] = {0};
+  int received;
+  bool resume_upgrades;
+  size_t room;
+  uint64_t count;
+  Connection *connection;
+  DeviceNode *device;
   ProtocolParameters propara;
   Message msg;
+  std::map<uint32_t, std::string> terminal_parameters;
+  std::vector<std::function<void(void)>> tasks;
+  PositionRecord position_record;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
-  while (1) {
-    ret = Jt808ServiceWait(time_out);
-    if (ret == 0) {  // epoll time out.
+  propara.position_record = &position_record;
+  while (running_) {
+    resume_upgrades = !reactor->upgrades.empty() &&
+                (upgrade_campaign_.bandwidth() > 0);
+    ret = Jt808ServiceWait(reactor, resume_upgrades ?
+                           std::min(time_out, kUpgradeResumeInterval) :
+                           time_out);
+    ExpireHandshakes(reactor);
+    ExpirePendingCommands(reactor);
+    ExpireUpgrades(reactor);
+    if (resume_upgrades) {
+      ResumeUpgrades(reactor);
+    }
+    if (ret <= 0) {  // epoll time out or interrupted.
+      ReleaseClosedConnections(reactor);
       continue;
     } else {
       active_count = ret;
       for (i = 0; i < active_count; ++i) {
-        if (epoll_events_[i].data.fd == listen_sock_) {
-          if (epoll_events_[i].events & EPOLLIN) {
-            AcceptNewClient();
-          }
-        } else if (epoll_events_[i].data.fd == socket_fd_) {
-          if (epoll_events_[i].events & EPOLLIN) {
-            AcceptNewCommandClient();
-            EpollRegister(epoll_fd_, client_fd_);
-          }
-        } else if (epoll_events_[i].data.fd == client_fd_) {
-          memset(recv_buff, 0x0, sizeof(recv_buff));
-          if ((ret = recv(client_fd_, recv_buff, sizeof(recv_buff), 0)) > 0) {
-            if (ParseCommand(recv_buff) >= 0) {
-               send(client_fd_, recv_buff, strlen(recv_buff), 0);
+        connection = static_cast<Connection *>(
+                         reactor->epoll_events[i].data.ptr);
+        if (connection->fd < 0) {  // closed earlier in this round.
+          continue;
+        }
+        switch (connection->type) {
+          case kTerminalListenConnection:
+            if (reactor->epoll_events[i].events & EPOLLIN) {
+              while (AcceptNewClient(reactor) >= 0) {}
             }
-          }
-          close(client_fd_);
-        } else if ((epoll_events_[i].events & EPOLLIN) &&
-                   !device_list_.empty()) {
-          for (auto *device : device_list_) {
-            if (epoll_events_[i].data.fd == device->socket_fd) {
-              if (RecvFrameData(epoll_events_[i].data.fd, &msg) > 0) {
-                int cmd = Jt808FrameParse(&msg, &propara);
-                switch (cmd) {
-                  case UP_HEARTBEAT:
-                  case UP_UPGRADERESULT:
-                  case UP_POSITIONREPORT:
-                    memset(msg.buffer, 0x0, sizeof(msg.buffer));
-                    PreparePhoneNum(device->phone_num, propara.phone_num);
-                    Jt808FramePack(DOWN_UNIRESPONSE, propara, &msg);
-                    if (SendFrameData(epoll_events_[i].data.fd, msg) < 0) {
-                      close(epoll_events_[i].data.fd);
-                      device->socket_fd = -1;
-                    }
-                    break;
-                  default:
+            break;
+          case kCommandListenConnection:
+            if (reactor->epoll_events[i].events & EPOLLIN) {
+              AcceptNewCommandClient(reactor);
+            }
+            break;
+          case kCommandConnection:
+            HandleCommandConnection(connection);
+            break;
+          case kWakeupConnection:
+            read(connection->fd, &count, sizeof(count));
+            {
+              std::lock_guard<std::mutex> lock(reactor->mutex);
+              tasks.swap(reactor->tasks);
+            }
+            for (auto &task : tasks) {
+              task();
+            }
+            tasks.clear();
+            break;
+          case kTerminalConnection:
+            if ((reactor->epoll_events[i].events & EPOLLOUT) &&
+                (FlushConnection(connection) < 0)) {
+              CloseTerminalConnection(connection);
+              break;
+            }
+            if (!(reactor->epoll_events[i].events & EPOLLIN)) {
+              break;
+            }
+            // Level-triggered reads once per wakeup. Edge-triggered drains
+            // the socket, a read short of the free space means it is empty.
+            do {
+              room = connection->recv_buffer->capacity() -
+                     connection->recv_buffer->size();
+              ++reactor->statistics.reads;
+              received = connection->recv_buffer->RecvFrom(connection->fd);
+              if (received < 0) {
+                CloseTerminalConnection(connection);
+                break;
+              }
+              // Deal every complete frame of this read in one pass.
+              while (connection->recv_buffer->PopFrame(&msg)) {
+                ++reactor->statistics.frames;
+                if ((device = connection->device) == nullptr) {
+                  HandleHandshakeFrame(connection, &msg);
+                  if (connection->fd == -1) {
                     break;
+                  }
+                  continue;
+                }
+                terminal_parameters.clear();
+                propara.terminal_parameter_map = &terminal_parameters;
+                reactor->dispatcher.Dispatch(
+                    Jt808FrameParse(&msg, &propara), connection, &msg,
+                    &propara);
+                if (connection->fd == -1) {
+                  break;
                 }
-              } else {
-                close(epoll_events_[i].data.fd);
-                device->socket_fd = -1;
               }
-              break;
+            } while (edge_triggered_ && (connection->fd >= 0) &&
+                     (received > 0) &&
+                     (static_cast<size_t>(received) == room));
+            if ((connection->fd >= 0) && (FlushConnection(connection) < 0)) {
+              CloseTerminalConnection(connection);
             }
-          }
+            break;
+          default:
+            break;
         }
       }
+      ReleaseClosedConnections(reactor);
     }
   }
 }
 
-int Jt808Service::SendFrameData(const int &fd, const Message &msg) {
-  int ret = -1;
+ReactorStatistics Jt808Service::statistics(void) const {
+  ReactorStatistics total;
 
-  signal(SIGPIPE, SIG_IGN);
-  ret = send(fd, msg.buffer, msg.size, 0);
-  if (ret < 0) {
-    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
-      ret = 0;
-    } else {
-      if (errno == EPIPE) {
-        printf("%s[%d]: remote socket close!!!\n", __FUNCTION__, __LINE__);
-      }
-      ret = -1;
-      printf("%s[%d]: send data failed!!!\n", __FUNCTION__, __LINE__);
-    }
-  } else if (ret == 0) {
-    printf("%s[%d]: connection disconect!!!\n", __FUNCTION__, __LINE__);
-    ret = -1;
+  for (auto *reactor : reactors_) {
+    total.epoll_waits += reactor->statistics.epoll_waits;
+    total.reads += reactor->statistics.reads;
+    total.writes += reactor->statistics.writes;
+    total.epoll_ctls += reactor->statistics.epoll_ctls;
+    total.frames += reactor->statistics.frames;
   }
+  return total;
+}
+
+MessageStatistics Jt808Service::message_statistics(
+    const uint16_t &id) const {
+  MessageStatistics total;
 
-  return ret;
+  for (auto *reactor : reactors_) {
+    total.Add(reactor->dispatcher.statistics(id));
+  }
+  return total;
 }
 
-int Jt808Service::RecvFrameData(const int &fd, Message *msg) {
-  int ret = -1;
+void Jt808Service::Stop(void) {
+  running_ = false;
+  {
+    // Under the lock, the track query thread may be about to wait.
+    std::lock_guard<std::mutex> lock(track_mutex_);
+  }
+  track_cond_.notify_all();
+  for (auto *reactor : reactors_) {
+    PostTask(reactor, [] {});
+  }
+}
 
-  memset(msg->buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-  ret = recv(fd, msg->buffer, MAX_PROFRAMEBUF_LEN, 0);
-  if (ret < 0) {
-    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
-      ret = 0;
-    } else {
-      ret = -1;
-      printf("%s[%d]: recv data failed!!!\n", __FUNCTION__, __LINE__);
+void Jt808Service::PostTask(Reactor *reactor,
+                            const std::function<void(void)> &task) {
+  uint64_t count = 1;
+
+  {
+    std::lock_guard<std::mutex> lock(reactor->mutex);
+    reactor->tasks.push_back(task);
+  }
+  write(reactor->wakeup_fd, &count, sizeof(count));
+}
+
+void Jt808Service::HandleCommandConnection(Connection *connection) {
+  char recv_buff[65536] = {0};
+  Reactor *reactor = connection->reactor;
+  int fd = connection->fd;
+
+  if (recv(fd, recv_buff, sizeof(recv_buff) - 1, 0) <= 0) {
+    CloseConnection(connection);
+    return;
+  }
+
+  EpollUnregister(reactor->epoll_fd, fd);
+  ReleaseConnection(connection);
+  ExecuteCommand(reactor, fd, recv_buff);
+}
+
+void Jt808Service::ExecuteCommand(Reactor *reactor, const int &fd,
+                                  const std::string &command) {
+  char buffer[65536] = {0};
+  std::string phone;
+  std::stringstream sstr(command);
+  DeviceNode *device;
+  Reactor *owner = nullptr;
+
+  // Commands run on the reactor serving the device, so that its socket is
+  // only ever used by one thread.
+  sstr >> phone;
+  if ((device = device_registry_.FindByPhone(phone.c_str())) != nullptr) {
+    owner = device_registry_.ReactorOf(device);
+  }
+  if ((owner != nullptr) && (owner != reactor)) {
+    PostTask(owner, [this, owner, fd, command] {
+      ExecuteCommand(owner, fd, command);
+    });
+    return;
+  }
+
+  command.copy(buffer, sizeof(buffer) - 1, 0);
+  switch (ParseCommand(reactor, fd, buffer)) {
+    case 1:  // answered when the terminal responds.
+      return;
+    case 0:
+      send(fd, buffer, strlen(buffer), MSG_NOSIGNAL);
+      break;
+    default:
+      break;
+  }
+  close(fd);
+}
+
+void Jt808Service::QueueFrameData(Connection *connection,
+                                  const Message &msg) {
+  connection->send_queue->Append(msg.buffer, msg.size);
+}
+
+int Jt808Service::FlushConnection(Connection *connection) {
+  WriteQueue *send_queue = connection->send_queue;
+  int ret = 0;
+
+  while (!send_queue->empty()) {
+    ++connection->reactor->statistics.writes;
+    if ((ret = send_queue->SendTo(connection->fd)) <= 0) {
+      break;
     }
-    msg->size = 0;
-  } else if (ret == 0) {
-    ret = -1;
-    msg->size = 0;
-    printf("%s[%d]: connection disconect!!!\n", __FUNCTION__, __LINE__);
-  } else {
-    msg->size = ret;
   }
+  if (ret < 0) {
+    return -1;
+  }
+  if (send_queue->size() > kMaxQueuedBytes) {
+    JT808_WARNING("terminal does not read!!!");
+    return -1;
+  }
+
+  // Wait for room in the socket only while something is left. In edge
+  // triggered mode EPOLLOUT stays registered, it only fires on a change.
+  if (!edge_triggered_ &&
+      (send_queue->empty() == connection->epollout_armed)) {
+    ++connection->reactor->statistics.epoll_ctls;
+    connection->epollout_armed = !send_queue->empty();
+    EpollModify(connection->reactor->epoll_fd, connection->fd, connection,
+                connection->epollout_armed ? EPOLLIN | EPOLLOUT : EPOLLIN);
+  }
+
+  return 0;
+}
+
+int Jt808Service::SendFrameData(Connection *connection, const Message &msg) {
+  QueueFrameData(connection, msg);
+  return FlushConnection(connection);
+}
+
+void Jt808Service::CloseConnection(Connection *connection) {
+  close(connection->fd);
+  ReleaseConnection(connection);
+}
+
+void Jt808Service::ReleaseConnection(Connection *connection) {
+  connection->fd = -1;
+  // Events for it may still be pending in this round, free it later.
+  std::lock_guard<std::mutex> lock(connection->reactor->mutex);
+  connection->reactor->closed_connections.push_back(connection);
+}
+
+void Jt808Service::CloseTerminalConnection(Connection *connection) {
+  if (connection->fd < 0) {
+    return;
+  }
+  if (connection->handshake_state != kHandshakeDone) {
+    connection->reactor->handshakes.erase(connection->handshake_it);
+    connection->handshake_state = kHandshakeDone;
+  }
+  // Unbind before close, the fd must not be reused while still indexed.
+  // The work of a device authenticated again elsewhere is handed over by
+  // its new connection instead.
+  if ((connection->device != nullptr) &&
+      (device_registry_.ConnectionOf(connection->device,
+                                     connection->reactor) == connection)) {
+    FailPendingCommands(connection->reactor, connection->device);
+    FailUpgrade(connection->reactor, connection->device);
+    device_registry_.UnbindConnection(connection->device, connection);
+  }
+  connection->device = nullptr;
+  CloseConnection(connection);
+}
+
+void Jt808Service::CloseDeviceConnection(DeviceNode *device) {
+  Connection *connection = device->connection;
+
+  if (connection != nullptr) {
+    CloseTerminalConnection(connection);
+  }
+}
 
-  return ret;
+void Jt808Service::ReleaseClosedConnections(Reactor *reactor) {
+  std::lock_guard<std::mutex> lock(reactor->mutex);
+  ClearContainerElement(&reactor->closed_connections);
 }
 
 size_t Jt808Service::Jt808FramePack(const uint16_t &command,
@@ -353,8 +901,7 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
   msghead_ptr->id = EndianSwap16(command);
   msghead_ptr->attribute.value = 0;
   msghead_ptr->attribute.bit.encrypt = 0;
-  message_flow_num_++;
-  msghead_ptr->msgflownum = EndianSwap16(message_flow_num_);
+  msghead_ptr->msgflownum = EndianSwap16(++message_flow_num_);
   msghead_ptr->attribute.bit.msglen = 0;
   memcpy(msghead_ptr->phone, propara.phone_num, 6);
   msghead_ptr->attribute.bit.package = 0;
@@ -363,16 +910,8 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
 
   switch (command) {
     case DOWN_UNIRESPONSE:
-      u16val = EndianSwap16(propara.respond_flow_num);
-      memcpy(msg_body, &u16val, 2);
-      msg_body += 2;
-      u16val = EndianSwap16(propara.respond_id);
-      memcpy(msg_body, &u16val, 2);
-      msg_body += 2;
-      msg_body[0] = propara.respond_result;
-      msg_body++;
-      msg->size += 5;
-      msghead_ptr->attribute.bit.msglen += 5;
+      msg_body = PackBody<UniResponseCodec>(propara, msg_body,
+                                            msghead_ptr, msg);
       break;
     case DOWN_REGISTERRESPONSE:
       u16val = EndianSwap16(propara.respond_flow_num);
@@ -467,49 +1006,11 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
       msg->size++;
       msghead_ptr->attribute.bit.msglen += 1;
       break;
-    case DOWN_UPGRADEPACKAGE:
-      if (propara.packet_total_num > 1) {
-        msghead_ptr->attribute.bit.package = 1;
-        u16val = EndianSwap16(propara.packet_total_num);
-        memcpy(&msg->buffer[13], &u16val, 2);
-        u16val = EndianSwap16(propara.packet_sequence_num);
-        memcpy(&msg->buffer[15], &u16val, 2);
-        msg_body += 4;
-        msg->size += 4;
-      }
-      msg_body[0] = propara.upgrade_type;
-      msg_body++;
-      memcpy(msg_body, propara.manufacturer_id, 5);
-      msg_body += 5;
-      msg->size += 6;
-      msg_body[0] = propara.version_num_len;
-      msg_body++;
-      msg->size++;
-      memcpy(msg_body, propara.version_num, propara.version_num_len);
-      msg_body += propara.version_num_len;
-      msg->size += propara.version_num_len;
-      u32val = EndianSwap32(propara.packet_data_len);
-      memcpy(msg_body, &u32val, 4);
-      msg_body += 4;
-      msg->size += 4;
-      // content of the upgrade file.
-      memcpy(msg_body, propara.packet_data, propara.packet_data_len);
-      msg_body += propara.packet_data_len;
-      msg->size += propara.packet_data_len;
-      msghead_ptr->attribute.bit.msglen += 11 + propara.version_num_len +
-                                          propara.packet_data_len;
-      break;
     case DOWN_GETPOSITIONINFO:
       break;
     case DOWN_POSITIONTRACK:
-      u16val = EndianSwap16(propara.report_interval);
-      memcpy(msg_body, &u16val, 2);
-      msg_body += 2;
-      u32val = EndianSwap32(propara.report_valid_time);
-      memcpy(msg_body, &u32val, 4);
-      msg_body += 4;
-      msg->size += 6;
-      msghead_ptr->attribute.bit.msglen += 6;
+      msg_body = PackBody<PositionTrackCodec>(propara, msg_body,
+                                              msghead_ptr, msg);
       break;
     case DOWN_VEHICLECONTROL:
       msg_body[0] = propara.vehicle_control_flag.value;
@@ -518,145 +1019,21 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
       msghead_ptr->attribute.bit.msglen++;
       break;
     case DOWN_SETCIRCULARAREA:
-      msg_body[0] = propara.set_area_route_type;
-      msg_body++;
-      msg_body[0] = static_cast<uint8_t>(propara.circular_area_list->size());
-      msg_body++;
-      msg->size += 2;
-      msghead_ptr->attribute.bit.msglen += 2;
-      for (auto circular_area : *propara.circular_area_list) {
-        u32val = EndianSwap32(circular_area->area_id);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u16val = EndianSwap16(circular_area->area_attribute.value);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        u32val = EndianSwap32(circular_area->center_point.latitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u32val = EndianSwap32(circular_area->center_point.longitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u32val = EndianSwap32(circular_area->radius);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        msg->size += 18;
-        msghead_ptr->attribute.bit.msglen += 18;
-        if (circular_area->area_attribute.bit.bytime) {
-          memcpy(msg_body, circular_area->start_time, 6);
-          msg_body += 6;
-          memcpy(msg_body, circular_area->end_time, 6);
-          msg_body += 6;
-          msg->size += 12;
-          msghead_ptr->attribute.bit.msglen += 12;
-        }
-        if (circular_area->area_attribute.bit.speedlimit) {
-          u16val = EndianSwap16(circular_area->max_speed);
-          memcpy(msg_body, &u16val, 2);
-          msg_body += 2;
-          *msg_body++ = circular_area->overspeed_duration;
-          msg->size += 3;
-          msghead_ptr->attribute.bit.msglen += 3;
-        }
-      }
+      msg_body = PackBody<SetCircularAreaCodec>(propara, msg_body,
+                                                msghead_ptr, msg);
       ClearContainerElement(propara.circular_area_list);
       delete propara.circular_area_list;
       break;
     case DOWN_SETRECTANGLEAREA:
-      msg_body[0] = propara.set_area_route_type;
-      msg_body++;
-      msg_body[0] = static_cast<uint8_t>(propara.rectangle_area_list->size());
-      msg_body++;
-      msg->size += 2;
-      msghead_ptr->attribute.bit.msglen += 2;
-      for (auto rectangle_area : *propara.rectangle_area_list) {
-        u32val = EndianSwap32(rectangle_area->area_id);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u16val = EndianSwap16(rectangle_area->area_attribute.value);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        u32val = EndianSwap32(rectangle_area->upper_left_corner.latitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u32val = EndianSwap32(rectangle_area->upper_left_corner.longitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u32val = EndianSwap32(rectangle_area->bottom_right_corner.latitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u32val = EndianSwap32(rectangle_area->bottom_right_corner.longitude);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        msg->size += 22;
-        msghead_ptr->attribute.bit.msglen += 12;
-        if (rectangle_area->area_attribute.bit.bytime) {
-          memcpy(msg_body, rectangle_area->start_time, 6);
-          msg_body += 6;
-          memcpy(msg_body, rectangle_area->end_time, 6);
-          msg_body += 6;
-          msg->size += 12;
-          msghead_ptr->attribute.bit.msglen += 12;
-        }
-        if (rectangle_area->area_attribute.bit.speedlimit) {
-          u16val = EndianSwap16(rectangle_area->max_speed);
-          memcpy(msg_body, &u16val, 2);
-          msg_body += 2;
-          *msg_body++ = rectangle_area->overspeed_duration;
-          msg->size += 3;
-          msghead_ptr->attribute.bit.msglen += 3;
-        }
-      }
+      msg_body = PackBody<SetRectangleAreaCodec>(propara, msg_body,
+                                                 msghead_ptr, msg);
       ClearContainerElement(propara.rectangle_area_list);
       delete propara.rectangle_area_list;
       break;
     case DOWN_SETPOLYGONALAREA:
-      msg_body[0] = propara.set_area_route_type;
-      msg_body++;
-      msg_body[0] = static_cast<uint8_t>(propara.polygonal_area_list->size());
-      msg_body++;
-      msg->size += 2;
-      msghead_ptr->attribute.bit.msglen += 2;
+      msg_body = PackBody<SetPolygonalAreaCodec>(propara, msg_body,
+                                                 msghead_ptr, msg);
       for (auto polygonal_area : *propara.polygonal_area_list) {
-        u32val = EndianSwap32(polygonal_area->area_id);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u16val = EndianSwap16(polygonal_area->area_attribute.value);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        msg->size += 6;
-        msghead_ptr->attribute.bit.msglen += 6;
-        if (polygonal_area->area_attribute.bit.bytime) {
-          memcpy(msg_body, polygonal_area->start_time, 6);
-          msg_body += 6;
-          memcpy(msg_body, polygonal_area->end_time, 6);
-          msg_body += 6;
-          msg->size += 12;
-          msghead_ptr->attribute.bit.msglen += 12;
-        }
-        if (polygonal_area->area_attribute.bit.speedlimit) {
-          u16val = EndianSwap16(polygonal_area->max_speed);
-          memcpy(msg_body, &u16val, 2);
-          msg_body += 2;
-          *msg_body++ = polygonal_area->overspeed_duration;
-          msg->size += 3;
-          msghead_ptr->attribute.bit.msglen += 3;
-        }
-        u16val = EndianSwap16(polygonal_area->coordinate_count);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        msg->size += 2;
-        msghead_ptr->attribute.bit.msglen += 2;
-        for (auto coordinate : *polygonal_area->coordinate_list) {
-          u32val = EndianSwap32(coordinate->latitude);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          u32val = EndianSwap32(coordinate->longitude);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          msg->size += 8;
-          msghead_ptr->attribute.bit.msglen += 8;
-        }
         ClearContainerElement(polygonal_area->coordinate_list);
         delete polygonal_area->coordinate_list;
       }
@@ -664,70 +1041,9 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
       delete propara.polygonal_area_list;
       break;
     case DOWN_SETROUTE:
-      msg_body[0] = propara.set_area_route_type;
-      msg_body++;
-      msg_body[0] = static_cast<uint8_t>(propara.route_list->size());
-      msg_body++;
-      msg->size += 2;
-      msghead_ptr->attribute.bit.msglen += 2;
+      msg_body = PackBody<SetRouteCodec>(propara, msg_body,
+                                         msghead_ptr, msg);
       for (auto route : *propara.route_list) {
-        u32val = EndianSwap32(route->route_id);
-        memcpy(msg_body, &u32val, 4);
-        msg_body += 4;
-        u16val = EndianSwap16(route->route_attribute.value);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        msg->size += 6;
-        msghead_ptr->attribute.bit.msglen += 6;
-        if (route->route_attribute.bit.bytime) {
-          memcpy(msg_body, route->start_time, 6);
-          msg_body += 6;
-          memcpy(msg_body, route->end_time, 6);
-          msg_body += 6;
-          msg->size += 12;
-          msghead_ptr->attribute.bit.msglen += 12;
-        }
-        u16val = EndianSwap16(route->inflection_point_count);
-        memcpy(msg_body, &u16val, 2);
-        msg_body += 2;
-        msg->size += 2;
-        msghead_ptr->attribute.bit.msglen += 2;
-        for (auto inflection_point : *route->inflection_point_list) {
-          u32val = EndianSwap32(inflection_point->inflection_point_id);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          u32val = EndianSwap32(inflection_point->road_section_id);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          u32val = EndianSwap32(inflection_point->coordinate.latitude);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          u32val = EndianSwap32(inflection_point->coordinate.longitude);
-          memcpy(msg_body, &u32val, 4);
-          msg_body += 4;
-          *msg_body++ = inflection_point->road_section_wide;
-          *msg_body++ = inflection_point->road_section_attribute.value;
-          msg->size += 18;
-          msghead_ptr->attribute.bit.msglen += 18;
-          if (inflection_point->road_section_attribute.bit.traveltime) {
-            u16val = EndianSwap16(inflection_point->max_driving_time);
-            memcpy(msg_body, &u16val, 2);
-            msg_body += 2;
-            u16val = EndianSwap16(inflection_point->min_driving_time);
-            memcpy(msg_body, &u16val, 2);
-            msg_body += 2;
-            msg->size += 4;
-            msghead_ptr->attribute.bit.msglen += 4;
-          }
-          if (inflection_point->road_section_attribute.bit.speedlimit) {
-            u16val = EndianSwap16(inflection_point->max_speed);
-            memcpy(msg_body, &u16val, 2);
-            msg_body += 2;
-            *msg_body++ = inflection_point->overspeed_duration;
-            msg->size += 3;
-            msghead_ptr->attribute.bit.msglen += 3;
-          }
-        }
         ClearContainerElement(route->inflection_point_list);
         delete route->inflection_point_list;
       }
@@ -766,15 +1082,11 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
   msg_body[0] = BccCheckSum(&msg->buffer[1], msg->size - 1);
   msg->size++;
 
-  msg->size = Escape(msg->buffer + 1, msg->size);
+  msg->size = Escape(msg->buffer + 1, msg->size - 1) + 1;
   msg->buffer[0] = PROTOCOL_SIGN;
   msg->buffer[msg->size++] = PROTOCOL_SIGN;
 
-  printf("%s[%d]: socket-send[%lu]:\n", __FUNCTION__, __LINE__, msg->size);
-  for (uint16_t i = 0; i < msg->size; ++i) {
-    printf("%02X ", msg->buffer[i]);
-  }
-  printf("\r\n");
+  JT808_TRACE_FRAME("socket-send", msg->buffer, msg->size);
 
   return msg->size;
 }
@@ -782,291 +1094,206 @@ size_t Jt808Service::Jt808FramePack(const uint16_t &command,
 uint16_t Jt808Service::Jt808FrameParse(Message *msg,
                                        ProtocolParameters *propara) {
   uint8_t *msg_body;
-  char phone_num[12] = {0};
-  uint8_t u8val;
-  uint16_t u16val;
-  uint32_t u32val;
-  MessageHead *msghead_ptr;
+  const char *name;
+  DeviceNode *device;
+  FrameView view;
+  FrameDecodeResult result;
   MessageBodyAttr msgbody_attribute;
 
-  // printf("%s[%d]: socket-recv[%lu]:\n", __FUNCTION__, __LINE__, msg.size);
-  // for (uint16_t i = 0; i < msg->size; ++i) {
-  //   printf("%02X ", msg->buffer[i]);
-  // }
-  // printf("\r\n");
+  JT808_TRACE_FRAME("socket-recv", msg->buffer, msg->size);
 
-  msg->size = ReverseEscape(&msg->buffer[1], msg->size);
-  msghead_ptr = reinterpret_cast<MessageHead *>(&msg->buffer[1]);
-  u16val = msghead_ptr->attribute.value;
-  msgbody_attribute.value = EndianSwap16(u16val);
-  if (msgbody_attribute.bit.package) {
-    msg_body = &msg->buffer[MSGBODY_PACKAGE_POS];
-  } else {
-    msg_body = &msg->buffer[MSGBODY_NOPACKAGE_POS];
+  // Corrupt frames are dropped before anything lands in |propara|.
+  result = DecodeFrame(msg, &view);
+  if (result != kFrameDecodeOk) {
+    JT808_WARNING("drop frame, %s!!!", FrameDecodeResultName(result));
+    return 0;
   }
-
-  u16val = msghead_ptr->msgflownum;
-  propara->respond_flow_num = EndianSwap16(u16val);
-  u16val = msghead_ptr->id;
-  uint16_t message_id = EndianSwap16(u16val);
+  msgbody_attribute = view.attribute;
+  msg_body = view.body;
+
+  propara->respond_flow_num = view.flow_num;
+  // |propara| lives as long as its reactor, nothing of an earlier frame
+  // may be taken for this one.
+  propara->packet_total_num = msgbody_attribute.bit.package ?
+                                  view.total_package : 0;
+  propara->packet_sequence_num = msgbody_attribute.bit.package ?
+                                     view.packet_seq : 0;
+  uint16_t message_id = view.id;
   propara->respond_id = message_id;
   switch (message_id) {
-    case UP_UNIRESPONSE:
-      memcpy(&u16val, &msg_body[2], 2);
-      propara->respond_id = EndianSwap16(u16val);
-      switch (propara->respond_id) {
-        case DOWN_UPGRADEPACKAGE:
-          printf("%s[%d]: received upgrade package respond: ",
-                 __FUNCTION__, __LINE__);
-          if (propara->packet_total_num && (msg_body[4] == kSuccess)) {
-            propara->packet_response_success_num++;
-          }
-          break;
-        case DOWN_SETTERMPARA:
-          printf("%s[%d]: received set terminal parameter respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_TERMINALCONTROL:
-          printf("%s[%d]: received terminal control respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_POSITIONTRACK:
-          printf("%s[%d]: received position track respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_SETCIRCULARAREA:
-          printf("%s[%d]: received set circular area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_DELCIRCULARAREA:
-          printf("%s[%d]: received delete circular area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_SETRECTANGLEAREA:
-          printf("%s[%d]: received set rectangle area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_DELRECTANGLEAREA:
-          printf("%s[%d]: received delete rectangle area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_SETPOLYGONALAREA:
-          printf("%s[%d]: received set polygonal area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_DELPOLYGONALAREA:
-          printf("%s[%d]: received delete polygonal area respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_SETROUTE:
-          printf("%s[%d]: received set route respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_DELROUTE:
-          printf("%s[%d]: received delete route respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        case DOWN_PASSTHROUGH:
-          printf("%s[%d]: received down passthrough respond: ",
-                 __FUNCTION__, __LINE__);
-          break;
-        default:
-          break;
+    case UP_UNIRESPONSE: {
+      GeneralResponseView response(view.body, view.body_len);
+      if (!response.valid()) {
+        return 0;
       }
-      // Respond result.
-      if (msg_body[4] == kSuccess) {
-        printf("normal\r\n");
-      } else if (msg_body[4] == kFailure) {
-        printf("failed\r\n");
-      } else if (msg_body[4] == kMessageHasWrong) {
-        printf("message has something wrong\r\n");
-      } else if (msg_body[4] == kNotSupport) {
-        printf("message not support\r\n");
+      propara->respond_id = response.id();
+      name = ResponseCommandName(propara->respond_id);
+      // Every upgrade packet is answered, keep those down to debug.
+      if (name != nullptr) {
+        JT808_LOG(propara->respond_id == DOWN_UPGRADEPACKAGE ? kLogDebug :
+                                                               kLogInfo,
+                  "received %s respond: %s", name,
+                  ResponseResultName(response.result()));
       }
       break;
+    }
     case UP_HEARTBEAT:
-      printf("%s[%d]: received heartbeat\r\n", __FUNCTION__, __LINE__);
+      JT808_DEVICE_LOG(kLogDebug, DeviceRegistry::PhoneKey(view.phone),
+                       "received heartbeat");
       break;
     case UP_REGISTER:
-      memcpy(propara->phone_num, msghead_ptr->phone, 6);
+      // Province and city ahead of the manufacturer id.
+      if (view.body_len < 4 + 5) {
+        return 0;
+      }
+      memcpy(propara->phone_num, view.phone, 6);
       propara->respond_result = kNoSuchVehicleInTheDatabase;
-      if (!device_list_.empty()) {
+      if (!device_registry_.empty()) {
         propara->respond_result = kNoSuchTerminalInTheDatabase;
-        for (auto *device : device_list_) {
-          BcdFromStringCompress(device->phone_num, phone_num,
-                                strlen(device->phone_num));
-          if (memcmp(phone_num, msghead_ptr->phone, 6) == 0) {
-            propara->respond_result = kTerminalHaveBeenRegistered;
-            if (device->socket_fd == -1) {
-              memcpy(propara->authen_code, device->authen_code, 4);
-              memcpy(propara->manufacturer_id, &msg_body[4], 5);
-              propara->respond_result = kRegisterSuccess;
-            }
-            break;
+        device = device_registry_.FindByPhone(view.phone);
+        if (device != nullptr) {
+          propara->respond_result = kTerminalHaveBeenRegistered;
+          if (!device_registry_.IsBound(device)) {
+            memcpy(propara->authen_code, device->authen_code, 4);
+            memcpy(propara->manufacturer_id, &msg_body[4], 5);
+            propara->respond_result = kRegisterSuccess;
           }
         }
       }
       break;
     case UP_AUTHENTICATION:
-      memcpy(propara->phone_num, msghead_ptr->phone, 6);
+      memcpy(propara->phone_num, view.phone, 6);
       propara->respond_result = kFailure;
-      if (!device_list_.empty()) {
-        for (auto *device : device_list_) {
-          BcdFromStringCompress(device->phone_num, phone_num,
-                                strlen(device->phone_num));
-          if (memcmp(phone_num, msghead_ptr->phone, 6) == 0) {
-            if ((memcmp(device->authen_code, msg_body,
-                    msgbody_attribute.bit.msglen) == 0)) {
-              propara->respond_result = kSuccess;
-              break;
-            }
-          }
-        }
+      device = device_registry_.FindByPhone(view.phone);
+      // Only the whole code handed out on registration authenticates.
+      if ((device != nullptr) && (view.body_len == 4) &&
+          (memcmp(device->authen_code, msg_body, 4) == 0)) {
+        propara->respond_result = kSuccess;
       }
       break;
-    case UP_GETPARARESPONSE:
-      printf("%s[%d]: received get terminal parameter respond\n",
-             __FUNCTION__, __LINE__);
+    case UP_GETPARARESPONSE: {
+      JT808_INFO("received get terminal parameter respond");
+      ParameterResponseView response(view.body, view.body_len);
+      ParameterResponseView::Parameter parameter;
       char parameter_value[256];
-      uint32_t parameter_id;
-      int parameter_count;
-      if (msgbody_attribute.bit.package) {
-        memcpy(&u16val, &msg->buffer[13], 2);
-        propara->packet_total_num = EndianSwap16(u16val);
-        memcpy(&u16val, &msg->buffer[15], 2);
-        propara->packet_sequence_num = EndianSwap16(u16val);
+      if (!response.valid()) {
+        return 0;
       }
-      parameter_count = msg_body[2];
-      msg_body += 3;
-      while (parameter_count--) {
-        memcpy(&u32val, &msg_body[0], 4);
-        parameter_id = EndianSwap32(u32val);
-        msg_body += 4;
-        u8val = msg_body[0];
-        msg_body++;
-        memset(parameter_value, 0x0, sizeof(parameter_value));
-        switch (GetParameterTypeByParameterId(parameter_id)) {
+      for (int i = 0; (i < response.count()) && response.Next(&parameter);
+           ++i) {
+        parameter_value[0] = '\0';
+        switch (GetParameterTypeByParameterId(parameter.id)) {
           case kByteType:
             snprintf(parameter_value, sizeof(parameter_value),
-                     "%u", msg_body[0]);
+                     "%u", parameter.value[0]);
             break;
           case kWordType:
-            memcpy(&u16val, &msg_body[0], u8val);
-            u16val = EndianSwap16(u16val);
-            snprintf(parameter_value, sizeof(parameter_value), "%u", u16val);
+            snprintf(parameter_value, sizeof(parameter_value), "%u",
+                     ReadBigEndian16(parameter.value));
             break;
           case kDwordType:
-            memcpy(&u32val, &msg_body[0], u8val);
-            u32val = EndianSwap32(u32val);
-            snprintf(parameter_value, sizeof(parameter_value), "%u", u32val);
+            snprintf(parameter_value, sizeof(parameter_value), "%u",
+                     ReadBigEndian32(parameter.value));
             break;
           case kStringType:
-            memcpy(parameter_value, &msg_body[0], u8val);
+            memcpy(parameter_value, parameter.value, parameter.len);
+            parameter_value[parameter.len] = '\0';
             break;
           default:
             break;
         }
-        msg_body += u8val;
         propara->terminal_parameter_map->insert(
-            std::make_pair(parameter_id, parameter_value));
+            std::make_pair(parameter.id, parameter_value));
       }
       propara->respond_result = kSuccess;
       break;
+    }
     case UP_UPGRADERESULT:
-      printf("%s[%d]: received upgrade result: ", __FUNCTION__, __LINE__);
-      if (msg_body[4] == 0x00) {
-        printf("normal\r\n");
-      } else if (msg_body[4] == 0x01) {
-        printf("failed\r\n");
-      } else if (msg_body[4] == 0x02) {
-        printf("message has something wrong\r\n");
-      } else if (msg_body[4] == 0x03) {
-        printf("message not support\r\n");
+      if (view.body_len < 5) {
+        return 0;
       }
+      JT808_INFO("received upgrade result: %s",
+                 ResponseResultName(msg_body[4]));
       propara->respond_result = kSuccess;
       break;
     case UP_GETPOSITIONINFORESPONSE:
-      printf("%s[%d]: received get position info:\n", __FUNCTION__, __LINE__);
-      ParsePositionReport(msg->buffer, msg->size, 2);
-      propara->respond_result = kSuccess;
-      break;
-    case UP_POSITIONREPORT:
-      printf("%s[%d]: received position report:\n", __FUNCTION__, __LINE__);
-      ParsePositionReport(msg->buffer, msg->size, 0);
-      propara->respond_result = kSuccess;
-      break;
     case UP_VEHICLECONTROLRESPONSE:
-      printf("%s[%d]: received vehicle control:\n", __FUNCTION__, __LINE__);
-      ParsePositionReport(msg->buffer, msg->size, 2);
+    case UP_POSITIONREPORT: {
+      // The answers lead with the flow number of the request.
+      size_t skip = (message_id == UP_POSITIONREPORT) ? 0 : 2;
+      PositionReportView report(view.body + skip,
+                                view.body_len > skip ? view.body_len - skip :
+                                                       0);
+      PositionRecord local_record;
+      PositionRecord *record = propara->position_record != nullptr ?
+                                   propara->position_record : &local_record;
+      if (!DecodePositionReport(view.phone, report, record)) {
+        return 0;
+      }
+      // Periodic reports are logged by the position pipeline.
+      if (message_id == UP_GETPOSITIONINFORESPONSE) {
+        LogPositionReport("get position info", *record, false);
+      } else if (message_id == UP_VEHICLECONTROLRESPONSE) {
+        LogPositionReport("vehicle control", *record, false);
+      }
       propara->respond_result = kSuccess;
       break;
+    }
     case UP_PASSTHROUGH:
-      printf("%s[%d]: received up passthrough\n", __FUNCTION__, __LINE__);
+      // The type byte, then at most a buffer of data.
+      if ((view.body_len < 1) ||
+          (view.body_len - 1u > sizeof(propara->pass_through->buffer))) {
+        return 0;
+      }
+      JT808_INFO("received up passthrough");
       if (propara->pass_through == nullptr) {
         propara->pass_through = new PassThrough;
         memset(propara->pass_through, 0x0, sizeof(PassThrough));
       }
       propara->pass_through->type = msg_body[0];
       msg_body++;
-      propara->pass_through->size = msgbody_attribute.bit.msglen - 1;
+      propara->pass_through->size = view.body_len - 1u;
       memcpy(propara->pass_through->buffer,
              msg_body, propara->pass_through->size);
       propara->respond_result = kSuccess;
       break;
-    case UP_CANBUSDATAUPLOAD:
-      printf("%s[%d]: received up can bus data:\n", __FUNCTION__, __LINE__);
-      if (propara->can_bus_data_list == nullptr) {
-        propara->can_bus_data_list = new std::vector<CanBusData*>;
+    case UP_CANBUSDATAUPLOAD: {
+      CanBatchView batch(view.body, view.body_len);
+      if (!batch.valid()) {
+        return 0;
       }
-      memcpy(&u16val, &msg_body[0], 2);
-      msg_body += 2;
-      u16val = EndianSwap16(u16val);
-      if (u16val > 0) {
-        uint16_t max_item_count = u16val;
-        u8val = HexFromBcd(msg_body[0]);
-        propara->can_bus_data_timestamp.hour = u8val;
-        u8val = HexFromBcd(msg_body[1]);
-        propara->can_bus_data_timestamp.minute = u8val;
-        u8val = HexFromBcd(msg_body[2]);
-        propara->can_bus_data_timestamp.second = u8val;
-        u8val = HexFromBcd(msg_body[3]);
-        u16val = u8val * 10;
-        u8val = HexFromBcd(msg_body[4]);
-        u16val += u8val;
-        propara->can_bus_data_timestamp.millisecond = u16val;
-        msg_body += 5;
-        CanBusData *item;
-        while (max_item_count--) {
-          item = new CanBusData;
-          memcpy(&(item->can_id), &msg_body[0], 4);
-          msg_body += 4;
-          memcpy(item->buffer, &msg_body[0], 8);
-          msg_body += 8;
-          propara->can_bus_data_list->push_back(item);
-        }
-        fprintf(stdout, "\tcount: %lu\n"
-                        "\ttimestamp: %02d:%02d:%02d%04d\n",
-                propara->can_bus_data_list->size(),
-                propara->can_bus_data_timestamp.hour,
-                propara->can_bus_data_timestamp.minute,
-                propara->can_bus_data_timestamp.second,
-                propara->can_bus_data_timestamp.millisecond);
-        ClearContainerElement(propara->can_bus_data_list);
-        delete propara->can_bus_data_list;
+      if (batch.count() > 0) {
+        propara->can_bus_data_timestamp.hour =
+            HexFromBcd(batch.timestamp()[0]);
+        propara->can_bus_data_timestamp.minute =
+            HexFromBcd(batch.timestamp()[1]);
+        propara->can_bus_data_timestamp.second =
+            HexFromBcd(batch.timestamp()[2]);
+        propara->can_bus_data_timestamp.millisecond = static_cast<uint16_t>(
+            HexFromBcd(batch.timestamp()[3]) * 10 +
+            HexFromBcd(batch.timestamp()[4]));
+        JT808_DEVICE_LOG(kLogInfo, DeviceRegistry::PhoneKey(view.phone),
+                         "received up can bus data:\n"
+                         "\tcount: %u\n"
+                         "\ttimestamp: %02d:%02d:%02d%04d",
+                         batch.count(),
+                         propara->can_bus_data_timestamp.hour,
+                         propara->can_bus_data_timestamp.minute,
+                         propara->can_bus_data_timestamp.second,
+                         propara->can_bus_data_timestamp.millisecond);
       }
       break;
-    case DOWN_PACKETRESEND:
-      msg_body += 2;
-      u8val = msg_body[0];
-      msg_body++;
-      for (int i = 0; i < u8val; ++i) {
-        memcpy(&u16val, &msg_body[0], 2);
-        u16val = EndianSwap16(u16val);
-        propara->packet_id_list->push_back(u16val);
-        msg_body += 2;
+    }
+    case DOWN_PACKETRESEND: {
+      PacketResendView request(view.body, view.body_len);
+      if (!request.valid()) {
+        return 0;
       }
+      JT808_INFO("received packet resend request: %zu packets",
+                 request.count());
       propara->respond_result = kSuccess;
       break;
+    }
     default:
       break;
   }
@@ -1075,8 +1302,8 @@ uint16_t Jt808Service::Jt808FrameParse(Message *msg,
 }
 
 int Jt808Service::DealGetTerminalParameterRequest(
-                      DeviceNode *device, std::vector<std::string> *va_vec) {
-  int retval = -1;
+                      DeviceNode *device, std::vector<std::string> *va_vec,
+                      PendingCommand *pending) {
   uint32_t u32val;
   uint32_t parameter_id;
   std::string arg;
@@ -1084,7 +1311,6 @@ int Jt808Service::DealGetTerminalParameterRequest(
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   PreparePhoneNum(device->phone_num, propara.phone_num);
   propara.terminal_parameter_id_count = 0;
   if (va_vec->empty()) {
@@ -1105,53 +1331,12 @@ int Jt808Service::DealGetTerminalParameterRequest(
     delete [] propara.terminal_parameter_id_buffer;
   }
 
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    if (propara.terminal_parameter_map == nullptr) {
-      propara.terminal_parameter_map = new std::map<uint32_t, std::string>;
-    }
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) == UP_GETPARARESPONSE) {
-          memset(&msg, 0x0, sizeof(msg));
-          Jt808FramePack(DOWN_UNIRESPONSE, propara, &msg);
-          if (SendFrameData(device->socket_fd, msg) < 0) {
-            close(device->socket_fd);
-            device->socket_fd = -1;
-            break;
-          }
-          if (propara.packet_total_num != propara.packet_sequence_num) {
-            continue;
-          }
-          char parameter_s[512] = {0};
-          for (auto &parameter : *propara.terminal_parameter_map) {
-            memset(parameter_s, 0x0, sizeof(parameter_s));
-            snprintf(parameter_s, sizeof(parameter_s), "%04X:%s",
-                     parameter.first, parameter.second.c_str());
-            va_vec->push_back(parameter_s);
-          }
-          reverse(va_vec->begin(), va_vec->end());
-          retval = 0;
-          break;
-        }
-      }
-    }
-  }
-  propara.terminal_parameter_map->clear();
-  delete propara.terminal_parameter_map;
-  propara.terminal_parameter_map = nullptr;
-  return retval;
+  return SendCommandFrame(pending, UP_GETPARARESPONSE, msg);
 }
 
 int Jt808Service::DealSetTerminalParameterRequest(
-                      DeviceNode *device, std::vector<std::string> *va_vec) {
+                      DeviceNode *device, std::vector<std::string> *va_vec,
+                      PendingCommand *pending) {
   int retval = 0;
   char value[256] = {0};
   uint16_t data_len = 0;
@@ -1161,7 +1346,6 @@ int Jt808Service::DealSetTerminalParameterRequest(
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   auto va_it = va_vec->begin();
   while (va_it != va_vec->end()) {
     data_len += 5 + va_it->size();
@@ -1193,19 +1377,10 @@ int Jt808Service::DealSetTerminalParameterRequest(
     }
     PreparePhoneNum(device->phone_num, propara.phone_num);
     Jt808FramePack(DOWN_SETTERMPARA, propara, &msg);
-    SendFrameData(device->socket_fd, msg);
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) &&
-            (propara.respond_id == DOWN_SETTERMPARA)) {
-          break;
-        }
-      }
+    // Every package is answered on its own.
+    if (SendCommandFrame(pending, UP_UNIRESPONSE, msg) < 0) {
+      retval = -1;
+      break;
     }
     propara.terminal_parameter_map->clear();
     if (va_vec->empty()) {
@@ -1219,7 +1394,8 @@ int Jt808Service::DealSetTerminalParameterRequest(
 }
 
 int Jt808Service::DealSetCircularAreaRequest(
-                      DeviceNode *device, std::vector<std::string> *va_vec) {
+                      DeviceNode *device, std::vector<std::string> *va_vec,
+                      PendingCommand *pending) {
   int retval = 0;
   uint32_t u32val;
   double doubleval;
@@ -1229,7 +1405,6 @@ int Jt808Service::DealSetCircularAreaRequest(
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   propara.circular_area_list = new std::vector<CircularArea*>;
   arg = va_vec->back();
   if (arg == "update") {
@@ -1291,25 +1466,12 @@ int Jt808Service::DealSetCircularAreaRequest(
 
   PreparePhoneNum(device->phone_num, propara.phone_num);
   Jt808FramePack(DOWN_SETCIRCULARAREA, propara, &msg);
-  SendFrameData(device->socket_fd, msg);
-  while (1) {
-    memset(&msg, 0x0, sizeof(msg));
-    if (RecvFrameData(device->socket_fd, &msg) < 0) {
-      close(device->socket_fd);
-      device->socket_fd = -1;
-      break;
-    } else if (msg.size > 0) {
-      if (Jt808FrameParse(&msg, &propara) &&
-          (propara.respond_id == DOWN_SETCIRCULARAREA)) {
-        break;
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealSetRectangleAreaRequest(
-                      DeviceNode *device, std::vector<std::string> *va_vec) {
+                      DeviceNode *device, std::vector<std::string> *va_vec,
+                      PendingCommand *pending) {
   int retval = 0;
   uint32_t u32val;
   double doubleval;
@@ -1319,7 +1481,6 @@ int Jt808Service::DealSetRectangleAreaRequest(
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
 
   propara.rectangle_area_list = new std::vector<RectangleArea*>;
   arg = va_vec->back();
@@ -1391,25 +1552,12 @@ int Jt808Service::DealSetRectangleAreaRequest(
 
   PreparePhoneNum(device->phone_num, propara.phone_num);
   Jt808FramePack(DOWN_SETRECTANGLEAREA, propara, &msg);
-  SendFrameData(device->socket_fd, msg);
-  while (1) {
-    memset(&msg, 0x0, sizeof(msg));
-    if (RecvFrameData(device->socket_fd, &msg) < 0) {
-      close(device->socket_fd);
-      device->socket_fd = -1;
-      break;
-    } else if (msg.size > 0) {
-      if (Jt808FrameParse(&msg, &propara) &&
-          (propara.respond_id == DOWN_SETRECTANGLEAREA)) {
-        break;
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealSetPolygonalAreaRequest(
-                      DeviceNode *device, std::vector<std::string> *va_vec) {
+                      DeviceNode *device, std::vector<std::string> *va_vec,
+                      PendingCommand *pending) {
   int retval = 0;
   uint32_t u32val;
   double doubleval;
@@ -1419,7 +1567,6 @@ int Jt808Service::DealSetPolygonalAreaRequest(
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   propara.polygonal_area_list = new std::vector<PolygonalArea*>;
   arg = va_vec->back();
   if (arg == "update") {
@@ -1488,25 +1635,12 @@ int Jt808Service::DealSetPolygonalAreaRequest(
 
   PreparePhoneNum(device->phone_num, propara.phone_num);
   Jt808FramePack(DOWN_SETPOLYGONALAREA, propara, &msg);
-  SendFrameData(device->socket_fd, msg);
-  while (1) {
-    memset(&msg, 0x0, sizeof(msg));
-    if (RecvFrameData(device->socket_fd, &msg) < 0) {
-      close(device->socket_fd);
-      device->socket_fd = -1;
-      break;
-    } else if (msg.size > 0) {
-      if (Jt808FrameParse(&msg, &propara) &&
-          (propara.respond_id == DOWN_SETPOLYGONALAREA)) {
-        break;
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealSetRouteRequest(DeviceNode *device,
-                                      std::vector<std::string> *va_vec) {
+                                      std::vector<std::string> *va_vec,
+                                      PendingCommand *pending) {
   int retval = 0;
   uint32_t u32val;
   double doubleval;
@@ -1516,7 +1650,6 @@ int Jt808Service::DealSetRouteRequest(DeviceNode *device,
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   propara.route_list = new std::vector<Route*>;
   arg = va_vec->back();
   if (arg == "update") {
@@ -1614,27 +1747,13 @@ int Jt808Service::DealSetRouteRequest(DeviceNode *device,
 
   PreparePhoneNum(device->phone_num, propara.phone_num);
   Jt808FramePack(DOWN_SETROUTE, propara, &msg);
-  SendFrameData(device->socket_fd, msg);
-  while (1) {
-    memset(&msg, 0x0, sizeof(msg));
-    if (RecvFrameData(device->socket_fd, &msg) < 0) {
-      close(device->socket_fd);
-      device->socket_fd = -1;
-      break;
-    } else if (msg.size > 0) {
-      if (Jt808FrameParse(&msg, &propara) &&
-          (propara.respond_id == DOWN_SETROUTE)) {
-        break;
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealDeleteAreaRouteRequest(DeviceNode *device,
                                              std::vector<std::string> *va_vec,
-                                             const uint16_t &command) {
-  int retval = -1;
+                                             const uint16_t &command,
+                                             PendingCommand *pending) {
   uint32_t u32val;
   uint32_t area_route_id;
   std::string arg;
@@ -1642,7 +1761,6 @@ int Jt808Service::DealDeleteAreaRouteRequest(DeviceNode *device,
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   PreparePhoneNum(device->phone_num, propara.phone_num);
   propara.area_route_id_count = 0;
   if (!va_vec->empty()) {
@@ -1661,67 +1779,28 @@ int Jt808Service::DealDeleteAreaRouteRequest(DeviceNode *device,
   Jt808FramePack(command, propara, &msg);
   delete [] propara.area_route_id_buffer;
 
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) &&
-                            (propara.respond_id == command)) {
-            retval = 0;
-            break;
-        }
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
-int Jt808Service::DealGetPositionInfoRequest(DeviceNode *device) {
-  int retval = -1;
+int Jt808Service::DealGetPositionInfoRequest(DeviceNode *device,
+                                             PendingCommand *pending) {
   ProtocolParameters propara;
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   Jt808FramePack(DOWN_GETPOSITIONINFO, propara, &msg);
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) == UP_GETPOSITIONINFORESPONSE) {
-            retval = 0;
-            break;
-        }
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_GETPOSITIONINFORESPONSE, msg);
 }
 
 int Jt808Service::DealPositionTrackRequest(DeviceNode *device,
-                                           std::vector<std::string> *va_vec) {
-  int retval = -1;
+                                           std::vector<std::string> *va_vec,
+                                           PendingCommand *pending) {
   uint32_t u32val;
   std::string arg;
   ProtocolParameters propara;
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   arg = va_vec->back();
   va_vec->pop_back();
   sscanf(arg.c_str(), "%u", &u32val);
@@ -1732,109 +1811,52 @@ int Jt808Service::DealPositionTrackRequest(DeviceNode *device,
   propara.report_valid_time = u32val;
 
   Jt808FramePack(DOWN_POSITIONTRACK, propara, &msg);
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) &&
-            (propara.respond_id == DOWN_POSITIONTRACK)) {
-            retval = 0;
-            break;
-        }
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealTerminalControlRequest(DeviceNode *device,
-                                             std::vector<std::string> *va_vec) {
-  int retval = -1;
+                                             std::vector<std::string> *va_vec,
+                                             PendingCommand *pending) {
   uint32_t u32val;
   std::string arg;
   ProtocolParameters propara;
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   arg = va_vec->back();
   va_vec->pop_back();
   sscanf(arg.c_str(), "%u", &u32val);
   propara.terminal_control_type = static_cast<uint8_t>(u32val);
 
   Jt808FramePack(DOWN_TERMINALCONTROL, propara, &msg);
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) &&
-            (propara.respond_id == DOWN_TERMINALCONTROL)) {
-            retval = 0;
-            break;
-        }
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_UNIRESPONSE, msg);
 }
 
 int Jt808Service::DealVehicleControlRequest(DeviceNode *device,
-                                            std::vector<std::string> *va_vec) {
-  int retval = -1;
+                                            std::vector<std::string> *va_vec,
+                                            PendingCommand *pending) {
   uint32_t u32val;
   std::string arg;
   ProtocolParameters propara;
   Message msg;
 
   memset(&propara, 0x0, sizeof (propara));
-  memset(&msg, 0x0, sizeof (msg));
   arg = va_vec->back();
   va_vec->pop_back();
   sscanf(arg.c_str(), "%x", &u32val);
   propara.vehicle_control_flag.value = static_cast<uint8_t>(u32val);
 
   Jt808FramePack(DOWN_VEHICLECONTROL, propara, &msg);
-  if (SendFrameData(device->socket_fd, msg) < 0) {
-    close(device->socket_fd);
-    device->socket_fd = -1;
-  } else {
-    while (1) {
-      memset(&msg, 0x0, sizeof(msg));
-      if (RecvFrameData(device->socket_fd, &msg) < 0) {
-        close(device->socket_fd);
-        device->socket_fd = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, &propara) == UP_VEHICLECONTROLRESPONSE) {
-            retval = 0;
-            break;
-        }
-      }
-    }
-  }
-  return retval;
+  return SendCommandFrame(pending, UP_VEHICLECONTROLRESPONSE, msg);
 }
 
-int Jt808Service::ParseCommand(char *buffer) {
+int Jt808Service::ParseCommand(Reactor *reactor, const int &client_fd,
+                               char *buffer) {
   int retval = 0;
   std::string arg;
-  std::string phone_num;
   std::stringstream sstr;
   std::vector<std::string> va_vec;
+  Connection *connection = nullptr;
 
   sstr.clear();
   sstr << buffer;
@@ -1853,17 +1875,16 @@ int Jt808Service::ParseCommand(char *buffer) {
 
   arg = va_vec.back();
   va_vec.pop_back();
-  if (!device_list_.empty()) {
-    auto device_it = device_list_.begin();
-    while (device_it != device_list_.end()) {
-      phone_num = (*device_it)->phone_num;
-      if (arg == phone_num) {
-        break;
-      }
-      ++device_it;
-    }
-
-    if (device_it != device_list_.end() && ((*device_it)->socket_fd > 0)) {
+  if (!device_registry_.empty()) {
+    DeviceNode *device = device_registry_.FindByPhone(arg.c_str());
+    if ((device != nullptr) && !va_vec.empty() &&
+        (va_vec.back() == "gettrack")) {
+      // Answered from history, the terminal need not be online.
+      va_vec.pop_back();
+      retval = DealGetTrackRequest(device, client_fd, &va_vec, buffer);
+    } else if ((device != nullptr) &&
+               ((connection = device_registry_.ConnectionOf(
+                                  device, reactor)) != nullptr)) {
       arg = va_vec.back();
       va_vec.pop_back();
       if (arg == "upgrade") {
@@ -1872,91 +1893,94 @@ int Jt808Service::ParseCommand(char *buffer) {
         if ((arg == "device") || (arg == "gps") ||
             (arg == "system") || (arg == "cdradio")) {
           if (arg == "device") {
-            (*device_it)->upgrade_type = 0x0;
+            device->upgrade_type = 0x0;
           } else if (arg == "gps") {
-            (*device_it)->upgrade_type = 0x34;
+            device->upgrade_type = 0x34;
           } else if (arg == "cdradio") {
-            (*device_it)->upgrade_type = 0x35;
+            device->upgrade_type = 0x35;
           } else if (arg == "system") {
-            (*device_it)->upgrade_type = 0x36;
+            device->upgrade_type = 0x36;
           } else {
             return -1;
           }
 
           arg = va_vec.back();
           va_vec.pop_back();
-          memset((*device_it)->upgrade_version,
-                 0x0, sizeof((*device_it)->upgrade_version));
-          arg.copy((*device_it)->upgrade_version, arg.length(), 0);
+          memset(device->upgrade_version, 0x0, sizeof(device->upgrade_version));
+          arg.copy(device->upgrade_version, arg.length(), 0);
           arg = va_vec.back();
           va_vec.pop_back();
-          memset((*device_it)->file_path, 0x0, sizeof((*device_it)->file_path));
-          arg.copy((*device_it)->file_path, arg.length(), 0);
-          (*device_it)->has_upgrade = true;
-          // start upgrade deal thread.
-          std::thread start_upgrade_thread(StartUpgradeThread, this);
-          start_upgrade_thread.detach();
-          memcpy(buffer, "operation completed.", 20);
-        }
-      } else if (arg == "getterminalparameter") {
-        EpollUnregister(epoll_fd_, (*device_it)->socket_fd);
-        retval = DealGetTerminalParameterRequest(*device_it, &va_vec);
-        if (retval == 0) {
-          std::string result = "terminal parameter(id:value): ";
-          while (!va_vec.empty()) {
-            result += va_vec.back();
-            va_vec.pop_back();
-            if (va_vec.empty()) {
-              break;
-            }
-            result += ",";
+          memset(device->file_path, 0x0, sizeof(device->file_path));
+          arg.copy(device->file_path, arg.length(), 0);
+          if (StartUpgrade(reactor, device)) {
+            memcpy(buffer, "operation completed.", 20);
+          } else {
+            memcpy(buffer, "operation failed!!!", 19);
           }
-          result.copy(buffer, result.size(), 0);
         }
-        EpollRegister(epoll_fd_, (*device_it)->socket_fd);
       } else {
+        PendingCommand *pending = new PendingCommand;
+        pending->client_fd = client_fd;
+        pending->device = device;
+        pending->connection = connection;
         retval = -1;
-        EpollUnregister(epoll_fd_, (*device_it)->socket_fd);
-        if (arg == "setterminalparameter") {
-          retval = DealSetTerminalParameterRequest(*device_it, &va_vec);
+        if (arg == "getterminalparameter") {
+          retval = DealGetTerminalParameterRequest(device, &va_vec, pending);
+        } else if (arg == "setterminalparameter") {
+          retval = DealSetTerminalParameterRequest(device, &va_vec, pending);
         } else if (arg == "setcirculararea") {
-          retval = DealSetCircularAreaRequest(*device_it, &va_vec);
+          retval = DealSetCircularAreaRequest(device, &va_vec, pending);
         } else if (arg == "delcirculararea") {
-          retval = DealDeleteAreaRouteRequest(*device_it, &va_vec,
-                                              DOWN_DELCIRCULARAREA);
+          retval = DealDeleteAreaRouteRequest(device, &va_vec,
+                                              DOWN_DELCIRCULARAREA, pending);
         } else if (arg == "setrectanglearea") {
-          retval = DealSetRectangleAreaRequest(*device_it, &va_vec);
+          retval = DealSetRectangleAreaRequest(device, &va_vec, pending);
         } else if (arg == "delrectanglearea") {
-          retval = DealDeleteAreaRouteRequest(*device_it, &va_vec,
-                                              DOWN_DELRECTANGLEAREA);
+          retval = DealDeleteAreaRouteRequest(device, &va_vec,
+                                              DOWN_DELRECTANGLEAREA, pending);
         } else if (arg == "setpolygonalarea") {
-          retval = DealSetPolygonalAreaRequest(*device_it, &va_vec);
+          retval = DealSetPolygonalAreaRequest(device, &va_vec, pending);
         } else if (arg == "delpolygonalarea") {
-          retval = DealDeleteAreaRouteRequest(*device_it, &va_vec,
-                                              DOWN_DELPOLYGONALAREA);
+          retval = DealDeleteAreaRouteRequest(device, &va_vec,
+                                              DOWN_DELPOLYGONALAREA, pending);
         } else if (arg == "setroute") {
-          retval = DealSetRouteRequest(*device_it, &va_vec);
+          retval = DealSetRouteRequest(device, &va_vec, pending);
         } else if (arg == "delroute") {
-          retval = DealDeleteAreaRouteRequest(*device_it, &va_vec,
-                                              DOWN_DELROUTE);
+          retval = DealDeleteAreaRouteRequest(device, &va_vec,
+                                              DOWN_DELROUTE, pending);
         } else if (arg == "getpositioninfo") {
-          retval = DealGetPositionInfoRequest(*device_it);
+          retval = DealGetPositionInfoRequest(device, pending);
         } else if (arg == "positiontrack") {
-          retval = DealPositionTrackRequest(*device_it, &va_vec);
+          retval = DealPositionTrackRequest(device, &va_vec, pending);
         } else if (arg == "terminalcontrol") {
-          retval = DealTerminalControlRequest(*device_it, &va_vec);
+          retval = DealTerminalControlRequest(device, &va_vec, pending);
         } else if (arg == "vehiclecontrol") {
-          retval = DealVehicleControlRequest(*device_it, &va_vec);
+          retval = DealVehicleControlRequest(device, &va_vec, pending);
+        }
+        if ((retval == 0) && !pending->flow_nums.empty() &&
+            (connection->fd >= 0)) {
+          // Answered from the event loop once the terminal responds.
+          pending->outstanding = pending->flow_nums.size();
+          for (auto &flow_num : pending->flow_nums) {
+            reactor->pending_commands[std::make_pair(device, flow_num)] =
+                pending;
+          }
+          pending->deadline = std::chrono::steady_clock::now() +
+                              std::chrono::seconds(kCommandTimeout);
+          pending->timeout_it = reactor->pending_timeouts.insert(
+                                    reactor->pending_timeouts.end(), pending);
+          va_vec.clear();
+          return 1;
         }
+        delete pending;
         if (retval == 0) {
           memcpy(buffer, "operation completed.", 20);
         } else {
           retval = 0;
           memcpy(buffer, "operation failed!!!", 19);
         }
-        EpollRegister(epoll_fd_, (*device_it)->socket_fd);
       }
-    } else if (device_it != device_list_.end()) {
+    } else if (device != nullptr) {
       memcpy(buffer, "device has not connect!!!\n", 25);
     } else {
       memcpy(buffer, "has not such device!!!\n", 22);
@@ -1967,152 +1991,556 @@ int Jt808Service::ParseCommand(char *buffer) {
   return retval;
 }
 
-bool Jt808Service::CheckPacketComplete(int *sock, ProtocolParameters *propara) {
-  Message msg;
-  if ((*propara).packet_total_num &&
-      ((*propara).packet_total_num ==
-       (*propara).packet_response_success_num)) {
-    return true;
-  } else {
-    while (1) {
-      if (RecvFrameData(*sock, &msg) < 0) {
-        close(*sock);
-        *sock = -1;
-        break;
-      } else if (msg.size > 0) {
-        if (Jt808FrameParse(&msg, propara) == DOWN_PACKETRESEND) {
-          memset(msg.buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-          Jt808FramePack(DOWN_UNIRESPONSE, *propara, &msg);
-          if (SendFrameData(*sock, msg) < 0) {
-            close(*sock);
-            *sock = -1;
-          }
-          break;
+int Jt808Service::DealGetTrackRequest(const DeviceNode *device,
+                                      const int &client_fd,
+                                      std::vector<std::string> *va_vec,
+                                      char *buffer) {
+  char time[6] = {0};
+  uint32_t range[2];
+
+  for (auto &value : range) {
+    if (va_vec->empty() || (va_vec->back().length() != 12)) {
+      memcpy(buffer, "operation failed!!!", 19);
+      return 0;
+    }
+    BcdFromStringCompress(va_vec->back().c_str(), time, 12);
+    va_vec->pop_back();
+    value = TrackArchive::TimeFromBcd(reinterpret_cast<uint8_t *>(time));
+  }
+  if ((archive_directory_ == nullptr) || (range[0] == 0) ||
+      (range[1] < range[0])) {
+    memcpy(buffer, "operation failed!!!", 19);
+    return 0;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(track_mutex_);
+    if (track_queries_.size() < kMaxTrackQueries) {
+      track_queries_.push_back({device, client_fd, range[0], range[1]});
+      track_cond_.notify_one();
+      return 1;
+    }
+  }
+  JT808_WARNING("too many track queries!!!");
+  memcpy(buffer, "operation failed!!!", 19);
+  return 0;
+}
+
+void Jt808Service::StreamTrack(const DeviceNode *device,
+                               const int &client_fd, const uint32_t &from,
+                               const uint32_t &to) {
+  std::string chunk = "track(time,latitude,longitude,altitude,speed,"
+                      "bearing,alarm,status):\n";
+  char line[128] = {0};
+  bool connected = true;
+  uint64_t points;
+  struct tm tm;
+  time_t local;
+
+  chunk.reserve(kTrackChunkSize + sizeof(line));
+  points = TrackArchive::Query(
+      archive_directory_, device->phone_bcd, from, to,
+      [&](const TrackColumns &columns, const size_t &begin,
+          const size_t &end) {
+        // Given up when the service stops.
+        if (!running_) {
+          connected = false;
+          return false;
         }
-      }
-      if (*sock == -1) break;
-      auto packet_id_it = (*propara).packet_id_list->begin();
-      for (auto packet : *(*propara).packet_map) {
-        if (packet_id_it == (*propara).packet_id_list->end()) break;
-        if (packet.first == *packet_id_it) {
-          if (SendFrameData(*sock, packet.second) < 0) {
-            close(*sock);
-            *sock = -1;
-            break;
-          } else {
-            while (1) {
-              if (RecvFrameData(*sock, &msg) < 0) {
-                close(*sock);
-                *sock = -1;
-                break;
-              } else if (msg.size > 0) {
-                if ((Jt808FrameParse(&msg, propara) == UP_UNIRESPONSE) &&
-                    ((*propara).respond_id == DOWN_UPGRADEPACKAGE)) {
-                  break;
-                }
-              }
+        for (size_t i = begin; i < end; ++i) {
+          // Times are shown in GMT+8 like the terminal reports them.
+          local = static_cast<time_t>(columns.time[i]) + 8 * 3600;
+          gmtime_r(&local, &tm);
+          snprintf(line, sizeof(line),
+                   "%02d%02d%02d%02d%02d%02d,%u.%06u,%u.%06u,%u,%u.%u,%u,"
+                   "%08X,%08X\n", tm.tm_year % 100, tm.tm_mon + 1,
+                   tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                   columns.latitude[i] / 1000000,
+                   columns.latitude[i] % 1000000,
+                   columns.longitude[i] / 1000000,
+                   columns.longitude[i] % 1000000, columns.altitude[i],
+                   columns.speed[i] / 10, columns.speed[i] % 10,
+                   columns.bearing[i], columns.alarm[i], columns.status[i]);
+          chunk += line;
+          if (chunk.size() >= kTrackChunkSize) {
+            connected = SendChunk(client_fd, chunk);
+            chunk.clear();
+            if (!connected) {
+              return false;
             }
-            if (*sock == -1) break;
           }
-          packet_id_it = (*propara).packet_id_list->erase(packet_id_it);
         }
+        return true;
+      });
+  if (connected) {
+    snprintf(line, sizeof(line), "operation completed, %" PRIu64 " points.",
+             points);
+    chunk += line;
+    SendChunk(client_fd, chunk);
+  }
+  close(client_fd);
+}
+
+void Jt808Service::RunTrackQueries(void) {
+  TrackQuery query;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(track_mutex_);
+      track_cond_.wait(lock, [this] {
+        return !running_ || !track_queries_.empty();
+      });
+      if (!running_) {
+        return;
       }
-      if (*sock == -1) break;
+      query = track_queries_.front();
+      track_queries_.pop_front();
     }
+    StreamTrack(query.device, query.client_fd, query.from, query.to);
   }
-  return false;
 }
 
-void Jt808Service::UpgradeHandler(void) {
-  Message msg;
-  ProtocolParameters propara;
-  std::ifstream ifs;
-  char *data = nullptr;
-
-  size_t max_data_len;
-
-  if (!device_list_.empty()) {
-    for (auto *device : device_list_) {
-      if (device->has_upgrade) {
-        device->has_upgrade = false;
-        memset(&propara, 0x0, sizeof(propara));
-        memcpy(propara.version_num, device->upgrade_version,
-               strlen(device->upgrade_version));
-        max_data_len = 1023 - 11 - strlen(device->upgrade_version);
-        EpollUnregister(epoll_fd_, device->socket_fd);
-        ifs.open(device->file_path, std::ios::binary | std::ios::in);
-        if (ifs.is_open()) {
-          ifs.seekg(0, std::ios::end);
-          auto count = ifs.tellg();
-          ifs.seekg(0, std::ios::beg);
-          data = new char[count];
-          ifs.read(data, count);
-          ifs.close();
-          size_t len = static_cast<size_t>(count);
-          propara.packet_total_num =
-              static_cast<uint16_t>(len/max_data_len + 1);
-          propara.packet_sequence_num = 1;
-          propara.upgrade_type = static_cast<uint8_t>(device->upgrade_type);
-          propara.version_num_len = static_cast<uint8_t>(
-                                        strlen(device->upgrade_version));
-          propara.packet_map = new std::map<uint16_t, Message>;
-          propara.packet_id_list = new std::list<uint16_t>;
-          while (len > 0) {
-            memset(msg.buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-            if (len > max_data_len) {
-              propara.packet_data_len = static_cast<uint16_t>(max_data_len);
-            } else {
-              propara.packet_data_len = static_cast<uint16_t>(len);
-            }
-            len -= propara.packet_data_len;
-            // prepare data content of the upgrade file.
-            memset(propara.packet_data, 0x0, sizeof(propara.packet_data));
-            memcpy(propara.packet_data,
-                   data + max_data_len * (propara.packet_sequence_num - 1),
-                   propara.packet_data_len);
-            Jt808FramePack(DOWN_UPGRADEPACKAGE, propara, &msg);
-            propara.packet_map->insert(
-                std::make_pair(propara.packet_sequence_num, msg));
-            if (SendFrameData(device->socket_fd, msg) < 0) {
-              close(device->socket_fd);
-              device->socket_fd = -1;
-              break;
-            } else {
-              while (1) {
-                if (RecvFrameData(device->socket_fd, &msg) < 0) {
-                  close(device->socket_fd);
-                  device->socket_fd = -1;
-                  break;
-                } else if (msg.size > 0) {
-                  if ((Jt808FrameParse(&msg, &propara) == UP_UNIRESPONSE) &&
-                      (propara.respond_id == DOWN_UPGRADEPACKAGE)) {
-                    break;
-                  }
-                }
-              }
-              if (device->socket_fd == -1) {
-                break;
-              }
-              ++propara.packet_sequence_num;
-              usleep(1000);
-            }
-          }
-          while (!CheckPacketComplete(&device->socket_fd, &propara)) {
-            if (device->socket_fd < 0) break;
-          }
-          if (device->socket_fd > 0) {
-            EpollRegister(epoll_fd_, device->socket_fd);
-          }
-          propara.packet_id_list->clear();
-          propara.packet_map->clear();
-          delete propara.packet_id_list;
-          delete propara.packet_map;
-          delete [] data;
-          data = nullptr;
-        }
-        break;
+int Jt808Service::SendCommandFrame(PendingCommand *pending,
+                                   const uint16_t &response_id,
+                                   const Message &msg) {
+  MessageHead head = FrameHead(msg);
+
+  if (SendFrameData(pending->connection, msg) < 0) {
+    CloseTerminalConnection(pending->connection);
+    return -1;
+  }
+  if (pending->flow_nums.empty()) {
+    pending->request_id = EndianSwap16(head.id);
+  }
+  pending->response_id = response_id;
+  pending->flow_nums.push_back(EndianSwap16(head.msgflownum));
+  return 0;
+}
+
+void Jt808Service::CompletePendingCommand(Connection *connection,
+                                          const uint16_t &command,
+                                          const Message &msg,
+                                          const ProtocolParameters &propara) {
+  Reactor *reactor = connection->reactor;
+  PendingCommand *pending;
+  MessageBodyAttr msgbody_attribute;
+  uint16_t u16val;
+  uint16_t total;
+  size_t pos;
+
+  if (reactor->pending_commands.empty()) {
+    return;
+  }
+
+  // Every answer starts with the flow number of the downlink frame.
+  memcpy(&u16val, &msg.buffer[3], 2);
+  msgbody_attribute.value = EndianSwap16(u16val);
+  pos = msgbody_attribute.bit.package ? MSGBODY_PACKAGE_POS :
+                                        MSGBODY_NOPACKAGE_POS;
+  memcpy(&u16val, &msg.buffer[pos], 2);
+  auto pending_it = reactor->pending_commands.find(
+                        std::make_pair(connection->device,
+                                       EndianSwap16(u16val)));
+  if ((pending_it == reactor->pending_commands.end()) ||
+      (pending_it->second->response_id != command)) {
+    return;
+  }
+
+  pending = pending_it->second;
+  if (command == UP_GETPARARESPONSE) {
+    pending->terminal_parameters.insert(
+        propara.terminal_parameter_map->begin(),
+        propara.terminal_parameter_map->end());
+    // The last package of a multi-package answer completes it.
+    if (msgbody_attribute.bit.package) {
+      memcpy(&u16val, &msg.buffer[13], 2);
+      total = EndianSwap16(u16val);
+      memcpy(&u16val, &msg.buffer[15], 2);
+      if (total != EndianSwap16(u16val)) {
+        return;
+      }
+    }
+  }
+  reactor->pending_commands.erase(pending_it);
+  if (--pending->outstanding == 0) {
+    FinishPendingCommand(reactor, pending, true);
+  }
+}
+
+void Jt808Service::FinishPendingCommand(Reactor *reactor,
+                                        PendingCommand *pending,
+                                        const bool &success) {
+  std::string result = "operation failed!!!";
+  char parameter_s[512] = {0};
+
+  for (auto &flow_num : pending->flow_nums) {
+    auto pending_it = reactor->pending_commands.find(
+                          std::make_pair(pending->device, flow_num));
+    if ((pending_it != reactor->pending_commands.end()) &&
+        (pending_it->second == pending)) {
+      reactor->pending_commands.erase(pending_it);
+    }
+  }
+  reactor->pending_timeouts.erase(pending->timeout_it);
+
+  if (success && ((pending->request_id == DOWN_GETTERMPARA) ||
+                  (pending->request_id == DOWN_GETSPECTERMPARA))) {
+    result = "terminal parameter(id:value): ";
+    for (auto &parameter : pending->terminal_parameters) {
+      if (parameter.first != pending->terminal_parameters.begin()->first) {
+        result += ",";
       }
+      memset(parameter_s, 0x0, sizeof(parameter_s));
+      snprintf(parameter_s, sizeof(parameter_s), "%04X:%s",
+               parameter.first, parameter.second.c_str());
+      result += parameter_s;
+    }
+  } else if (success) {
+    result = "operation completed.";
+  }
+
+  send(pending->client_fd, result.c_str(), result.size(), MSG_NOSIGNAL);
+  close(pending->client_fd);
+  delete pending;
+}
+
+void Jt808Service::FailPendingCommands(Reactor *reactor,
+                                       const DeviceNode *device) {
+  auto pending_it = reactor->pending_commands.lower_bound(
+                        std::make_pair(device, static_cast<uint16_t>(0)));
+  while ((pending_it != reactor->pending_commands.end()) &&
+         (pending_it->first.first == device)) {
+    FinishPendingCommand(reactor, pending_it->second, false);
+    pending_it = reactor->pending_commands.lower_bound(
+                     std::make_pair(device, static_cast<uint16_t>(0)));
+  }
+}
+
+void Jt808Service::ExpirePendingCommands(Reactor *reactor) {
+  auto now = std::chrono::steady_clock::now();
+
+  // Same timeout for all, so the list is ordered by deadline.
+  while (!reactor->pending_timeouts.empty() &&
+         (reactor->pending_timeouts.front()->deadline <= now)) {
+    JT808_WARNING("command time out!!!");
+    FinishPendingCommand(reactor, reactor->pending_timeouts.front(), false);
+  }
+}
+
+bool Jt808Service::StartUpgrade(Reactor *reactor, DeviceNode *device) {
+  // Test and set in one step, the reactor ending an earlier upgrade of the
+  // device may release it meanwhile.
+  if ((device_registry_.ConnectionOf(device, reactor) == nullptr) ||
+      device->upgrading.exchange(true)) {
+    return false;
+  }
+  if (!AdmitUpgrade(reactor, device)) {
+    device->upgrading = false;
+    return false;
+  }
+  return true;
+}
+
+bool Jt808Service::AdmitUpgrade(Reactor *reactor, DeviceNode *device) {
+  UpgradeRequest request;
+
+  request.device = device;
+  request.image = upgrade_campaign_.Image(
+                      device->file_path,
+                      static_cast<uint8_t>(device->upgrade_type),
+                      device->upgrade_version);
+  if (request.image == nullptr) {
+    JT808_ERROR("load upgrade file %s failed!!!", device->file_path);
+    return false;
+  }
+  if (!upgrade_campaign_.Admit(request)) {
+    JT808_INFO("upgrade %s to version %s queued, %zu waiting",
+               device->phone_num, device->upgrade_version,
+               upgrade_campaign_.queued());
+    return true;
+  }
+  RunUpgrade(reactor, request);
+  return true;
+}
+
+void Jt808Service::RunUpgrade(Reactor *reactor,
+                              const UpgradeRequest &request) {
+  DeviceNode *device = request.device;
+  size_t window = std::min(upgrade_window_,
+                           kMaxQueuedBytes / MAX_PROFRAMEBUF_LEN);
+  UpgradeProgress progress;
+  UpgradeSession *session;
+
+  // Disconnected while queued.
+  if (device_registry_.ConnectionOf(device, reactor) == nullptr) {
+    device->upgrading = false;
+    StartQueuedUpgrade(upgrade_campaign_.Release(device));
+    return;
+  }
+  session = new UpgradeSession(device, request.image, window);
+  // Saved progress only counts for the very same image.
+  if (upgrade_progress_.is_open() &&
+      upgrade_progress_.Load(device->phone_num, &progress) &&
+      (progress.type == request.image->type()) &&
+      (progress.version == request.image->version()) &&
+      (progress.size == request.image->size()) &&
+      (progress.hash == request.image->hash())) {
+    session->Restore(progress.acked);
+  }
+  JT808_INFO("upgrade %s to version %s, %u packets, %u done before",
+             device->phone_num, request.image->version().c_str(),
+             session->chunk_count(), session->acked_count());
+  reactor->upgrades[device] = session;
+  PumpUpgrade(reactor, session);
+}
+
+void Jt808Service::ResumeUpgrade(Reactor *reactor, DeviceNode *device) {
+  UpgradeProgress progress;
+
+  if (!upgrade_progress_.is_open() ||
+      (device_registry_.ConnectionOf(device, reactor) == nullptr) ||
+      device->upgrading.exchange(true)) {
+    return;
+  }
+  if (!upgrade_progress_.Load(device->phone_num, &progress) ||
+      (progress.version.size() >= sizeof(device->upgrade_version)) ||
+      (progress.path.size() >= sizeof(device->file_path))) {
+    device->upgrading = false;
+    return;
+  }
+  device->upgrade_type = static_cast<char>(progress.type);
+  memset(device->upgrade_version, 0x0, sizeof(device->upgrade_version));
+  progress.version.copy(device->upgrade_version, progress.version.size());
+  memset(device->file_path, 0x0, sizeof(device->file_path));
+  progress.path.copy(device->file_path, progress.path.size());
+  JT808_INFO("resume upgrade %s to version %s", device->phone_num,
+             device->upgrade_version);
+  if (!AdmitUpgrade(reactor, device)) {
+    device->upgrading = false;
+    upgrade_progress_.Remove(device->phone_num);
+  }
+}
+
+void Jt808Service::HandOverDevice(Reactor *reactor, DeviceNode *device) {
+  auto it = reactor->upgrades.find(device);
+  Reactor *owner;
+
+  FailPendingCommands(reactor, device);
+  // The progress saved here is picked up on the new connection. A queued
+  // upgrade is run there once admitted.
+  if (it != reactor->upgrades.end()) {
+    FinishUpgrade(reactor, it->second, false);
+  }
+  if ((owner = device_registry_.ReactorOf(device)) == reactor) {
+    ResumeUpgrade(reactor, device);
+  } else if (owner != nullptr) {
+    PostTask(owner, [this, owner, device] {
+      ResumeUpgrade(owner, device);
+    });
+  }
+}
+
+void Jt808Service::SaveUpgradeProgress(const UpgradeSession *session) {
+  const UpgradeImage *image = session->image();
+  UpgradeProgress progress;
+
+  if (!upgrade_progress_.is_open()) {
+    return;
+  }
+  progress.type = image->type();
+  progress.version = image->version();
+  progress.path = image->path();
+  progress.size = image->size();
+  progress.hash = image->hash();
+  progress.acked = session->acked();
+  upgrade_progress_.Save(session->device()->phone_num, progress);
+}
+
+void Jt808Service::StartQueuedUpgrade(UpgradeRequest request) {
+  Reactor *owner;
+
+  while (request.device != nullptr) {
+    if ((owner = device_registry_.ReactorOf(request.device)) != nullptr) {
+      PostTask(owner, [this, owner, request] {
+        RunUpgrade(owner, request);
+      });
+      return;
+    }
+    request.device->upgrading = false;
+    request = upgrade_campaign_.Release(request.device);
+  }
+}
+
+void Jt808Service::PumpUpgrade(Reactor *reactor, UpgradeSession *session) {
+  DeviceNode *device = session->device();
+  const UpgradeImage *image = session->image();
+  Connection *connection = device_registry_.ConnectionOf(device, reactor);
+  Message msg;
+  uint16_t sequence;
+  uint16_t flow_num;
+  int count = 0;
+
+  // Authenticated again elsewhere, the session is being handed over.
+  if (connection == nullptr) {
+    return;
+  }
+
+  // Everything the window and the bandwidth allow goes out in one flush.
+  while (upgrade_campaign_.HasBandwidth() &&
+         ((sequence = session->NextChunk()) != 0)) {
+    flow_num = ++message_flow_num_;
+    image->PackChunk(sequence, device->phone_bcd, flow_num, &msg);
+    session->OnSent(sequence, flow_num);
+    upgrade_campaign_.Consume(msg.size);
+    QueueFrameData(connection, msg);
+    ++count;
+  }
+  if ((count > 0) && (FlushConnection(connection) < 0)) {
+    // Fails the upgrade as well.
+    CloseTerminalConnection(connection);
+  }
+}
+
+bool Jt808Service::ResendUpgradeChunks(Reactor *reactor,
+                                       UpgradeSession *session) {
+  DeviceNode *device = session->device();
+  const UpgradeImage *image = session->image();
+  Connection *connection = device_registry_.ConnectionOf(device, reactor);
+  WriteQueue *send_queue;
+  uint16_t sequences[UINT8_MAX];
+  uint16_t flow_num;
+  uint8_t *frames;
+  size_t count;
+  size_t len = 0;
+
+  if (connection == nullptr) {
+    return true;
+  }
+  send_queue = connection->send_queue;
+  if (!upgrade_campaign_.HasBandwidth() ||
+      (send_queue->size() >= kMaxQueuedBytes)) {
+    return true;
+  }
+  // As many as surely fit in the queue, the rest follow in the window.
+  count = std::min(static_cast<size_t>(UINT8_MAX),
+                   (kMaxQueuedBytes - send_queue->size()) /
+                       MAX_PROFRAMEBUF_LEN);
+  if ((count = session->TakeResend(sequences, count)) == 0) {
+    return true;
+  }
+
+  // Packed back to back into one buffer, the batch goes out with as few
+  // writes as the socket takes. It may overdraw the bandwidth once.
+  frames = send_queue->Reserve(count * MAX_PROFRAMEBUF_LEN);
+  for (size_t i = 0; i < count; ++i) {
+    flow_num = ++message_flow_num_;
+    len += image->PackChunk(sequences[i], device->phone_bcd, flow_num,
+                            frames + len);
+    session->OnSent(sequences[i], flow_num);
+  }
+  send_queue->Commit(len);
+  upgrade_campaign_.Consume(len);
+  if (FlushConnection(connection) < 0) {
+    CloseTerminalConnection(connection);
+    return false;
+  }
+  return true;
+}
+
+void Jt808Service::HandleUpgradeResponse(Connection *connection,
+                                         const Message &msg) {
+  Reactor *reactor = connection->reactor;
+  const uint8_t *body;
+  size_t len;
+
+  auto it = reactor->upgrades.find(connection->device);
+  if (it == reactor->upgrades.end()) {
+    return;
+  }
+  body = FrameBody(msg, &len);
+  GeneralResponseView response(body, len);
+  if (!response.valid()) {
+    return;
+  }
+  if (!it->second->OnAnswer(response.flow_num(),
+                            response.result() == kSuccess)) {
+    return;
+  }
+  if (it->second->complete()) {
+    FinishUpgrade(reactor, it->second, true);
+    return;
+  }
+  if ((response.result() == kSuccess) &&
+      (it->second->acked_count() % kUpgradeSaveChunks == 0)) {
+    SaveUpgradeProgress(it->second);
+  }
+  PumpUpgrade(reactor, it->second);
+}
+
+void Jt808Service::FinishUpgrade(Reactor *reactor, UpgradeSession *session,
+                                 const bool &success) {
+  UpgradeStatistics statistics = session->statistics();
+  DeviceNode *device = session->device();
+  // Chunks resumed from an earlier connection were not sent this time.
+  double sent_bytes = static_cast<double>(statistics.bytes) *
+                      statistics.sent / statistics.chunks;
+
+  JT808_INFO("upgrade %s %s: %" PRIu64 " bytes, %u packets, %u resumed, "
+             "%u retransmitted, %" PRIu64 " ms, %.1f KB/s", device->phone_num,
+             success ? "completed" : "failed", statistics.bytes,
+             statistics.chunks, statistics.resumed,
+             statistics.retransmitted, statistics.elapsed_ms,
+             statistics.elapsed_ms > 0 ?
+                 sent_bytes / 1.024 / statistics.elapsed_ms : 0.0);
+  if (success) {
+    upgrade_progress_.Remove(device->phone_num);
+  } else {
+    SaveUpgradeProgress(session);
+  }
+  reactor->upgrades.erase(device);
+  device->upgrading = false;
+  delete session;
+  StartQueuedUpgrade(upgrade_campaign_.Release(device));
+}
+
+void Jt808Service::FailUpgrade(Reactor *reactor, DeviceNode *device) {
+  auto it = reactor->upgrades.find(device);
+
+  if (it != reactor->upgrades.end()) {
+    FinishUpgrade(reactor, it->second, false);
+  } else if (device->upgrading) {
+    // Still waiting its turn.
+    device->upgrading = false;
+    StartQueuedUpgrade(upgrade_campaign_.Release(device));
+  }
+}
+
+void Jt808Service::ExpireUpgrades(Reactor *reactor) {
+  auto now = std::chrono::steady_clock::now();
+  UpgradeSession *session;
+
+  for (auto it = reactor->upgrades.begin(); it != reactor->upgrades.end(); ) {
+    session = (it++)->second;
+    if (now - session->last_progress() >=
+        std::chrono::seconds(kUpgradeTimeout)) {
+      JT808_WARNING("upgrade time out!!!");
+      FinishUpgrade(reactor, session, false);
+    }
+  }
+}
+
+void Jt808Service::ResumeUpgrades(Reactor *reactor) {
+  auto it = reactor->upgrades.upper_bound(reactor->upgrade_cursor);
+  UpgradeSession *session;
+
+  for (size_t i = reactor->upgrades.size();
+       (i > 0) && upgrade_campaign_.HasBandwidth(); --i) {
+    if (it == reactor->upgrades.end()) {
+      it = reactor->upgrades.begin();
     }
+    reactor->upgrade_cursor = it->first;
+    session = (it++)->second;
+    PumpUpgrade(reactor, session);
   }
 }
 
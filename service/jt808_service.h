@@ -16,14 +16,30 @@
 #define JT808_SERVICE_JT808_SERVICE_H_
 
 #include <sys/epoll.h>
+#include <netinet/in.h>
 #include <string.h>
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
 #include <list>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "common/jt808_util.h"
+#include "service/jt808_connection.h"
+#include "service/jt808_device_registry.h"
+#include "service/jt808_pending_command.h"
+#include "service/jt808_position_pipeline.h"
 #include "service/jt808_protocol.h"
+#include "service/jt808_reactor.h"
+#include "service/jt808_track_archive.h"
+#include "service/jt808_track_store.h"
+#include "service/jt808_upgrade_campaign.h"
+#include "service/jt808_upgrade_progress.h"
 #include "service/jt808_util.h"
 
 class Jt808Service {
@@ -33,72 +49,277 @@ class Jt808Service {
   Jt808Service& operator=(const Jt808Service&) = delete;
   virtual ~Jt808Service();
 
+  // Number of event loops, each one accepts on its own SO_REUSEPORT
+  // listener. Must be set before Init, default is 1.
+  void set_worker_count(const int &count) {
+    worker_count_ = count > 0 ? count : 1;
+  }
+  // Register terminals edge-triggered and drain them on every wakeup.
+  // Must be set before Init, default is level-triggered.
+  void set_edge_triggered(const bool &edge_triggered) {
+    edge_triggered_ = edge_triggered;
+  }
+  void set_devices_file_path(const char *path) { devices_file_path_ = path; }
+  void set_command_interface_path(const char *path) {
+    command_interface_path_ = path;
+  }
+  // Log the position reports of all devices under |directory| in arrival
+  // order. Must be set before Init, default is not to record them.
+  void set_track_directory(const char *directory) {
+    track_directory_ = directory;
+  }
+  // Archive positions per device and day under |directory|. Must be set
+  // before Init, default is not to archive them.
+  void set_archive_directory(const char *directory) {
+    archive_directory_ = directory;
+  }
+  // Upgrade package frames a terminal may leave unanswered at once, at
+  // most what fits in kMaxQueuedBytes.
+  void set_upgrade_window(const size_t &window) { upgrade_window_ = window; }
+  // Keep the progress of upgrades under |directory|, so that they go on
+  // where they stopped when the terminal authenticates again. Must be set
+  // before Init, default is to start over.
+  void set_upgrade_progress_directory(const char *directory) {
+    upgrade_progress_directory_ = directory;
+  }
+  // Devices upgrading at once, the others wait their turn. 0, the default,
+  // for no limit.
+  void set_max_concurrent_upgrades(const size_t &count) {
+    upgrade_campaign_.set_max_concurrent(count);
+  }
+  // Bytes per second of upgrade package frames over all devices. 0, the
+  // default, for no limit.
+  void set_upgrade_bandwidth(const uint64_t &bandwidth) {
+    upgrade_campaign_.set_bandwidth(bandwidth);
+  }
+
   // Init service.
   bool Init(const uint16_t &port, const int &max_count);
   bool Init(const char *ip, const uint16_t &port, const int &max_count);
-  int AcceptNewClient(void);
+  // Accept a terminal, its handshake is then driven by its events.
+  int AcceptNewClient(Reactor *reactor);
+  // Deal a frame of a terminal not authenticated yet.
+  void HandleHandshakeFrame(Connection *connection, Message *msg);
+  // Add the uplink handlers to the dispatcher of |reactor|, a handler is
+  // called with the frame already parsed into |propara|.
+  void RegisterMessageHandlers(Reactor *reactor);
+  // Match an answer of a terminal against its pending commands.
+  void HandleCommandResponse(Connection *connection, const uint16_t &id,
+                             Message *msg, ProtocolParameters *propara);
+  // Acknowledge with a general response.
+  void HandleAcknowledgedMessage(Connection *connection, const uint16_t &id,
+                                 Message *msg, ProtocolParameters *propara);
+  // Match every package of a parameter answer and acknowledge it.
+  void HandleParameterResponse(Connection *connection, const uint16_t &id,
+                               Message *msg, ProtocolParameters *propara);
+  // Acknowledge a position report and queue its record for processing.
+  void HandlePositionReport(Connection *connection, const uint16_t &id,
+                            Message *msg, ProtocolParameters *propara);
+  // Acknowledge a resend request and send the chunks asked for again.
+  void HandlePacketResend(Connection *connection, const uint16_t &id,
+                          Message *msg, ProtocolParameters *propara);
+  // Close terminals not authenticated within |kHandshakeTimeout|.
+  void ExpireHandshakes(Reactor *reactor);
 
   // Accept when command client connect.
-  int AcceptNewCommandClient(void);
+  int AcceptNewCommandClient(Reactor *reactor);
 
-  int Jt808ServiceWait(const int &time_out);
+  int Jt808ServiceWait(Reactor *reactor, const int &time_out);
+  // Run worker reactors on their own threads and the first one on the
+  // calling thread, return after Stop.
   void Run(const int &time_out);
+  void RunReactor(Reactor *reactor, const int &time_out);
+  void Stop(void);
+  // Counters summed over all reactors, exact once Run has returned.
+  ReactorStatistics statistics(void) const;
+  MessageStatistics message_statistics(const uint16_t &id) const;
+  // Position reports are processed off the reactors, add stages after Init
+  // and before Run.
+  PositionPipeline *position_pipeline(void) { return &position_pipeline_; }
+  // Run |task| on the thread of |reactor|.
+  void PostTask(Reactor *reactor, const std::function<void(void)> &task);
+  // Parse and answer a control command on the reactor owning the device.
+  void ExecuteCommand(Reactor *reactor, const int &fd,
+                      const std::string &command);
 
-  int SendFrameData(const int &fd, const Message &msg);
-  int RecvFrameData(const int &fd, Message *msg);
+  // Queue |msg| and flush, what the socket does not take now is written
+  // when it becomes writable. Return -1 on error.
+  int SendFrameData(Connection *connection, const Message &msg);
+  // Queue |msg| to be written by the next FlushConnection.
+  void QueueFrameData(Connection *connection, const Message &msg);
+  // Write queued frames in batches, EPOLLOUT is armed while some are left.
+  // Return -1 on error or when the terminal stopped reading.
+  int FlushConnection(Connection *connection);
+  void CloseConnection(Connection *connection);
+  // Free |connection| after the current round, the fd is left open.
+  void ReleaseConnection(Connection *connection);
+  void CloseTerminalConnection(Connection *connection);
+  void CloseDeviceConnection(DeviceNode *device);
+  // Free connections closed during the last round of events.
+  void ReleaseClosedConnections(Reactor *reactor);
 
   size_t Jt808FramePack(const uint16_t &command,
                         const ProtocolParameters &propara, Message *msg);
 
   uint16_t Jt808FrameParse(Message *msg, ProtocolParameters *propara);
 
+  // Deal*Request send the downlink frames of a control command and record
+  // them in |pending|, the answers are matched in the event loop.
   int DealGetTerminalParameterRequest(DeviceNode *device,
-                                      std::vector<std::string> *va_vec);
+                                      std::vector<std::string> *va_vec,
+                                      PendingCommand *pending);
   int DealSetTerminalParameterRequest(DeviceNode *device,
-                                      std::vector<std::string> *va_vec);
+                                      std::vector<std::string> *va_vec,
+                                      PendingCommand *pending);
   int DealSetCircularAreaRequest(DeviceNode *device,
-                                 std::vector<std::string> *va_vec);
+                                 std::vector<std::string> *va_vec,
+                                 PendingCommand *pending);
   int DealSetRectangleAreaRequest(DeviceNode *device,
-                                  std::vector<std::string> *va_vec);
+                                  std::vector<std::string> *va_vec,
+                                  PendingCommand *pending);
   int DealSetPolygonalAreaRequest(DeviceNode *device,
-                                  std::vector<std::string> *va_vec);
-  int DealSetRouteRequest(DeviceNode *device, std::vector<std::string> *va_vec);
+                                  std::vector<std::string> *va_vec,
+                                  PendingCommand *pending);
+  int DealSetRouteRequest(DeviceNode *device, std::vector<std::string> *va_vec,
+                          PendingCommand *pending);
   int DealDeleteAreaRouteRequest(DeviceNode *device,
                                  std::vector<std::string> *va_vec,
-                                 const uint16_t &command);
-  int DealGetPositionInfoRequest(DeviceNode *device);
+                                 const uint16_t &command,
+                                 PendingCommand *pending);
+  int DealGetPositionInfoRequest(DeviceNode *device, PendingCommand *pending);
   int DealPositionTrackRequest(DeviceNode *device,
-                               std::vector<std::string> *va_vec);
+                               std::vector<std::string> *va_vec,
+                               PendingCommand *pending);
+  // Answer "gettrack starttime endtime" from the track archive on the
+  // track query thread, return 1 if queued, otherwise 0 with the answer
+  // in |buffer|.
+  int DealGetTrackRequest(const DeviceNode *device, const int &client_fd,
+                          std::vector<std::string> *va_vec, char *buffer);
+  // Send the archived points of |device| in [from, to] to |client_fd|
+  // kTrackChunkSize bytes at a time, then close it.
+  void StreamTrack(const DeviceNode *device, const int &client_fd,
+                   const uint32_t &from, const uint32_t &to);
+  // Body of the track query thread, answers queued queries in turn until
+  // the service stops.
+  void RunTrackQueries(void);
   int DealTerminalControlRequest(DeviceNode *device,
-                                 std::vector<std::string> *va_vec);
+                                 std::vector<std::string> *va_vec,
+                                 PendingCommand *pending);
   int DealVehicleControlRequest(DeviceNode *device,
-                                std::vector<std::string> *va_vec);
+                                std::vector<std::string> *va_vec,
+                                PendingCommand *pending);
 
-  int ParseCommand(char *command);
-  bool CheckPacketComplete(int *sock, ProtocolParameters *propara);
+  // Send a downlink frame of |pending| answered by |response_id|.
+  int SendCommandFrame(PendingCommand *pending, const uint16_t &response_id,
+                       const Message &msg);
+  // Return 1 if the command is waiting for the terminal, the client is
+  // then answered by FinishPendingCommand.
+  int ParseCommand(Reactor *reactor, const int &client_fd, char *command);
+  // Match a terminal answer against the pending commands of its reactor.
+  void CompletePendingCommand(Connection *connection, const uint16_t &command,
+                              const Message &msg,
+                              const ProtocolParameters &propara);
+  void FinishPendingCommand(Reactor *reactor, PendingCommand *pending,
+                            const bool &success);
+  // Fail commands of |device| when it disconnects.
+  void FailPendingCommands(Reactor *reactor, const DeviceNode *device);
+  // Fail commands not answered within |kCommandTimeout|.
+  void ExpirePendingCommands(Reactor *reactor);
 
-  // Deal upgrade request thread.
-  void UpgradeHandler(void);
-  static void *StartUpgradeThread(void *arg) {
-    Jt808Service *_this = reinterpret_cast<Jt808Service *>(arg);
-    _this->UpgradeHandler();
-    return nullptr;
-  }
+  // Upgrade |device| with the image of its file_path from |reactor|, the
+  // one serving it, now or once the campaign has room. Return false if the
+  // image can not be mapped.
+  bool StartUpgrade(Reactor *reactor, DeviceNode *device);
+  // Run the upgrade of |device|, already claimed, now or queue it. Return
+  // false if the image can not be mapped.
+  bool AdmitUpgrade(Reactor *reactor, DeviceNode *device);
+  // Run the admitted |request| on |reactor|.
+  void RunUpgrade(Reactor *reactor, const UpgradeRequest &request);
+  // Go on with the saved upgrade of |device|, just authenticated.
+  void ResumeUpgrade(Reactor *reactor, DeviceNode *device);
+  // Drop the work |reactor| still holds for |device|, authenticated again
+  // on another connection, and go on with its upgrade there.
+  void HandOverDevice(Reactor *reactor, DeviceNode *device);
+  // Save the chunks of |session| answered so far.
+  void SaveUpgradeProgress(const UpgradeSession *session);
+  // Hand the upgrade let out of the queue to the reactor of its device.
+  void StartQueuedUpgrade(UpgradeRequest request);
+  // Send chunks of |session| on |reactor| while its window and the
+  // bandwidth allow.
+  void PumpUpgrade(Reactor *reactor, UpgradeSession *session);
+  // Send the chunks the terminal asked for again in one batch, outside of
+  // the window. Return false if the connection failed, which ends
+  // |session|.
+  bool ResendUpgradeChunks(Reactor *reactor, UpgradeSession *session);
+  // Feed the answer to an upgrade package frame into its session.
+  void HandleUpgradeResponse(Connection *connection, const Message &msg);
+  // End |session| and log the throughput of the device.
+  void FinishUpgrade(Reactor *reactor, UpgradeSession *session,
+                     const bool &success);
+  // Fail the upgrade of |device| when it disconnects.
+  void FailUpgrade(Reactor *reactor, DeviceNode *device);
+  // Fail upgrades the terminal stopped answering for |kUpgradeTimeout|.
+  void ExpireUpgrades(Reactor *reactor);
+  // Go on with upgrades held back by the bandwidth, round robin.
+  void ResumeUpgrades(Reactor *reactor);
 
  private:
-  const char *kDevicesFilePath = "/etc/jt808/service/devices.txt";
-  const char *kCommandInterfacePath = "/tmp/jt808cmd.sock";
+  bool Init(const struct sockaddr_in &server_addr, const int &max_count);
+  bool InitReactor(Reactor *reactor, const struct sockaddr_in &server_addr);
+  void HandleCommandConnection(Connection *connection);
+
+  const char *devices_file_path_ = "/etc/jt808/service/devices.txt";
+  const char *command_interface_path_ = "/tmp/jt808cmd.sock";
+  const char *track_directory_ = nullptr;
+  const char *archive_directory_ = nullptr;
+  const char *upgrade_progress_directory_ = nullptr;
+  // Buffered points of a device silent this long are written out.
+  const uint64_t kArchiveIdleMs = 60 * 1000;
+  // Bytes of track points sent to a command client at once.
+  const size_t kTrackChunkSize = 16 * 1024;
+  // gettrack queries waiting for the track query thread at most.
+  const size_t kMaxTrackQueries = 16;
+  const int kHandshakeTimeout = 10;  // seconds.
+  const int kCommandTimeout = 30;  // seconds.
+  const int kUpgradeTimeout = 30;  // seconds.
+  // Upgrade progress is saved every so many chunks answered.
+  const uint16_t kUpgradeSaveChunks = 64;
+  // Wakeups of a reactor with upgrades held back by the bandwidth.
+  const int kUpgradeResumeInterval = 10;  // milliseconds.
+  // Unsent bytes a terminal may fall behind before it is dropped.
+  const size_t kMaxQueuedBytes = 256 * 1024;
 
-  int listen_sock_ = -1;
-  int epoll_fd_ = -1;
+  int worker_count_ = 1;
+  size_t upgrade_window_ = UpgradeSession::kDefaultWindow;
+  bool edge_triggered_ = false;
   int max_count_ = 0;
-  uint16_t message_flow_num_ = 0;
+  std::atomic<uint16_t> message_flow_num_{0};
+  std::atomic<bool> running_{false};
   int socket_fd_ = -1;
-  int client_fd_ = -1;
-  uid_t uid_;
-  char file_path[256] = {0};
-  std::list<DeviceNode *> device_list_;
-  struct epoll_event *epoll_events_ = nullptr;
+  DeviceRegistry device_registry_;
+  Connection *command_listen_connection_ = nullptr;
+  std::vector<Reactor *> reactors_;
+  UpgradeCampaign upgrade_campaign_;
+  UpgradeProgressStore upgrade_progress_;
+  // Written by the pipeline thread only, so declared before it.
+  TrackStore track_store_;
+  TrackArchive track_archive_;
+  uint64_t archive_flushed_ms_ = 0;
+  PositionPipeline position_pipeline_;
+
+  // A gettrack query waiting for the track query thread.
+  struct TrackQuery {
+    const DeviceNode *device;
+    int client_fd;
+    uint32_t from;
+    uint32_t to;
+  };
+  // Archive reads may take a while, one thread owned by the service
+  // answers them off the reactors.
+  std::thread track_thread_;
+  std::mutex track_mutex_;
+  std::condition_variable track_cond_;
+  std::deque<TrackQuery> track_queries_;
 };
 
 #endif  // JT808_SERVICE_JT808_SERVICE_H_
@@ -0,0 +1,308 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_service.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>  // NOLINT
+
+#include "benchmark/service_benchmark.h"
+#include "common/jt808_util.h"
+#include "service/jt808_frame_decoder.h"
+#include "unix_socket/unix_socket.h"
+
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+using ::testing::Lt;
+
+static const uint16_t kBasePort = 18493;
+// Some 66 package frames.
+static const size_t kImageSize = 64 * 1024;
+
+// A terminal on the service, answering the upgrade packages it is sent.
+class UpgradeTerminal {
+ public:
+  explicit UpgradeTerminal(const uint16_t &port)
+      : fd_(ConnectTerminal(port, 0, phone_bcd_, &buffer_)) {}
+  ~UpgradeTerminal() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool connected(void) const { return fd_ >= 0; }
+  const std::set<uint16_t> &received(void) const { return received_; }
+  uint16_t total(void) const { return total_; }
+
+  // Receive packages for up to 50ms and answer those up to |last|. Return
+  // false once the service has closed the connection.
+  bool Serve(const uint16_t &last) {
+    uint8_t body[5] = {0};
+    uint8_t frame[MAX_PROFRAMEBUF_LEN];
+    uint16_t sequence;
+    FrameView view;
+    Message msg;
+    size_t len;
+    struct pollfd pfd = {fd_, POLLIN, 0};
+
+    if ((poll(&pfd, 1, 50) > 0) && (buffer_.RecvFrom(fd_) < 0)) {
+      return false;
+    }
+    while (buffer_.PopFrame(&msg)) {
+      if ((DecodeFrame(&msg, &view) != kFrameDecodeOk) ||
+          (view.id != DOWN_UPGRADEPACKAGE)) {
+        continue;
+      }
+      sequence = view.attribute.bit.package ? view.packet_seq : 1;
+      total_ = view.attribute.bit.package ? view.total_package : 1;
+      received_.insert(sequence);
+      if (sequence > last) {
+        continue;
+      }
+      body[0] = static_cast<uint8_t>(view.flow_num >> 8);
+      body[1] = static_cast<uint8_t>(view.flow_num);
+      body[2] = static_cast<uint8_t>(DOWN_UPGRADEPACKAGE >> 8);
+      body[3] = static_cast<uint8_t>(DOWN_UPGRADEPACKAGE & 0xFF);
+      body[4] = kSuccess;
+      len = PackTerminalFrame(UP_UNIRESPONSE, phone_bcd_, flow_num_++, body,
+                              sizeof(body), frame);
+      if (send(fd_, frame, len, MSG_NOSIGNAL) < 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  uint8_t phone_bcd_[6] = {0};
+  uint16_t flow_num_ = 1;
+  uint16_t total_ = 0;
+  std::set<uint16_t> received_;
+  FrameBuffer buffer_;
+  int fd_;
+};
+
+// Connect to the service on |port| without a handshake.
+static int ConnectService(const uint16_t &port) {
+  struct sockaddr_in server_addr;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&server_addr),
+              sizeof(server_addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Send a frame of |id| without a body from the terminal with |phone_bcd|.
+static bool SendEmptyFrame(const int &fd, const uint16_t &id,
+                           const uint8_t *phone_bcd) {
+  uint8_t body[1] = {0};
+  uint8_t frame[MAX_PROFRAMEBUF_LEN];
+  size_t len = PackTerminalFrame(id, phone_bcd, 1, body, 0, frame);
+
+  return send(fd, frame, len, MSG_NOSIGNAL) == static_cast<ssize_t>(len);
+}
+
+// Wait up to a second for the service to close |fd|.
+static bool WaitClosed(const int &fd) {
+  FrameBuffer buffer;
+  struct pollfd pfd = {fd, POLLIN, 0};
+
+  for (int rounds = 0; rounds < 20; ++rounds) {
+    if ((poll(&pfd, 1, 50) > 0) && (buffer.RecvFrom(fd) < 0)) {
+      return true;
+    }
+    buffer.Clear();
+  }
+  return false;
+}
+
+class Jt808ServiceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/jt808_service_XXXXXX";
+    ASSERT_THAT(mkdtemp(path) != nullptr, IsTrue());
+    directory_ = path;
+    devices_path_ = directory_ + "/devices.txt";
+    command_path_ = directory_ + "/cmd.sock";
+    image_path_ = directory_ + "/image.bin";
+    progress_directory_ = directory_ + "/progress";
+    progress_path_ = progress_directory_ + "/" +
+                     std::to_string(TerminalPhoneNumber(0)) + ".upg";
+
+    WriteBenchmarkDevices(devices_path_.c_str(), 1);
+    std::ofstream ofs(image_path_, std::ios::out | std::ios::binary);
+    for (size_t i = 0; i < kImageSize; ++i) {
+      ofs.put(static_cast<char>(i * 131));
+    }
+    ofs.close();
+  }
+
+  void TearDown() override {
+    if (service_thread_.joinable()) {
+      service_.Stop();
+      service_thread_.join();
+    }
+    std::string command = "rm -rf " + directory_;
+    ASSERT_THAT(system(command.c_str()), Eq(0));
+  }
+
+  void Start(const int &workers) {
+    port_ = kBasePort + workers;
+    service_.set_worker_count(workers);
+    service_.set_upgrade_window(4);
+    service_.set_devices_file_path(devices_path_.c_str());
+    service_.set_command_interface_path(command_path_.c_str());
+    service_.set_upgrade_progress_directory(progress_directory_.c_str());
+    ASSERT_THAT(service_.Init(port_, 1024), IsTrue());
+    service_thread_ = std::thread([this] { service_.Run(100); });
+  }
+
+  void Upgrade(void) {
+    char answer[256] = {0};
+    std::string command = std::to_string(TerminalPhoneNumber(0)) +
+                          " upgrade device 1.0.0 " + image_path_;
+    int fd = ClientConnect(command_path_.c_str());
+
+    ASSERT_THAT(fd, Gt(0));
+    send(fd, command.c_str(), command.length(), 0);
+    recv(fd, answer, sizeof(answer) - 1, 0);
+    close(fd);
+  }
+
+  bool ProgressSaved(void) const {
+    struct stat st;
+    return stat(progress_path_.c_str(), &st) == 0;
+  }
+
+  // Upgrade the terminal, answer its first 8 packages and authenticate it
+  // again while the old connection is still open. The upgrade must go on
+  // over the new connection with the packages not answered yet.
+  void ReconnectDuringUpgrade(void) {
+    UpgradeTerminal first(port_);
+    int rounds;
+
+    ASSERT_THAT(first.connected(), IsTrue());
+    Upgrade();
+    // The window then holds 9 to 12.
+    for (rounds = 0; (rounds < 100) && !first.received().count(12);
+         ++rounds) {
+      ASSERT_THAT(first.Serve(8), IsTrue());
+    }
+    ASSERT_THAT(first.received().count(12), Eq(1u));
+    ASSERT_THAT(first.total(), Gt(12));
+
+    UpgradeTerminal second(port_);
+    ASSERT_THAT(second.connected(), IsTrue());
+    // The old connection is shut down once the device is bound again.
+    for (rounds = 0; (rounds < 100) && first.Serve(0); ++rounds) {}
+    EXPECT_THAT(rounds, Lt(100));
+
+    for (rounds = 0; (rounds < 200) &&
+                     ((second.total() == 0) ||
+                      (second.received().size() + 8 < second.total()) ||
+                      ProgressSaved()); ++rounds) {
+      ASSERT_THAT(second.Serve(0xFFFF), IsTrue());
+    }
+    ASSERT_THAT(second.total(), Eq(first.total()));
+    // Only the packages not answered on the old connection are sent again.
+    EXPECT_THAT(*second.received().begin(), Eq(9));
+    EXPECT_THAT(second.received().size() + 8, Eq(second.total()));
+    // Completed, the saved progress is removed.
+    EXPECT_THAT(ProgressSaved(), IsFalse());
+  }
+
+  Jt808Service service_;
+  std::thread service_thread_;
+  std::string directory_;
+  std::string devices_path_;
+  std::string command_path_;
+  std::string image_path_;
+  std::string progress_directory_;
+  std::string progress_path_;
+  uint16_t port_ = 0;
+};
+
+// Both connections are served by one event loop.
+TEST_F(Jt808ServiceTest, ReconnectOnSameReactorTest) {
+  Start(1);
+  ReconnectDuringUpgrade();
+}
+
+// The new connection is likely accepted by another event loop, which takes
+// the upgrade over.
+TEST_F(Jt808ServiceTest, ReconnectOnOtherReactorTest) {
+  Start(4);
+  ReconnectDuringUpgrade();
+}
+
+// An authentication without the code must not let the terminal in.
+TEST_F(Jt808ServiceTest, EmptyAuthenticationTest) {
+  uint8_t phone_bcd[6] = {0};
+  std::string phone_num = std::to_string(TerminalPhoneNumber(0));
+  int fd;
+
+  Start(1);
+  PreparePhoneNum(phone_num.c_str(), phone_bcd);
+  fd = ConnectService(port_);
+  ASSERT_THAT(fd, Gt(0));
+  ASSERT_THAT(SendEmptyFrame(fd, UP_AUTHENTICATION, phone_bcd), IsTrue());
+  EXPECT_THAT(WaitClosed(fd), IsTrue());
+  close(fd);
+}
+
+// A pass through frame without its type byte is dropped, the terminal is
+// still served afterwards.
+TEST_F(Jt808ServiceTest, EmptyPassThroughTest) {
+  uint8_t phone_bcd[6] = {0};
+  bool answered = false;
+  FrameBuffer buffer;
+  Message msg;
+  int fd;
+
+  Start(1);
+  fd = ConnectTerminal(port_, 0, phone_bcd, &buffer);
+  ASSERT_THAT(fd, Gt(0));
+  ASSERT_THAT(SendEmptyFrame(fd, UP_PASSTHROUGH, phone_bcd), IsTrue());
+  ASSERT_THAT(SendEmptyFrame(fd, UP_HEARTBEAT, phone_bcd), IsTrue());
+  // The heartbeat is answered.
+  for (int tries = 0; (tries < 20) && !answered; ++tries) {
+    ASSERT_THAT(buffer.RecvFrom(fd), Ge(0));
+    answered = buffer.PopFrame(&msg);
+  }
+  EXPECT_THAT(answered, IsTrue());
+  close(fd);
+}
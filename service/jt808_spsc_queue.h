@@ -0,0 +1,101 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_SPSC_QUEUE_H_
+#define JT808_SERVICE_JT808_SPSC_QUEUE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+
+// Bounded lock-free queue between exactly one producer and one consumer
+// thread. Push and PopBatch never block or allocate. Each side only writes
+// its own index and keeps a cached copy of the other one, so the shared
+// cache lines are only touched when the cached view runs out.
+template <typename T>
+class SpscQueue {
+ public:
+  // |capacity| is rounded up to a power of two.
+  explicit SpscQueue(const size_t &capacity) {
+    capacity_ = 1;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+    buffer_ = new T[capacity_];
+  }
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+  virtual ~SpscQueue() { delete [] buffer_; }
+
+  // Producer side, return false when the queue is full.
+  bool Push(const T &value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+
+    if (tail - cached_head_ >= capacity_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ >= capacity_) {
+        return false;
+      }
+    }
+    buffer_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, move up to |max| values into |out| and return how many.
+  size_t PopBatch(T *out, const size_t &max) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t count;
+
+    if (cached_tail_ - head < max) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+    }
+    count = std::min(max, cached_tail_ - head);
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = buffer_[(head + i) & mask_];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Approximate unless called from a quiescent queue.
+  size_t size(void) const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  size_t capacity(void) const { return capacity_; }
+
+ private:
+  static const size_t kCacheLine = 64;
+
+  T *buffer_ = nullptr;
+  size_t capacity_ = 0;
+  size_t mask_ = 0;
+  char pad0_[kCacheLine];
+  // Consumer owned.
+  std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+  char pad1_[kCacheLine];
+  // Producer owned.
+  std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+  char pad2_[kCacheLine];
+};
+
+#endif  // JT808_SERVICE_JT808_SPSC_QUEUE_H_
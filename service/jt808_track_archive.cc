@@ -0,0 +1,511 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_track_archive.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "bcd/bcd.h"
+#include "common/jt808_logger.h"
+#include "service/jt808_util.h"
+
+
+const uint32_t TrackArchive::kBlockMagic;
+const uint16_t TrackArchive::kVersion;
+
+// The protocol stamps positions in GMT+8.
+static const uint32_t kTimeZoneOffset = 8 * 3600;
+
+static void PutVarint(uint64_t value, std::vector<uint8_t> *out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+static uint64_t ZigZag(const int64_t &value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+// Decode |count| varints from [*data, end) into |out| and advance *data.
+static bool GetVarints(const uint8_t **data, const uint8_t *end,
+                       uint64_t *out, const size_t &count) {
+  const uint8_t *p = *data;
+  uint64_t word;
+  uint64_t value;
+  size_t i = 0;
+  int shift;
+
+  while (i < count) {
+    // Eight one byte varints at once, the usual case for small deltas.
+    if ((count - i >= 8) && (end - p >= 8)) {
+      memcpy(&word, p, 8);
+      if ((word & 0x8080808080808080ULL) == 0) {
+        for (int k = 0; k < 8; ++k) {
+          out[i + k] = p[k];
+        }
+        i += 8;
+        p += 8;
+        continue;
+      }
+    }
+    value = 0;
+    shift = 0;
+    do {
+      if ((p == end) || (shift > 63)) {
+        return false;
+      }
+      value |= static_cast<uint64_t>(*p & 0x7F) << shift;
+      shift += 7;
+    } while (*p++ & 0x80);
+    out[i++] = value;
+  }
+  *data = p;
+  return true;
+}
+
+template <typename T>
+static void EncodeDeltas(const T *values, const size_t &count,
+                         std::vector<uint8_t> *out) {
+  int64_t previous = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    PutVarint(ZigZag(static_cast<int64_t>(values[i]) - previous), out);
+    previous = static_cast<int64_t>(values[i]);
+  }
+}
+
+template <typename T>
+static bool DecodeDeltas(const uint8_t **data, const uint8_t *end,
+                         const size_t &count, uint64_t *scratch,
+                         T *values) {
+  uint64_t sum = 0;
+
+  if (!GetVarints(data, end, scratch, count)) {
+    return false;
+  }
+  // Undo the zigzag in a pass of its own, it has no dependencies between
+  // elements and vectorizes; only the prefix sum is sequential.
+  for (size_t i = 0; i < count; ++i) {
+    scratch[i] = (scratch[i] >> 1) ^ (~(scratch[i] & 1) + 1);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    sum += scratch[i];
+    values[i] = static_cast<T>(sum);
+  }
+  return true;
+}
+
+template <typename T>
+static void EncodeRuns(const T *values, const size_t &count,
+                       std::vector<uint8_t> *out) {
+  size_t i = 0;
+  size_t run;
+
+  while (i < count) {
+    run = 1;
+    while ((i + run < count) && (values[i + run] == values[i])) {
+      ++run;
+    }
+    PutVarint(run, out);
+    PutVarint(values[i], out);
+    i += run;
+  }
+}
+
+template <typename T>
+static bool DecodeRuns(const uint8_t **data, const uint8_t *end,
+                       const size_t &count, T *values) {
+  uint64_t pair[2];
+  size_t i = 0;
+
+  while (i < count) {
+    if (!GetVarints(data, end, pair, 2) || (pair[0] == 0) ||
+        (pair[0] > count - i)) {
+      return false;
+    }
+    std::fill(values + i, values + i + pair[0], static_cast<T>(pair[1]));
+    i += pair[0];
+  }
+  return true;
+}
+
+// "013826539850", the directory of a device.
+static std::string PhoneDirectory(const std::string &directory,
+                                  const uint8_t *phone_bcd) {
+  char name[16];
+  snprintf(name, sizeof(name), "/%02X%02X%02X%02X%02X%02X", phone_bcd[0],
+           phone_bcd[1], phone_bcd[2], phone_bcd[3], phone_bcd[4],
+           phone_bcd[5]);
+  return directory + name;
+}
+
+// "<phone directory>/YYYYMMDD.<suffix>" of days since the epoch |day|.
+static std::string DayPath(const std::string &phone_directory,
+                           const uint32_t &day, const char *suffix) {
+  time_t seconds = static_cast<time_t>(day) * 86400;
+  struct tm tm;
+  char name[32];
+
+  gmtime_r(&seconds, &tm);
+  snprintf(name, sizeof(name), "/%04d%02d%02d.%s", tm.tm_year + 1900,
+           tm.tm_mon + 1, tm.tm_mday, suffix);
+  return phone_directory + name;
+}
+
+static uint32_t DayOf(const uint32_t &time) {
+  return (time + kTimeZoneOffset) / 86400;
+}
+
+// Order the points of |columns| by time, they usually are already.
+static void SortByTime(TrackColumns *columns) {
+  std::unique_ptr<TrackColumns> sorted;
+  size_t order[kTrackBlockPoints];
+  size_t count = columns->count;
+
+  if (std::is_sorted(columns->time, columns->time + count)) {
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order, order + count,
+                   [columns](const size_t &a, const size_t &b) {
+                     return columns->time[a] < columns->time[b];
+                   });
+  sorted.reset(new TrackColumns);
+  sorted->count = count;
+  for (size_t i = 0; i < count; ++i) {
+    sorted->time[i] = columns->time[order[i]];
+    sorted->latitude[i] = columns->latitude[order[i]];
+    sorted->longitude[i] = columns->longitude[order[i]];
+    sorted->altitude[i] = columns->altitude[order[i]];
+    sorted->speed[i] = columns->speed[order[i]];
+    sorted->bearing[i] = columns->bearing[order[i]];
+    sorted->alarm[i] = columns->alarm[order[i]];
+    sorted->status[i] = columns->status[order[i]];
+  }
+  memcpy(columns, sorted.get(), sizeof(*columns));
+}
+
+TrackArchive::~TrackArchive() {
+  Flush();
+}
+
+bool TrackArchive::Open(const char *directory) {
+  directory_ = directory;
+  if (!MakeDirectories(directory_)) {
+    JT808_ERROR("create %s failed!!!", directory);
+    return false;
+  }
+  return true;
+}
+
+uint32_t TrackArchive::PositionTime(const PositionRecord &record) {
+  return TimeFromBcd(record.timestamp);
+}
+
+uint32_t TrackArchive::TimeFromBcd(const uint8_t *bcd) {
+  struct tm tm;
+  uint8_t fields[6];
+  time_t seconds;
+
+  for (int i = 0; i < 6; ++i) {
+    fields[i] = HexFromBcd(bcd[i]);
+  }
+  if ((fields[1] < 1) || (fields[1] > 12) || (fields[2] < 1) ||
+      (fields[2] > 31) || (fields[3] > 23) || (fields[4] > 59) ||
+      (fields[5] > 59)) {
+    return 0;
+  }
+  memset(&tm, 0x0, sizeof(tm));
+  tm.tm_year = 100 + fields[0];
+  tm.tm_mon = fields[1] - 1;
+  tm.tm_mday = fields[2];
+  tm.tm_hour = fields[3];
+  tm.tm_min = fields[4];
+  tm.tm_sec = fields[5];
+  seconds = timegm(&tm);
+  return seconds > kTimeZoneOffset ?
+             static_cast<uint32_t>(seconds - kTimeZoneOffset) : 0;
+}
+
+void TrackArchive::Append(const uint64_t &received_ms,
+                          const PositionRecord &record) {
+  uint32_t time = PositionTime(record);
+  uint32_t day;
+  uint64_t key = 0;
+  Pending *pending;
+  size_t i;
+
+  if (time == 0) {
+    time = static_cast<uint32_t>(received_ms / 1000);
+  }
+  day = DayOf(time);
+  memcpy(&key, record.phone_bcd, 6);
+  auto pending_it = pending_.find(key);
+  if (pending_it == pending_.end()) {
+    pending = new Pending;
+    memcpy(pending->phone_bcd, record.phone_bcd, 6);
+    pending->columns.count = 0;
+    pending_.insert(std::make_pair(key, pending));
+  } else {
+    pending = pending_it->second;
+  }
+  // A block never spans two day files.
+  if ((pending->columns.count > 0) && (pending->day != day)) {
+    WriteBlock(pending);
+  }
+  pending->day = day;
+  pending->last_ms = received_ms;
+  i = pending->columns.count++;
+  pending->columns.time[i] = time;
+  pending->columns.latitude[i] = record.latitude;
+  pending->columns.longitude[i] = record.longitude;
+  pending->columns.altitude[i] = record.altitude;
+  pending->columns.speed[i] = record.speed;
+  pending->columns.bearing[i] = record.bearing;
+  pending->columns.alarm[i] = record.alarm;
+  pending->columns.status[i] = record.status;
+  ++points_;
+  if (pending->columns.count == kTrackBlockPoints) {
+    WriteBlock(pending);
+  }
+}
+
+void TrackArchive::FlushIdle(const uint64_t &now_ms,
+                             const uint64_t &idle_ms) {
+  for (auto it = pending_.begin(); it != pending_.end();) {
+    if (it->second->last_ms + idle_ms > now_ms) {
+      ++it;
+      continue;
+    }
+    WriteBlock(it->second);
+    delete it->second;
+    it = pending_.erase(it);
+  }
+}
+
+void TrackArchive::Flush(void) {
+  for (auto &pending : pending_) {
+    WriteBlock(pending.second);
+    delete pending.second;
+  }
+  pending_.clear();
+}
+
+bool TrackArchive::WriteBlock(Pending *pending) {
+  std::string directory = PhoneDirectory(directory_, pending->phone_bcd);
+  std::vector<uint8_t> block;
+  TrackBlockIndex index;
+  struct stat st;
+  int fd;
+  bool ok = false;
+
+  if (pending->columns.count == 0) {
+    return true;
+  }
+  SortByTime(&pending->columns);
+  EncodeBlock(pending->columns, &block);
+  index.first_time = pending->columns.time[0];
+  index.last_time = pending->columns.time[pending->columns.count - 1];
+  pending->columns.count = 0;
+
+  mkdir(directory.c_str(), 0755);
+  fd = open(DayPath(directory, pending->day, "blk").c_str(),
+            O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if ((fd >= 0) && (fstat(fd, &st) == 0)) {
+    index.offset = static_cast<uint64_t>(st.st_size);
+    ok = write(fd, block.data(), block.size()) ==
+         static_cast<ssize_t>(block.size());
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  // The index entry only once the block is complete.
+  if (ok) {
+    fd = open(DayPath(directory, pending->day, "idx").c_str(),
+              O_WRONLY | O_CREAT | O_APPEND, 0644);
+    ok = (fd >= 0) &&
+         (write(fd, &index, sizeof(index)) ==
+          static_cast<ssize_t>(sizeof(index)));
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  if (!ok) {
+    JT808_ERROR("write block of %s failed!!!", directory.c_str());
+    return false;
+  }
+  bytes_written_ += block.size() + sizeof(index);
+  return true;
+}
+
+void TrackArchive::EncodeBlock(const TrackColumns &columns,
+                               std::vector<uint8_t> *out) {
+  TrackBlockHeader header;
+  size_t start = out->size();
+  size_t count = columns.count;
+
+  out->resize(start + sizeof(header));
+  EncodeDeltas(columns.time, count, out);
+  EncodeDeltas(columns.latitude, count, out);
+  EncodeDeltas(columns.longitude, count, out);
+  EncodeDeltas(columns.altitude, count, out);
+  EncodeDeltas(columns.speed, count, out);
+  EncodeDeltas(columns.bearing, count, out);
+  EncodeRuns(columns.alarm, count, out);
+  EncodeRuns(columns.status, count, out);
+
+  header.magic = kBlockMagic;
+  header.count = static_cast<uint16_t>(count);
+  header.version = kVersion;
+  header.first_time = count > 0 ? columns.time[0] : 0;
+  header.last_time = count > 0 ? columns.time[count - 1] : 0;
+  header.payload_len = static_cast<uint32_t>(out->size() - start -
+                                             sizeof(header));
+  memcpy(out->data() + start, &header, sizeof(header));
+}
+
+bool TrackArchive::DecodeBlock(const uint8_t *data, const size_t &len,
+                               TrackColumns *columns) {
+  TrackBlockHeader header;
+  uint64_t scratch[kTrackBlockPoints];
+  const uint8_t *p = data + sizeof(header);
+  const uint8_t *end;
+  size_t count;
+
+  if (len < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if ((header.magic != kBlockMagic) || (header.version != kVersion) ||
+      (header.count > kTrackBlockPoints) ||
+      (header.payload_len > len - sizeof(header))) {
+    return false;
+  }
+  count = header.count;
+  end = p + header.payload_len;
+  columns->count = count;
+  return DecodeDeltas(&p, end, count, scratch, columns->time) &&
+         DecodeDeltas(&p, end, count, scratch, columns->latitude) &&
+         DecodeDeltas(&p, end, count, scratch, columns->longitude) &&
+         DecodeDeltas(&p, end, count, scratch, columns->altitude) &&
+         DecodeDeltas(&p, end, count, scratch, columns->speed) &&
+         DecodeDeltas(&p, end, count, scratch, columns->bearing) &&
+         DecodeRuns(&p, end, count, columns->alarm) &&
+         DecodeRuns(&p, end, count, columns->status) && (p == end);
+}
+
+uint64_t TrackArchive::Query(
+    const char *directory, const uint8_t *phone_bcd, const uint32_t &from,
+    const uint32_t &to,
+    const std::function<bool(const TrackColumns &columns,
+                             const size_t &begin,
+                             const size_t &end)> &visit) {
+  std::string phone_directory = PhoneDirectory(directory, phone_bcd);
+  std::unique_ptr<TrackColumns> columns(new TrackColumns);
+  std::vector<TrackBlockIndex> index;
+  std::vector<TrackBlockIndex> matches;
+  std::vector<uint8_t> block;
+  TrackBlockHeader header;
+  struct stat st;
+  uint64_t visited = 0;
+  size_t begin;
+  size_t end;
+  int index_fd;
+  int block_fd;
+
+  if (from > to) {
+    return 0;
+  }
+  for (uint32_t day = DayOf(from); day <= DayOf(to); ++day) {
+    index_fd = open(DayPath(phone_directory, day, "idx").c_str(), O_RDONLY);
+    if (index_fd < 0) {
+      continue;
+    }
+    index.clear();
+    if (fstat(index_fd, &st) == 0) {
+      index.resize(static_cast<size_t>(st.st_size) / sizeof(TrackBlockIndex));
+      if (read(index_fd, index.data(), index.size() * sizeof(index[0])) !=
+          static_cast<ssize_t>(index.size() * sizeof(index[0]))) {
+        index.clear();
+      }
+    }
+    close(index_fd);
+    block_fd = open(DayPath(phone_directory, day, "blk").c_str(), O_RDONLY);
+    if (block_fd < 0) {
+      continue;
+    }
+    // Late reports and clock jumps leave blocks out of time order, the
+    // small index is scanned whole and the matches read in time order.
+    matches.clear();
+    for (auto &entry : index) {
+      if ((entry.last_time >= from) && (entry.first_time <= to)) {
+        matches.push_back(entry);
+      }
+    }
+    std::stable_sort(matches.begin(), matches.end(),
+                     [](const TrackBlockIndex &a, const TrackBlockIndex &b) {
+                       return a.first_time < b.first_time;
+                     });
+    for (auto it = matches.begin(); it != matches.end(); ++it) {
+      if ((pread(block_fd, &header, sizeof(header),
+                 static_cast<off_t>(it->offset)) !=
+           static_cast<ssize_t>(sizeof(header))) ||
+          (header.magic != kBlockMagic)) {
+        break;
+      }
+      block.resize(sizeof(header) + header.payload_len);
+      if ((pread(block_fd, block.data(), block.size(),
+                 static_cast<off_t>(it->offset)) !=
+           static_cast<ssize_t>(block.size())) ||
+          !DecodeBlock(block.data(), block.size(), columns.get())) {
+        JT808_WARNING("bad block in %s!!!", phone_directory.c_str());
+        break;
+      }
+      begin = std::lower_bound(columns->time,
+                               columns->time + columns->count, from) -
+              columns->time;
+      end = std::upper_bound(columns->time,
+                             columns->time + columns->count, to) -
+            columns->time;
+      if (begin == end) {
+        continue;
+      }
+      visited += end - begin;
+      if (!visit(*columns, begin, end)) {
+        close(block_fd);
+        return visited;
+      }
+    }
+    close(block_fd);
+  }
+  return visited;
+}
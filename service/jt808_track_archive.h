@@ -0,0 +1,136 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_TRACK_ARCHIVE_H_
+#define JT808_SERVICE_JT808_TRACK_ARCHIVE_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "service/jt808_position_report.h"
+
+
+// Points of a block, the unit of encoding and of reading back.
+static const size_t kTrackBlockPoints = 256;
+
+// One block decoded column by column.
+struct TrackColumns {
+  size_t count;
+  uint32_t time[kTrackBlockPoints];  // Unix seconds.
+  uint32_t latitude[kTrackBlockPoints];
+  uint32_t longitude[kTrackBlockPoints];
+  uint16_t altitude[kTrackBlockPoints];
+  uint16_t speed[kTrackBlockPoints];
+  uint16_t bearing[kTrackBlockPoints];
+  uint32_t alarm[kTrackBlockPoints];
+  uint32_t status[kTrackBlockPoints];
+};
+
+#pragma pack(push, 1)
+
+// 轨迹块头, 其后为按列编码的数据: 时间, 纬度, 经度, 海拔, 速度, 方向为
+// delta + zigzag varint, 报警和状态为游程编码 (次数 varint + 值 varint).
+struct TrackBlockHeader {
+  uint32_t magic;
+  uint16_t count;
+  uint16_t version;
+  uint32_t first_time;
+  uint32_t last_time;
+  uint32_t payload_len;
+};
+
+// 块索引项, 每块一项, 存于同名 .idx 文件.
+struct TrackBlockIndex {
+  uint32_t first_time;
+  uint32_t last_time;
+  uint64_t offset;
+};
+
+#pragma pack(pop)
+
+// Columnar, compressed archive of the positions of every device, one
+// "<phone>/<YYYYMMDD>.blk" file per device and day (GMT+8, the protocol
+// time zone) with its block index in "<phone>/<YYYYMMDD>.idx". Positions
+// are buffered per device and written a block at a time. Not thread safe,
+// Query only reads complete blocks and may run anywhere.
+class TrackArchive {
+ public:
+  static const uint32_t kBlockMagic = 0x4B425454;  // "TTBK"
+  static const uint16_t kVersion = 1;
+
+  TrackArchive() = default;
+  TrackArchive(const TrackArchive&) = delete;
+  TrackArchive& operator=(const TrackArchive&) = delete;
+  virtual ~TrackArchive();
+
+  // Create |directory| if needed, return false on error.
+  bool Open(const char *directory);
+  // Buffer |record|. Stamped with its own time, or with |received_ms| if
+  // the terminal sent no valid one.
+  void Append(const uint64_t &received_ms, const PositionRecord &record);
+  // Write the buffered points of devices silent for |idle_ms| as of
+  // |now_ms|, so they can be queried.
+  void FlushIdle(const uint64_t &now_ms, const uint64_t &idle_ms);
+  // Write every buffered point.
+  void Flush(void);
+
+  uint64_t points(void) const { return points_; }
+  uint64_t bytes_written(void) const { return bytes_written_; }
+
+  // Visit the blocks of |phone_bcd| holding points in [from, to] (Unix
+  // seconds) by time of their first point, one decoded block at a time,
+  // until |visit| returns false. Blocks may overlap when points came late.
+  // |visit| gets the columns and the range [begin, end) of points in the
+  // time range. Return the points visited.
+  static uint64_t Query(
+      const char *directory, const uint8_t *phone_bcd, const uint32_t &from,
+      const uint32_t &to,
+      const std::function<bool(const TrackColumns &columns,
+                               const size_t &begin,
+                               const size_t &end)> &visit);
+
+  // Encode |count| points of |columns| into |out|, header included.
+  static void EncodeBlock(const TrackColumns &columns,
+                          std::vector<uint8_t> *out);
+  // Decode a block of |len| bytes, return false if it is malformed.
+  static bool DecodeBlock(const uint8_t *data, const size_t &len,
+                          TrackColumns *columns);
+  // Unix time of the BCD timestamp (GMT+8) of |record|, 0 if invalid.
+  static uint32_t PositionTime(const PositionRecord &record);
+  // Unix time of a 6 bytes BCD "yymmddhhmmss" (GMT+8), 0 if invalid.
+  static uint32_t TimeFromBcd(const uint8_t *bcd);
+
+ private:
+  struct Pending {
+    uint8_t phone_bcd[6];
+    uint32_t day;  // Days since the epoch in GMT+8.
+    uint64_t last_ms;
+    TrackColumns columns;
+  };
+
+  bool WriteBlock(Pending *pending);
+
+  std::string directory_;
+  std::unordered_map<uint64_t, Pending *> pending_;
+  uint64_t points_ = 0;
+  uint64_t bytes_written_ = 0;
+};
+
+#endif  // JT808_SERVICE_JT808_TRACK_ARCHIVE_H_
@@ -0,0 +1,210 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_track_archive.h"
+
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+using ::testing::Lt;
+
+static const uint8_t kPhone[6] = {0x01, 0x38, 0x26, 0x53, 0x98, 0x50};
+// 2019-06-01 00:00:00 GMT+8.
+static const uint32_t kDayStart = 1559318400;
+
+static uint8_t Bcd(const int &value) {
+  return static_cast<uint8_t>(((value / 10) << 4) | (value % 10));
+}
+
+// A record stamped |time| (Unix seconds) by the terminal.
+static PositionRecord Record(const uint32_t &time, const uint32_t &latitude) {
+  PositionRecord record;
+  time_t local = time + 8 * 3600;
+  struct tm tm;
+
+  memset(&record, 0x0, sizeof(record));
+  memcpy(record.phone_bcd, kPhone, 6);
+  gmtime_r(&local, &tm);
+  record.timestamp[0] = Bcd(tm.tm_year - 100);
+  record.timestamp[1] = Bcd(tm.tm_mon + 1);
+  record.timestamp[2] = Bcd(tm.tm_mday);
+  record.timestamp[3] = Bcd(tm.tm_hour);
+  record.timestamp[4] = Bcd(tm.tm_min);
+  record.timestamp[5] = Bcd(tm.tm_sec);
+  record.latitude = latitude;
+  record.longitude = 113900000 + latitude % 1000;
+  record.speed = static_cast<uint16_t>(latitude % 7);
+  record.status = 0x00040003;
+  return record;
+}
+
+class TrackArchiveTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/jt808_archive_XXXXXX";
+    ASSERT_THAT(mkdtemp(path) != nullptr, IsTrue());
+    directory_ = path;
+  }
+
+  void TearDown() override {
+    std::string command = "rm -rf " + directory_;
+    ASSERT_THAT(system(command.c_str()), Eq(0));
+  }
+
+  // Times of the points in [from, to].
+  std::vector<uint32_t> Query(const uint32_t &from, const uint32_t &to) {
+    std::vector<uint32_t> times;
+    TrackArchive::Query(directory_.c_str(), kPhone, from, to,
+                        [&times](const TrackColumns &columns,
+                                 const size_t &begin, const size_t &end) {
+                          times.insert(times.end(), columns.time + begin,
+                                       columns.time + end);
+                          return true;
+                        });
+    return times;
+  }
+
+  std::string directory_;
+};
+
+TEST(TrackBlockTest, RoundTripTest) {
+  std::unique_ptr<TrackColumns> columns(new TrackColumns);
+  std::unique_ptr<TrackColumns> decoded(new TrackColumns);
+  std::vector<uint8_t> block;
+
+  columns->count = kTrackBlockPoints;
+  for (size_t i = 0; i < kTrackBlockPoints; ++i) {
+    columns->time[i] = kDayStart + static_cast<uint32_t>(i) * 30;
+    // Wrap around and jump, deltas of either sign.
+    columns->latitude[i] = static_cast<uint32_t>(22500000 + i * 37);
+    columns->longitude[i] = i == 100 ? 0xFFFFFFFF :
+                                       static_cast<uint32_t>(113900000 - i);
+    columns->altitude[i] = static_cast<uint16_t>(i % 3);
+    columns->speed[i] = static_cast<uint16_t>(i * 300);
+    columns->bearing[i] = static_cast<uint16_t>(359 - i % 360);
+    columns->alarm[i] = i < 200 ? 0 : 4;
+    columns->status[i] = 3;
+  }
+  TrackArchive::EncodeBlock(*columns, &block);
+  ASSERT_THAT(TrackArchive::DecodeBlock(block.data(), block.size(),
+                                        decoded.get()), IsTrue());
+  EXPECT_THAT(decoded->count, Eq(kTrackBlockPoints));
+  EXPECT_THAT(memcmp(decoded->time, columns->time, sizeof(columns->time)),
+              Eq(0));
+  EXPECT_THAT(memcmp(decoded->latitude, columns->latitude,
+                     sizeof(columns->latitude)), Eq(0));
+  EXPECT_THAT(memcmp(decoded->longitude, columns->longitude,
+                     sizeof(columns->longitude)), Eq(0));
+  EXPECT_THAT(memcmp(decoded->speed, columns->speed, sizeof(columns->speed)),
+              Eq(0));
+  EXPECT_THAT(memcmp(decoded->bearing, columns->bearing,
+                     sizeof(columns->bearing)), Eq(0));
+  EXPECT_THAT(memcmp(decoded->alarm, columns->alarm, sizeof(columns->alarm)),
+              Eq(0));
+  EXPECT_THAT(memcmp(decoded->status, columns->status,
+                     sizeof(columns->status)), Eq(0));
+  // Truncated blocks and foreign data are refused.
+  EXPECT_THAT(TrackArchive::DecodeBlock(block.data(), block.size() - 1,
+                                        decoded.get()), IsFalse());
+  block[0] = 0x00;
+  EXPECT_THAT(TrackArchive::DecodeBlock(block.data(), block.size(),
+                                        decoded.get()), IsFalse());
+}
+
+TEST(TrackBlockTest, PositionTimeTest) {
+  const uint8_t bcd[6] = {0x19, 0x06, 0x01, 0x00, 0x01, 0x01};
+  PositionRecord record = Record(kDayStart + 61, 0);
+
+  EXPECT_THAT(TrackArchive::PositionTime(record), Eq(kDayStart + 61));
+  EXPECT_THAT(TrackArchive::TimeFromBcd(bcd), Eq(kDayStart + 61));
+  memset(record.timestamp, 0x0, sizeof(record.timestamp));
+  EXPECT_THAT(TrackArchive::PositionTime(record), Eq(0u));
+}
+
+TEST_F(TrackArchiveTest, QueryTest) {
+  TrackArchive archive;
+
+  ASSERT_THAT(archive.Open(directory_.c_str()), IsTrue());
+  // Two and a half blocks, then the next day.
+  for (uint32_t i = 0; i < 2 * kTrackBlockPoints + 10; ++i) {
+    archive.Append(0, Record(kDayStart + i * 10, 22500000 + i));
+  }
+  archive.Append(0, Record(kDayStart + 86400 + 5, 22600000));
+  archive.Flush();
+
+  EXPECT_THAT(Query(kDayStart + 2555, kDayStart + 2575),
+              ElementsAre(kDayStart + 2560, kDayStart + 2570));
+  EXPECT_THAT(Query(kDayStart + 5200, kDayStart + 86400 + 10),
+              ElementsAre(kDayStart + 5200, kDayStart + 5210,
+                          kDayStart + 86400 + 5));
+  EXPECT_THAT(Query(kDayStart - 86400, kDayStart - 1).size(), Eq(0u));
+  EXPECT_THAT(Query(kDayStart, kDayStart + 86400 * 2).size(),
+              Eq(2 * kTrackBlockPoints + 11));
+}
+
+TEST_F(TrackArchiveTest, LateBlockTest) {
+  TrackArchive archive;
+
+  ASSERT_THAT(archive.Open(directory_.c_str()), IsTrue());
+  for (uint32_t i = 0; i < kTrackBlockPoints; ++i) {
+    archive.Append(0, Record(kDayStart + 10000 + i * 10, 22500000 + i));
+  }
+  archive.Flush();
+  // Reported late, written after a block of later points.
+  archive.Append(0, Record(kDayStart + 15, 22400000));
+  archive.Append(0, Record(kDayStart + 5, 22400001));
+  archive.Flush();
+
+  EXPECT_THAT(Query(kDayStart, kDayStart + 20),
+              ElementsAre(kDayStart + 5, kDayStart + 15));
+  EXPECT_THAT(Query(kDayStart, kDayStart + 10010),
+              ElementsAre(kDayStart + 5, kDayStart + 15, kDayStart + 10000,
+                          kDayStart + 10010));
+}
+
+TEST_F(TrackArchiveTest, IdleFlushTest) {
+  TrackArchive archive;
+
+  ASSERT_THAT(archive.Open(directory_.c_str()), IsTrue());
+  archive.Append(1000, Record(kDayStart, 1));
+  archive.FlushIdle(30000, 60000);
+  EXPECT_THAT(Query(kDayStart, kDayStart).size(), Eq(0u));
+  archive.FlushIdle(61000, 60000);
+  EXPECT_THAT(Query(kDayStart, kDayStart), ElementsAre(kDayStart));
+}
+
+TEST_F(TrackArchiveTest, CompressionTest) {
+  TrackArchive archive;
+
+  ASSERT_THAT(archive.Open(directory_.c_str()), IsTrue());
+  for (uint32_t i = 0; i < 10 * kTrackBlockPoints; ++i) {
+    archive.Append(0, Record(kDayStart + i * 30, 22500000 + i * 50));
+  }
+  archive.Flush();
+  // A PositionBasicInfo alone is 28 bytes a point.
+  EXPECT_THAT(archive.bytes_written(), Lt(archive.points() * 28 / 3));
+}
@@ -0,0 +1,372 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_track_store.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "common/jt808_logger.h"
+#include "service/jt808_util.h"
+
+
+const uint32_t TrackStore::kVersion;
+const size_t TrackStore::kHeaderSize;
+
+static const char kTrackMagic[8] = {'J', 'T', '8', '0', '8', 'T', 'R', 'K'};
+
+static std::string SegmentPath(const std::string &directory,
+                               const uint32_t &number, const char *suffix) {
+  char name[32];
+  snprintf(name, sizeof(name), "/%010u.%s", number, suffix);
+  return directory + name;
+}
+
+static size_t PageSize(void) {
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+TrackStore::~TrackStore() {
+  Close();
+}
+
+uint64_t TrackStore::NowMs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+std::vector<uint32_t> TrackStore::ListSegments(const char *directory) {
+  std::vector<uint32_t> numbers;
+  DIR *dir = opendir(directory);
+  struct dirent *entry;
+  unsigned int number;
+  char suffix[8];
+
+  if (dir == nullptr) {
+    return numbers;
+  }
+  while ((entry = readdir(dir)) != nullptr) {
+    if ((sscanf(entry->d_name, "%10u.%3s", &number, suffix) == 2) &&
+        (strcmp(suffix, "seg") == 0)) {
+      numbers.push_back(number);
+    }
+  }
+  closedir(dir);
+  std::sort(numbers.begin(), numbers.end());
+  return numbers;
+}
+
+bool TrackStore::Open(const char *directory) {
+  std::vector<uint32_t> numbers;
+
+  if (is_open()) {
+    return true;
+  }
+  directory_ = directory;
+  if (!MakeDirectories(directory_)) {
+    JT808_ERROR("create %s failed!!!", directory);
+    return false;
+  }
+  // Never append to an old segment, one left by a crash keeps its count.
+  numbers = ListSegments(directory);
+  return OpenSegment(numbers.empty() ? 0 : numbers.back() + 1, NowMs());
+}
+
+void TrackStore::Close(void) {
+  CloseSegment();
+}
+
+bool TrackStore::OpenSegment(const uint32_t &number,
+                             const uint64_t &now_ms) {
+  std::string path = SegmentPath(directory_, number, "seg");
+  size_t len = kHeaderSize + segment_records_ * sizeof(TrackRecord);
+  void *base;
+
+  segment_fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (segment_fd_ < 0) {
+    JT808_ERROR("open %s failed!!!", path.c_str());
+    return false;
+  }
+  // Reserve the blocks now, a full disk must not turn into SIGBUS on a
+  // write to the mapping.
+  if (posix_fallocate(segment_fd_, 0, static_cast<off_t>(len)) != 0) {
+    JT808_ERROR("allocate %s failed!!!", path.c_str());
+    close(segment_fd_);
+    segment_fd_ = -1;
+    unlink(path.c_str());
+    return false;
+  }
+  base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+              segment_fd_, 0);
+  if (base == MAP_FAILED) {
+    JT808_ERROR("map %s failed!!!", path.c_str());
+    close(segment_fd_);
+    segment_fd_ = -1;
+    unlink(path.c_str());
+    return false;
+  }
+  path = SegmentPath(directory_, number, "idx");
+  index_fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                   0644);
+
+  base_ = static_cast<uint8_t *>(base);
+  mapped_len_ = len;
+  header_ = reinterpret_cast<TrackSegmentHeader *>(base_);
+  records_ = reinterpret_cast<TrackRecord *>(base_ + kHeaderSize);
+  memcpy(header_->magic, kTrackMagic, sizeof(kTrackMagic));
+  header_->version = kVersion;
+  header_->record_size = sizeof(TrackRecord);
+  header_->capacity = segment_records_;
+  header_->count = 0;
+  header_->first_ms = 0;
+  header_->last_ms = 0;
+  header_->index_stride = index_stride_;
+  header_->closed = 0;
+  segment_number_ = number;
+  opened_ms_ = now_ms;
+  last_sync_ms_ = now_ms;
+  synced_count_ = 0;
+  return true;
+}
+
+void TrackStore::CloseSegment(void) {
+  uint64_t count;
+
+  if (header_ == nullptr) {
+    return;
+  }
+  count = header_->count;
+  header_->closed = 1;
+  msync(base_, mapped_len_, MS_SYNC);
+  munmap(base_, mapped_len_);
+  // Give back the unused preallocation.
+  if (ftruncate(segment_fd_, static_cast<off_t>(
+                    kHeaderSize + count * sizeof(TrackRecord))) < 0) {
+    JT808_WARNING("truncate segment %u failed!!!", segment_number_);
+  }
+  fsync(segment_fd_);
+  close(segment_fd_);
+  if (index_fd_ >= 0) {
+    fsync(index_fd_);
+    close(index_fd_);
+  }
+  segment_fd_ = -1;
+  index_fd_ = -1;
+  base_ = nullptr;
+  header_ = nullptr;
+  records_ = nullptr;
+  mapped_len_ = 0;
+}
+
+bool TrackStore::ShouldRoll(const uint64_t &received_ms) const {
+  return (header_->count == header_->capacity) ||
+         ((header_->count > 0) &&
+          (received_ms >= opened_ms_ + roll_interval_ * 1000ULL));
+}
+
+bool TrackStore::Append(const uint64_t &received_ms,
+                        const PositionRecord &record) {
+  return Append(received_ms, &record, 1);
+}
+
+bool TrackStore::Append(const uint64_t &received_ms,
+                        const PositionRecord *records,
+                        const size_t &count) {
+  uint64_t position;
+  TrackIndexEntry entry;
+
+  if (header_ == nullptr) {
+    return false;
+  }
+  // Kept non-decreasing across segments, Scan relies on it.
+  if (received_ms > last_ms_) {
+    last_ms_ = received_ms;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (ShouldRoll(last_ms_)) {
+      uint32_t next = segment_number_ + 1;
+      CloseSegment();
+      if (!OpenSegment(next, last_ms_)) {
+        return false;
+      }
+    }
+    position = header_->count;
+    records_[position].received_ms = last_ms_;
+    records_[position].position = records[i];
+    if ((position % index_stride_ == 0) && (index_fd_ >= 0)) {
+      entry.received_ms = last_ms_;
+      entry.record = position;
+      if (write(index_fd_, &entry, sizeof(entry)) !=
+          static_cast<ssize_t>(sizeof(entry))) {
+        JT808_WARNING("write index of segment %u failed!!!",
+                      segment_number_);
+      }
+    }
+    if (position == 0) {
+      header_->first_ms = last_ms_;
+    }
+    header_->last_ms = last_ms_;
+    // Published last, a reader never sees a half written record.
+    __atomic_store_n(&header_->count, position + 1, __ATOMIC_RELEASE);
+    ++appended_;
+  }
+  if (last_ms_ >= last_sync_ms_ + static_cast<uint64_t>(sync_interval_)) {
+    return Sync();
+  }
+  return true;
+}
+
+bool TrackStore::Sync(void) {
+  size_t page = PageSize();
+  size_t begin;
+  size_t end;
+  bool ok = true;
+
+  if (header_ == nullptr) {
+    return false;
+  }
+  begin = kHeaderSize + synced_count_ * sizeof(TrackRecord);
+  end = kHeaderSize + header_->count * sizeof(TrackRecord);
+  begin -= begin % page;
+  if ((end > begin) &&
+      (msync(base_ + begin, end - begin, MS_SYNC) < 0)) {
+    ok = false;
+  }
+  if (msync(base_, kHeaderSize, MS_SYNC) < 0) {
+    ok = false;
+  }
+  if ((index_fd_ >= 0) && (fdatasync(index_fd_) < 0)) {
+    ok = false;
+  }
+  if (!ok) {
+    JT808_ERROR("sync segment %u failed!!!", segment_number_);
+  }
+  synced_count_ = header_->count;
+  last_sync_ms_ = last_ms_;
+  return ok;
+}
+
+// Index entries of |number|, empty if there is no usable index.
+static std::vector<TrackIndexEntry> ReadIndex(const std::string &directory,
+                                              const uint32_t &number) {
+  std::vector<TrackIndexEntry> entries;
+  std::string path = SegmentPath(directory, number, "idx");
+  struct stat st;
+  int fd = open(path.c_str(), O_RDONLY);
+  ssize_t len;
+
+  if (fd < 0) {
+    return entries;
+  }
+  if (fstat(fd, &st) == 0) {
+    entries.resize(static_cast<size_t>(st.st_size) / sizeof(TrackIndexEntry));
+    len = read(fd, entries.data(), entries.size() * sizeof(TrackIndexEntry));
+    entries.resize(len > 0 ? static_cast<size_t>(len) /
+                                 sizeof(TrackIndexEntry) : 0);
+  }
+  close(fd);
+  return entries;
+}
+
+uint64_t TrackStore::Scan(
+    const char *directory, const uint64_t &from_ms, const uint64_t &to_ms,
+    const std::function<bool(const TrackRecord &)> &visit) {
+  std::string path;
+  std::vector<TrackIndexEntry> index;
+  const TrackSegmentHeader *header;
+  const TrackRecord *records;
+  struct stat st;
+  void *base;
+  uint64_t count;
+  uint64_t position;
+  uint64_t visited = 0;
+  bool more = true;
+  int fd;
+
+  for (auto number : ListSegments(directory)) {
+    path = SegmentPath(directory, number, "seg");
+    if ((fd = open(path.c_str(), O_RDONLY)) < 0) {
+      continue;
+    }
+    if ((fstat(fd, &st) < 0) ||
+        (static_cast<size_t>(st.st_size) < kHeaderSize)) {
+      close(fd);
+      continue;
+    }
+    base = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      continue;
+    }
+    header = static_cast<const TrackSegmentHeader *>(base);
+    records = reinterpret_cast<const TrackRecord *>(
+                  static_cast<const uint8_t *>(base) + kHeaderSize);
+    count = std::min<uint64_t>(
+                __atomic_load_n(&header->count, __ATOMIC_ACQUIRE),
+                (st.st_size - kHeaderSize) / sizeof(TrackRecord));
+    if ((memcmp(header->magic, kTrackMagic, sizeof(kTrackMagic)) != 0) ||
+        (header->version != kVersion) ||
+        (header->record_size != sizeof(TrackRecord)) || (count == 0) ||
+        (records[0].received_ms > to_ms) ||
+        (records[count - 1].received_ms < from_ms)) {
+      munmap(base, static_cast<size_t>(st.st_size));
+      continue;
+    }
+    // Start at the last indexed record before |from_ms|, segments later
+    // than one ending past |to_ms| need not be opened.
+    position = 0;
+    index = ReadIndex(directory, number);
+    auto it = std::lower_bound(
+                  index.begin(), index.end(), from_ms,
+                  [](const TrackIndexEntry &entry, const uint64_t &ms) {
+                    return entry.received_ms < ms;
+                  });
+    if (it != index.begin()) {
+      position = std::min((it - 1)->record, count);
+    }
+    for (; position < count; ++position) {
+      if (records[position].received_ms < from_ms) {
+        continue;
+      }
+      if (records[position].received_ms > to_ms) {
+        break;
+      }
+      ++visited;
+      if (!(more = visit(records[position]))) {
+        break;
+      }
+    }
+    munmap(base, static_cast<size_t>(st.st_size));
+    if (!more || (position < count)) {
+      break;
+    }
+  }
+  return visited;
+}
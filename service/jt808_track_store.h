@@ -0,0 +1,144 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_TRACK_STORE_H_
+#define JT808_SERVICE_JT808_TRACK_STORE_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "service/jt808_position_report.h"
+
+
+// A position report as stored, ordered by the time it was received.
+struct TrackRecord {
+  uint64_t received_ms;  // Unix time in milliseconds.
+  PositionRecord position;
+};
+
+// 轨迹分段文件头, 占文件开头一页, 记录紧随其后.
+struct TrackSegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t capacity;  // 可容纳的记录数
+  uint64_t count;  // 已写入的记录数
+  uint64_t first_ms;
+  uint64_t last_ms;
+  uint32_t index_stride;
+  uint32_t closed;  // 正常关闭后置 1, 文件已截断到实际长度
+};
+
+// 稀疏时间索引项, 每 |index_stride| 条记录一项.
+struct TrackIndexEntry {
+  uint64_t received_ms;
+  uint64_t record;
+};
+
+// Append-only store of position reports, a write-ahead log of the whole
+// fleet: the fixed-size records of all devices are interleaved in arrival
+// order. Records go into memory-mapped, preallocated segment files,
+// "NNNNNNNNNN.seg" in the store directory, with a sparse time index next
+// to each segment in "NNNNNNNNNN.idx". A segment is rolled over when it is
+// full or older than the roll interval, dirty pages are synced every sync
+// interval. The history of one device is looked up in the TrackArchive,
+// not here. Not thread safe, one writer appends while Scan may run
+// anywhere.
+class TrackStore {
+ public:
+  static const uint32_t kVersion = 1;
+  // The header takes a page so the records start page aligned.
+  static const size_t kHeaderSize = 4096;
+
+  TrackStore() = default;
+  TrackStore(const TrackStore&) = delete;
+  TrackStore& operator=(const TrackStore&) = delete;
+  virtual ~TrackStore();
+
+  // Set before Open. Records in a segment, default 1M (88MB).
+  void set_segment_records(const uint64_t &records) {
+    segment_records_ = records > 0 ? records : 1;
+  }
+  // Seconds before a segment is rolled over, default an hour.
+  void set_roll_interval(const int &seconds) { roll_interval_ = seconds; }
+  // Milliseconds between syncs, 0 syncs every record.
+  void set_sync_interval(const int &milliseconds) {
+    sync_interval_ = milliseconds;
+  }
+  // Records between two index entries, default 1024.
+  void set_index_stride(const uint32_t &stride) {
+    index_stride_ = stride > 0 ? stride : 1;
+  }
+
+  // Create |directory| if needed and start a new segment after the ones
+  // already there. Return false on error.
+  bool Open(const char *directory);
+  // Sync, shrink the active segment to its records and close it.
+  void Close(void);
+  bool is_open(void) const { return header_ != nullptr; }
+
+  // Append |record| received at |received_ms|, return false on error.
+  bool Append(const uint64_t &received_ms, const PositionRecord &record);
+  // Append |count| records received at |received_ms|.
+  bool Append(const uint64_t &received_ms, const PositionRecord *records,
+              const size_t &count);
+  // Write dirty records and index entries to disk.
+  bool Sync(void);
+
+  // Milliseconds since the epoch.
+  static uint64_t NowMs(void);
+
+  uint64_t appended(void) const { return appended_; }
+  uint32_t segment_number(void) const { return segment_number_; }
+
+  // Visit the records of |directory| received in [from_ms, to_ms] in
+  // order, until |visit| returns false. Return the records visited. The
+  // records of every device in the range are read, e.g. for replay.
+  static uint64_t Scan(const char *directory, const uint64_t &from_ms,
+                       const uint64_t &to_ms,
+                       const std::function<bool(const TrackRecord &)> &visit);
+  // Segment numbers in |directory|, ascending.
+  static std::vector<uint32_t> ListSegments(const char *directory);
+
+ private:
+  bool OpenSegment(const uint32_t &number, const uint64_t &now_ms);
+  void CloseSegment(void);
+  bool ShouldRoll(const uint64_t &received_ms) const;
+
+  std::string directory_;
+  uint64_t segment_records_ = 1024 * 1024;
+  int roll_interval_ = 3600;
+  int sync_interval_ = 1000;
+  uint32_t index_stride_ = 1024;
+
+  int segment_fd_ = -1;
+  int index_fd_ = -1;
+  uint32_t segment_number_ = 0;
+  size_t mapped_len_ = 0;
+  uint8_t *base_ = nullptr;
+  TrackSegmentHeader *header_ = nullptr;
+  TrackRecord *records_ = nullptr;
+  uint64_t opened_ms_ = 0;
+  uint64_t last_ms_ = 0;
+  uint64_t last_sync_ms_ = 0;
+  // Records before this one are on disk.
+  uint64_t synced_count_ = 0;
+  uint64_t appended_ = 0;
+};
+
+#endif  // JT808_SERVICE_JT808_TRACK_STORE_H_
@@ -0,0 +1,145 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <sys/stat.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_track_store.h"
+
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsTrue;
+
+class TrackStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/jt808_track_XXXXXX";
+    ASSERT_THAT(mkdtemp(path) != nullptr, IsTrue());
+    directory_ = path;
+  }
+
+  void TearDown() override {
+    std::string command = "rm -rf " + directory_;
+    ASSERT_THAT(system(command.c_str()), Eq(0));
+  }
+
+  static PositionRecord Record(const uint32_t &mileage) {
+    PositionRecord record;
+    memset(&record, 0x0, sizeof(record));
+    record.mileage = mileage;
+    return record;
+  }
+
+  // Mileages of the records received in [from_ms, to_ms].
+  std::vector<uint32_t> Scan(const uint64_t &from_ms, const uint64_t &to_ms) {
+    std::vector<uint32_t> mileages;
+    TrackStore::Scan(directory_.c_str(), from_ms, to_ms,
+                     [&mileages](const TrackRecord &record) {
+                       mileages.push_back(record.position.mileage);
+                       return true;
+                     });
+    return mileages;
+  }
+
+  std::string directory_;
+};
+
+TEST_F(TrackStoreTest, AppendScanTest) {
+  TrackStore store;
+
+  store.set_index_stride(2);
+  ASSERT_THAT(store.Open(directory_.c_str()), IsTrue());
+  for (uint32_t i = 0; i < 10; ++i) {
+    EXPECT_THAT(store.Append(1000 + i * 10, Record(i)), IsTrue());
+  }
+  // Readable while the segment is still being written.
+  EXPECT_THAT(Scan(1025, 1050), ElementsAre(3, 4, 5));
+  store.Close();
+  EXPECT_THAT(Scan(1025, 1050), ElementsAre(3, 4, 5));
+  EXPECT_THAT(Scan(0, 1000), ElementsAre(0));
+  EXPECT_THAT(Scan(2000, 3000).size(), Eq(0u));
+}
+
+TEST_F(TrackStoreTest, RolloverTest) {
+  TrackStore store;
+  PositionRecord records[5];
+  struct stat st;
+
+  store.set_segment_records(4);
+  store.set_roll_interval(60);
+  ASSERT_THAT(store.Open(directory_.c_str()), IsTrue());
+  for (uint32_t i = 0; i < 5; ++i) {
+    records[i] = Record(i);
+  }
+  // Four to a segment, then the fifth rolls over by size.
+  EXPECT_THAT(store.Append(1000, records, 5), IsTrue());
+  EXPECT_THAT(store.segment_number(), Eq(1u));
+  // A minute later rolls over by time.
+  EXPECT_THAT(store.Append(61000, Record(5)), IsTrue());
+  EXPECT_THAT(store.segment_number(), Eq(2u));
+  store.Close();
+
+  EXPECT_THAT(TrackStore::ListSegments(directory_.c_str()),
+              ElementsAre(0u, 1u, 2u));
+  // Closed segments are shrunk to their records.
+  ASSERT_THAT(stat((directory_ + "/0000000001.seg").c_str(), &st), Eq(0));
+  EXPECT_THAT(static_cast<size_t>(st.st_size),
+              Eq(TrackStore::kHeaderSize + sizeof(TrackRecord)));
+  EXPECT_THAT(Scan(0, 100000), ElementsAre(0, 1, 2, 3, 4, 5));
+  EXPECT_THAT(Scan(61000, 61000), ElementsAre(5));
+}
+
+TEST_F(TrackStoreTest, ReopenTest) {
+  {
+    TrackStore store;
+    ASSERT_THAT(store.Open(directory_.c_str()), IsTrue());
+    store.Append(1000, Record(1));
+  }
+  TrackStore store;
+  ASSERT_THAT(store.Open(directory_.c_str()), IsTrue());
+  // A new segment after the old one.
+  EXPECT_THAT(store.segment_number(), Eq(1u));
+  store.Append(2000, Record(2));
+  store.Sync();
+  EXPECT_THAT(Scan(0, 3000), ElementsAre(1, 2));
+}
+
+TEST_F(TrackStoreTest, SparseIndexTest) {
+  TrackStore store;
+  uint64_t visited;
+
+  store.set_index_stride(16);
+  ASSERT_THAT(store.Open(directory_.c_str()), IsTrue());
+  for (uint32_t i = 0; i < 1000; ++i) {
+    store.Append(i, Record(i));
+  }
+  store.Close();
+  EXPECT_THAT(Scan(500, 502), ElementsAre(500, 501, 502));
+  // Stops when the visitor does.
+  visited = TrackStore::Scan(directory_.c_str(), 0, 1000,
+                             [](const TrackRecord &record) {
+                               return record.position.mileage < 9;
+                             });
+  EXPECT_THAT(visited, Eq(10u));
+}
@@ -0,0 +1,154 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_upgrade_campaign.h"
+
+#include <algorithm>
+
+
+// The budget saved up while idle, in seconds of bandwidth.
+static const double kBurstSeconds = 0.1;
+
+void UpgradeCampaign::set_max_concurrent(const size_t &count) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_concurrent_ = count;
+}
+
+void UpgradeCampaign::set_bandwidth(const uint64_t &bandwidth) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  bandwidth_ = bandwidth;
+  // Start with a full burst.
+  tokens_ = bandwidth * kBurstSeconds;
+  refilled_ = std::chrono::steady_clock::now();
+}
+
+uint64_t UpgradeCampaign::bandwidth(void) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bandwidth_;
+}
+
+std::shared_ptr<const UpgradeImage> UpgradeCampaign::Image(
+    const char *path, const uint8_t &type, const char *version) {
+  std::string key = std::to_string(type) + ":" + version + ":" + path;
+  std::shared_ptr<const UpgradeImage> image;
+  std::shared_ptr<const UpgradeImage> current;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = images_.find(key);
+    if (it != images_.end()) {
+      image = it->second.lock();
+    }
+  }
+  // Checking, mapping and encoding the file take a while, the reactors go
+  // on scheduling meanwhile.
+  if ((image != nullptr) && image->Unchanged(path)) {
+    return image;
+  }
+  std::shared_ptr<UpgradeImage> mapped = std::make_shared<UpgradeImage>();
+  if (!mapped->Map(path, type, version)) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another thread may have mapped it again first.
+  auto it = images_.find(key);
+  if (it != images_.end()) {
+    current = it->second.lock();
+    if ((current != nullptr) && (current != image)) {
+      return current;
+    }
+  }
+  // Forget the images nobody uses any more.
+  for (auto it = images_.begin(); it != images_.end(); ) {
+    if (it->second.expired()) {
+      it = images_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  images_[key] = mapped;
+  return mapped;
+}
+
+bool UpgradeCampaign::Admit(const UpgradeRequest &request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if ((max_concurrent_ == 0) || (active_.size() < max_concurrent_)) {
+    active_.insert(request.device);
+    return true;
+  }
+  queue_.push_back(request);
+  return false;
+}
+
+UpgradeRequest UpgradeCampaign::Release(const DeviceNode *device) {
+  UpgradeRequest next;
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (active_.erase(device) == 0) {
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                [device](const UpgradeRequest &request) {
+                                  return request.device == device;
+                                }),
+                 queue_.end());
+    return next;
+  }
+  if (!queue_.empty() &&
+      ((max_concurrent_ == 0) || (active_.size() < max_concurrent_))) {
+    next = queue_.front();
+    queue_.pop_front();
+    active_.insert(next.device);
+  }
+  return next;
+}
+
+bool UpgradeCampaign::HasBandwidth(void) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (bandwidth_ == 0) {
+    return true;
+  }
+  Refill();
+  return tokens_ > 0.0;
+}
+
+void UpgradeCampaign::Consume(const size_t &bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  if (bandwidth_ > 0) {
+    tokens_ -= bytes;
+  }
+}
+
+size_t UpgradeCampaign::active(void) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return active_.size();
+}
+
+size_t UpgradeCampaign::queued(void) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+void UpgradeCampaign::Refill(void) {
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed = now - refilled_;
+  double burst = std::max(bandwidth_ * kBurstSeconds,
+                          static_cast<double>(MAX_PROFRAMEBUF_LEN));
+
+  tokens_ = std::min(burst, tokens_ + elapsed.count() * bandwidth_);
+  refilled_ = now;
+}
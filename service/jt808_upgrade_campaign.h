@@ -0,0 +1,92 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_UPGRADE_CAMPAIGN_H_
+#define JT808_SERVICE_JT808_UPGRADE_CAMPAIGN_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+
+#include "service/jt808_upgrade_image.h"
+#include "service/jt808_util.h"
+
+
+// Upgrade of one device to an image.
+struct UpgradeRequest {
+  DeviceNode *device = nullptr;
+  std::shared_ptr<const UpgradeImage> image;
+};
+
+// Schedules the upgrades of the whole fleet. An image is mapped once and
+// shared by every device upgraded to it, at most |max_concurrent| devices
+// upgrade at once while the others wait in order, and the package frames
+// of all of them share one bandwidth budget. Thread safe, the reactors
+// share one campaign.
+class UpgradeCampaign {
+ public:
+  UpgradeCampaign() = default;
+  UpgradeCampaign(const UpgradeCampaign&) = delete;
+  UpgradeCampaign& operator=(const UpgradeCampaign&) = delete;
+  virtual ~UpgradeCampaign() = default;
+
+  // 0 for no limit, the default.
+  void set_max_concurrent(const size_t &count);
+  // Bytes of package frames per second over all devices, 0 for no limit,
+  // the default.
+  void set_bandwidth(const uint64_t &bandwidth);
+  uint64_t bandwidth(void) const;
+
+  // The image of |path| for upgrade |type| to |version|, mapped again only
+  // once no upgrade uses it or the file changed. nullptr if it can not be
+  // mapped.
+  std::shared_ptr<const UpgradeImage> Image(const char *path,
+                                            const uint8_t &type,
+                                            const char *version);
+  // Return true if |request| may start now, otherwise it is queued.
+  bool Admit(const UpgradeRequest &request);
+  // The upgrade of |device| ended, or |device| gave up waiting. Return the
+  // queued upgrade to start in its place, with no device if there is none.
+  UpgradeRequest Release(const DeviceNode *device);
+  // Whether the budget allows sending another package frame now.
+  bool HasBandwidth(void);
+  // |bytes| of package frames were sent.
+  void Consume(const size_t &bytes);
+
+  size_t active(void) const;
+  size_t queued(void) const;
+
+ private:
+  void Refill(void);
+
+  mutable std::mutex mutex_;
+  size_t max_concurrent_ = 0;
+  uint64_t bandwidth_ = 0;
+  // Keyed by type, version and path.
+  std::map<std::string, std::weak_ptr<const UpgradeImage>> images_;
+  std::set<const DeviceNode *> active_;
+  std::deque<UpgradeRequest> queue_;
+  // Token bucket in bytes, overdrawn by at most the last frames sent.
+  double tokens_ = 0.0;
+  std::chrono::steady_clock::time_point refilled_;
+};
+
+#endif  // JT808_SERVICE_JT808_UPGRADE_CAMPAIGN_H_
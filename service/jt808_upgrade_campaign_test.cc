@@ -0,0 +1,127 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <memory>
+#include <thread>  // NOLINT
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_upgrade_campaign.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsNull;
+using ::testing::IsTrue;
+using ::testing::NotNull;
+
+static const char *kImagePath = "/tmp/jt808_upgrade_campaign_test.bin";
+
+static void WriteImage(const size_t &size) {
+  FILE *fp = fopen(kImagePath, "wb");
+
+  for (size_t i = 0; i < size; ++i) {
+    fputc(static_cast<int>(i), fp);
+  }
+  fclose(fp);
+}
+
+TEST(UpgradeCampaignTest, ImageTest) {
+  UpgradeCampaign campaign;
+
+  WriteImage(3000);
+  auto image = campaign.Image(kImagePath, 0, "1.0.0");
+  ASSERT_THAT(image, NotNull());
+  // One mapping for every device upgraded to the same version.
+  EXPECT_THAT(campaign.Image(kImagePath, 0, "1.0.0").get(), Eq(image.get()));
+  EXPECT_THAT(campaign.Image(kImagePath, 0, "1.0.1").get() == image.get(),
+              IsFalse());
+  EXPECT_THAT(campaign.Image("/tmp/jt808_no_such_image.bin", 0, "1.0.0"),
+              IsNull());
+
+  // A rewritten file is mapped again.
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  WriteImage(4000);
+  auto rewritten = campaign.Image(kImagePath, 0, "1.0.0");
+  ASSERT_THAT(rewritten, NotNull());
+  EXPECT_THAT(rewritten->size(), Eq(4000u));
+  EXPECT_THAT(image->size(), Eq(3000u));
+  unlink(kImagePath);
+}
+
+TEST(UpgradeCampaignTest, ConcurrentImageTest) {
+  std::shared_ptr<const UpgradeImage> images[4];
+  std::thread threads[4];
+  UpgradeCampaign campaign;
+
+  // Mapped outside the lock by any of them, shared by all.
+  WriteImage(300000);
+  for (int i = 0; i < 4; ++i) {
+    threads[i] = std::thread([&campaign, &images, i] {
+      images[i] = campaign.Image(kImagePath, 0, "1.0.0");
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  ASSERT_THAT(images[0], NotNull());
+  for (auto &image : images) {
+    EXPECT_THAT(image.get(), Eq(images[0].get()));
+  }
+  unlink(kImagePath);
+}
+
+TEST(UpgradeCampaignTest, ScheduleTest) {
+  DeviceNode devices[4];
+  UpgradeCampaign campaign;
+  UpgradeRequest request;
+
+  campaign.set_max_concurrent(2);
+  for (auto &device : devices) {
+    request.device = &device;
+    EXPECT_THAT(campaign.Admit(request), Eq(&device < &devices[2]));
+  }
+  EXPECT_THAT(campaign.active(), Eq(2u));
+  EXPECT_THAT(campaign.queued(), Eq(2u));
+
+  // A queued device gives up, the other one takes the first free slot.
+  EXPECT_THAT(campaign.Release(&devices[2]).device, IsNull());
+  EXPECT_THAT(campaign.queued(), Eq(1u));
+  EXPECT_THAT(campaign.Release(&devices[0]).device, Eq(&devices[3]));
+  EXPECT_THAT(campaign.Release(&devices[1]).device, IsNull());
+  EXPECT_THAT(campaign.Release(&devices[3]).device, IsNull());
+  EXPECT_THAT(campaign.active(), Eq(0u));
+}
+
+TEST(UpgradeCampaignTest, BandwidthTest) {
+  UpgradeCampaign campaign;
+
+  EXPECT_THAT(campaign.HasBandwidth(), IsTrue());
+  campaign.Consume(1 << 20);
+  EXPECT_THAT(campaign.HasBandwidth(), IsTrue());
+
+  // 100 KB/s starts with 10 KB saved up.
+  campaign.set_bandwidth(100 * 1024);
+  EXPECT_THAT(campaign.HasBandwidth(), IsTrue());
+  campaign.Consume(20 * 1024);
+  EXPECT_THAT(campaign.HasBandwidth(), IsFalse());
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_THAT(campaign.HasBandwidth(), IsTrue());
+}
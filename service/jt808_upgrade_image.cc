@@ -0,0 +1,171 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_upgrade_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <unistd.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "common/jt808_util.h"
+
+
+// Room of the version in an upgrade package.
+static const size_t kMaxVersionLength = 32;
+
+static uint64_t Fnv1a(const uint8_t *data, const size_t &len) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+UpgradeImage::~UpgradeImage() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+bool UpgradeImage::Map(const char *path, const uint8_t &type,
+                       const char *version) {
+  struct stat st;
+  uint8_t head[11 + kMaxVersionLength];
+  uint8_t *dst;
+  size_t version_len = strlen(version);
+  size_t count;
+  size_t len;
+  uint32_t u32val;
+  void *base;
+  int fd;
+
+  if ((data_ != nullptr) || (version_len > kMaxVersionLength)) {
+    return false;
+  }
+  if ((fd = open(path, O_RDONLY)) < 0) {
+    return false;
+  }
+  if ((fstat(fd, &st) < 0) || (st.st_size <= 0)) {
+    close(fd);
+    return false;
+  }
+  base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<uint8_t *>(base);
+  size_ = static_cast<size_t>(st.st_size);
+  mtime_ = st.st_mtim;
+  hash_ = Fnv1a(data_, size_);
+  path_ = path;
+  type_ = type;
+  version_ = version;
+  // The body length has 10 bits, the chunk follows 11 bytes and the
+  // version.
+  chunk_size_ = 1023 - 11 - version_len;
+  count = (size_ + chunk_size_ - 1) / chunk_size_;
+  if (count > UINT16_MAX) {
+    return false;
+  }
+
+  // Upgrade type, manufacturer id, version and chunk length.
+  memset(head, 0x0, sizeof(head));
+  head[0] = type;
+  head[6] = static_cast<uint8_t>(version_len);
+  memcpy(&head[7], version, version_len);
+  bodies_.resize(2 * (count * (11 + version_len) + size_));
+  offsets_.assign(1, 0);
+  checksums_.assign(1, 0);
+  dst = bodies_.data();
+  for (uint16_t sequence = 1; sequence <= count; ++sequence) {
+    len = chunk_size(sequence);
+    u32val = EndianSwap32(static_cast<uint32_t>(len));
+    memcpy(&head[7 + version_len], &u32val, 4);
+    dst += Escape(head, 11 + version_len, dst);
+    dst += Escape(chunk(sequence), len, dst);
+    offsets_.push_back(static_cast<size_t>(dst - bodies_.data()));
+    checksums_.push_back(BccCheckSum(head, 11 + version_len) ^
+                         BccCheckSum(chunk(sequence), len));
+  }
+  bodies_.resize(offsets_.back());
+  bodies_.shrink_to_fit();
+  return true;
+}
+
+size_t UpgradeImage::PackChunk(const uint16_t &sequence,
+                               const uint8_t *phone_bcd,
+                               const uint16_t &flow_num,
+                               Message *msg) const {
+  msg->size = PackChunk(sequence, phone_bcd, flow_num, msg->buffer);
+  return msg->size;
+}
+
+size_t UpgradeImage::PackChunk(const uint16_t &sequence,
+                               const uint8_t *phone_bcd,
+                               const uint16_t &flow_num,
+                               uint8_t *frame) const {
+  uint8_t head[sizeof(MessageHead) + 1];
+  MessageHead *msghead_ptr = reinterpret_cast<MessageHead *>(head);
+  size_t head_len = MSGBODY_NOPACKAGE_POS - 1;
+  size_t body_len = offsets_[sequence] - offsets_[sequence - 1];
+  uint8_t *dst = frame;
+
+  msghead_ptr->id = EndianSwap16(DOWN_UPGRADEPACKAGE);
+  msghead_ptr->attribute.value = 0;
+  msghead_ptr->attribute.bit.msglen = static_cast<uint16_t>(
+      11 + version_.size() + chunk_size(sequence));
+  memcpy(msghead_ptr->phone, phone_bcd, 6);
+  msghead_ptr->msgflownum = EndianSwap16(flow_num);
+  if (chunk_count() > 1) {
+    msghead_ptr->attribute.bit.package = 1;
+    msghead_ptr->totalpackage = EndianSwap16(chunk_count());
+    msghead_ptr->packetseq = EndianSwap16(sequence);
+    head_len = MSGBODY_PACKAGE_POS - 1;
+  }
+  msghead_ptr->attribute.value = EndianSwap16(msghead_ptr->attribute.value);
+  head[head_len] = BccCheckSum(head, head_len) ^ checksums_[sequence];
+
+  // Head, shared body, then the check code.
+  *dst++ = PROTOCOL_SIGN;
+  dst += Escape(head, head_len, dst);
+  memcpy(dst, &bodies_[offsets_[sequence - 1]], body_len);
+  dst += body_len;
+  dst += Escape(&head[head_len], 1, dst);
+  *dst++ = PROTOCOL_SIGN;
+  return static_cast<size_t>(dst - frame);
+}
+
+bool UpgradeImage::Unchanged(const char *path) const {
+  struct stat st;
+
+  return (stat(path, &st) == 0) &&
+         (static_cast<size_t>(st.st_size) == size_) &&
+         (st.st_mtim.tv_sec == mtime_.tv_sec) &&
+         (st.st_mtim.tv_nsec == mtime_.tv_nsec);
+}
+
+size_t UpgradeImage::chunk_size(const uint16_t &sequence) const {
+  size_t offset = (sequence - 1) * chunk_size_;
+
+  return std::min(chunk_size_, size_ - offset);
+}
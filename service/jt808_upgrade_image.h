@@ -0,0 +1,85 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_UPGRADE_IMAGE_H_
+#define JT808_SERVICE_JT808_UPGRADE_IMAGE_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "common/jt808_protocol.h"
+
+
+// An upgrade file memory-mapped once and cut into the chunks of one
+// upgrade type and version. The escaped package body and the check code
+// of every chunk are encoded up front, packing the frame for a terminal
+// only escapes its head. Read only once mapped, so any number of
+// upgrades on any thread may share it.
+class UpgradeImage {
+ public:
+  UpgradeImage() = default;
+  UpgradeImage(const UpgradeImage&) = delete;
+  UpgradeImage& operator=(const UpgradeImage&) = delete;
+  virtual ~UpgradeImage();
+
+  // Map the file at |path| for upgrade |type| to |version|. Return false
+  // if it can not be mapped, is empty or needs more chunks than a packet
+  // sequence can number.
+  bool Map(const char *path, const uint8_t &type, const char *version);
+  // Pack the frame of chunk |sequence| to the terminal |phone_bcd|,
+  // numbered |flow_num|, into |msg|. Return the frame size.
+  size_t PackChunk(const uint16_t &sequence, const uint8_t *phone_bcd,
+                   const uint16_t &flow_num, Message *msg) const;
+  // Same into |frame|, which has room for MAX_PROFRAMEBUF_LEN bytes.
+  size_t PackChunk(const uint16_t &sequence, const uint8_t *phone_bcd,
+                   const uint16_t &flow_num, uint8_t *frame) const;
+  // Whether the file at |path| is still the one mapped.
+  bool Unchanged(const char *path) const;
+
+  const std::string &path(void) const { return path_; }
+  uint8_t type(void) const { return type_; }
+  const std::string &version(void) const { return version_; }
+  size_t size(void) const { return size_; }
+  // FNV-1a of the file, tells a resumed upgrade it is the same image.
+  uint64_t hash(void) const { return hash_; }
+  uint16_t chunk_count(void) const {
+    return static_cast<uint16_t>(checksums_.size() - 1);
+  }
+  const uint8_t *chunk(const uint16_t &sequence) const {
+    return data_ + (sequence - 1) * chunk_size_;
+  }
+  size_t chunk_size(const uint16_t &sequence) const;
+
+ private:
+  uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  struct timespec mtime_ = {0, 0};
+  uint64_t hash_ = 0;
+  std::string path_;
+  uint8_t type_ = 0;
+  std::string version_;
+  size_t chunk_size_ = 0;
+  // Escaped package bodies back to back, chunk |sequence| starts at
+  // |offsets_[sequence - 1]| and ends at |offsets_[sequence]|.
+  std::vector<uint8_t> bodies_;
+  std::vector<size_t> offsets_;
+  // XOR of each unescaped body, indexed by sequence, entry 0 unused.
+  std::vector<uint8_t> checksums_;
+};
+
+#endif  // JT808_SERVICE_JT808_UPGRADE_IMAGE_H_
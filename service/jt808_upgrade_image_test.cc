@@ -0,0 +1,114 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "common/jt808_util.h"
+#include "service/jt808_frame_decoder.h"
+#include "service/jt808_upgrade_image.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+static const char *kImagePath = "/tmp/jt808_upgrade_image_test.bin";
+// Chunk size with a five character version.
+static const size_t kChunkSize = 1023 - 11 - 5;
+
+class UpgradeImageTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FILE *fp = fopen(kImagePath, "wb");
+
+    // Flags and escape bytes all over the image.
+    image_.resize(2 * kChunkSize + 100);
+    for (size_t i = 0; i < image_.size(); ++i) {
+      image_[i] = static_cast<uint8_t>(0x7C + i % 4);
+    }
+    fwrite(image_.data(), 1, image_.size(), fp);
+    fclose(fp);
+  }
+  void TearDown() override { unlink(kImagePath); }
+
+  std::vector<uint8_t> image_;
+};
+
+TEST_F(UpgradeImageTest, MapTest) {
+  UpgradeImage missing;
+  UpgradeImage image;
+
+  EXPECT_THAT(missing.Map("/tmp/jt808_no_such_image.bin", 0, "1.0.0"),
+              IsFalse());
+  ASSERT_THAT(image.Map(kImagePath, 0x34, "1.0.0"), IsTrue());
+  EXPECT_THAT(image.size(), Eq(image_.size()));
+  EXPECT_THAT(image.chunk_count(), Eq(3));
+  EXPECT_THAT(image.chunk_size(1), Eq(kChunkSize));
+  EXPECT_THAT(image.chunk_size(3), Eq(100u));
+  EXPECT_THAT(memcmp(image.chunk(3), &image_[2 * kChunkSize], 100), Eq(0));
+  EXPECT_THAT(image.Unchanged(kImagePath), IsTrue());
+  EXPECT_THAT(image.Unchanged("/tmp/jt808_no_such_image.bin"), IsFalse());
+}
+
+TEST_F(UpgradeImageTest, PackChunkTest) {
+  const uint8_t phone_bcd[6] = {0x01, 0x38, 0x26, 0x53, 0x98, 0x50};
+  UpgradeImage image;
+  FrameView view;
+  Message msg;
+
+  ASSERT_THAT(image.Map(kImagePath, 0x34, "1.0.0"), IsTrue());
+  for (uint16_t sequence = 1; sequence <= 3; ++sequence) {
+    // Flow numbers that need escaping.
+    image.PackChunk(sequence, phone_bcd, 0x7E7D, &msg);
+    ASSERT_THAT(DecodeFrame(&msg, &view), Eq(kFrameDecodeOk));
+    EXPECT_THAT(view.id, Eq(DOWN_UPGRADEPACKAGE));
+    EXPECT_THAT(memcmp(view.phone, phone_bcd, 6), Eq(0));
+    EXPECT_THAT(view.flow_num, Eq(0x7E7D));
+    EXPECT_THAT(view.attribute.bit.package, Eq(1));
+    EXPECT_THAT(view.total_package, Eq(3));
+    EXPECT_THAT(view.packet_seq, Eq(sequence));
+    ASSERT_THAT(view.body_len, Eq(16 + image.chunk_size(sequence)));
+    EXPECT_THAT(view.body[0], Eq(0x34));
+    EXPECT_THAT(view.body[6], Eq(5));
+    EXPECT_THAT(memcmp(&view.body[7], "1.0.0", 5), Eq(0));
+    EXPECT_THAT(memcmp(&view.body[16], image.chunk(sequence),
+                       image.chunk_size(sequence)), Eq(0));
+  }
+}
+
+TEST(UpgradeImageSingleTest, SinglePackageTest) {
+  const uint8_t phone_bcd[6] = {0};
+  const uint8_t data[] = {0x7E, 0x00, 0x7D};
+  FILE *fp = fopen(kImagePath, "wb");
+  UpgradeImage image;
+  FrameView view;
+  Message msg;
+
+  fwrite(data, 1, sizeof(data), fp);
+  fclose(fp);
+  ASSERT_THAT(image.Map(kImagePath, 0, "1.0"), IsTrue());
+  unlink(kImagePath);
+  image.PackChunk(1, phone_bcd, 1, &msg);
+  ASSERT_THAT(DecodeFrame(&msg, &view), Eq(kFrameDecodeOk));
+  EXPECT_THAT(view.attribute.bit.package, Eq(0));
+  EXPECT_THAT(view.body_len, Eq(14 + sizeof(data)));
+  EXPECT_THAT(memcmp(&view.body[14], data, sizeof(data)), Eq(0));
+}
@@ -0,0 +1,155 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_upgrade_progress.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+
+#include "common/jt808_logger.h"
+#include "service/jt808_util.h"
+
+
+static const char kProgressMagic[8] = {'J', 'T', '8', '0', '8', 'U', 'P', 'G'};
+static const uint32_t kProgressFormat = 1;
+
+static bool WriteAll(const int &fd, const uint8_t *data, const size_t &len) {
+  size_t written = 0;
+  ssize_t ret;
+
+  while (written < len) {
+    ret = write(fd, data + written, len - written);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += static_cast<size_t>(ret);
+  }
+  return true;
+}
+
+bool UpgradeProgressStore::Open(const char *directory) {
+  if (!MakeDirectories(directory)) {
+    JT808_ERROR("create %s failed!!!", directory);
+    return false;
+  }
+  directory_ = directory;
+  return true;
+}
+
+bool UpgradeProgressStore::Save(const char *phone_num,
+                                const UpgradeProgress &progress) const {
+  UpgradeProgressHeader header;
+  std::vector<uint8_t> bitmap((progress.acked.size() + 7) / 8, 0);
+  std::string path = PathOf(phone_num);
+  std::string temporary = path + ".tmp";
+  bool written;
+  int fd;
+
+  if (!is_open() || (progress.acked.size() < 2)) {
+    return false;
+  }
+  memset(&header, 0x0, sizeof(header));
+  memcpy(header.magic, kProgressMagic, sizeof(header.magic));
+  header.format = kProgressFormat;
+  header.upgrade_type = progress.type;
+  progress.version.copy(header.upgrade_version,
+                        sizeof(header.upgrade_version) - 1);
+  progress.path.copy(header.file_path, sizeof(header.file_path) - 1);
+  header.image_size = progress.size;
+  header.image_hash = progress.hash;
+  header.chunk_count = static_cast<uint32_t>(progress.acked.size() - 1);
+  for (size_t i = 1; i < progress.acked.size(); ++i) {
+    if (progress.acked[i]) {
+      bitmap[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+      ++header.acked_count;
+    }
+  }
+
+  // On disk before the rename, so that a crash leaves the old or the new
+  // file whole, never an empty one.
+  if ((fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                 0644)) < 0) {
+    JT808_ERROR("save upgrade progress %s failed!!!", path.c_str());
+    return false;
+  }
+  written = WriteAll(fd, reinterpret_cast<const uint8_t *>(&header),
+                     sizeof(header)) &&
+            WriteAll(fd, bitmap.data(), bitmap.size()) && (fsync(fd) == 0);
+  close(fd);
+  if (!written || (rename(temporary.c_str(), path.c_str()) != 0)) {
+    JT808_ERROR("save upgrade progress %s failed!!!", path.c_str());
+    unlink(temporary.c_str());
+    return false;
+  }
+  // And the rename itself.
+  if ((fd = open(directory_.c_str(), O_RDONLY | O_DIRECTORY)) >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+  return true;
+}
+
+bool UpgradeProgressStore::Load(const char *phone_num,
+                                UpgradeProgress *progress) const {
+  UpgradeProgressHeader header;
+  std::vector<uint8_t> bitmap;
+  std::ifstream ifs(PathOf(phone_num), std::ios::binary);
+  uint32_t acked_count = 0;
+
+  if (!is_open() ||
+      !ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      (memcmp(header.magic, kProgressMagic, sizeof(header.magic)) != 0) ||
+      (header.format != kProgressFormat) || (header.chunk_count == 0) ||
+      (header.chunk_count > UINT16_MAX)) {
+    return false;
+  }
+  bitmap.resize((header.chunk_count + 1 + 7) / 8);
+  if (!ifs.read(reinterpret_cast<char *>(bitmap.data()), bitmap.size())) {
+    return false;
+  }
+
+  header.upgrade_version[sizeof(header.upgrade_version) - 1] = '\0';
+  header.file_path[sizeof(header.file_path) - 1] = '\0';
+  progress->type = static_cast<uint8_t>(header.upgrade_type);
+  progress->version = header.upgrade_version;
+  progress->path = header.file_path;
+  progress->size = header.image_size;
+  progress->hash = header.image_hash;
+  progress->acked.assign(header.chunk_count + 1, false);
+  for (size_t i = 1; i < progress->acked.size(); ++i) {
+    progress->acked[i] = (bitmap[i / 8] >> (i % 8)) & 0x1;
+    acked_count += progress->acked[i] ? 1 : 0;
+  }
+  return acked_count == header.acked_count;
+}
+
+void UpgradeProgressStore::Remove(const char *phone_num) const {
+  if (is_open()) {
+    unlink(PathOf(phone_num).c_str());
+  }
+}
+
+std::string UpgradeProgressStore::PathOf(const char *phone_num) const {
+  return directory_ + "/" + phone_num + ".upg";
+}
@@ -0,0 +1,75 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_UPGRADE_PROGRESS_H_
+#define JT808_SERVICE_JT808_UPGRADE_PROGRESS_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// 升级进度文件头, 应答位图紧随其后.
+struct UpgradeProgressHeader {
+  char magic[8];
+  uint32_t format;
+  uint32_t upgrade_type;
+  char upgrade_version[32];
+  char file_path[256];
+  uint64_t image_size;
+  uint64_t image_hash;  // 升级文件的 FNV-1a 哈希
+  uint32_t chunk_count;
+  uint32_t acked_count;  // 已应答的分包数
+};
+
+// Progress of one upgrade, enough to go on with it on a new connection.
+struct UpgradeProgress {
+  uint8_t type = 0;
+  std::string version;
+  std::string path;
+  uint64_t size = 0;
+  uint64_t hash = 0;
+  // Answered chunks indexed by sequence, entry 0 unused.
+  std::vector<bool> acked;
+};
+
+// Upgrade progress of the devices, "<phone>.upg" under the store directory
+// for each one with an upgrade under way. A save replaces the file whole
+// through a rename, so a crash leaves the previous one. Holds no state but
+// the directory, devices may be saved from any thread.
+class UpgradeProgressStore {
+ public:
+  UpgradeProgressStore() = default;
+  UpgradeProgressStore(const UpgradeProgressStore&) = delete;
+  UpgradeProgressStore& operator=(const UpgradeProgressStore&) = delete;
+  virtual ~UpgradeProgressStore() = default;
+
+  // Keep progress under |directory|, created if missing.
+  bool Open(const char *directory);
+  bool is_open(void) const { return !directory_.empty(); }
+
+  bool Save(const char *phone_num, const UpgradeProgress &progress) const;
+  // Return false if there is no progress for |phone_num| or it is damaged.
+  bool Load(const char *phone_num, UpgradeProgress *progress) const;
+  void Remove(const char *phone_num) const;
+
+ private:
+  std::string PathOf(const char *phone_num) const;
+
+  std::string directory_;
+};
+
+#endif  // JT808_SERVICE_JT808_UPGRADE_PROGRESS_H_
@@ -0,0 +1,93 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_upgrade_progress.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+static const char *kDirectory = "/tmp/jt808_upgrade_progress_test";
+
+class UpgradeProgressTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_THAT(store_.Open(kDirectory), IsTrue());
+    progress_.type = 0x34;
+    progress_.version = "1.0.1";
+    progress_.path = "/upgrade/image.bin";
+    progress_.size = 300000;
+    progress_.hash = 0x0123456789ABCDEFULL;
+    progress_.acked.assign(300, false);
+    for (size_t i = 1; i < progress_.acked.size(); i += 3) {
+      progress_.acked[i] = true;
+    }
+  }
+  void TearDown() override {
+    store_.Remove("13826539850");
+    rmdir(kDirectory);
+  }
+
+  UpgradeProgressStore store_;
+  UpgradeProgress progress_;
+};
+
+TEST_F(UpgradeProgressTest, SaveLoadTest) {
+  UpgradeProgress loaded;
+
+  EXPECT_THAT(store_.Load("13826539850", &loaded), IsFalse());
+  ASSERT_THAT(store_.Save("13826539850", progress_), IsTrue());
+  ASSERT_THAT(store_.Load("13826539850", &loaded), IsTrue());
+  EXPECT_THAT(loaded.type, Eq(progress_.type));
+  EXPECT_THAT(loaded.version, Eq(progress_.version));
+  EXPECT_THAT(loaded.path, Eq(progress_.path));
+  EXPECT_THAT(loaded.size, Eq(progress_.size));
+  EXPECT_THAT(loaded.hash, Eq(progress_.hash));
+  EXPECT_THAT(loaded.acked == progress_.acked, IsTrue());
+
+  // A later save replaces the earlier one.
+  progress_.acked[2] = true;
+  ASSERT_THAT(store_.Save("13826539850", progress_), IsTrue());
+  ASSERT_THAT(store_.Load("13826539850", &loaded), IsTrue());
+  EXPECT_THAT(loaded.acked[2], IsTrue());
+  store_.Remove("13826539850");
+  EXPECT_THAT(store_.Load("13826539850", &loaded), IsFalse());
+}
+
+TEST_F(UpgradeProgressTest, DamagedTest) {
+  std::string path = std::string(kDirectory) + "/13826539850.upg";
+  UpgradeProgress loaded;
+
+  ASSERT_THAT(store_.Save("13826539850", progress_), IsTrue());
+  // The bitmap no longer agrees with the count in the header.
+  FILE *fp = fopen(path.c_str(), "r+b");
+  fseek(fp, -1, SEEK_END);
+  fputc(0xFF, fp);
+  fclose(fp);
+  EXPECT_THAT(store_.Load("13826539850", &loaded), IsFalse());
+
+  // Cut short.
+  ASSERT_THAT(truncate(path.c_str(), 100), Eq(0));
+  EXPECT_THAT(store_.Load("13826539850", &loaded), IsFalse());
+}
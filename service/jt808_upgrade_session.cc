@@ -0,0 +1,144 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "service/jt808_upgrade_session.h"
+
+
+const size_t UpgradeSession::kDefaultWindow;
+
+UpgradeSession::UpgradeSession(
+    DeviceNode *device, const std::shared_ptr<const UpgradeImage> &image,
+    const size_t &window)
+    : device_(device), window_(window > 0 ? window : 1), image_(image),
+      acked_(image->chunk_count() + 1, false),
+      requested_(image->chunk_count() + 1, false) {
+  acked_[0] = true;
+  last_progress_ = std::chrono::steady_clock::now();
+}
+
+bool UpgradeSession::Restore(const std::vector<bool> &acked) {
+  if ((acked.size() != acked_.size()) || (sent_ > 0)) {
+    return false;
+  }
+  acked_count_ = 0;
+  for (uint16_t sequence = 1; sequence < chunk_count(); ++sequence) {
+    acked_[sequence] = acked[sequence];
+    acked_count_ += acked[sequence] ? 1 : 0;
+  }
+  resumed_ = acked_count_;
+  return true;
+}
+
+uint16_t UpgradeSession::NextChunk(void) {
+  uint16_t sequence;
+
+  if (in_flight_.size() >= window_) {
+    return 0;
+  }
+  while (!resend_.empty()) {
+    sequence = resend_.front();
+    resend_.pop_front();
+    requested_[sequence] = false;
+    if (!acked_[sequence]) {
+      ++retransmitted_;
+      return sequence;
+    }
+  }
+  while ((next_ <= chunk_count()) && acked_[next_]) {
+    ++next_;
+  }
+  if (next_ <= chunk_count()) {
+    return next_++;
+  }
+  return 0;
+}
+
+void UpgradeSession::OnSent(const uint16_t &sequence,
+                            const uint16_t &flow_num) {
+  if (sent_++ == 0) {
+    started_ = std::chrono::steady_clock::now();
+  }
+  in_flight_[flow_num] = sequence;
+}
+
+bool UpgradeSession::OnAnswer(const uint16_t &flow_num,
+                              const bool &success) {
+  auto it = in_flight_.find(flow_num);
+
+  if (it == in_flight_.end()) {
+    return false;
+  }
+  if (success && !acked_[it->second]) {
+    acked_[it->second] = true;
+    if (++acked_count_ == chunk_count()) {
+      finished_ = std::chrono::steady_clock::now();
+    }
+  }
+  in_flight_.erase(it);
+  last_progress_ = std::chrono::steady_clock::now();
+  return true;
+}
+
+void UpgradeSession::OnResendRequest(const uint16_t *sequences,
+                                     const size_t &count) {
+  for (size_t i = 0; i < count; ++i) {
+    if ((sequences[i] == 0) || (sequences[i] > chunk_count())) {
+      continue;
+    }
+    // Taken as lost even if answered, the terminal knows best.
+    if (acked_[sequences[i]]) {
+      acked_[sequences[i]] = false;
+      --acked_count_;
+    }
+    if (!requested_[sequences[i]]) {
+      requested_[sequences[i]] = true;
+      resend_.push_back(sequences[i]);
+    }
+  }
+  last_progress_ = std::chrono::steady_clock::now();
+}
+
+size_t UpgradeSession::TakeResend(uint16_t *sequences, const size_t &max) {
+  size_t count = 0;
+  uint16_t sequence;
+
+  while ((count < max) && !resend_.empty()) {
+    sequence = resend_.front();
+    resend_.pop_front();
+    requested_[sequence] = false;
+    if (!acked_[sequence]) {
+      sequences[count++] = sequence;
+    }
+  }
+  retransmitted_ += static_cast<uint32_t>(count);
+  return count;
+}
+
+UpgradeStatistics UpgradeSession::statistics(void) const {
+  UpgradeStatistics statistics;
+  auto end = complete() ? finished_ : std::chrono::steady_clock::now();
+
+  statistics.bytes = image_->size();
+  statistics.chunks = chunk_count();
+  statistics.sent = sent_;
+  statistics.retransmitted = retransmitted_;
+  statistics.resumed = resumed_;
+  if (sent_ > 0) {
+    statistics.elapsed_ms = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - started_).count());
+  }
+  return statistics;
+}
@@ -0,0 +1,118 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef JT808_SERVICE_JT808_UPGRADE_SESSION_H_
+#define JT808_SERVICE_JT808_UPGRADE_SESSION_H_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "service/jt808_upgrade_image.h"
+#include "service/jt808_util.h"
+
+
+// Counters of one upgrade, reported when it ends.
+struct UpgradeStatistics {
+  // Size of the image.
+  uint64_t bytes = 0;
+  uint32_t chunks = 0;
+  // Chunk frames sent, retransmissions included.
+  uint32_t sent = 0;
+  uint32_t retransmitted = 0;
+  // Chunks answered on an earlier connection.
+  uint32_t resumed = 0;
+  // From the first chunk sent to the last one answered.
+  uint64_t elapsed_ms = 0;
+};
+
+// Firmware upgrade of one terminal to |image|, whose chunks are numbered
+// from 1 like the packet sequence. Up to |window| chunk frames may
+// wait for their general response at once. The session only decides what
+// to send next, the reactor owning the device packs the frames, sends
+// them and feeds the answers back. A chunk answered with a failure is sent
+// again once the terminal asks for it with a resend request, requested
+// chunks go out together without waiting for the window.
+class UpgradeSession {
+ public:
+  static const size_t kDefaultWindow = 16;
+
+  UpgradeSession(DeviceNode *device,
+                 const std::shared_ptr<const UpgradeImage> &image,
+                 const size_t &window);
+  UpgradeSession(const UpgradeSession&) = delete;
+  UpgradeSession& operator=(const UpgradeSession&) = delete;
+  virtual ~UpgradeSession() = default;
+
+  // Take the chunks answered on an earlier connection as done, all but the
+  // last one, terminals look for missing chunks once it arrives. Return
+  // false if |acked| is not for as many chunks.
+  bool Restore(const std::vector<bool> &acked);
+  // Return the next chunk to send, requested ones first, or 0 if the
+  // window is full or every chunk has been sent.
+  uint16_t NextChunk(void);
+  // |sequence| went out in the frame numbered |flow_num|.
+  void OnSent(const uint16_t &sequence, const uint16_t &flow_num);
+  // The terminal answered the frame numbered |flow_num|. Return false if
+  // it is not a chunk frame waiting for an answer.
+  bool OnAnswer(const uint16_t &flow_num, const bool &success);
+  // The terminal asks for |count| chunks again.
+  void OnResendRequest(const uint16_t *sequences, const size_t &count);
+  // Move up to |max| requested chunks still missing into |sequences|
+  // regardless of the window. Return how many.
+  size_t TakeResend(uint16_t *sequences, const size_t &max);
+
+  bool complete(void) const { return acked_count_ == chunk_count(); }
+  DeviceNode *device(void) const { return device_; }
+  const UpgradeImage *image(void) const { return image_.get(); }
+  uint16_t chunk_count(void) const { return image_->chunk_count(); }
+  // Answered chunks indexed by sequence, entry 0 unused.
+  const std::vector<bool> &acked(void) const { return acked_; }
+  uint16_t acked_count(void) const { return acked_count_; }
+  size_t in_flight(void) const { return in_flight_.size(); }
+  // Last time the terminal answered or asked for chunks.
+  std::chrono::steady_clock::time_point last_progress(void) const {
+    return last_progress_;
+  }
+  UpgradeStatistics statistics(void) const;
+
+ private:
+  DeviceNode *device_;
+  size_t window_;
+  std::shared_ptr<const UpgradeImage> image_;
+  // Indexed by sequence, entry 0 unused.
+  std::vector<bool> acked_;
+  uint16_t acked_count_ = 0;
+  // Next chunk never sent yet.
+  uint16_t next_ = 1;
+  // Chunks sent again before any new one, each at most once.
+  std::deque<uint16_t> resend_;
+  // Whether a chunk is in |resend_|, indexed by sequence.
+  std::vector<bool> requested_;
+  // Sequence of the chunk frames waiting for an answer by flow number.
+  std::unordered_map<uint16_t, uint16_t> in_flight_;
+  uint32_t sent_ = 0;
+  uint32_t retransmitted_ = 0;
+  uint32_t resumed_ = 0;
+  std::chrono::steady_clock::time_point started_;
+  std::chrono::steady_clock::time_point finished_;
+  std::chrono::steady_clock::time_point last_progress_;
+};
+
+#endif  // JT808_SERVICE_JT808_UPGRADE_SESSION_H_
@@ -0,0 +1,176 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_upgrade_session.h"
+
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+static const char *kImagePath = "/tmp/jt808_upgrade_session_test.bin";
+
+class UpgradeSessionTest : public ::testing::Test {
+ protected:
+  // Write an image of |count| chunks, the last one 10 bytes long.
+  std::shared_ptr<const UpgradeImage> MapImage(const size_t &count) {
+    std::shared_ptr<UpgradeImage> image = std::make_shared<UpgradeImage>();
+    std::vector<uint8_t> data((count - 1) * kChunkSize + 10);
+    FILE *fp = fopen(kImagePath, "wb");
+
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<uint8_t>(i);
+    }
+    fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    EXPECT_THAT(image->Map(kImagePath, 0, "1.0.0"), IsTrue());
+    return image;
+  }
+  void TearDown() override { unlink(kImagePath); }
+
+  // Chunk size with a five character version.
+  static const size_t kChunkSize = 1023 - 11 - 5;
+  DeviceNode device_;
+};
+
+const size_t UpgradeSessionTest::kChunkSize;
+
+TEST_F(UpgradeSessionTest, WindowTest) {
+  UpgradeSession session(&device_, MapImage(10), 3);
+  uint16_t sequence;
+  uint16_t flow_num = 100;
+
+  // Three chunks in flight, the fourth waits for an answer.
+  for (uint16_t i = 1; i <= 3; ++i) {
+    EXPECT_THAT(session.NextChunk(), Eq(i));
+    session.OnSent(i, flow_num++);
+  }
+  EXPECT_THAT(session.NextChunk(), Eq(0));
+  EXPECT_THAT(session.OnAnswer(100, true), IsTrue());
+  EXPECT_THAT(session.OnAnswer(100, true), IsFalse());
+  EXPECT_THAT(session.NextChunk(), Eq(4));
+  session.OnSent(4, flow_num++);
+
+  // Answers in any order, the rest go out as the window opens.
+  EXPECT_THAT(session.OnAnswer(102, true), IsTrue());
+  EXPECT_THAT(session.OnAnswer(101, true), IsTrue());
+  EXPECT_THAT(session.OnAnswer(103, true), IsTrue());
+  while ((sequence = session.NextChunk()) != 0) {
+    session.OnSent(sequence, flow_num);
+    EXPECT_THAT(session.OnAnswer(flow_num++, true), IsTrue());
+  }
+  EXPECT_THAT(session.complete(), IsTrue());
+  EXPECT_THAT(session.statistics().sent, Eq(10u));
+  EXPECT_THAT(session.statistics().retransmitted, Eq(0u));
+}
+
+TEST_F(UpgradeSessionTest, ResendTest) {
+  UpgradeSession session(&device_, MapImage(4), 16);
+  const uint16_t requested[] = {2, 4, 11};
+  uint16_t sequence;
+  uint16_t flow_num = 0;
+
+  while ((sequence = session.NextChunk()) != 0) {
+    session.OnSent(sequence, flow_num);
+    // The second chunk arrives damaged.
+    session.OnAnswer(flow_num++, sequence != 2);
+  }
+  EXPECT_THAT(session.complete(), IsFalse());
+
+  // Out of range sequences are ignored.
+  session.OnResendRequest(requested, 3);
+  EXPECT_THAT(session.NextChunk(), Eq(2));
+  session.OnSent(2, flow_num);
+  EXPECT_THAT(session.NextChunk(), Eq(4));
+  session.OnSent(4, flow_num + 1);
+  EXPECT_THAT(session.NextChunk(), Eq(0));
+  session.OnAnswer(flow_num, true);
+  EXPECT_THAT(session.complete(), IsFalse());
+  session.OnAnswer(flow_num + 1, true);
+  EXPECT_THAT(session.complete(), IsTrue());
+  EXPECT_THAT(session.statistics().retransmitted, Eq(2u));
+  EXPECT_THAT(session.statistics().bytes, Eq(3 * kChunkSize + 10));
+}
+
+TEST_F(UpgradeSessionTest, TakeResendTest) {
+  UpgradeSession session(&device_, MapImage(8), 3);
+  const uint16_t requested[] = {5, 3, 5, 8, 3, 6};
+  uint16_t sequences[8];
+  uint16_t sequence;
+  uint16_t flow_num = 0;
+
+  // Chunks 3, 5 and 8 never arrive and fill the window.
+  while (session.acked_count() + session.in_flight() < 8) {
+    ASSERT_THAT((sequence = session.NextChunk()) != 0, IsTrue());
+    session.OnSent(sequence, flow_num);
+    if ((sequence != 3) && (sequence != 5) && (sequence != 8)) {
+      session.OnAnswer(flow_num, true);
+    }
+    ++flow_num;
+  }
+  EXPECT_THAT(session.NextChunk(), Eq(0));
+
+  // Requested chunks are taken once each even with the window full, in
+  // the order asked, a limited batch leaves the rest queued.
+  session.OnResendRequest(requested, 6);
+  EXPECT_THAT(session.TakeResend(sequences, 2), Eq(2u));
+  EXPECT_THAT(sequences[0], Eq(5));
+  EXPECT_THAT(sequences[1], Eq(3));
+  session.OnSent(5, flow_num);
+  session.OnAnswer(flow_num++, true);
+  session.OnResendRequest(requested, 1);
+  EXPECT_THAT(session.TakeResend(sequences, 8), Eq(3u));
+  EXPECT_THAT(sequences[0], Eq(8));
+  EXPECT_THAT(sequences[1], Eq(6));
+  EXPECT_THAT(sequences[2], Eq(5));
+  EXPECT_THAT(session.TakeResend(sequences, 8), Eq(0u));
+  EXPECT_THAT(session.statistics().retransmitted, Eq(5u));
+}
+
+TEST_F(UpgradeSessionTest, RestoreTest) {
+  UpgradeSession session(&device_, MapImage(6), 16);
+  std::vector<bool> acked(7, false);
+  uint16_t sequence;
+  uint16_t flow_num = 0;
+
+  EXPECT_THAT(session.Restore(std::vector<bool>(5, true)), IsFalse());
+  // Chunks 1, 2, 4 and 6 were answered before, the last one is sent again.
+  acked[1] = acked[2] = acked[4] = acked[6] = true;
+  ASSERT_THAT(session.Restore(acked), IsTrue());
+  EXPECT_THAT(session.acked_count(), Eq(3));
+  EXPECT_THAT(session.NextChunk(), Eq(3));
+  EXPECT_THAT(session.NextChunk(), Eq(5));
+  EXPECT_THAT(session.NextChunk(), Eq(6));
+  EXPECT_THAT(session.NextChunk(), Eq(0));
+
+  UpgradeSession resumed(&device_, MapImage(6), 16);
+  ASSERT_THAT(resumed.Restore(acked), IsTrue());
+  while ((sequence = resumed.NextChunk()) != 0) {
+    resumed.OnSent(sequence, flow_num);
+    resumed.OnAnswer(flow_num++, true);
+  }
+  EXPECT_THAT(resumed.complete(), IsTrue());
+  EXPECT_THAT(resumed.statistics().sent, Eq(3u));
+  EXPECT_THAT(resumed.statistics().resumed, Eq(3u));
+}
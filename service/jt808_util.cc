@@ -15,6 +15,7 @@
 #include "service/jt808_util.h"
 
 #include <sys/epoll.h>
+#include <sys/stat.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -31,7 +32,8 @@
 #include "bcd/bcd.h"
 
 
-int EpollRegister(const int &epoll_fd, const int &fd) {
+int EpollRegister(const int &epoll_fd, const int &fd, void *ptr,
+                  const uint32_t &events) {
   struct epoll_event ev;
   int ret;
   int flags;
@@ -40,9 +42,8 @@ int EpollRegister(const int &epoll_fd, const int &fd) {
   flags = fcntl(fd, F_GETFL);
   fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 
-  ev.events = EPOLLIN;
-  // ev.events = EPOLLIN | EPOLLET;
-  ev.data.fd = fd;
+  ev.events = events;
+  ev.data.ptr = ptr;
   do {
       ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
   } while (ret < 0 && errno == EINTR);
@@ -60,6 +61,20 @@ int EpollUnregister(const int &epoll_fd, const int &fd) {
   return ret;
 }
 
+int EpollModify(const int &epoll_fd, const int &fd, void *ptr,
+                const uint32_t &events) {
+  struct epoll_event ev;
+  int ret;
+
+  ev.events = events;
+  ev.data.ptr = ptr;
+  do {
+    ret = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  } while (ret < 0 && errno == EINTR);
+
+  return ret;
+}
+
 bool ReadDevicesList(const char *path, std::list<DeviceNode *> *list) {
   char *result;
   char line[128] = {0};
@@ -72,8 +87,7 @@ bool ReadDevicesList(const char *path, std::list<DeviceNode *> *list) {
     std::string str;
     char *remaining;
     while (getline(ifs, str)) {
-      DeviceNode *node = new DeviceNode;
-      memset(node, 0x0, sizeof (*node));
+      DeviceNode *node = new DeviceNode();
       memset(line, 0x0, sizeof(line));
       str.copy(line, str.length(), 0);
       result = strtok_r(line, flags, &remaining);
@@ -105,3 +119,20 @@ int SearchStringInList(const std::vector<std::string> &va_vec,
   return (va_it == va_vec.end() ? 0 : 1);
 }
 
+bool MakeDirectories(const std::string &path) {
+  size_t pos = 0;
+  std::string partial;
+
+  while (pos != std::string::npos) {
+    pos = path.find('/', pos + 1);
+    partial = path.substr(0, pos);
+    if (partial.empty()) {
+      continue;
+    }
+    if ((mkdir(partial.c_str(), 0755) < 0) && (errno != EEXIST)) {
+      return false;
+    }
+  }
+  return true;
+}
+
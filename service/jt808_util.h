@@ -15,27 +15,43 @@
 #ifndef JT808_SERVICE_JT808_UTIL_H_
 #define JT808_SERVICE_JT808_UTIL_H_
 
+#include <sys/epoll.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <string>
 #include <list>
 #include <vector>
 
+struct Connection;
 
 struct DeviceNode {
   bool has_upgrade;
-  bool upgrading;
+  // Claimed by the reactor starting an upgrade, released by the one ending
+  // it, which may not be the same after a reconnect.
+  std::atomic<bool> upgrading;
   char phone_num[12];
+  uint8_t phone_bcd[6];
   char authen_code[8];
   char manufacturer_id[5];
   char upgrade_version[12];
   char upgrade_type;
   char file_path[256];
   int socket_fd;
+  Connection *connection;
 };
 
-int EpollRegister(const int &epoll_fd, const int &fd);
+// Register |fd| for |events| with |ptr| as its event data.
+int EpollRegister(const int &epoll_fd, const int &fd, void *ptr,
+                  const uint32_t &events = EPOLLIN);
 int EpollUnregister(const int &epoll_fd, const int &fd);
+// Change the events |fd| is registered for, e.g. EPOLLIN | EPOLLOUT.
+int EpollModify(const int &epoll_fd, const int &fd, void *ptr,
+                const uint32_t &events);
 bool ReadDevicesList(const char *path, std::list<DeviceNode *> *list);
 int SearchStringInList(const std::vector<std::string> &va_vec,
                        const std::string &str);
+// Create |path| and its missing parents like "mkdir -p".
+bool MakeDirectories(const std::string &path);
 
 #endif  // JT808_SERVICE_JT808_UTIL_H_
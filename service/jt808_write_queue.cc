@@ -0,0 +1,133 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "service/jt808_write_queue.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "common/jt808_logger.h"
+
+
+const int WriteQueue::kMaxIovecs;
+const size_t WriteQueue::kMaxSpareCapacity;
+
+void WriteQueue::Append(const uint8_t *data, const size_t &len) {
+  if (len == 0) {
+    return;
+  }
+  if (spare_.empty()) {
+    frames_.push_back(std::vector<uint8_t>(data, data + len));
+  } else {
+    frames_.push_back(std::move(spare_.back()));
+    spare_.pop_back();
+    frames_.back().assign(data, data + len);
+  }
+  size_ += len;
+}
+
+uint8_t *WriteQueue::Reserve(const size_t &len) {
+  if (spare_.empty()) {
+    frames_.push_back(std::vector<uint8_t>(len));
+  } else {
+    frames_.push_back(std::move(spare_.back()));
+    spare_.pop_back();
+    frames_.back().resize(len);
+  }
+  return frames_.back().data();
+}
+
+void WriteQueue::Commit(const size_t &len) {
+  if (len == 0) {
+    frames_.pop_back();
+    return;
+  }
+  frames_.back().resize(len);
+  size_ += len;
+}
+
+int WriteQueue::SendTo(const int &fd) {
+  struct iovec iov[kMaxIovecs];
+  struct msghdr msghdr;
+  int iov_count = 0;
+  ssize_t ret;
+  size_t len;
+
+  if (empty()) {
+    return 0;
+  }
+
+  for (auto &frame : frames_) {
+    if (iov_count == kMaxIovecs) {
+      break;
+    }
+    len = iov_count == 0 ? offset_ : 0;
+    iov[iov_count].iov_base = frame.data() + len;
+    iov[iov_count].iov_len = frame.size() - len;
+    ++iov_count;
+  }
+
+  // sendmsg() rather than writev() for MSG_NOSIGNAL.
+  memset(&msghdr, 0x0, sizeof(msghdr));
+  msghdr.msg_iov = iov;
+  msghdr.msg_iovlen = iov_count;
+  do {
+    ret = sendmsg(fd, &msghdr, MSG_NOSIGNAL);
+  } while ((ret < 0) && (errno == EINTR));
+  if (ret < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+      return 0;
+    }
+    JT808_ERROR("send data failed!!!");
+    return -1;
+  }
+
+  size_ -= static_cast<size_t>(ret);
+  len = static_cast<size_t>(ret);
+  while (len > 0) {
+    std::vector<uint8_t> &frame = frames_.front();
+    if (len < frame.size() - offset_) {
+      offset_ += len;
+      break;
+    }
+    len -= frame.size() - offset_;
+    offset_ = 0;
+    Recycle();
+  }
+
+  return static_cast<int>(ret);
+}
+
+void WriteQueue::Clear(void) {
+  while (!frames_.empty()) {
+    Recycle();
+  }
+  offset_ = 0;
+  size_ = 0;
+}
+
+void WriteQueue::Recycle(void) {
+  if ((spare_.size() < static_cast<size_t>(kMaxIovecs)) &&
+      (frames_.front().capacity() <= kMaxSpareCapacity)) {
+    spare_.push_back(std::move(frames_.front()));
+  }
+  frames_.pop_front();
+}
@@ -0,0 +1,68 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef JT808_SERVICE_JT808_WRITE_QUEUE_H_
+#define JT808_SERVICE_JT808_WRITE_QUEUE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+#include <vector>
+
+
+// Per-connection outbound queue. Frames are kept until the socket has
+// accepted all of their bytes, and are written out in batches with one
+// writev() for many frames.
+class WriteQueue {
+ public:
+  // Frames handed to a single writev().
+  static const int kMaxIovecs = 64;
+  // Larger frame buffers are freed rather than kept for reuse.
+  static const size_t kMaxSpareCapacity = 4096;
+
+  WriteQueue() = default;
+  WriteQueue(const WriteQueue&) = delete;
+  WriteQueue& operator=(const WriteQueue&) = delete;
+  virtual ~WriteQueue() = default;
+
+  void Append(const uint8_t *data, const size_t &len);
+  // Open a frame buffer of |len| bytes at the tail to pack many frames
+  // into in place, they then go out as one piece. Commit() the bytes
+  // actually packed before anything else is appended.
+  uint8_t *Reserve(const size_t &len);
+  void Commit(const size_t &len);
+  // Write as much as the socket takes with a single writev().
+  // Return bytes written, 0 if the socket is full, -1 on error.
+  // Interrupted writes are retried.
+  int SendTo(const int &fd);
+  void Clear(void);
+
+  // Bytes not written yet.
+  size_t size(void) const { return size_; }
+  bool empty(void) const { return size_ == 0; }
+
+ private:
+  // Drop the first frame, keeping its buffer for reuse.
+  void Recycle(void);
+
+  std::deque<std::vector<uint8_t>> frames_;
+  // Frame buffers already written, reused to avoid allocations.
+  std::vector<std::vector<uint8_t>> spare_;
+  // Bytes of the first frame already written.
+  size_t offset_ = 0;
+  size_t size_ = 0;
+};
+
+#endif  // JT808_SERVICE_JT808_WRITE_QUEUE_H_
@@ -0,0 +1,140 @@
+// Copyright 2019 Yuming Meng. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "service/jt808_write_queue.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <vector>
+
+
+using ::testing::Eq;
+using ::testing::IsTrue;
+
+class WriteQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds_), Eq(0));
+    fcntl(fds_[0], F_SETFL, fcntl(fds_[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds_[1], F_SETFL, fcntl(fds_[1], F_GETFL) | O_NONBLOCK);
+  }
+
+  void TearDown() override {
+    close(fds_[0]);
+    close(fds_[1]);
+  }
+
+  // Read everything available on the peer end.
+  std::vector<uint8_t> Drain(void) {
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    ssize_t ret;
+    while ((ret = read(fds_[1], buffer, sizeof(buffer))) > 0) {
+      data.insert(data.end(), buffer, buffer + ret);
+    }
+    return data;
+  }
+
+  int fds_[2];
+};
+
+TEST_F(WriteQueueTest, BatchedFramesTest) {
+  const uint8_t frame1[] = {0x7E, 0x80, 0x01, 0x7E};
+  const uint8_t frame2[] = {0x7E, 0x81, 0x00, 0x02, 0x7E};
+  WriteQueue queue;
+
+  queue.Append(frame1, sizeof(frame1));
+  queue.Append(frame2, sizeof(frame2));
+  EXPECT_THAT(queue.size(), Eq(sizeof(frame1) + sizeof(frame2)));
+  // Both frames go out with a single call.
+  EXPECT_THAT(queue.SendTo(fds_[0]),
+              Eq(static_cast<int>(sizeof(frame1) + sizeof(frame2))));
+  EXPECT_THAT(queue.empty(), IsTrue());
+
+  std::vector<uint8_t> data = Drain();
+  ASSERT_THAT(data.size(), Eq(sizeof(frame1) + sizeof(frame2)));
+  EXPECT_THAT(memcmp(data.data(), frame1, sizeof(frame1)), Eq(0));
+  EXPECT_THAT(memcmp(data.data() + sizeof(frame1), frame2, sizeof(frame2)),
+              Eq(0));
+}
+
+TEST_F(WriteQueueTest, PartialWriteTest) {
+  std::vector<uint8_t> frame(1000);
+  std::vector<uint8_t> sent;
+  std::vector<uint8_t> received;
+  WriteQueue queue;
+  int ret;
+
+  for (int i = 0; i < 2000; ++i) {
+    for (size_t j = 0; j < frame.size(); ++j) {
+      frame[j] = static_cast<uint8_t>(i + j);
+    }
+    queue.Append(frame.data(), frame.size());
+    sent.insert(sent.end(), frame.begin(), frame.end());
+  }
+
+  // The socket fills up long before the queue is empty, nothing is lost.
+  while (!queue.empty()) {
+    ret = queue.SendTo(fds_[0]);
+    ASSERT_THAT(ret >= 0, IsTrue());
+    std::vector<uint8_t> data = Drain();
+    received.insert(received.end(), data.begin(), data.end());
+  }
+  std::vector<uint8_t> data = Drain();
+  received.insert(received.end(), data.begin(), data.end());
+  EXPECT_THAT(received == sent, IsTrue());
+}
+
+TEST_F(WriteQueueTest, PeerClosedTest) {
+  const uint8_t frame[] = {0x7E, 0x80, 0x01, 0x7E};
+  WriteQueue queue;
+
+  close(fds_[1]);
+  fds_[1] = socket(AF_UNIX, SOCK_STREAM, 0);
+  queue.Append(frame, sizeof(frame));
+  EXPECT_THAT(queue.SendTo(fds_[0]), Eq(-1));
+}
+
+TEST_F(WriteQueueTest, ReservedFramesTest) {
+  const uint8_t frame1[] = {0x7E, 0x80, 0x01, 0x7E};
+  const uint8_t frame2[] = {0x7E, 0x81, 0x00, 0x02, 0x7E};
+  WriteQueue queue;
+  uint8_t *buffer;
+
+  queue.Append(frame1, sizeof(frame1));
+  // Packed in place behind the queued frame, only committed bytes count.
+  buffer = queue.Reserve(64);
+  memcpy(buffer, frame2, sizeof(frame2));
+  memcpy(buffer + sizeof(frame2), frame1, sizeof(frame1));
+  queue.Commit(sizeof(frame2) + sizeof(frame1));
+  EXPECT_THAT(queue.size(), Eq(2 * sizeof(frame1) + sizeof(frame2)));
+  queue.Reserve(64);
+  queue.Commit(0);
+  EXPECT_THAT(queue.size(), Eq(2 * sizeof(frame1) + sizeof(frame2)));
+  EXPECT_THAT(queue.SendTo(fds_[0]),
+              Eq(static_cast<int>(2 * sizeof(frame1) + sizeof(frame2))));
+
+  std::vector<uint8_t> data = Drain();
+  ASSERT_THAT(data.size(), Eq(2 * sizeof(frame1) + sizeof(frame2)));
+  EXPECT_THAT(memcmp(data.data(), frame1, sizeof(frame1)), Eq(0));
+  EXPECT_THAT(memcmp(data.data() + sizeof(frame1), frame2, sizeof(frame2)),
+              Eq(0));
+  EXPECT_THAT(memcmp(data.data() + sizeof(frame1) + sizeof(frame2), frame1,
+                     sizeof(frame1)), Eq(0));
+}
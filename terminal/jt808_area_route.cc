@@ -24,6 +24,7 @@
 #include <string>
 
 #include "bcd/bcd.h"
+#include "common/jt808_message_schema.h"
 #include "common/jt808_util.h"
 #include "util/container_clear.h"
 
@@ -508,40 +509,22 @@ void WriteAreaRouteToFile(const char *path,
   }
 }
 
-int DealSetCircularAreaRequest(const uint8_t *data,
+int DealSetCircularAreaRequest(const uint8_t *data, const size_t &len,
                                AreaRouteSet *area_route_set) {
-  uint8_t operation = *data++;
-  uint8_t count = *data++;
-  uint16_t u16val = 0;
-  uint32_t u32val = 0;
+  const uint8_t *end = data + len;
+  AreaRouteSetHead head;
+  data = AreaRouteSetHeadCodec::Decode(data, end, &head);
+  if (data == nullptr) {
+    return -1;
+  }
+  uint8_t operation = head.operation;
+  uint8_t count = head.count;
   for (int i = 0; i < count; ++i) {
-    CircularArea *circular_area = new CircularArea;
-    memcpy(&u32val, data, 4);
-    circular_area->area_id = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u16val, data, 2);
-    circular_area->area_attribute.value = EndianSwap16(u16val);
-    data += 2;
-    memcpy(&u32val, data, 4);
-    circular_area->center_point.latitude = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u32val, data, 4);
-    circular_area->center_point.longitude = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u32val, data, 4);
-    circular_area->radius = EndianSwap32(u32val);
-    data += 4;
-    if (circular_area->area_attribute.bit.bytime) {
-      memcpy(circular_area->start_time, data, 6);
-      data += 6;
-      memcpy(circular_area->end_time, data, 6);
-      data += 6;
-    }
-    if (circular_area->area_attribute.bit.speedlimit) {
-      memcpy(&u16val, data, 2);
-      circular_area->max_speed = EndianSwap16(u16val);
-      data += 2;
-      circular_area->overspeed_duration = *data++;
+    CircularArea *circular_area = new CircularArea();
+    data = CircularAreaCodec::Decode(data, end, circular_area);
+    if (data == nullptr) {
+      delete circular_area;
+      return -1;
     }
     if (area_route_set->circular_area_list == nullptr) {
       area_route_set->circular_area_list = new std::list<CircularArea *>;
@@ -565,43 +548,22 @@ int DealSetCircularAreaRequest(const uint8_t *data,
   return (count > 0 ? 0 : -1);
 }
 
-int DealSetRectangleAreaRequest(const uint8_t *data,
+int DealSetRectangleAreaRequest(const uint8_t *data, const size_t &len,
                                 AreaRouteSet *area_route_set) {
-  uint8_t operation = *data++;
-  uint8_t count = *data++;
-  uint16_t u16val = 0;
-  uint32_t u32val = 0;
+  const uint8_t *end = data + len;
+  AreaRouteSetHead head;
+  data = AreaRouteSetHeadCodec::Decode(data, end, &head);
+  if (data == nullptr) {
+    return -1;
+  }
+  uint8_t operation = head.operation;
+  uint8_t count = head.count;
   for (int i = 0; i < count; ++i) {
-    RectangleArea *rectangle_area = new RectangleArea;
-    memcpy(&u32val, data, 4);
-    rectangle_area->area_id = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u16val, data, 2);
-    rectangle_area->area_attribute.value = EndianSwap16(u16val);
-    data += 2;
-    memcpy(&u32val, data, 4);
-    rectangle_area->upper_left_corner.latitude = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u32val, data, 4);
-    rectangle_area->upper_left_corner.longitude = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u32val, data, 4);
-    rectangle_area->bottom_right_corner.latitude = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u32val, data, 4);
-    rectangle_area->bottom_right_corner.longitude = EndianSwap32(u32val);
-    data += 4;
-    if (rectangle_area->area_attribute.bit.bytime) {
-      memcpy(rectangle_area->start_time, data, 6);
-      data += 6;
-      memcpy(rectangle_area->end_time, data, 6);
-      data += 6;
-    }
-    if (rectangle_area->area_attribute.bit.speedlimit) {
-      memcpy(&u16val, data, 2);
-      rectangle_area->max_speed = EndianSwap16(u16val);
-      data += 2;
-      rectangle_area->overspeed_duration = *data++;
+    RectangleArea *rectangle_area = new RectangleArea();
+    data = RectangleAreaCodec::Decode(data, end, rectangle_area);
+    if (data == nullptr) {
+      delete rectangle_area;
+      return -1;
     }
     if (area_route_set->rectangle_area_list == nullptr) {
       area_route_set->rectangle_area_list = new std::list<RectangleArea *>;
@@ -625,47 +587,26 @@ int DealSetRectangleAreaRequest(const uint8_t *data,
   return (count > 0 ? 0 : -1);
 }
 
-int DealSetPolygonalAreaRequest(const uint8_t *data,
+int DealSetPolygonalAreaRequest(const uint8_t *data, const size_t &len,
                                 AreaRouteSet *area_route_set) {
-  uint8_t operation = *data++;
-  uint8_t count = *data++;
-  uint16_t u16val = 0;
-  uint32_t u32val = 0;
-  operation = *data++;
-  count = *data++;
+  const uint8_t *end = data + len;
+  AreaRouteSetHead head;
+  data = AreaRouteSetHeadCodec::Decode(data, end, &head);
+  if (data == nullptr) {
+    return -1;
+  }
+  uint8_t operation = head.operation;
+  uint8_t count = head.count;
   for (int i = 0; i < count; ++i) {
-    PolygonalArea *polygonal_area = new PolygonalArea;
-    memcpy(&u32val, data, 4);
-    polygonal_area->area_id = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u16val, data, 2);
-    polygonal_area->area_attribute.value = EndianSwap16(u16val);
-    data += 2;
-    if (polygonal_area->area_attribute.bit.bytime) {
-      memcpy(polygonal_area->start_time, data, 6);
-      data += 6;
-      memcpy(polygonal_area->end_time, data, 6);
-      data += 6;
-    }
-    if (polygonal_area->area_attribute.bit.speedlimit) {
-      memcpy(&u16val, data, 2);
-      polygonal_area->max_speed = EndianSwap16(u16val);
-      data += 2;
-      polygonal_area->overspeed_duration = *data++;
-    }
-    memcpy(&u16val, data, 2);
-    polygonal_area->coordinate_count = EndianSwap16(u16val);
-    data += 2;
-    polygonal_area->coordinate_list = new std::vector<Coordinate*>;
-    for (int i = 0; i < polygonal_area->coordinate_count; ++i) {
-      Coordinate *coordinate = new Coordinate;
-      memcpy(&u32val, data, 4);
-      coordinate->latitude = EndianSwap32(u32val);
-      data += 4;
-      memcpy(&u32val, data, 4);
-      coordinate->longitude = EndianSwap32(u32val);
-      data += 4;
-      polygonal_area->coordinate_list->push_back(coordinate);
+    PolygonalArea *polygonal_area = new PolygonalArea();
+    data = PolygonalAreaCodec::Decode(data, end, polygonal_area);
+    if (data == nullptr) {
+      if (polygonal_area->coordinate_list != nullptr) {
+        ClearContainerElement(polygonal_area->coordinate_list);
+        delete polygonal_area->coordinate_list;
+      }
+      delete polygonal_area;
+      return -1;
     }
     if (area_route_set->polygonal_area_list == nullptr) {
       area_route_set->polygonal_area_list = new std::list<PolygonalArea *>;
@@ -691,63 +632,26 @@ int DealSetPolygonalAreaRequest(const uint8_t *data,
   return (count > 0 ? 0 : -1);
 }
 
-int DealSetRouteAreaRequest(const uint8_t *data,
+int DealSetRouteAreaRequest(const uint8_t *data, const size_t &len,
                             AreaRouteSet *area_route_set) {
-  uint8_t operation = *data++;
-  uint8_t count = *data++;
-  uint16_t u16val = 0;
-  uint32_t u32val = 0;
-  operation = *data++;
-  count = *data++;
+  const uint8_t *end = data + len;
+  AreaRouteSetHead head;
+  data = AreaRouteSetHeadCodec::Decode(data, end, &head);
+  if (data == nullptr) {
+    return -1;
+  }
+  uint8_t operation = head.operation;
+  uint8_t count = head.count;
   for (int i = 0; i < count; ++i) {
-    Route *route = new Route;
-    memcpy(&u32val, data, 4);
-    route->route_id = EndianSwap32(u32val);
-    data += 4;
-    memcpy(&u16val, data, 2);
-    route->route_attribute.value = EndianSwap16(u16val);
-    data += 2;
-    if (route->route_attribute.bit.bytime) {
-      memcpy(route->start_time, data, 6);
-      data += 6;
-      memcpy(route->end_time, data, 6);
-      data += 6;
-    }
-    memcpy(&u16val, data, 2);
-    route->inflection_point_count = EndianSwap16(u16val);
-    data += 2;
-    route->inflection_point_list = new std::vector<InflectionPoint *>;
-    for (int i = 0; i < route->inflection_point_count; ++i) {
-      InflectionPoint *inflection_point = new InflectionPoint;
-      memcpy(&u32val, data, 4);
-      inflection_point->inflection_point_id = EndianSwap32(u32val);
-      data += 4;
-      memcpy(&u32val, data, 4);
-      inflection_point->road_section_id = EndianSwap32(u32val);
-      data += 4;
-      memcpy(&u32val, data, 4);
-      inflection_point->coordinate.latitude = EndianSwap32(u32val);
-      data += 4;
-      memcpy(&u32val, data, 4);
-      inflection_point->coordinate.longitude = EndianSwap32(u32val);
-      data += 4;
-      inflection_point->road_section_wide = *data++;
-      inflection_point->road_section_attribute.value = *data++;
-      if (inflection_point->road_section_attribute.bit.traveltime) {
-        memcpy(&u16val, data, 2);
-        inflection_point->max_driving_time = EndianSwap16(u16val);
-        data += 2;
-        memcpy(&u16val, data, 2);
-        inflection_point->min_driving_time = EndianSwap16(u16val);
-        data += 2;
-      }
-      if (inflection_point->road_section_attribute.bit.speedlimit) {
-        memcpy(&u16val, data, 2);
-        inflection_point->max_speed = EndianSwap16(u16val);
-        data += 2;
-        inflection_point->overspeed_duration = *data++;
+    Route *route = new Route();
+    data = RouteCodec::Decode(data, end, route);
+    if (data == nullptr) {
+      if (route->inflection_point_list != nullptr) {
+        ClearContainerElement(route->inflection_point_list);
+        delete route->inflection_point_list;
       }
-      route->inflection_point_list->push_back(inflection_point);
+      delete route;
+      return -1;
     }
     if (area_route_set->route_list == nullptr) {
       area_route_set->route_list = new std::list<Route *>;
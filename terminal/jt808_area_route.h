@@ -15,6 +15,7 @@
 #ifndef JT808_TERMINAL_JT808_AREA_ROUTE_H_
 #define JT808_TERMINAL_JT808_AREA_ROUTE_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <list>
@@ -32,13 +33,15 @@ struct AreaRouteSet {
 void ClearAreaRouteListElement(AreaRouteSet *area_route_set);
 void ReadAreaRouteFormFile(const char *path, AreaRouteSet *area_route_set);
 void WriteAreaRouteToFile(const char *path, const AreaRouteSet &area_route_set);
-int DealSetCircularAreaRequest(const uint8_t *data,
+// Apply a set area/route request body of |len| bytes, return -1 if the
+// body is empty or truncated.
+int DealSetCircularAreaRequest(const uint8_t *data, const size_t &len,
+                               AreaRouteSet *area_route_set);
+int DealSetRectangleAreaRequest(const uint8_t *data, const size_t &len,
                                 AreaRouteSet *area_route_set);
-int DealSetRectangleAreaRequest(const uint8_t *data,
+int DealSetPolygonalAreaRequest(const uint8_t *data, const size_t &len,
                                 AreaRouteSet *area_route_set);
-int DealSetPolygonalAreaRequest(const uint8_t *data,
-                                AreaRouteSet *area_route_set);
-int DealSetRouteAreaRequest(const uint8_t *data,
+int DealSetRouteAreaRequest(const uint8_t *data, const size_t &len,
                             AreaRouteSet *area_route_set);
 int DeleteAreaRouteFromSet(const uint8_t *data, const uint8_t &type,
                            AreaRouteSet *area_route_set);
@@ -29,11 +29,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <utility>
 
+#include "common/jt808_message_schema.h"
 #include "common/jt808_util.h"
 #include "terminal/jt808_terminal_parameters.h"
 #include "bcd/bcd.h"
@@ -53,9 +55,7 @@ Jt808Terminal::~Jt808Terminal() {
 int Jt808Terminal::Init() {
   message_flow_number_ = 0;
   parameter_set_type_ = 0;
-  pro_para_.packet_map = nullptr;
-  pro_para_.packet_id_list = nullptr;
-  pro_para_.terminal_parameter_id_list = nullptr;
+  memset(&pro_para_, 0x0, sizeof(pro_para_));
   if (ReadTerminalParameterFormFile(kTerminalParametersFlie,
                                     &terminal_parameter_map_) < 0) {
     return -1;
@@ -200,6 +200,7 @@ void Jt808Terminal::ClearConnect(void) {
   }
   socket_fd_ = -1;
   is_connect_ = false;
+  recv_buffer_.clear();
 }
 
 int Jt808Terminal::SendFrameData(void) {
@@ -226,10 +227,16 @@ int Jt808Terminal::SendFrameData(void) {
 }
 
 int Jt808Terminal::RecvFrameData(void) {
+  uint8_t buffer[MAX_PROFRAMEBUF_LEN];
   int retval = -1;
 
   memset(message_.buffer, 0x0, MAX_PROFRAMEBUF_LEN);
-  retval = recv(socket_fd_, message_.buffer, MAX_PROFRAMEBUF_LEN, 0);
+  message_.size = 0;
+  // One frame per call, what came with it is handed out first.
+  if (PopFrame()) {
+    return static_cast<int>(message_.size);
+  }
+  retval = recv(socket_fd_, buffer, sizeof(buffer), 0);
   if (retval < 0) {
     if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
       retval = 0;  // Not data, but is normal.
@@ -237,18 +244,47 @@ int Jt808Terminal::RecvFrameData(void) {
       retval = -1;
       printf("%s[%d]: recv data failed!!!\n", __FUNCTION__, __LINE__);
     }
-    message_.size = 0;
   } else if (retval == 0) {
     retval = -1;
-    message_.size = 0;
     printf("%s[%d]: connection disconect!!!\n", __FUNCTION__, __LINE__);
   } else {
-    message_.size = retval;
+    recv_buffer_.insert(recv_buffer_.end(), buffer, buffer + retval);
+    retval = PopFrame() ? static_cast<int>(message_.size) : 0;
   }
 
   return retval;
 }
 
+bool Jt808Terminal::PopFrame(void) {
+  auto begin = std::find(recv_buffer_.begin(), recv_buffer_.end(),
+                         PROTOCOL_SIGN);
+  decltype(begin) end;
+
+  // Drop garbage before the start flag.
+  recv_buffer_.erase(recv_buffer_.begin(), begin);
+  while (!recv_buffer_.empty()) {
+    end = std::find(recv_buffer_.begin() + 1, recv_buffer_.end(),
+                    PROTOCOL_SIGN);
+    if (end == recv_buffer_.end()) {
+      if (recv_buffer_.size() >= MAX_PROFRAMEBUF_LEN) {
+        recv_buffer_.clear();
+      }
+      return false;
+    }
+    // "7E 7E", the second flag starts the next frame.
+    if ((end == recv_buffer_.begin() + 1) ||
+        (end - recv_buffer_.begin() >= MAX_PROFRAMEBUF_LEN)) {
+      recv_buffer_.erase(recv_buffer_.begin(), end);
+      continue;
+    }
+    message_.size = static_cast<size_t>(end - recv_buffer_.begin() + 1);
+    memcpy(message_.buffer, recv_buffer_.data(), message_.size);
+    recv_buffer_.erase(recv_buffer_.begin(), end + 1);
+    return true;
+  }
+  return false;
+}
+
 size_t Jt808Terminal::Jt808FramePack(const uint16_t &command) {
   MessageHead *msghead_ptr;
   PositionBasicInfo *pbi_ptr;
@@ -273,20 +309,17 @@ size_t Jt808Terminal::Jt808FramePack(const uint16_t &command) {
   message_.size = 13;
 
   switch (command) {
-    case UP_UNIRESPONSE:
-      memcpy(&u16val, &pro_para_.respond_flow_num, 2);
-      u16val = EndianSwap16(u16val);
-      memcpy(msg_body, &u16val, 2);
-      msg_body += 2;
-      memcpy(&u16val, &pro_para_.respond_id, 2);
-      u16val = EndianSwap16(u16val);
-      memcpy(msg_body, &u16val, 2);
-      msg_body += 2;
-      *msg_body = pro_para_.respond_result;
-      msg_body++;
-      message_.size += 5;
-      msghead_ptr->attribute.bit.msglen += 5;
+    case UP_UNIRESPONSE: {
+      GeneralResponse response;
+      response.flow_num = pro_para_.respond_flow_num;
+      response.id = pro_para_.respond_id;
+      response.result = pro_para_.respond_result;
+      u16val = static_cast<uint16_t>(GeneralResponseCodec::Size(response));
+      msg_body = GeneralResponseCodec::Encode(response, msg_body);
+      message_.size += u16val;
+      msghead_ptr->attribute.bit.msglen += u16val;
       break;
+    }
     case UP_HEARTBEAT:
       msghead_ptr->attribute.bit.msglen += 0;
       break;
@@ -462,8 +495,9 @@ size_t Jt808Terminal::Jt808FramePack(const uint16_t &command) {
         memcpy(msg_body, &u16val, 2);
         msg_body += 2;
       }
-      message_.size += 3 + pro_para_.packet_id_list->size();
-      msghead_ptr->attribute.bit.msglen += 3 + pro_para_.packet_id_list->size();
+      message_.size += 3 + 2 * pro_para_.packet_id_list->size();
+      msghead_ptr->attribute.bit.msglen +=
+          3 + 2 * pro_para_.packet_id_list->size();
       break;
     default:
       break;
@@ -871,17 +905,17 @@ uint16_t Jt808Terminal::Jt808FrameParse() {
       Jt808FramePack(UP_GETPOSITIONINFORESPONSE);
       SendFrameData();
       break;
-    case DOWN_POSITIONTRACK:
-      memcpy(&u16val, &msg_body[0], 2);
-      u16val = EndianSwap16(u16val);
-      report_interval_ = static_cast<int>(u16val);
-      msg_body += 2;
-      memcpy(&u32val, &msg_body[0], 4);
-      u32val = EndianSwap32(u32val);
-      report_valid_time_ = static_cast<int64_t>(u32val);
-      msg_body += 4;
+    case DOWN_POSITIONTRACK: {
+      PositionTrackRequest request;
+      if (PositionTrackRequestCodec::Decode(
+              msg_body, msg_body + msgbody_attribute.bit.msglen,
+              &request) != nullptr) {
+        report_interval_ = static_cast<int>(request.report_interval);
+        report_valid_time_ = static_cast<int64_t>(request.report_valid_time);
+      }
       pro_para_.respond_result = 0;
       break;
+    }
     case DOWN_VEHICLECONTROL:
       pro_para_.vehicle_control_flag.value = *msg_body++;
       status_bit_.bit.doorlock = pro_para_.vehicle_control_flag.bit.doorlock;
@@ -890,7 +924,8 @@ uint16_t Jt808Terminal::Jt808FrameParse() {
       SendFrameData();
       break;
     case DOWN_SETCIRCULARAREA:
-      if (DealSetCircularAreaRequest(msg_body, &area_route_set_) == 0) {
+      if (DealSetCircularAreaRequest(msg_body, msgbody_attribute.bit.msglen,
+                                    &area_route_set_) == 0) {
         WriteAreaRouteToFile(kAreaRouteFlie, area_route_set_);
         pro_para_.respond_result = kSuccess;
       } else {
@@ -909,7 +944,8 @@ uint16_t Jt808Terminal::Jt808FrameParse() {
       SendCommonResponse();
       break;
     case DOWN_SETRECTANGLEAREA:
-      if (DealSetRectangleAreaRequest(msg_body, &area_route_set_) == 0) {
+      if (DealSetRectangleAreaRequest(msg_body, msgbody_attribute.bit.msglen,
+                                     &area_route_set_) == 0) {
         WriteAreaRouteToFile(kAreaRouteFlie, area_route_set_);
         pro_para_.respond_result = kSuccess;
       } else {
@@ -929,7 +965,8 @@ uint16_t Jt808Terminal::Jt808FrameParse() {
       SendCommonResponse();
       break;
     case DOWN_SETPOLYGONALAREA:
-      if (DealSetPolygonalAreaRequest(msg_body, &area_route_set_) == 0) {
+      if (DealSetPolygonalAreaRequest(msg_body, msgbody_attribute.bit.msglen,
+                                     &area_route_set_) == 0) {
         WriteAreaRouteToFile(kAreaRouteFlie, area_route_set_);
         pro_para_.respond_result = kSuccess;
       } else {
@@ -950,7 +987,8 @@ uint16_t Jt808Terminal::Jt808FrameParse() {
       SendCommonResponse();
       break;
     case DOWN_SETROUTE:
-      if (DealSetRouteAreaRequest(msg_body, &area_route_set_) == 0) {
+      if (DealSetRouteAreaRequest(msg_body, msgbody_attribute.bit.msglen,
+                                 &area_route_set_) == 0) {
         WriteAreaRouteToFile(kAreaRouteFlie, area_route_set_);
         pro_para_.respond_result = kSuccess;
       } else {
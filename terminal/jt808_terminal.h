@@ -147,6 +147,9 @@ class Jt808Terminal {
   int socket_fd(void) const { return socket_fd_; }
 
  private:
+  // Move the next complete frame of |recv_buffer_| into |message_|.
+  bool PopFrame(void);
+
   const char *kDownloadDir = "/upgrade";
   const char *kTerminalParametersFlie =
      "/etc/jt808/terminal/terminalparameter.txt";
@@ -166,6 +169,9 @@ class Jt808Terminal {
   UpgradeInfo upgrade_info_;
   AuthenticationCode authentication_code_;
   Message message_;
+  // Received bytes not parsed yet, the service may send frames back to
+  // back.
+  std::vector<uint8_t> recv_buffer_;
   PositionExtension custom_item_len_;
   PositionExtension position_status_;
   PositionExtension gnss_satellite_num_;